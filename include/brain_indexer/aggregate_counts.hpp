@@ -0,0 +1,90 @@
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/memory_mapped_index.hpp>
+
+
+namespace brain_indexer {
+
+/** \brief An R-Tree augmented with the number of elements below every node.
+ *
+ * A regular `count_intersecting` visits every intersecting element. Here,
+ * nodes whose bounding box is contained in the query shape aren't descended;
+ * instead the number of elements below them is added. Hence, counting over a
+ * large region costs roughly the nodes along the boundary of the query shape,
+ * rather than the number of results. The results are the same as those of
+ * `count_intersecting`.
+ *
+ * Nodes are only skipped for `Box3D` and `Sphere` queries, other query shapes
+ * are counted element by element.
+ *
+ * The counts are computed once, on construction, in one pass over the tree.
+ * The R-Tree must outlive this object and must not be modified afterwards.
+ *
+ * \tparam RTree  The boost R-Tree, e.g. `IndexTreeBaseT<T, A>`.
+ */
+template <typename RTree>
+class AggregateCounts {
+  public:
+    inline explicit AggregateCounts(const RTree& rtree);
+
+    /// \brief Counts the elements intersecting `shape`.
+    template <typename GeometryMode = BoundingBoxGeometry, typename ShapeT>
+    inline size_t count_intersecting(const ShapeT& shape) const;
+
+    /// \brief The number of elements of the R-Tree when the counts were computed.
+    inline size_t size() const {
+        return size_;
+    }
+
+  private:
+    using members_holder =
+        typename bgi::detail::rtree::const_private_view<RTree>::members_holder;
+    using node_pointer = typename members_holder::node_pointer;
+    using internal_node = typename members_holder::internal_node;
+    using leaf = typename members_holder::leaf;
+
+    inline size_t count_elements(node_pointer node, size_t level);
+
+    /// \brief The number of elements below `node`, which is at `level`.
+    inline size_t n_elements(node_pointer node, size_t level) const;
+
+    template <typename Predicates, typename ShapeT>
+    inline size_t count_intersecting(node_pointer node,
+                                     size_t level,
+                                     const Predicates& predicates,
+                                     const ShapeT& shape) const;
+
+    inline size_t leafs_level() const;
+
+    static inline const void* key(node_pointer node) {
+        return std::addressof(*node);
+    }
+
+    const RTree* rtree_;
+    size_t size_ = 0;
+
+    // Only the internal nodes are stored, leaves know their size.
+    std::unordered_map<const void*, size_t> counts_;
+};
+
+
+/// \brief Computes the counts per node of `index`.
+template <typename T, typename A>
+inline auto make_aggregate_counts(const IndexTree<T, A>& index) {
+    using rtree_type = IndexTreeBaseT<T, A>;
+    return AggregateCounts<rtree_type>(static_cast<const rtree_type&>(index));
+}
+
+/// \brief Computes the counts per node of the memory mapped `index`.
+template <typename T>
+inline auto make_aggregate_counts(const MemoryMappedIndexTree<T>& index) {
+    return make_aggregate_counts(index.rtree());
+}
+
+}  // namespace brain_indexer
+
+#include "detail/aggregate_counts.hpp"
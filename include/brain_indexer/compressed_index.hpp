@@ -0,0 +1,208 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/packed_index.hpp>
+
+namespace brain_indexer {
+
+namespace detail {
+
+/**
+ * \brief How elements of type `T` are split into the parts stored by
+ * `CompressedIndexTree`.
+ *
+ * Every element is described by:
+ *   - `n_points` points, which are quantized;
+ *   - a radius, stored as is;
+ *   - `n_ids` ids, which are stored exactly as varints;
+ *   - optionally, a one byte tag, e.g. the type of the element.
+ *
+ * Specializations provide the static members `n_points`, `n_ids`, `has_tag`
+ * and the functions `points`, `radius`, `ids`, `tag`, `make` and `set_ids`.
+ * An element created by `make` has all ids set to zero.
+ */
+template <typename T>
+struct CompressedCodec;
+
+/// \brief Appends `x` as a LEB128 varint, i.e. 7 bits per byte.
+inline void append_varint(std::vector<std::uint8_t>& bytes, std::uint64_t x);
+
+/// \brief Reads a varint and advances `p` past it.
+inline std::uint64_t read_varint(const std::uint8_t*& p);
+
+/// \brief Maps small signed integers to small unsigned integers.
+inline std::uint64_t zigzag_encode(std::int64_t x);
+inline std::int64_t zigzag_decode(std::uint64_t x);
+
+}  // namespace detail
+
+
+/**
+ * \brief An immutable R-Tree which stores its values compressed.
+ *
+ * The tree has the same layout as `PackedIndexTree`. However, the values
+ * aren't stored as is. Instead, the values of each leaf, i.e. the up to
+ * `fanout` children of a node on the last level, are encoded together:
+ *   - All points are quantized to 16-bit offsets relative to the bounding box
+ *     of the points of the leaf.
+ *   - The values of a leaf are sorted by their first id. The first id is
+ *     stored as the varint encoded difference to the previous value, all
+ *     other ids as the zig-zag and varint encoded difference.
+ *   - Radii are stored as `CoordType`, unless all of them are zero.
+ *
+ * Quantization is lossy, the error of each coordinate is at most half a
+ * step, i.e. `1/131070` of the extent of the leaf. The ids are exact. The
+ * index is built from, and queries return, the decoded values. Therefore,
+ * the results of queries are exactly those of an `IndexTree` built from
+ * `values()`.
+ *
+ * Leaves are decoded while scanning, ids only when a value of the leaf
+ * matches. Queries return values, rather than references.
+ *
+ * Supported element types are `Synapse` and `MorphoEntry`, see
+ * `detail::CompressedCodec`.
+ */
+template <typename T>
+class CompressedIndexTree: public IndexTreeMixin<CompressedIndexTree<T>, T> {
+  public:
+    using value_type = T;
+    using codec_type = detail::CompressedCodec<T>;
+
+    /// \brief The maximum number of children of each node.
+    static constexpr size_t fanout = detail::packed_block_size;
+
+    inline CompressedIndexTree() = default;
+
+    /// \brief Builds the index from the elements `[begin, end)`.
+    template <typename Iterator>
+    inline CompressedIndexTree(Iterator begin, Iterator end)
+        : CompressedIndexTree(std::vector<T>(begin, end)) {}
+
+    /// \brief Builds the index from the elements in `values`.
+    inline explicit CompressedIndexTree(std::vector<T> values);
+
+    /**
+     * \brief Find elements in tree that intersect with the given shape.
+     *
+     * See `IndexTreeMixin::find_intersecting`.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT, typename OutputIt>
+    inline void find_intersecting(const ShapeT& shape, const OutputIt& iter) const;
+
+    /**
+     * \brief Gets the ids of the the nearest K objects
+     * \returns The ids, ordered by increasing distance to the shape.
+     */
+    template <typename ShapeT>
+    inline decltype(auto) find_nearest(const ShapeT& shape, unsigned k_neighbors) const;
+
+    /// \brief Checks whether a given shape intersects any object in the tree
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline bool is_intersecting(const ShapeT& shape) const;
+
+    /**
+     * \brief Finds & return objects which intersect.
+     * \returns A vector of the decoded objects.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline std::vector<T> find_intersecting_objs(const ShapeT& shape) const;
+
+    inline size_t size() const {
+        return n_values_;
+    }
+
+    inline bool empty() const {
+        return n_values_ == 0;
+    }
+
+    /// \brief The bounding box of all elements.
+    inline Box3D bounds() const;
+
+    /// \brief The number of levels of nodes, excluding the values.
+    inline size_t n_levels() const {
+        return level_sizes_.size();
+    }
+
+    /// \brief All values, decoded, in the order they're stored.
+    inline std::vector<T> values() const;
+
+    /// \brief The number of bytes allocated by the index.
+    inline size_t memory_usage() const;
+
+  private:
+    using points_type = std::array<Point3D, codec_type::n_points>;
+    using ids_type = std::array<identifier_t, codec_type::n_ids>;
+
+    /// \brief The number of nodes on `level`, or the number of values.
+    inline size_t level_size(size_t level) const {
+        return level == n_levels() ? n_values_ : level_sizes_[level];
+    }
+
+    /// \brief The range of children of node `i` on `level`.
+    inline std::pair<size_t, size_t> children(size_t level, size_t i) const {
+        auto first = i * fanout;
+        return {first, std::min(first + fanout, level_size(level + 1))};
+    }
+
+    /**
+     * \brief Decodes the geometry of the values of `leaf` into `out`.
+     *
+     * The ids are left as zero.
+     * \returns The number of values in the leaf.
+     */
+    inline size_t decode_geometry(size_t leaf, T* out) const;
+
+    /// \brief Sets the ids of the values of `leaf` for which `mask` is set.
+    inline void decode_ids(size_t leaf, detail::packed_mask_t mask, T* out) const;
+
+    /// \brief Decodes the values of `leaf` into `out`, see `decode_geometry`.
+    inline size_t decode_leaf(size_t leaf, T* out) const;
+
+    /**
+     * \brief Calls `visitor(leaf)` for every leaf that passes the filters of `query`.
+     *
+     * The traversal stops early if the visitor returns `false`.
+     */
+    template <typename Visitor>
+    inline void visit_leaves(const detail::PackedQuery& query, Visitor&& visitor) const;
+
+    size_t n_values_ = 0;
+
+    /// The quantized points, `n_points` per value.
+    std::vector<std::uint16_t> coords_;
+
+    /// The position of `q == 0` and the size of a step, for each leaf.
+    std::vector<Point3D> leaf_origins_;
+    std::vector<Point3D> leaf_steps_;
+
+    /// Empty if all radii are zero.
+    std::vector<CoordType> radii_;
+
+    /// Empty if the codec doesn't have tags.
+    std::vector<std::uint8_t> tags_;
+
+    /// The ids of leaf `j` are `id_bytes_[id_offsets_[j], id_offsets_[j+1])`.
+    std::vector<std::uint8_t> id_bytes_;
+    std::vector<size_t> id_offsets_;
+
+    /// All nodes in breadth-first order.
+    PackedBoxes node_boxes_;
+
+    /// The nodes on level `l` start at `level_offsets_[l]`, a multiple of `fanout`.
+    std::vector<size_t> level_offsets_;
+    std::vector<size_t> level_sizes_;
+};
+
+
+template <typename T>
+inline std::ostream& operator<<(std::ostream& os, const CompressedIndexTree<T>& index);
+
+}  // namespace brain_indexer
+
+#include "detail/compressed_index.hpp"
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "../aggregate_counts.hpp"
+
+namespace brain_indexer {
+
+/////////////////////////////////////////
+// class AggregateCounts
+/////////////////////////////////////////
+
+template <typename RTree>
+inline AggregateCounts<RTree>::AggregateCounts(const RTree& rtree)
+    : rtree_(&rtree) {
+    if (!rtree.empty()) {
+        const auto& members = bgi::detail::rtree::const_private_view<RTree>(rtree).members();
+        size_ = count_elements(members.root, 0);
+    }
+}
+
+
+template <typename RTree>
+inline size_t AggregateCounts<RTree>::count_elements(node_pointer node, size_t level) {
+    namespace bgid = bgi::detail::rtree;
+
+    if (level == leafs_level()) {
+        return bgid::elements(bgid::get<leaf>(*node)).size();
+    }
+
+    size_t count = 0;
+    for (const auto& child : bgid::elements(bgid::get<internal_node>(*node))) {
+        count += count_elements(child.second, level + 1);
+    }
+
+    counts_[key(node)] = count;
+    return count;
+}
+
+
+template <typename RTree>
+inline size_t AggregateCounts<RTree>::n_elements(node_pointer node, size_t level) const {
+    namespace bgid = bgi::detail::rtree;
+
+    if (level == leafs_level()) {
+        return bgid::elements(bgid::get<leaf>(*node)).size();
+    }
+
+    return counts_.at(key(node));
+}
+
+
+template <typename RTree>
+inline size_t AggregateCounts<RTree>::leafs_level() const {
+    return bgi::detail::rtree::const_private_view<RTree>(*rtree_).members().leafs_level;
+}
+
+
+template <typename RTree>
+template <typename GeometryMode, typename ShapeT>
+inline size_t AggregateCounts<RTree>::count_intersecting(const ShapeT& shape) const {
+    if (rtree_->empty()) {
+        return 0;
+    }
+
+    const auto& members = bgi::detail::rtree::const_private_view<RTree>(*rtree_).members();
+    if (detail::box_covered_by(Box3D(rtree_->bounds()), shape)) {
+        return size_;
+    }
+
+    auto predicates = detail::intersects_predicate<GeometryMode>(shape);
+    return count_intersecting(members.root, 0, predicates, shape);
+}
+
+
+template <typename RTree>
+template <typename Predicates, typename ShapeT>
+inline size_t AggregateCounts<RTree>::count_intersecting(node_pointer node,
+                                                         size_t level,
+                                                         const Predicates& predicates,
+                                                         const ShapeT& shape) const {
+    namespace bgid = bgi::detail::rtree;
+    constexpr auto n_predicates = bgi::detail::predicates_length<Predicates>::value;
+
+    const auto& members = bgid::const_private_view<RTree>(*rtree_).members();
+    auto strategy = bgi::detail::get_strategy(members.parameters());
+
+    size_t count = 0;
+    if (level == leafs_level()) {
+        for (const auto& value : bgid::elements(bgid::get<leaf>(*node))) {
+            if (bgi::detail::predicates_check<bgi::detail::value_tag, 0, n_predicates>(
+                    predicates, value, members.translator()(value), strategy)) {
+                ++count;
+            }
+        }
+
+        return count;
+    }
+
+    for (const auto& child : bgid::elements(bgid::get<internal_node>(*node))) {
+        if (!bgi::detail::predicates_check<bgi::detail::bounds_tag, 0, n_predicates>(
+                predicates, 0, child.first, strategy)) {
+            continue;
+        }
+
+        // Every element below the child intersects the shape.
+        if (detail::box_covered_by(Box3D(child.first), shape)) {
+            count += n_elements(child.second, level + 1);
+        } else {
+            count += count_intersecting(child.second, level + 1, predicates, shape);
+        }
+    }
+
+    return count;
+}
+
+}  // namespace brain_indexer
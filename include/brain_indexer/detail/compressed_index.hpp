@@ -0,0 +1,612 @@
+#pragma once
+
+#include "../compressed_index.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+
+namespace brain_indexer {
+
+namespace detail {
+
+template <>
+struct CompressedCodec<Synapse> {
+    static constexpr size_t n_points = 1;
+    static constexpr size_t n_ids = 3;
+    static constexpr bool has_tag = false;
+
+    static inline std::array<Point3D, 1> points(const Synapse& synapse) {
+        return {synapse.centroid};
+    }
+
+    static inline CoordType radius(const Synapse& synapse) {
+        return synapse.radius;
+    }
+
+    static inline std::array<identifier_t, 3> ids(const Synapse& synapse) {
+        return {synapse.id, synapse.post_gid_, synapse.pre_gid_};
+    }
+
+    static inline std::uint8_t tag(const Synapse&) {
+        return 0;
+    }
+
+    static inline Synapse make(const std::array<Point3D, 1>& points,
+                               CoordType radius,
+                               std::uint8_t /* tag */) {
+        return Synapse(0, points[0], radius);
+    }
+
+    static inline void set_ids(Synapse& synapse, const std::array<identifier_t, 3>& ids) {
+        synapse.id = ids[0];
+        synapse.post_gid_ = ids[1];
+        synapse.pre_gid_ = ids[2];
+    }
+};
+
+
+/// Somas are stored as segments of length zero, the tag is `is_segment | section_type << 1`.
+template <>
+struct CompressedCodec<MorphoEntry> {
+    static constexpr size_t n_points = 2;
+    static constexpr size_t n_ids = 1;
+    static constexpr bool has_tag = true;
+
+    static inline std::array<Point3D, 2> points(const MorphoEntry& entry) {
+        if (const auto* segment = boost::get<Segment>(&entry)) {
+            return {segment->p1, segment->p2};
+        }
+
+        const auto& soma = boost::get<Soma>(entry);
+        return {soma.centroid, soma.centroid};
+    }
+
+    static inline CoordType radius(const MorphoEntry& entry) {
+        return boost::apply_visitor([](const auto& e) { return e.radius; }, entry);
+    }
+
+    static inline std::array<identifier_t, 1> ids(const MorphoEntry& entry) {
+        return {boost::apply_visitor([](const auto& e) { return e.id; }, entry)};
+    }
+
+    static inline std::uint8_t tag(const MorphoEntry& entry) {
+        if (const auto* segment = boost::get<Segment>(&entry)) {
+            return std::uint8_t(1u | (unsigned(segment->section_type()) << 1));
+        }
+
+        return 0;
+    }
+
+    static inline MorphoEntry make(const std::array<Point3D, 2>& points,
+                                   CoordType radius,
+                                   std::uint8_t tag) {
+        if (tag & 1u) {
+            return Segment(0, 0, 0, points[0], points[1], radius, SectionType(tag >> 1));
+        }
+
+        return Soma(MorphPartId{0}, Sphere{points[0], radius});
+    }
+
+    static inline void set_ids(MorphoEntry& entry, const std::array<identifier_t, 1>& ids) {
+        boost::apply_visitor([&ids](auto& e) { e.id = ids[0]; }, entry);
+    }
+};
+
+
+inline void append_varint(std::vector<std::uint8_t>& bytes, std::uint64_t x) {
+    while (x >= 0x80) {
+        bytes.push_back(std::uint8_t(x | 0x80));
+        x >>= 7;
+    }
+    bytes.push_back(std::uint8_t(x));
+}
+
+
+inline std::uint64_t read_varint(const std::uint8_t*& p) {
+    std::uint64_t x = 0;
+    for (unsigned shift = 0;; shift += 7) {
+        auto byte = *p++;
+        x |= std::uint64_t(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return x;
+        }
+    }
+}
+
+
+inline std::uint64_t zigzag_encode(std::int64_t x) {
+    return (std::uint64_t(x) << 1) ^ std::uint64_t(x >> 63);
+}
+
+
+inline std::int64_t zigzag_decode(std::uint64_t x) {
+    return std::int64_t(x >> 1) ^ -std::int64_t(x & 1);
+}
+
+
+inline std::array<CoordType, 3> compressed_coordinates(const Point3D& p) {
+    return {p.get<0>(), p.get<1>(), p.get<2>()};
+}
+
+
+inline CoordType compressed_decode(CoordType origin, CoordType step, std::uint16_t q) {
+    return origin + CoordType(q) * step;
+}
+
+}  // namespace detail
+
+
+template <typename T>
+inline CompressedIndexTree<T>::CompressedIndexTree(std::vector<T> values) {
+    constexpr auto n_points = codec_type::n_points;
+    constexpr auto n_ids = codec_type::n_ids;
+    constexpr auto q_max = double(std::numeric_limits<std::uint16_t>::max());
+
+    n_values_ = values.size();
+    if (n_values_ == 0) {
+        return;
+    }
+
+    // The same order as `PackedIndexTree`.
+    size_t subtree_size = 1;
+    while (subtree_size * fanout < n_values_) {
+        subtree_size *= fanout;
+    }
+
+    std::vector<detail::PackedEntry> entries(n_values_);
+    for (size_t i = 0; i < n_values_; ++i) {
+        Box3D box = bgi::indexable<T>{}(values[i]);
+        Point3D center;
+        bg::centroid(box, center);
+
+        entries[i] = {{center.get<0>(), center.get<1>(), center.get<2>()}, i};
+    }
+
+    detail::packed_partition(entries.begin(), entries.end(), subtree_size, fanout);
+
+    auto n_leaves = detail::packed_ceil_div(n_values_, fanout);
+
+    // Within a leaf the order doesn't matter, sorting by the first id makes
+    // the differences small.
+    for (size_t leaf = 0; leaf < n_leaves; ++leaf) {
+        auto first = entries.begin() + std::ptrdiff_t(leaf * fanout);
+        auto last = entries.begin() + std::ptrdiff_t(std::min((leaf + 1) * fanout, n_values_));
+        std::sort(first, last, [&values](const auto& a, const auto& b) {
+            return codec_type::ids(values[a.index])[0] < codec_type::ids(values[b.index])[0];
+        });
+    }
+
+    bool has_radii = std::any_of(values.begin(), values.end(), [](const T& v) {
+        return codec_type::radius(v) != CoordType(0);
+    });
+
+    coords_.resize(n_values_ * n_points * 3);
+    leaf_origins_.resize(n_leaves);
+    leaf_steps_.resize(n_leaves);
+    id_offsets_.reserve(n_leaves + 1);
+    id_offsets_.push_back(0);
+
+    if (has_radii) {
+        radii_.resize(n_values_);
+    }
+
+    if constexpr (codec_type::has_tag) {
+        tags_.resize(n_values_);
+    }
+
+    for (size_t leaf = 0; leaf < n_leaves; ++leaf) {
+        auto first = leaf * fanout;
+        auto last = std::min(first + fanout, n_values_);
+
+        std::array<double, 3> lo, hi;
+        lo.fill(std::numeric_limits<double>::infinity());
+        hi.fill(-std::numeric_limits<double>::infinity());
+        for (size_t i = first; i < last; ++i) {
+            for (const auto& p : codec_type::points(values[entries[i].index])) {
+                auto x = detail::compressed_coordinates(p);
+                for (size_t d = 0; d < 3; ++d) {
+                    lo[d] = std::min(lo[d], double(x[d]));
+                    hi[d] = std::max(hi[d], double(x[d]));
+                }
+            }
+        }
+
+        std::array<CoordType, 3> origin, step;
+        for (size_t d = 0; d < 3; ++d) {
+            origin[d] = CoordType(lo[d]);
+            step[d] = CoordType((hi[d] - lo[d]) / q_max);
+        }
+        leaf_origins_[leaf] = Point3D{origin[0], origin[1], origin[2]};
+        leaf_steps_[leaf] = Point3D{step[0], step[1], step[2]};
+
+        ids_type previous{};
+        for (size_t i = first; i < last; ++i) {
+            const auto& value = values[entries[i].index];
+
+            auto points = codec_type::points(value);
+            for (size_t k = 0; k < n_points; ++k) {
+                auto x = detail::compressed_coordinates(points[k]);
+                for (size_t d = 0; d < 3; ++d) {
+                    double q = step[d] == 0 ? 0.0 : std::round((double(x[d]) - origin[d]) / step[d]);
+                    coords_[(i * n_points + k) * 3 + d] = std::uint16_t(std::clamp(q, 0.0, q_max));
+                }
+            }
+
+            if (has_radii) {
+                radii_[i] = codec_type::radius(value);
+            }
+
+            if constexpr (codec_type::has_tag) {
+                tags_[i] = codec_type::tag(value);
+            }
+
+            auto ids = codec_type::ids(value);
+            detail::append_varint(id_bytes_, ids[0] - previous[0]);
+            for (size_t k = 1; k < n_ids; ++k) {
+                detail::append_varint(id_bytes_,
+                                      detail::zigzag_encode(std::int64_t(ids[k] - previous[k])));
+            }
+            previous = ids;
+        }
+
+        id_offsets_.push_back(id_bytes_.size());
+    }
+    id_bytes_.shrink_to_fit();
+
+    // Free the originals before allocating the nodes.
+    values = std::vector<T>{};
+    entries = std::vector<detail::PackedEntry>{};
+
+    // Number of nodes on each level, bottom-up.
+    level_sizes_ = {n_leaves};
+    while (level_sizes_.back() > 1) {
+        level_sizes_.push_back(detail::packed_ceil_div(level_sizes_.back(), fanout));
+    }
+    std::reverse(level_sizes_.begin(), level_sizes_.end());
+
+    auto n_node_levels = level_sizes_.size();
+    level_offsets_.resize(n_node_levels + 1, 0);
+    for (size_t level = 0; level < n_node_levels; ++level) {
+        level_offsets_[level + 1] = level_offsets_[level]
+                                    + detail::packed_ceil_div(level_sizes_[level], fanout) * fanout;
+    }
+
+    node_boxes_.resize(level_offsets_.back());
+
+    // The leaves are bounded by their decoded values. They're widened by an
+    // ulp, in case the decoding rounds differently when inlined elsewhere.
+    std::array<T, fanout> decoded;
+    for (size_t leaf = 0; leaf < n_leaves; ++leaf) {
+        auto n = decode_geometry(leaf, decoded.data());
+
+        Box3D box;
+        bg::assign_inverse(box);
+        for (size_t i = 0; i < n; ++i) {
+            bg::expand(box, bgi::indexable<T>{}(decoded[i]));
+        }
+
+        constexpr auto inf = std::numeric_limits<CoordType>::infinity();
+        auto min_c = detail::compressed_coordinates(box.min_corner());
+        auto max_c = detail::compressed_coordinates(box.max_corner());
+        for (size_t d = 0; d < 3; ++d) {
+            min_c[d] = std::nextafter(min_c[d], -inf);
+            max_c[d] = std::nextafter(max_c[d], inf);
+        }
+
+        node_boxes_.set(level_offsets_[n_node_levels - 1] + leaf,
+                        Box3D{Point3D{min_c[0], min_c[1], min_c[2]},
+                              Point3D{max_c[0], max_c[1], max_c[2]}});
+    }
+
+    for (size_t level = n_node_levels - 1; level-- > 0;) {
+        auto child_offset = level_offsets_[level + 1];
+
+        for (size_t i = 0; i < level_sizes_[level]; ++i) {
+            auto [first, last] = children(level, i);
+            node_boxes_.set(
+                level_offsets_[level] + i,
+                detail::packed_envelope(node_boxes_, child_offset + first, child_offset + last)
+            );
+        }
+    }
+}
+
+
+template <typename T>
+inline size_t CompressedIndexTree<T>::decode_geometry(size_t leaf, T* out) const {
+    constexpr auto n_points = codec_type::n_points;
+
+    auto first = leaf * fanout;
+    auto last = std::min(first + fanout, n_values_);
+    auto origin = detail::compressed_coordinates(leaf_origins_[leaf]);
+    auto step = detail::compressed_coordinates(leaf_steps_[leaf]);
+
+    for (size_t i = first; i < last; ++i) {
+        points_type points;
+        const auto* q = coords_.data() + i * n_points * 3;
+        for (size_t k = 0; k < n_points; ++k, q += 3) {
+            points[k] = Point3D{detail::compressed_decode(origin[0], step[0], q[0]),
+                                detail::compressed_decode(origin[1], step[1], q[1]),
+                                detail::compressed_decode(origin[2], step[2], q[2])};
+        }
+
+        auto radius = radii_.empty() ? CoordType(0) : radii_[i];
+        auto tag = tags_.empty() ? std::uint8_t(0) : tags_[i];
+        out[i - first] = codec_type::make(points, radius, tag);
+    }
+
+    return last - first;
+}
+
+
+template <typename T>
+inline void CompressedIndexTree<T>::decode_ids(size_t leaf,
+                                               detail::packed_mask_t mask,
+                                               T* out) const {
+    constexpr auto n_ids = codec_type::n_ids;
+
+    const auto* p = id_bytes_.data() + id_offsets_[leaf];
+    ids_type ids{};
+
+    // The differences must be read up to the last value that's needed.
+    for (size_t i = 0; mask != 0; ++i, mask >>= 1) {
+        ids[0] += detail::read_varint(p);
+        for (size_t k = 1; k < n_ids; ++k) {
+            ids[k] += identifier_t(detail::zigzag_decode(detail::read_varint(p)));
+        }
+
+        if (mask & 1u) {
+            codec_type::set_ids(out[i], ids);
+        }
+    }
+}
+
+
+template <typename T>
+inline size_t CompressedIndexTree<T>::decode_leaf(size_t leaf, T* out) const {
+    auto n = decode_geometry(leaf, out);
+    decode_ids(leaf, detail::packed_mask_t((std::uint64_t(1) << n) - 1), out);
+    return n;
+}
+
+
+template <typename T>
+template <typename Visitor>
+inline void CompressedIndexTree<T>::visit_leaves(const detail::PackedQuery& query,
+                                                 Visitor&& visitor) const {
+    if (empty()) {
+        return;
+    }
+
+    const auto& kernels = detail::packed_kernels();
+
+    if ((detail::packed_filter_boxes(kernels, node_boxes_, 0, query) & 1u) == 0) {
+        return;
+    }
+
+    auto leaf_level = n_levels() - 1;
+
+    // Depth-first traversal, see `PackedIndexTree::visit_candidates`.
+    std::array<std::pair<size_t, size_t>, fanout * 16> stack;
+    size_t stack_size = 0;
+    stack[stack_size++] = {0, 0};
+
+    while (stack_size != 0) {
+        auto [level, node] = stack[--stack_size];
+
+        if (level == leaf_level) {
+            if (!visitor(node)) {
+                return;
+            }
+            continue;
+        }
+
+        auto first = node * fanout;
+        auto mask = detail::packed_filter_boxes(
+            kernels, node_boxes_, level_offsets_[level + 1] + first, query
+        );
+
+        // Push in reverse, such that the children are visited in order.
+        while (mask != 0) {
+            auto i = size_t(31 - __builtin_clz(mask));
+            mask ^= detail::packed_mask_t(1) << i;
+            stack[stack_size++] = {level + 1, first + i};
+        }
+    }
+}
+
+
+template <typename T>
+template <typename GeometryMode, typename ShapeT, typename OutputIt>
+inline void CompressedIndexTree<T>::find_intersecting(const ShapeT& shape,
+                                                      const OutputIt& iter) const {
+    auto query_box = bg::return_envelope<Box3D>(bgi::indexable<ShapeT>{}(shape));
+    auto query = detail::make_packed_query<GeometryMode, T>(shape);
+    auto out = iter;
+
+    std::array<T, fanout> leaf_values;
+    visit_leaves(query, [&](size_t leaf) {
+        auto n = decode_geometry(leaf, leaf_values.data());
+
+        detail::packed_mask_t hits = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const auto& value = leaf_values[i];
+            if (bg::intersects(query_box, bgi::indexable<T>{}(value))
+                && geometry_intersects(shape, value, GeometryMode{})) {
+                hits |= detail::packed_mask_t(1) << i;
+            }
+        }
+
+        if (hits != 0) {
+            decode_ids(leaf, hits, leaf_values.data());
+            for (; hits != 0; hits &= hits - 1) {
+                *out = leaf_values[size_t(__builtin_ctz(hits))];
+                ++out;
+            }
+        }
+
+        return true;
+    });
+}
+
+
+template <typename T>
+template <typename GeometryMode, typename ShapeT>
+inline bool CompressedIndexTree<T>::is_intersecting(const ShapeT& shape) const {
+    auto query_box = bg::return_envelope<Box3D>(bgi::indexable<ShapeT>{}(shape));
+    auto query = detail::make_packed_query<GeometryMode, T>(shape);
+
+    bool found = false;
+    std::array<T, fanout> leaf_values;
+    visit_leaves(query, [&](size_t leaf) {
+        auto n = decode_geometry(leaf, leaf_values.data());
+        for (size_t i = 0; i < n && !found; ++i) {
+            const auto& value = leaf_values[i];
+            found = bg::intersects(query_box, bgi::indexable<T>{}(value))
+                    && geometry_intersects(shape, value, GeometryMode{});
+        }
+
+        return !found;
+    });
+
+    return found;
+}
+
+
+template <typename T>
+template <typename ShapeT>
+inline decltype(auto) CompressedIndexTree<T>::find_nearest(const ShapeT& shape,
+                                                           unsigned k_neighbors) const {
+    using ids_getter = typename detail::id_getter_for<T>::type;
+    std::vector<typename ids_getter::value_type> ids;
+
+    if (empty() || k_neighbors == 0) {
+        return ids;
+    }
+
+    // Best-first search, see `PackedIndexTree::find_nearest`. The values of a
+    // leaf are decoded when the leaf is reached, and then refer to `decoded`.
+    struct Candidate {
+        double distance;
+        size_t level;
+        size_t index;
+
+        bool operator>(const Candidate& other) const {
+            return distance > other.distance;
+        }
+    };
+
+    auto distance = [&shape](const Box3D& box) {
+        return static_cast<double>(bg::comparable_distance(shape, box));
+    };
+
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> queue;
+    queue.push({distance(node_boxes_.get(0)), 0, 0});
+
+    std::vector<T> decoded;
+    std::array<T, fanout> leaf_values;
+    auto leaf_level = n_levels() - 1;
+
+    auto out = ids_getter(ids);
+    while (!queue.empty() && ids.size() < k_neighbors) {
+        auto candidate = queue.top();
+        queue.pop();
+
+        if (candidate.level == n_levels()) {
+            *out = decoded[candidate.index];
+            ++out;
+            continue;
+        }
+
+        if (candidate.level == leaf_level) {
+            auto n = decode_leaf(candidate.index, leaf_values.data());
+            for (size_t i = 0; i < n; ++i) {
+                Box3D box = bgi::indexable<T>{}(leaf_values[i]);
+                queue.push({distance(box), n_levels(), decoded.size()});
+                decoded.push_back(leaf_values[i]);
+            }
+            continue;
+        }
+
+        auto [first, last] = children(candidate.level, candidate.index);
+        auto child_level = candidate.level + 1;
+
+        for (size_t i = first; i < last; ++i) {
+            auto box = node_boxes_.get(level_offsets_[child_level] + i);
+            queue.push({distance(box), child_level, i});
+        }
+    }
+
+    return ids;
+}
+
+
+template <typename T>
+template <typename GeometryMode, typename ShapeT>
+inline std::vector<T> CompressedIndexTree<T>::find_intersecting_objs(const ShapeT& shape) const {
+    std::vector<T> results;
+    find_intersecting<GeometryMode>(shape, std::back_inserter(results));
+    return results;
+}
+
+
+template <typename T>
+inline Box3D CompressedIndexTree<T>::bounds() const {
+    if (empty()) {
+        Box3D box;
+        bg::assign_inverse(box);
+        return box;
+    }
+
+    return node_boxes_.get(0);
+}
+
+
+template <typename T>
+inline std::vector<T> CompressedIndexTree<T>::values() const {
+    std::vector<T> values(n_values_);
+
+    auto n_leaves = leaf_origins_.size();
+    for (size_t leaf = 0; leaf < n_leaves; ++leaf) {
+        decode_leaf(leaf, values.data() + leaf * fanout);
+    }
+
+    return values;
+}
+
+
+template <typename T>
+inline size_t CompressedIndexTree<T>::memory_usage() const {
+    auto bytes = [](const auto& v) {
+        return v.capacity() * sizeof(typename std::decay_t<decltype(v)>::value_type);
+    };
+
+    size_t n_bytes = bytes(coords_) + bytes(leaf_origins_) + bytes(leaf_steps_)
+                     + bytes(radii_) + bytes(tags_) + bytes(id_bytes_) + bytes(id_offsets_)
+                     + bytes(level_offsets_) + bytes(level_sizes_);
+
+    for (size_t d = 0; d < 3; ++d) {
+        n_bytes += bytes(node_boxes_.min_corner[d]) + bytes(node_boxes_.max_corner[d]);
+    }
+
+    return n_bytes;
+}
+
+
+template <typename T>
+inline std::ostream& operator<<(std::ostream& os, const CompressedIndexTree<T>& index) {
+    int n_obj = 50;   // display the first 50 objects
+    os << "CompressedIndexTree([\n";
+    for (const auto& item : index.values()) {
+        if (n_obj-- == 0) {
+            os << "  ...\n";
+            break;
+        }
+        os << "  " << item << '\n';
+    }
+    return os << "])";
+}
+
+}  // namespace brain_indexer
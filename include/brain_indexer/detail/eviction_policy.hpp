@@ -0,0 +1,422 @@
+#pragma once
+
+#include "../eviction_policy.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace brain_indexer {
+
+inline double
+UsageRateMetaData::usage_rate(size_t query_count) const {
+    if (query_count == load_generation_) {
+        // These were loaded during this query. Try not to evict these. However,
+        // it's safe to evict these since the subtree that will be queried next
+        // will be loaded after this eviction; and therefore can't be evicted
+        // before it's ever used.
+        return std::numeric_limits<double>::max();
+    }
+
+    return double(access_count()) / double(incache_count(query_count));
+}
+
+inline size_t
+UsageRateMetaData::access_count() const {
+    return previous_access_count_ + current_access_count_;
+}
+
+inline size_t
+UsageRateMetaData::incache_count(size_t query_count) const {
+    return (query_count - load_generation_ + 1) + previous_age_;
+}
+
+inline size_t
+UsageRateMetaData::eviction_count() const {
+    return eviction_count_;
+}
+
+inline void
+UsageRateMetaData::on_query() {
+    ++current_access_count_;
+    unused_prefetch_ = false;
+}
+
+inline void
+UsageRateMetaData::on_load(size_t query_count) {
+    load_generation_ = query_count;
+    current_access_count_ = 1;
+    unused_prefetch_ = false;
+}
+
+inline void
+UsageRateMetaData::on_evict(size_t query_count) {
+    previous_access_count_ += current_access_count_;
+    previous_age_ = query_count - load_generation_ + 1;
+
+    current_access_count_ = 0;
+    eviction_count_ += 1;
+    unused_prefetch_ = false;
+}
+
+inline void
+UsageRateMetaData::on_prefetch() {
+    // Nobody asked for it yet; if it stays that way, it's evicted first.
+    current_access_count_ = 0;
+    unused_prefetch_ = true;
+}
+
+inline void
+UsageRateMetaData::on_read(size_t bytes, double load_seconds) {
+    bytes_ = bytes;
+    load_seconds_ = load_seconds;
+}
+
+inline bool
+UsageRateMetaData::is_unused_prefetch() const {
+    return unused_prefetch_;
+}
+
+
+/////////////////////////////////////////
+// class UsageRatePolicy
+/////////////////////////////////////////
+
+inline void
+UsageRatePolicy::on_insert(size_t id, const UsageRateMetaData& md, size_t /* query_count */) {
+    cached_[id] = &md;
+}
+
+inline void
+UsageRatePolicy::on_access(size_t /* id */, size_t /* query_count */) {
+    // The cache updates the meta data.
+}
+
+inline void
+UsageRatePolicy::on_remove(size_t id, size_t /* query_count */) {
+    cached_.erase(id);
+}
+
+inline boost::optional<size_t>
+UsageRatePolicy::select_victim(size_t query_count) {
+    auto victim = boost::optional<size_t>();
+    auto lowest_usage_rate = std::numeric_limits<double>::infinity();
+
+    for (const auto& [id, md] : cached_) {
+        auto usage_rate = md->usage_rate(query_count);
+        if (!victim || usage_rate < lowest_usage_rate) {
+            victim = id;
+            lowest_usage_rate = usage_rate;
+        }
+    }
+
+    return victim;
+}
+
+
+/////////////////////////////////////////
+// class LRUPolicy
+/////////////////////////////////////////
+
+inline void
+LRUPolicy::on_insert(size_t id, const UsageRateMetaData& md, size_t query_count) {
+    on_remove(id, query_count);
+
+    // Prefetched subtrees are evicted first, unless a query uses them.
+    auto position = md.is_unused_prefetch() ? recency_.end() : recency_.begin();
+    position_[id] = recency_.insert(position, id);
+}
+
+inline void
+LRUPolicy::on_access(size_t id, size_t /* query_count */) {
+    auto it = position_.find(id);
+    if (it != position_.end()) {
+        recency_.splice(recency_.begin(), recency_, it->second);
+    }
+}
+
+inline void
+LRUPolicy::on_remove(size_t id, size_t /* query_count */) {
+    auto it = position_.find(id);
+    if (it != position_.end()) {
+        recency_.erase(it->second);
+        position_.erase(it);
+    }
+}
+
+inline boost::optional<size_t>
+LRUPolicy::select_victim(size_t /* query_count */) {
+    if (recency_.empty()) {
+        return boost::none;
+    }
+
+    return recency_.back();
+}
+
+
+/////////////////////////////////////////
+// class ClockPolicy
+/////////////////////////////////////////
+
+inline void
+ClockPolicy::on_insert(size_t id, const UsageRateMetaData& md, size_t query_count) {
+    on_remove(id, query_count);
+
+    size_t k = slots_.size();
+    if (free_slots_.empty()) {
+        slots_.emplace_back();
+    } else {
+        k = free_slots_.back();
+        free_slots_.pop_back();
+    }
+
+    slots_[k] = Slot{id, !md.is_unused_prefetch(), true};
+    slot_of_[id] = k;
+}
+
+inline void
+ClockPolicy::on_access(size_t id, size_t /* query_count */) {
+    auto it = slot_of_.find(id);
+    if (it != slot_of_.end()) {
+        slots_[it->second].referenced = true;
+    }
+}
+
+inline void
+ClockPolicy::on_remove(size_t id, size_t /* query_count */) {
+    auto it = slot_of_.find(id);
+    if (it != slot_of_.end()) {
+        slots_[it->second].occupied = false;
+        free_slots_.push_back(it->second);
+        slot_of_.erase(it);
+    }
+}
+
+inline boost::optional<size_t>
+ClockPolicy::select_victim(size_t /* query_count */) {
+    if (slot_of_.empty()) {
+        return boost::none;
+    }
+
+    // Terminates after at most two rounds, since the first clears all bits.
+    while (true) {
+        hand_ = hand_ % slots_.size();
+        auto& slot = slots_[hand_];
+
+        if (slot.occupied) {
+            if (!slot.referenced) {
+                return slot.id;
+            }
+            slot.referenced = false;
+        }
+
+        ++hand_;
+    }
+}
+
+
+/////////////////////////////////////////
+// class ARCPolicy
+/////////////////////////////////////////
+
+inline void
+ARCPolicy::on_insert(size_t id, const UsageRateMetaData& md, size_t /* query_count */) {
+    auto it = entries_.find(id);
+    if (it != entries_.end() && (it->second.list == t1 || it->second.list == t2)) {
+        // Already cached; nothing to learn.
+        return;
+    }
+
+    if (it == entries_.end()) {
+        move_to(id, t1);
+
+        if (md.is_unused_prefetch()) {
+            // Like in `LRUPolicy`, unused prefetches are evicted first.
+            lists_[t1].splice(lists_[t1].end(), lists_[t1], entries_[id].position);
+        }
+    } else {
+        // A ghost hit: the list it was evicted from should have been larger.
+        double n_b1 = double(lists_[b1].size());
+        double n_b2 = double(lists_[b2].size());
+
+        if (it->second.list == b1) {
+            p_ = std::min(double(n_cached() + 1), p_ + std::max(1.0, n_b2 / n_b1));
+        } else {
+            p_ = std::max(0.0, p_ - std::max(1.0, n_b1 / n_b2));
+        }
+
+        move_to(id, t2);
+    }
+
+    trim_ghosts();
+}
+
+inline void
+ARCPolicy::on_access(size_t id, size_t /* query_count */) {
+    auto it = entries_.find(id);
+    if (it != entries_.end() && (it->second.list == t1 || it->second.list == t2)) {
+        move_to(id, t2);
+    }
+}
+
+inline void
+ARCPolicy::on_remove(size_t id, size_t /* query_count */) {
+    auto it = entries_.find(id);
+    if (it == entries_.end()) {
+        return;
+    }
+
+    if (it->second.list == t1) {
+        move_to(id, b1);
+    } else if (it->second.list == t2) {
+        move_to(id, b2);
+    }
+
+    trim_ghosts();
+}
+
+inline boost::optional<size_t>
+ARCPolicy::select_victim(size_t /* query_count */) {
+    const auto& l1 = lists_[t1];
+    const auto& l2 = lists_[t2];
+
+    if (!l1.empty() && (double(l1.size()) > p_ || l2.empty())) {
+        return l1.back();
+    }
+
+    if (!l2.empty()) {
+        return l2.back();
+    }
+
+    return boost::none;
+}
+
+inline void
+ARCPolicy::move_to(size_t id, ListID list) {
+    erase(id);
+
+    lists_[list].push_front(id);
+    entries_[id] = Entry{list, lists_[list].begin()};
+}
+
+inline void
+ARCPolicy::erase(size_t id) {
+    auto it = entries_.find(id);
+    if (it != entries_.end()) {
+        lists_[it->second.list].erase(it->second.position);
+        entries_.erase(it);
+    }
+}
+
+inline void
+ARCPolicy::trim_ghosts() {
+    auto forget_oldest = [this](ListID list) {
+        auto id = lists_[list].back();
+        lists_[list].pop_back();
+        entries_.erase(id);
+    };
+
+    auto capacity = std::max<size_t>(n_cached(), 1);
+    while (lists_[b1].size() > capacity) {
+        forget_oldest(b1);
+    }
+
+    while (lists_[b1].size() + lists_[b2].size() > capacity) {
+        forget_oldest(lists_[b2].empty() ? b1 : b2);
+    }
+}
+
+
+/////////////////////////////////////////
+// class CostAwarePolicy
+/////////////////////////////////////////
+
+inline void
+CostAwarePolicy::on_insert(size_t id, const UsageRateMetaData& md, size_t query_count) {
+    on_remove(id, query_count);
+
+    auto entry = Entry{};
+    entry.cost_per_byte = md.load_seconds() / double(std::max<size_t>(md.bytes(), 1));
+    entry.frequency = md.is_unused_prefetch() ? 0 : 1;
+
+    set_priority(id, entries_[id] = entry);
+}
+
+inline void
+CostAwarePolicy::on_access(size_t id, size_t /* query_count */) {
+    auto it = entries_.find(id);
+    if (it != entries_.end()) {
+        by_priority_.erase({it->second.priority, id});
+        ++it->second.frequency;
+        set_priority(id, it->second);
+    }
+}
+
+inline void
+CostAwarePolicy::on_remove(size_t id, size_t /* query_count */) {
+    auto it = entries_.find(id);
+    if (it != entries_.end()) {
+        // Only once the victim is actually gone, `select_victim` may be
+        // called without evicting anything.
+        inflation_ = std::max(inflation_, it->second.priority);
+        by_priority_.erase({it->second.priority, id});
+        entries_.erase(it);
+    }
+}
+
+inline boost::optional<size_t>
+CostAwarePolicy::select_victim(size_t /* query_count */) {
+    if (by_priority_.empty()) {
+        return boost::none;
+    }
+
+    return by_priority_.begin()->second;
+}
+
+inline void
+CostAwarePolicy::set_priority(size_t id, Entry& entry) {
+    entry.priority = inflation_ + double(entry.frequency) * entry.cost_per_byte;
+    by_priority_.emplace(entry.priority, id);
+}
+
+
+inline std::unique_ptr<EvictionPolicy>
+make_eviction_policy(EvictionPolicyKind kind) {
+    switch (kind) {
+    case EvictionPolicyKind::usage_rate:
+        return std::make_unique<UsageRatePolicy>();
+    case EvictionPolicyKind::lru:
+        return std::make_unique<LRUPolicy>();
+    case EvictionPolicyKind::clock:
+        return std::make_unique<ClockPolicy>();
+    case EvictionPolicyKind::arc:
+        return std::make_unique<ARCPolicy>();
+    case EvictionPolicyKind::cost_aware:
+        return std::make_unique<CostAwarePolicy>();
+    }
+
+    throw std::runtime_error("Invalid eviction policy.");
+}
+
+inline EvictionPolicyKind
+eviction_policy_kind(const std::string& name) {
+    if (name == "usage_rate") {
+        return EvictionPolicyKind::usage_rate;
+    }
+    if (name == "lru") {
+        return EvictionPolicyKind::lru;
+    }
+    if (name == "clock") {
+        return EvictionPolicyKind::clock;
+    }
+    if (name == "arc") {
+        return EvictionPolicyKind::arc;
+    }
+    if (name == "cost_aware") {
+        return EvictionPolicyKind::cost_aware;
+    }
+
+    throw std::runtime_error("Invalid eviction policy: " + name + ".");
+}
+
+}  // namespace brain_indexer
@@ -84,6 +84,25 @@ inline CoordType distance_segment_segment(Point3D const& s1_0, Point3D const& s1
     return std::sqrt(square_distance_segment_segment(s1_0, s1_1, s2_0, s2_1));
 }
 
+/**
+ * \brief The square distance between `p` and the segment from `s0` to `s1`.
+ *
+ * Segments of length zero are treated as the point `s0`.
+ */
+inline CoordType square_distance_point_segment(Point3D const& p,
+                                               Point3D const& s0, Point3D const& s1) {
+    const Point3Dx v = Point3Dx(s1) - s0;
+    const Point3Dx u = Point3Dx(p) - s0;
+    const CoordType v_dot_v = v.norm_sq();
+
+    if (v_dot_v <= CoordType(0)) {
+        return u.norm_sq();
+    }
+
+    const CoordType t = std::clamp(u.dot(v) / v_dot_v, CoordType(0), CoordType(1));
+    return (u - t * v).norm_sq();
+}
+
 }  // namespace detail
 
 
@@ -326,6 +345,104 @@ inline bool Cylinder::contains(Point3D const& p) const {
 }
 
 
+inline Box3D Polyline::bounding_box() const {
+    Point3D low = points[0];
+    Point3D high = points[0];
+
+    for (const auto& p: points) {
+        low = min(low, p);
+        high = max(high, p);
+    }
+
+    return Box3D(Point3Dx(low) - radius, Point3Dx(high) + radius);
+}
+
+inline bool Polyline::intersects(Box3D const& b) const {
+    // Most segments of a long path are far away from any given box; which is
+    // decided cheaply by the bounding box of the capsule.
+    for (size_t i = 0; i < n_segments(); ++i) {
+        const auto capsule = segment(i);
+        const Box3D capsule_box(Point3Dx(min(capsule.p1, capsule.p2)) - radius,
+                                Point3Dx(max(capsule.p1, capsule.p2)) + radius);
+
+        if (bg::intersects(capsule_box, b) && capsule.intersects(b)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+inline bool Polyline::intersects(Sphere const& s) const {
+    const CoordType max_distance = radius + s.radius;
+    for (size_t i = 0; i < n_segments(); ++i) {
+        const auto capsule = segment(i);
+        const auto dist_sq = detail::square_distance_point_segment(s.centroid,
+                                                                   capsule.p1,
+                                                                   capsule.p2);
+        if (dist_sq <= max_distance * max_distance) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+inline bool Polyline::intersects(Cylinder const& c) const {
+    // Like `Cylinder::intersects(Cylinder)` the cylinder is treated as a capsule.
+    for (size_t i = 0; i < n_segments(); ++i) {
+        if (segment(i).intersects(c)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+inline bool Polyline::intersects(Point3D const& p) const {
+    for (size_t i = 0; i < n_segments(); ++i) {
+        const auto capsule = segment(i);
+        if (detail::square_distance_point_segment(p, capsule.p1, capsule.p2)
+            <= radius * radius) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+inline CoordType geometry_distance(const Point3D& point, const Point3D& element_shape) {
+    return (Point3Dx(point) - element_shape).norm();
+}
+
+inline CoordType geometry_distance(const Point3D& point, const Box3D& element_shape) {
+    auto p = clamp(point, element_shape.min_corner(), element_shape.max_corner());
+    return (Point3Dx(p) - point).norm();
+}
+
+inline CoordType geometry_distance(const Point3D& point, const Sphere& element_shape) {
+    auto d = (Point3Dx(point) - element_shape.centroid).norm();
+    return std::max(CoordType(0), d - element_shape.radius);
+}
+
+inline CoordType geometry_distance(const Point3D& point, const Cylinder& element_shape) {
+    const auto axis = Point3Dx(element_shape.p2) - element_shape.p1;
+    const auto u = Point3Dx(point) - element_shape.p1;
+    const auto length = axis.norm();
+
+    // The coordinates of `point` along the axis and orthogonal to it.
+    const auto s = length > CoordType(0) ? u.dot(axis) / length : CoordType(0);
+    const auto rho = std::sqrt(std::max(CoordType(0), u.norm_sq() - s * s));
+
+    // Points over the caps are closest to the cap, otherwise to the mantle.
+    const auto axial = s < CoordType(0) ? -s : std::max(CoordType(0), s - length);
+    const auto radial = std::max(CoordType(0), rho - element_shape.radius);
+
+    return std::sqrt(axial * axial + radial * radial);
+}
+
+
 // String representation
 
 inline std::ostream& operator<<(std::ostream& os, const Sphere& s) {
@@ -338,6 +455,14 @@ inline std::ostream& operator<<(std::ostream& os, const Cylinder& c) {
                  "radius=" << boost::format("%.3g") % c.radius << ')';
 }
 
+inline std::ostream& operator<<(std::ostream& os, const Polyline& p) {
+    os << "Polyline(points=(";
+    for (size_t i = 0; i < p.points.size(); ++i) {
+        os << (i == 0 ? "" : ", ") << p.points[i];
+    }
+    return os << "), radius=" << boost::format("%.3g") % p.radius << ')';
+}
+
 }  // namespace brain_indexer
 
 namespace boost { namespace geometry { namespace model {
@@ -2,11 +2,14 @@
 
 #include "../index.hpp"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <numeric>
 
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/archive/binary_oarchive.hpp>
+#include <boost/iterator/counting_iterator.hpp>
 #include <boost/iterator/function_output_iterator.hpp>
 
 #include "output_iterators.hpp"
@@ -27,6 +30,95 @@ bool geometry_intersects(const T& query_shape,
         element_shape);
 }
 
+// The cached box is exactly the bounding box of the element, i.e. the
+// 'bounding box geometry' of the element.
+template <typename ShapeT, typename T>
+inline bool geometry_intersects(const ShapeT& query_shape,
+                                const CachedBoxEntry<T>& element_shape,
+                                BoundingBoxGeometry geo) {
+    return geometry_intersects(query_shape, element_shape.bounding_box(), geo);
+}
+
+template <typename ShapeT, typename T>
+inline bool geometry_intersects(const ShapeT& query_shape,
+                                const CachedBoxEntry<T>& element_shape,
+                                BestEffortGeometry geo) {
+    return geometry_intersects(query_shape, element_shape.element(), geo);
+}
+
+template <typename... VarT>
+inline CoordType geometry_distance(const Point3D& point,
+                                   const boost::variant<VarT...>& element_shape) {
+    return boost::apply_visitor(
+        [&point](const auto& e1) { return geometry_distance(point, e1); },
+        element_shape);
+}
+
+template <typename T>
+inline CoordType geometry_distance(const Point3D& point,
+                                   const CachedBoxEntry<T>& element_shape) {
+    return geometry_distance(point, element_shape.element());
+}
+
+namespace detail {
+
+/**
+ * \brief The predicate of a polyline query.
+ *
+ * The nodes of the tree are pruned unless one of the segments intersects the
+ * bounding box of the node. Hence, the tree is traversed once, and only the
+ * parts near the path are visited. See the `predicate_check` specializations.
+ */
+template <typename GeometryMode>
+struct polyline_intersects {
+    const Polyline* polyline;
+    Box3D bounding_box;
+};
+
+/// \brief The predicate used by queries, i.e. bounding box and exact check.
+template <typename GeometryMode, typename ShapeT>
+inline auto intersects_predicate(const ShapeT& shape) {
+    auto real_intersects = [&shape](const auto& v) {
+        return geometry_intersects(shape, v, GeometryMode{});
+    };
+
+    return bgi::intersects(bgi::indexable<ShapeT>{}(shape)) && bgi::satisfies(real_intersects);
+}
+
+template <typename GeometryMode>
+inline auto intersects_predicate(const Polyline& polyline) {
+    return polyline_intersects<GeometryMode>{&polyline, polyline.bounding_box()};
+}
+
+/** \brief Is `box` contained in `shape`?
+ *
+ * If so, every element inside `box` intersects `shape`, regardless of the
+ * `GeometryMode`. Only boxes and spheres are checked, for all other shapes
+ * this conservatively returns `false`.
+ */
+template <typename ShapeT>
+inline bool box_covered_by(const Box3D& /* box */, const ShapeT& /* shape */) {
+    return false;
+}
+
+inline bool box_covered_by(const Box3D& box, const Box3D& shape) {
+    return bg::covered_by(box, shape);
+}
+
+inline bool box_covered_by(const Box3D& box, const Sphere& sphere) {
+    // The corner furthest from the center must be inside the sphere.
+    const auto& c = sphere.centroid;
+    const auto& lo = box.min_corner();
+    const auto& hi = box.max_corner();
+    auto dx = std::max(std::abs(lo.get<0>() - c.get<0>()), std::abs(hi.get<0>() - c.get<0>()));
+    auto dy = std::max(std::abs(lo.get<1>() - c.get<1>()), std::abs(hi.get<1>() - c.get<1>()));
+    auto dz = std::max(std::abs(lo.get<2>() - c.get<2>()), std::abs(hi.get<2>() - c.get<2>()));
+    return dx * dx + dy * dy + dz * dz <= sphere.radius * sphere.radius;
+}
+
+}  // namespace detail
+
+
 template <typename T>
 inline Point3D get_centroid(const T& geometry) {
     return geometry.get_centroid();
@@ -40,9 +132,37 @@ inline Point3D get_centroid(const boost::variant<VariantT...>& mixed_geometry) {
     );
 }
 
+template <typename T>
+inline Point3D get_centroid(const CachedBoxEntry<T>& entry) {
+    return get_centroid(entry.element());
+}
+
+template<class Value>
+std::string value_to_element_type();
+
+namespace detail {
+
+template <class Value>
+struct element_type_name {
+    static std::string get() {
+        return "unknown";
+    }
+};
+
+// The cached box isn't serialized, but the wrapper changes the format of the
+// archive. Hence, it's a type of its own.
+template <class T>
+struct element_type_name<CachedBoxEntry<T>> {
+    static std::string get() {
+        return "cached_" + value_to_element_type<T>();
+    }
+};
+
+}  // namespace detail
+
 template<class Value>
 std::string value_to_element_type() {
-    return "unknown";
+    return detail::element_type_name<Value>::get();
 }
 
 template<>
@@ -65,6 +185,20 @@ inline std::string value_to_element_type<Synapse>() {
     return "synapse";
 }
 
+template<>
+inline std::string value_to_element_type<PointSynapse>() {
+    return "point_synapse";
+}
+
+
+/////////////////////////////////////////
+// class CachedBoxEntry
+
+template <typename T>
+inline Box3D CachedBoxEntry<T>::compute_bounding_box() const {
+    return bgi::indexable<T>{}(element());
+}
+
 
 /////////////////////////////////////////
 // class IndexTree
@@ -77,13 +211,7 @@ inline void IndexTreeMixin<Derived, T>::find_intersecting(const ShapeT& shape,
 
     const auto &derived = static_cast<const Derived&>(*this);
     // Using a callback makes the query slightly faster than using qbegin()...qend()
-    auto real_intersects = [&shape](const auto &v) {
-        return geometry_intersects(shape, v, GeometryMode{});
-    };
-
-    derived.query(
-        bgi::intersects(bgi::indexable<ShapeT>{}(shape)) && bgi::satisfies(real_intersects),
-        iter);
+    derived.query(detail::intersects_predicate<GeometryMode>(shape), iter);
 }
 
 
@@ -92,14 +220,168 @@ inline void IndexTreeMixin<Derived, T>::find_intersecting(const ShapeT& shape,
 template <typename Derived, typename T>
 template <typename GeometryMode, typename ShapeT>
 inline decltype(auto) 
-IndexTreeMixin<Derived, T>::find_intersecting_np(const ShapeT& shape) const {
+IndexTreeMixin<Derived, T>::find_intersecting_np(const ShapeT& shape,
+                                                 field_mask_t fields) const {
     using getter_t = iter_entry_getter<T>;
     typename getter_t::result_t result;
-    find_intersecting<GeometryMode>(shape, getter_t(result));
+    const auto& derived = static_cast<const Derived&>(*this);
+    derived.template find_intersecting<GeometryMode>(shape, getter_t(result, fields));
     return result;
 }
 
 
+namespace detail {
+
+/// \brief Runs the queries `[first, last)` one after the other, see `find_intersecting_batch_np`.
+template <typename GeometryMode, typename T, typename Index, typename ShapeIt>
+inline auto find_intersecting_batch_np(const Index& index, ShapeIt first, ShapeIt last) {
+    using getter_t = iter_entry_getter<T>;
+    batch_query_result<typename getter_t::result_t> batch;
+    batch.offsets.reserve(static_cast<size_t>(std::distance(first, last)) + 1);
+    batch.offsets.push_back(0);
+
+    size_t n_found = 0;
+    auto getter = getter_t(batch.results);
+    auto counter = boost::make_function_output_iterator(
+        [&getter, &n_found](const auto& elem) {
+            getter = elem;
+            ++n_found;
+        }
+    );
+
+    for (auto it = first; it != last; ++it) {
+        index.template find_intersecting<GeometryMode>(*it, counter);
+        batch.offsets.push_back(n_found);
+    }
+
+    return batch;
+}
+
+/** \brief Runs a batch of queries on `n_threads` threads.
+ *
+ * The queries are split into chunks, `run_chunk(first, last)` runs the
+ * queries `[first, last)` and returns a `batch_query_result`. The chunks are
+ * concatenated in order, i.e. the result is the same as running all queries
+ * in one chunk.
+ */
+template <typename ShapeT, typename RunChunk>
+inline auto run_batch_concurrently(const std::vector<ShapeT>& shapes,
+                                   ThreadPool& pool,
+                                   size_t n_threads,
+                                   const RunChunk& run_chunk) {
+    if (n_threads <= 1) {
+        return run_chunk(shapes.begin(), shapes.end());
+    }
+
+    // More chunks than threads, since the cost of queries varies a lot.
+    auto n_queries = shapes.size();
+    auto n_chunks = std::min(n_queries, 8 * n_threads);
+
+    using batch_t = decltype(run_chunk(shapes.begin(), shapes.end()));
+    std::vector<batch_t> chunks(n_chunks);
+
+    parallel_for(pool, n_chunks, n_threads, [&](size_t k) {
+        auto range = util::balanced_chunks(n_queries, n_chunks, k);
+        chunks[k] = run_chunk(shapes.begin() + std::ptrdiff_t(range.low),
+                              shapes.begin() + std::ptrdiff_t(range.high));
+    });
+
+    // Concatenate the chunks in order.
+    batch_t batch;
+    batch.offsets.reserve(n_queries + 1);
+    batch.offsets.push_back(0);
+    for (auto& chunk : chunks) {
+        auto n_found = batch.offsets.back();
+        for (size_t i = 1; i < chunk.offsets.size(); ++i) {
+            batch.offsets.push_back(n_found + chunk.offsets[i]);
+        }
+
+        detail::append_query_result(batch.results, chunk.results);
+        chunk = batch_t{};
+    }
+
+    return batch;
+}
+
+/// \brief Runs the queries `[first, last)` one after the other, see `find_unique_gids_batch`.
+template <typename GeometryMode, typename Index, typename ShapeIt>
+inline auto find_unique_gids_batch(const Index& index, ShapeIt first, ShapeIt last) {
+    batch_query_result<unique_gids_result> batch;
+    batch.offsets.reserve(static_cast<size_t>(std::distance(first, last)) + 1);
+    batch.offsets.push_back(0);
+
+    std::unordered_map<identifier_t, size_t> counts;
+    auto counter = boost::make_function_output_iterator(
+        [&counts](const auto& elem) {
+            ++counts[get_gid_from(elem)];
+        }
+    );
+
+    for (auto it = first; it != last; ++it) {
+        index.template find_intersecting<GeometryMode>(*it, counter);
+        append_unique_gids(counts, batch.results);
+        batch.offsets.push_back(batch.results.gids.size());
+    }
+
+    return batch;
+}
+
+/// \brief Runs the queries `[first, last)` one after the other, see `count_intersecting_grouped`.
+template <typename GeometryMode, typename Index, typename ShapeIt>
+inline auto count_intersecting_grouped(const Index& index,
+                                       ShapeIt first,
+                                       ShapeIt last,
+                                       GroupBy group_by) {
+    batch_query_result<grouped_counts_result> batch;
+    batch.offsets.reserve(static_cast<size_t>(std::distance(first, last)) + 1);
+    batch.offsets.push_back(0);
+
+    GroupedCounter grouped_counter(group_by);
+    auto counter = boost::make_function_output_iterator(
+        [&grouped_counter](const auto& elem) {
+            grouped_counter.add(elem);
+        }
+    );
+
+    for (auto it = first; it != last; ++it) {
+        index.template find_intersecting<GeometryMode>(*it, counter);
+        grouped_counter.flush(batch.results);
+        batch.offsets.push_back(batch.results.counts.size());
+    }
+
+    return batch;
+}
+
+}  // namespace detail
+
+
+template <typename Derived, typename T>
+template <typename GeometryMode, typename ShapeT>
+inline decltype(auto)
+IndexTreeMixin<Derived, T>::find_intersecting_batch_np(const std::vector<ShapeT>& shapes) const {
+    const auto& derived = static_cast<const Derived&>(*this);
+    return detail::find_intersecting_batch_np<GeometryMode, T>(derived, shapes.begin(), shapes.end());
+}
+
+
+template <typename Derived, typename T>
+template <typename GeometryMode, typename ShapeT>
+inline decltype(auto)
+IndexTreeMixin<Derived, T>::find_intersecting_batch_np(const std::vector<ShapeT>& shapes,
+                                                       ThreadPool& pool,
+                                                       size_t n_threads) const {
+    static_assert(supports_concurrent_queries<Derived>::value,
+                  "This index can't be queried concurrently.");
+
+    const auto& derived = static_cast<const Derived&>(*this);
+    return detail::run_batch_concurrently(shapes, pool, n_threads,
+        [&derived](auto first, auto last) {
+            return detail::find_intersecting_batch_np<GeometryMode, T>(derived, first, last);
+        }
+    );
+}
+
+
 template <typename Derived, typename T>
 template <typename GeometryMode, typename ShapeT>
 inline size_t IndexTreeMixin<Derived, T>::count_intersecting(const ShapeT& shape) const {
@@ -108,7 +390,8 @@ inline size_t IndexTreeMixin<Derived, T>::count_intersecting(const ShapeT& shape
         [&cardinality](const auto&) { ++cardinality; }
     );
 
-    find_intersecting<GeometryMode>(shape, counter);
+    const auto& derived = static_cast<const Derived&>(*this);
+    derived.template find_intersecting<GeometryMode>(shape, counter);
     return cardinality;
 }
 
@@ -123,10 +406,84 @@ IndexTreeMixin<Derived, T>::count_intersecting_agg_gid(const ShapeT& shape) cons
         }
     );
 
-    find_intersecting<GeometryMode>(shape, counter);
+    const auto& derived = static_cast<const Derived&>(*this);
+    derived.template find_intersecting<GeometryMode>(shape, counter);
     return counts;
 }
 
+template <typename Derived, typename T>
+template <typename GeometryMode, typename ShapeT>
+inline decltype(auto) IndexTreeMixin<Derived, T>::find_unique_gids(const ShapeT& shape) const {
+    detail::unique_gids_result result;
+    std::unordered_map<identifier_t, size_t> counts;
+    auto counter = boost::make_function_output_iterator(
+        [&counts](const auto& elem) {
+            ++counts[detail::get_gid_from(elem)];
+        }
+    );
+
+    const auto& derived = static_cast<const Derived&>(*this);
+    derived.template find_intersecting<GeometryMode>(shape, counter);
+    detail::append_unique_gids(counts, result);
+    return result;
+}
+
+template <typename Derived, typename T>
+template <typename GeometryMode, typename ShapeT>
+inline decltype(auto)
+IndexTreeMixin<Derived, T>::find_unique_gids_batch(const std::vector<ShapeT>& shapes) const {
+    const auto& derived = static_cast<const Derived&>(*this);
+    return detail::find_unique_gids_batch<GeometryMode>(derived, shapes.begin(), shapes.end());
+}
+
+template <typename Derived, typename T>
+template <typename GeometryMode, typename ShapeT>
+inline decltype(auto)
+IndexTreeMixin<Derived, T>::find_unique_gids_batch(const std::vector<ShapeT>& shapes,
+                                                   ThreadPool& pool,
+                                                   size_t n_threads) const {
+    static_assert(supports_concurrent_queries<Derived>::value,
+                  "This index can't be queried concurrently.");
+
+    const auto& derived = static_cast<const Derived&>(*this);
+    return detail::run_batch_concurrently(shapes, pool, n_threads,
+        [&derived](auto first, auto last) {
+            return detail::find_unique_gids_batch<GeometryMode>(derived, first, last);
+        }
+    );
+}
+
+template <typename Derived, typename T>
+template <typename GeometryMode, typename ShapeT>
+inline decltype(auto)
+IndexTreeMixin<Derived, T>::count_intersecting_grouped(const std::vector<ShapeT>& shapes,
+                                                       GroupBy group_by) const {
+    const auto& derived = static_cast<const Derived&>(*this);
+    return detail::count_intersecting_grouped<GeometryMode>(
+        derived, shapes.begin(), shapes.end(), group_by
+    );
+}
+
+template <typename Derived, typename T>
+template <typename GeometryMode, typename ShapeT>
+inline decltype(auto)
+IndexTreeMixin<Derived, T>::count_intersecting_grouped(const std::vector<ShapeT>& shapes,
+                                                       GroupBy group_by,
+                                                       ThreadPool& pool,
+                                                       size_t n_threads) const {
+    static_assert(supports_concurrent_queries<Derived>::value,
+                  "This index can't be queried concurrently.");
+
+    const auto& derived = static_cast<const Derived&>(*this);
+    return detail::run_batch_concurrently(shapes, pool, n_threads,
+        [&derived, group_by](auto first, auto last) {
+            return detail::count_intersecting_grouped<GeometryMode>(
+                derived, first, last, group_by
+            );
+        }
+    );
+}
+
 template <typename Derived, typename T>
 template <typename ShapeT>
 inline decltype(auto) IndexTreeMixin<Derived, T>::find_nearest(const ShapeT& shape,
@@ -140,6 +497,163 @@ inline decltype(auto) IndexTreeMixin<Derived, T>::find_nearest(const ShapeT& sha
 }
 
 
+namespace detail {
+
+/// \brief The nearest elements of `index`, see `IndexTreeMixin::find_nearest_exact`.
+template <typename T, typename Index>
+inline auto find_nearest_exact(const Index& index,
+                               const Point3D& point,
+                               unsigned k_neighbors,
+                               CoordType max_distance) {
+    using ids_getter = typename id_getter_for<T>::type;
+    using id_type = typename ids_getter::value_type;
+
+    nearest_result<id_type> result;
+    if (k_neighbors == 0) {
+        return result;
+    }
+
+    std::vector<id_type> ids;
+    std::vector<CoordType> distances;
+    auto ids_out = ids_getter(ids);
+    auto out = boost::make_function_output_iterator([&](const auto& value) {
+        *ids_out = value;
+        distances.push_back(geometry_distance(point, value));
+    });
+
+    // Fewer than `k` candidates means there are fewer than `k` elements.
+    index.query(bgi::nearest(point, k_neighbors), out);
+    if (distances.size() >= k_neighbors) {
+        auto kth = distances;
+        std::nth_element(kth.begin(), kth.begin() + (k_neighbors - 1), kth.end());
+        auto radius = std::min(kth[k_neighbors - 1], max_distance);
+
+        // The bounding box of an element contains the element. Hence, every
+        // element within `radius` intersects the sphere in bounding box mode.
+        // The margin protects against round-off at exactly `radius`.
+        auto margin = CoordType(1e-5);
+        ids.clear();
+        distances.clear();
+        index.template find_intersecting<BoundingBoxGeometry>(
+            Sphere{point, radius * (1 + margin) + margin}, out
+        );
+    }
+
+    std::vector<size_t> order(distances.size());
+    std::iota(order.begin(), order.end(), size_t(0));
+
+    auto n_nearest = std::min(order.size(), size_t(k_neighbors));
+    std::partial_sort(order.begin(),
+                      order.begin() + std::ptrdiff_t(n_nearest),
+                      order.end(),
+                      [&distances](size_t i, size_t j) { return distances[i] < distances[j]; });
+
+    for (size_t i = 0; i < n_nearest && distances[order[i]] <= max_distance; ++i) {
+        result.ids.push_back(ids[order[i]]);
+        result.distances.push_back(distances[order[i]]);
+    }
+
+    return result;
+}
+
+/// \brief A `n_queries x k_neighbors` result, with every row padded.
+template <typename T>
+inline auto make_nearest_batch(size_t n_queries, unsigned k_neighbors) {
+    using id_type = typename id_getter_for<T>::type::value_type;
+
+    nearest_result<id_type> batch;
+    batch.ids.resize(n_queries * k_neighbors, id_type{});
+    batch.distances.resize(n_queries * k_neighbors,
+                           std::numeric_limits<CoordType>::infinity());
+    return batch;
+}
+
+/// \brief Runs the queries `*it` for all `it` in `[first, last)`, and stores
+/// the result of query `i` in row `i` of `batch`.
+template <typename T, typename Index, typename QueryIt, typename Batch>
+inline void find_nearest_exact_rows(const Index& index,
+                                    const std::vector<Point3D>& points,
+                                    QueryIt first,
+                                    QueryIt last,
+                                    unsigned k_neighbors,
+                                    CoordType max_distance,
+                                    Batch& batch) {
+    for (auto it = first; it != last; ++it) {
+        auto i = static_cast<size_t>(*it);
+        auto nearest = find_nearest_exact<T>(index, points[i], k_neighbors, max_distance);
+
+        auto offset = std::ptrdiff_t(i * k_neighbors);
+        std::copy(nearest.ids.begin(), nearest.ids.end(), batch.ids.begin() + offset);
+        std::copy(nearest.distances.begin(),
+                  nearest.distances.end(),
+                  batch.distances.begin() + offset);
+    }
+}
+
+}  // namespace detail
+
+
+template <typename Derived, typename T>
+inline decltype(auto)
+IndexTreeMixin<Derived, T>::find_nearest_exact(const Point3D& point,
+                                               unsigned k_neighbors,
+                                               CoordType max_distance) const {
+    const auto& derived = static_cast<const Derived&>(*this);
+    return detail::find_nearest_exact<T>(derived, point, k_neighbors, max_distance);
+}
+
+
+template <typename Derived, typename T>
+inline decltype(auto)
+IndexTreeMixin<Derived, T>::find_nearest_exact_batch(const std::vector<Point3D>& points,
+                                                     unsigned k_neighbors,
+                                                     CoordType max_distance) const {
+    const auto& derived = static_cast<const Derived&>(*this);
+
+    auto batch = detail::make_nearest_batch<T>(points.size(), k_neighbors);
+    detail::find_nearest_exact_rows<T>(derived,
+                                       points,
+                                       boost::counting_iterator<size_t>(0),
+                                       boost::counting_iterator<size_t>(points.size()),
+                                       k_neighbors,
+                                       max_distance,
+                                       batch);
+    return batch;
+}
+
+
+template <typename Derived, typename T>
+inline decltype(auto)
+IndexTreeMixin<Derived, T>::find_nearest_exact_batch(const std::vector<Point3D>& points,
+                                                     unsigned k_neighbors,
+                                                     CoordType max_distance,
+                                                     ThreadPool& pool,
+                                                     size_t n_threads) const {
+    static_assert(supports_concurrent_queries<Derived>::value,
+                  "This index can't be queried concurrently.");
+
+    const auto& derived = static_cast<const Derived&>(*this);
+
+    // Every query writes to its own row, hence the chunks need no merging.
+    auto n_queries = points.size();
+    auto n_chunks = std::min(n_queries, 8 * std::max(n_threads, size_t(1)));
+    auto batch = detail::make_nearest_batch<T>(n_queries, k_neighbors);
+
+    parallel_for(pool, n_chunks, n_threads, [&](size_t k) {
+        auto range = util::balanced_chunks(n_queries, n_chunks, k);
+        detail::find_nearest_exact_rows<T>(derived,
+                                           points,
+                                           boost::counting_iterator<size_t>(range.low),
+                                           boost::counting_iterator<size_t>(range.high),
+                                           k_neighbors,
+                                           max_distance,
+                                           batch);
+    });
+
+    return batch;
+}
+
+
 // Serialization: Load ctor
 template <typename T, typename A>
 inline IndexTree<T, A>::IndexTree(const std::string& path) {
@@ -177,14 +691,7 @@ inline void IndexTree<T, A>::dump(const std::string& index_path) const {
 template <typename T, typename A>
 template <typename GeometryMode, typename ShapeT>
 inline bool IndexTree<T, A>::is_intersecting(const ShapeT& shape) const {
-    auto real_intersects = [&shape](const auto& v) {
-        return geometry_intersects(shape, v, GeometryMode{});
-    };
-
-    auto it = this->qbegin(
-        bgi::intersects(bgi::indexable<ShapeT>{}(shape)) && bgi::satisfies(real_intersects)
-    );
-
+    auto it = this->qbegin(detail::intersects_predicate<GeometryMode>(shape));
     return it != this->qend();
 }
 
@@ -345,9 +852,10 @@ template<> struct indexable<Soma> : public indexable_with_bounding_box<Soma> {};
 template<> struct indexable<Segment> : public indexable_with_bounding_box<Segment> {};
 template<> struct indexable<IndexedSubtreeBox> : public indexable_with_bounding_box<IndexedSubtreeBox> {};
 
-template <>
-struct indexable<IndexedPoint> {
-    typedef IndexedPoint V;
+// Points are indexed by the degenerate box `{p, p}`.
+template <typename T>
+struct indexable_point {
+    typedef T V;
     typedef Box3D const result_type;
 
     inline result_type operator()(V const& s) const noexcept {
@@ -356,6 +864,9 @@ struct indexable<IndexedPoint> {
     }
 };
 
+template<> struct indexable<IndexedPoint> : public indexable_point<IndexedPoint> {};
+template<> struct indexable<PointSynapse> : public indexable_point<PointSynapse> {};
+
 
 template <typename... VariantArgs>
 struct indexable<boost::variant<VariantArgs...>> {
@@ -369,6 +880,50 @@ struct indexable<boost::variant<VariantArgs...>> {
     }
 };
 
+template<> struct indexable<Polyline> : public indexable_with_bounding_box<Polyline> {};
+
+// Returns a copy, since Boost may call it on temporaries, e.g. when packing a
+// range of `T` into a tree of `CachedBoxEntry<T>`.
+template <typename T>
+struct indexable<CachedBoxEntry<T>> {
+    typedef CachedBoxEntry<T> V;
+    typedef Box3D const result_type;
+
+    inline result_type operator()(V const& v) const noexcept {
+        return v.bounding_box();
+    }
+};
+
+
+namespace detail {
+
+// Boost checks the predicate against the bounding box of every visited node
+// (`bounds_tag`) and against every value of the visited leaves (`value_tag`).
+
+template <typename GeometryMode>
+struct predicate_check<brain_indexer::detail::polyline_intersects<GeometryMode>, bounds_tag> {
+    template <typename Value, typename Box, typename... Strategy>
+    static inline bool apply(const brain_indexer::detail::polyline_intersects<GeometryMode>& p,
+                             const Value&,
+                             const Box& box,
+                             const Strategy&...) {
+        return bg::intersects(p.bounding_box, box) && p.polyline->intersects(box);
+    }
+};
+
+template <typename GeometryMode>
+struct predicate_check<brain_indexer::detail::polyline_intersects<GeometryMode>, value_tag> {
+    template <typename Value, typename Indexable, typename... Strategy>
+    static inline bool apply(const brain_indexer::detail::polyline_intersects<GeometryMode>& p,
+                             const Value& v,
+                             const Indexable& indexable,
+                             const Strategy&...) {
+        return bg::intersects(p.bounding_box, indexable)
+               && geometry_intersects(*p.polyline, v, GeometryMode{});
+    }
+};
+
+}  // namespace detail
 
 }  // namespace index
 }  // namespace geometry
@@ -391,6 +946,12 @@ struct version<brain_indexer::IndexedShape<ShapeT, IndexT>>
     constexpr static unsigned int value = SPATIAL_INDEX_STRUCT_VERSION;
 };
 
+template <typename T>
+struct version<brain_indexer::CachedBoxEntry<T>>
+{
+    constexpr static unsigned int value = SPATIAL_INDEX_STRUCT_VERSION;
+};
+
 }  // namespace serialization
 }  // namespace boost
 
@@ -399,6 +960,7 @@ BOOST_CLASS_VERSION(brain_indexer::ShapeId, SPATIAL_INDEX_STRUCT_VERSION);
 BOOST_CLASS_VERSION(brain_indexer::SynapseId, SPATIAL_INDEX_STRUCT_VERSION);
 BOOST_CLASS_VERSION(brain_indexer::MorphPartId, SPATIAL_INDEX_STRUCT_VERSION);
 BOOST_CLASS_VERSION(brain_indexer::Synapse, SPATIAL_INDEX_STRUCT_VERSION);
+BOOST_CLASS_VERSION(brain_indexer::PointSynapse, SPATIAL_INDEX_STRUCT_VERSION);
 BOOST_CLASS_VERSION(brain_indexer::Soma, SPATIAL_INDEX_STRUCT_VERSION);
 BOOST_CLASS_VERSION(brain_indexer::Segment, SPATIAL_INDEX_STRUCT_VERSION);
 BOOST_CLASS_VERSION(brain_indexer::SubtreeId, SPATIAL_INDEX_STRUCT_VERSION);
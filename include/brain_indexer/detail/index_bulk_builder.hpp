@@ -2,6 +2,8 @@
 
 #include "../index_bulk_builder.hpp"
 
+#include <type_traits>
+
 namespace brain_indexer {
 
 template <class Value>
@@ -34,11 +36,15 @@ inline size_t IndexBulkBuilderBase<Value>::size() const {
 
 
 template <class Index, class Value>
-inline void IndexBulkBuilder<Index, Value>::finalize() {
+inline void IndexBulkBuilder<Index, Value>::finalize(size_t n_threads) {
     size_t n_values = this->values_.size();
     this->n_total_values_ = n_values;
 
-    index_ = Index(this->values_);
+    if constexpr (std::is_same<Index, IndexTree<Value>>::value) {
+        index_ = parallel_bulk_load(this->values_, ThreadPool::global(), n_threads);
+    } else {
+        index_ = Index(this->values_);
+    }
 }
 
 template <class Index, class Value>
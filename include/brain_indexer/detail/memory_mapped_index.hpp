@@ -0,0 +1,122 @@
+#pragma once
+
+#include "../memory_mapped_index.hpp"
+
+#include <filesystem>
+#include <iterator>
+
+namespace brain_indexer {
+
+namespace detail {
+
+/** \brief A first guess for the size of the mapped file.
+ *
+ * The packing algorithm fills the nodes almost completely, but the nodes are
+ * a variant of leaves and internal nodes. Hence, a leaf can't be smaller than
+ * an internal node. The estimate is generous, since the file is shrunk to
+ * its minimal size afterwards.
+ */
+template <typename T>
+inline size_t estimate_memory_mapped_size(size_t n_elements) {
+    constexpr size_t min_size = 1ul << 20;
+    constexpr size_t element_size = std::max(sizeof(T), sizeof(Box3D) + sizeof(void*));
+
+    return min_size + 2 * n_elements * (element_size + 16ul);
+}
+
+}
+
+
+template <typename T>
+inline MemoryMappedIndexTree<T>::MemoryMappedIndexTree(const std::string& index_path) {
+    auto filename = resolve_heavy_data_path(index_path, MetaDataConstants::memory_mapped_key);
+
+    mapped_file_ = std::make_unique<bip::managed_mapped_file>(
+        bip::open_read_only, filename.c_str()
+    );
+
+    // The mapping is read-only, locking the mutex of the segment manager would
+    // require writing to the mapping. Since the file is never modified after
+    // it's been created, it's safe to skip the lock.
+    rtree_ = mapped_file_->template find_no_lock<rtree_type>(rtree_name).first;
+
+    if (rtree_ == nullptr) {
+        throw std::runtime_error("No R-Tree found in: " + filename);
+    }
+}
+
+
+template <typename T>
+template <typename Iterator>
+inline void MemoryMappedIndexTree<T>::create(const std::string& index_path,
+                                             Iterator begin,
+                                             Iterator end) {
+    util::ensure_valid_output_directory(index_path);
+
+    auto heavy_data_relpath = "index.mmap";
+    auto filename = join_path(index_path, heavy_data_relpath);
+
+    auto n_elements = util::safe_integer_cast<size_t>(std::distance(begin, end));
+    auto file_size = detail::estimate_memory_mapped_size<T>(n_elements);
+
+    // The size of the mapped file is fixed when it's created. If the guess
+    // was too small, retry with a larger file.
+    bool is_created = false;
+    while (!is_created) {
+        std::filesystem::remove(filename);
+
+        try {
+            bip::managed_mapped_file mapped_file(bip::create_only, filename.c_str(), file_size);
+            auto alloc = MemoryMappedAllocator<T>(mapped_file.get_segment_manager());
+
+            mapped_file.template construct<rtree_type>(rtree_name)(
+                begin, end,
+                bgi::linear<16, 2>(), bgi::indexable<T>(), bgi::equal_to<T>(),
+                alloc
+            );
+
+            is_created = true;
+        } catch (const bip::bad_alloc&) {
+            log_info(boost::format("Memory mapped file of %d bytes is too small, retrying.")
+                     % file_size);
+            file_size *= 2;
+        }
+    }
+
+    bip::managed_mapped_file::shrink_to_fit(filename.c_str());
+
+    auto meta_data = create_basic_meta_data(value_to_element_type<T>());
+    meta_data[MetaDataConstants::memory_mapped_key] = {
+        // The heavy data, i.e. the relative path of the mapped file.
+        {"heavy_data_path", heavy_data_relpath}
+    };
+
+    write_meta_data(default_meta_data_path(index_path), meta_data);
+}
+
+
+template <typename T>
+template <typename GeometryMode, typename ShapeT>
+inline std::vector<typename MemoryMappedIndexTree<T>::cref_t>
+MemoryMappedIndexTree<T>::find_intersecting_objs(const ShapeT& shape) const {
+    std::vector<cref_t> results;
+    this->template find_intersecting<GeometryMode>(shape, std::back_inserter(results));
+    return results;
+}
+
+
+template <typename T>
+inline std::ostream& operator<<(std::ostream& os, const MemoryMappedIndexTree<T>& index) {
+    int n_obj = 50;   // display the first 50 objects
+    os << "MemoryMappedIndexTree([\n";
+    for (const auto& item : index) {
+        if (n_obj-- == 0) {
+            os << "  ...\n";
+            break;
+        }
+        os << "  " << item << '\n';
+    }
+    return os << "])";
+}
+
+}  // namespace brain_indexer
@@ -3,6 +3,11 @@
 #include <brain_indexer/distributed_sort_tile_recursion.hpp>
 #include <brain_indexer/meta_data.hpp>
 
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <queue>
+
 namespace brain_indexer {
 
 template <class Derived, class TopTree, class SubTree, class Filenames>
@@ -62,6 +67,16 @@ MultiIndexStorage<Derived, TopTree, SubTree, Filenames>::load_subtree(
     );
 }
 
+template <class Derived, class TopTree, class SubTree, class Filenames>
+template <class RTree>
+inline void
+MultiIndexStorage<Derived, TopTree, SubTree, Filenames>::load_subtree_into(
+    size_t subtree_id,
+    RTree& subtree) const {
+
+    Derived::load_tree_into(subtree, Filenames::subtree(output_dir, subtree_id));
+}
+
 template <class Derived, class TopTree, class SubTree, class Filenames>
 inline TopTree
 MultiIndexStorage<Derived, TopTree, SubTree, Filenames>::load_top_tree() const {
@@ -76,6 +91,54 @@ MultiIndexStorage<Derived, TopTree, SubTree, Filenames>::load_top_tree(
     return Derived::template load_tree<TopTree>(Filenames::top_tree(output_dir));
 }
 
+namespace detail {
+
+/// \brief The number of nodes below `node`, which is at `level`; including itself.
+template <class RTree, class NodePointer>
+inline size_t count_rtree_nodes(const RTree& rtree, NodePointer node, size_t level) {
+    namespace bgid = bgi::detail::rtree;
+    using members_holder = typename bgid::const_private_view<RTree>::members_holder;
+    using internal_node = typename members_holder::internal_node;
+
+    if (level == bgid::const_private_view<RTree>(rtree).members().leafs_level) {
+        return 1;
+    }
+
+    size_t n_nodes = 1;
+    for (const auto& child : bgid::elements(bgid::get<internal_node>(*node))) {
+        n_nodes += count_rtree_nodes(rtree, child.second, level + 1);
+    }
+
+    return n_nodes;
+}
+
+/// \brief The memory occupied by the nodes of `rtree`, see `MultiIndexStorage::allocated_bytes`.
+template <class RTree>
+inline size_t rtree_allocated_bytes(const RTree& rtree) {
+    using members_holder =
+        typename bgi::detail::rtree::const_private_view<RTree>::members_holder;
+
+    const auto& members = bgi::detail::rtree::const_private_view<RTree>(rtree).members();
+    if (members.root == nullptr) {
+        return sizeof(RTree);
+    }
+
+    // Leaves and internal nodes are allocated as the same variant, which
+    // stores the values inline.
+    auto n_nodes = count_rtree_nodes(rtree, members.root, 0);
+    return sizeof(RTree) + n_nodes * sizeof(typename members_holder::node);
+}
+
+}  // namespace detail
+
+template <class Derived, class TopTree, class SubTree, class Filenames>
+inline size_t
+MultiIndexStorage<Derived, TopTree, SubTree, Filenames>::allocated_bytes(
+    const SubTree& subtree) {
+
+    return detail::rtree_allocated_bytes(subtree);
+}
+
 template <class TopTree, class SubTree>
 inline
 NativeStorage<TopTree, SubTree>::NativeStorage(std::string output_dir)
@@ -103,6 +166,14 @@ NativeStorage<TopTree, SubTree>::load_tree(const std::string& filename) {
     return rtree;
 }
 
+template <class TopTree, class SubTree>
+template <class RTree>
+inline void
+NativeStorage<TopTree, SubTree>::load_tree_into(RTree& rtree, const std::string& filename) {
+    load_tree_impl(rtree, filename);
+    util::check_signals();
+}
+
 template <class TopTree, class SubTree>
 template <class... Args>
 inline void
@@ -125,166 +196,343 @@ NativeStorage<TopTree, SubTree>::save_tree_impl(const bgi::rtree<Args...>& tree,
 
 
 template <class Storage>
-inline double
-UsageRateCache<Storage>::MetaData::usage_rate(size_t query_count) const {
-    if (query_count == load_generation_) {
-        // These were loaded during this query. Try not to evict these. However,
-        // it's safe to evict these since the subtree that will be queried next
-        // will be loaded after this eviction; and therefore can't be evicted
-        // before it's ever used.
-        return std::numeric_limits<double>::max();
-    }
+UsageRateCache<Storage>::~UsageRateCache() {
+    auto should_write = util::read_boolean_environment_variable("SI_REPORT_USAGE_STATS");
 
-    return double(access_count()) / double(incache_count(query_count));
-}
+    // Moved-from caches have no shards, and nothing to report.
+    if(should_write && !shards.empty()) {
+        auto query_count = most_recent_query_count.load();
 
-template <class Storage>
-inline size_t
-UsageRateCache<Storage>::MetaData::access_count() const {
-    return previous_access_count_ + current_access_count_;
+        nlohmann::json j;
+        for(const auto &shard : shards) {
+            for(const auto &[id, md] : shard.meta_data) {
+                j.push_back({
+                    { "id", id },
+                    { "access_count", md.access_count() },
+                    { "eviction_count", md.eviction_count() },
+                    { "incache_count", md.incache_count(query_count) },
+                    { "usage_rate", md.usage_rate(query_count) },
+                    { "bytes", md.bytes() },
+                    { "load_seconds", md.load_seconds() }
+                });
+            }
+        }
+
+        auto filename = "si_cache_stats_" + util::iso_datetime_now() + ".json";
+        auto o = util::open_ofstream(filename);
+        o << std::setw(4) << j << std::endl;
+    }
 }
 
+
 template <class Storage>
-inline size_t
-UsageRateCache<Storage>::MetaData::incache_count(size_t query_count) const {
-    return (query_count - load_generation_ + 1) + previous_age_;
+template<class SubtreeID>
+inline auto
+UsageRateCache<Storage>::load_subtree(const SubtreeID& subtree_id, size_t query_count)
+        -> subtree_handle {
+
+    most_recent_query_count = query_count;
+    auto id = subtree_id.id;
+    auto& shard = shard_of(id);
+
+    std::promise<subtree_handle> promise;
+    {
+        std::unique_lock<std::mutex> lock(shard.mutex);
+
+        auto found = shard.subtrees.find(id);
+        if (found != shard.subtrees.end()) {
+            on_query(id, shard.meta_data[id], query_count);
+            return found->second;
+        }
+
+        // Another thread is loading the subtree, wait for it.
+        auto pending = shard.pending.find(id);
+        if (pending != shard.pending.end()) {
+            auto future = pending->second;
+            on_query(id, shard.meta_data[id], query_count);
+
+            lock.unlock();
+            return future.get();
+        }
+
+        shard.meta_data[id].on_load(query_count);
+        shard.pending[id] = promise.get_future().share();
+    }
+
+    try {
+        evict_subtrees(estimated_bytes(subtree_id.n_elements), query_count);
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.pending.erase(id);
+        }
+
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+
+    auto subtree = load_pending(shard, id, promise, query_count);
+
+    // The estimate might have been too low.
+    evict_subtrees(0, query_count, id);
+    return subtree;
 }
 
 template <class Storage>
-inline size_t
-UsageRateCache<Storage>::MetaData::eviction_count() const {
-    return eviction_count_;
+inline auto
+UsageRateCache<Storage>::load_pending(Shard& shard,
+                                      size_t id,
+                                      std::promise<subtree_handle>& promise,
+                                      size_t query_count)
+        -> subtree_handle {
+    try {
+        auto start = std::chrono::steady_clock::now();
+        auto subtree = std::make_shared<subtree_type>(storage.load_subtree(id));
+        auto load_seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+
+        auto n_bytes = storage.allocated_bytes(*subtree);
+        n_read_bytes += n_bytes;
+        n_read_elements += subtree->size();
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.meta_data[id].on_read(n_bytes, load_seconds);
+            cache_subtree(shard, id, subtree, query_count);
+            shard.pending.erase(id);
+        }
+
+        promise.set_value(subtree);
+        return subtree;
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.pending.erase(id);
+        }
+
+        promise.set_exception(std::current_exception());
+        throw;
+    }
 }
 
 template <class Storage>
 inline void
-UsageRateCache<Storage>::MetaData::on_query() {
-    ++current_access_count_;
+UsageRateCache<Storage>::cache_subtree(Shard& shard,
+                                       size_t id,
+                                       subtree_ptr subtree,
+                                       size_t query_count) {
+    const auto& md = shard.meta_data[id];
+    shard.subtrees[id] = std::move(subtree);
+    n_cached_bytes += md.bytes();
+
+    std::lock_guard<std::mutex> lock(policy_mutex);
+    policy->on_insert(id, md, query_count);
 }
 
 template <class Storage>
-inline void
-UsageRateCache<Storage>::MetaData::on_load(size_t query_count) {
-    load_generation_ = query_count;
-    current_access_count_ = 1;
+inline auto
+UsageRateCache<Storage>::uncache_subtree(Shard& shard, size_t id, size_t query_count)
+        -> subtree_ptr {
+    auto it = shard.subtrees.find(id);
+    if (it == shard.subtrees.end()) {
+        return nullptr;
+    }
+
+    auto subtree = std::move(it->second);
+    shard.subtrees.erase(it);
+    n_cached_bytes -= shard.meta_data[id].bytes();
+
+    std::lock_guard<std::mutex> lock(policy_mutex);
+    policy->on_remove(id, query_count);
+    return subtree;
 }
 
 template <class Storage>
-inline void
-UsageRateCache<Storage>::MetaData::on_evict(size_t query_count) {
-    previous_access_count_ += current_access_count_;
-    previous_age_ = query_count - load_generation_ + 1;
+template<class SubtreeID>
+inline bool
+UsageRateCache<Storage>::prefetch_subtree(const SubtreeID& subtree_id, size_t query_count) {
+    most_recent_query_count = query_count;
+    auto id = subtree_id.id;
+    auto& shard = shard_of(id);
 
-    current_access_count_ = 0;
-    eviction_count_ += 1;
+    if (cached_bytes() + estimated_bytes(subtree_id.n_elements) > cache_params.max_cached_bytes) {
+        return false;
+    }
+
+    std::promise<subtree_handle> promise;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (shard.subtrees.count(id) != 0 || shard.pending.count(id) != 0) {
+            return false;
+        }
+
+        auto& md = shard.meta_data[id];
+        md.on_load(query_count);
+        md.on_prefetch();
+        shard.pending[id] = promise.get_future().share();
+    }
+
+    load_pending(shard, id, promise, query_count);
+    ++n_prefetched;
+    return true;
 }
 
+template <class Storage>
+inline PrefetchStats
+UsageRateCache<Storage>::prefetch_stats() const {
+    auto stats = PrefetchStats{};
+    stats.n_prefetched = n_prefetched.load();
+    stats.n_hits = n_prefetch_hits.load();
+    stats.n_wasted = n_prefetch_wasted.load();
+    return stats;
+}
 
 template <class Storage>
-UsageRateCache<Storage>::~UsageRateCache() {
-    auto should_write = util::read_boolean_environment_variable("SI_REPORT_USAGE_STATS");
+inline void
+UsageRateCache<Storage>::on_query(size_t id, MetaData& md, size_t query_count) {
+    if (md.is_unused_prefetch()) {
+        ++n_prefetch_hits;
+    }
 
-    if(should_write) {
-        nlohmann::json j;
-        for(const auto &[id, md] : meta_data) {
-            j.push_back({
-                { "id", id },
-                { "access_count", md.access_count() },
-                { "eviction_count", md.eviction_count() },
-                { "incache_count", md.incache_count(most_recent_query_count) },
-                { "usage_rate", md.usage_rate(most_recent_query_count) }
-            });
-        }
+    // The policy may read `md` while selecting a victim.
+    std::lock_guard<std::mutex> lock(policy_mutex);
+    md.on_query();
+    policy->on_access(id, query_count);
+}
 
-        auto filename = "si_cache_stats_" + util::iso_datetime_now() + ".json";
-        auto o = util::open_ofstream(filename);
-        o << std::setw(4) << j << std::endl;
+template <class Storage>
+inline void
+UsageRateCache<Storage>::on_evict(MetaData& md, size_t query_count) {
+    if (md.is_unused_prefetch()) {
+        ++n_prefetch_wasted;
     }
+    md.on_evict(query_count);
 }
 
-
 template <class Storage>
 template<class SubtreeID>
 inline auto
-UsageRateCache<Storage>::load_subtree(const SubtreeID& subtree_id, size_t query_count)
-        -> const subtree_type& {
+UsageRateCache<Storage>::find_subtree(const SubtreeID& subtree_id, size_t query_count)
+        -> subtree_handle {
 
     most_recent_query_count = query_count;
     auto id = subtree_id.id;
+    auto& shard = shard_of(id);
 
-    const auto& found = subtrees.find(id);
-    if (found == subtrees.end()) {
-        evict_subtrees(subtree_id, query_count);
-
-        meta_data[id].on_load(query_count);
-        return subtrees[id] = storage.load_subtree(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto found = shard.subtrees.find(id);
+    if (found == shard.subtrees.end()) {
+        return nullptr;
     }
 
-    meta_data[id].on_query();
+    on_query(id, shard.meta_data[id], query_count);
     return found->second;
 }
 
+template <class Storage>
+template<class SubtreeID>
+inline bool
+UsageRateCache<Storage>::is_cached(const SubtreeID& subtree_id) {
+    auto id = subtree_id.id;
+    auto& shard = shard_of(id);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.subtrees.count(id) != 0 || shard.pending.count(id) != 0;
+}
+
 template <class Storage>
 inline size_t
-UsageRateCache<Storage>::cached_elements() const {
-    size_t n_cached_elements = 0ul;
-    for(const auto &[_, subtree] : subtrees) {
-        n_cached_elements += subtree.size();
+UsageRateCache<Storage>::estimated_bytes(size_t n_elements) const {
+    auto n_elements_read = n_read_elements.load();
+    if (n_elements_read == 0) {
+        return 0;
     }
 
-    return n_cached_elements;
+    return size_t(double(n_elements) * double(n_read_bytes.load()) / double(n_elements_read));
 }
 
 
 template <class Storage>
-template<class SubtreeID>
 inline void
-UsageRateCache<Storage>::evict_subtrees(const SubtreeID& subtree_id,
-                                        size_t query_count) {
-    auto n_cached_elements = cached_elements();
-    auto n_elements = subtree_id.n_elements;
+UsageRateCache<Storage>::evict_subtrees(size_t n_bytes,
+                                        size_t query_count,
+                                        boost::optional<size_t> keep) {
+    auto fits = [this, n_bytes]() {
+        return cached_bytes() + n_bytes <= cache_params.max_cached_bytes;
+    };
 
-    if (n_cached_elements + n_elements <= cache_params.max_cached_elements) {
+    if (fits()) {
         return;
     }
 
-    auto loaded_subtree_ids = subtree_ids_sorted_by_usage_rate(query_count);
+    // Concurrent evictions would each evict subtrees to make room for the
+    // same bytes.
+    std::lock_guard<std::mutex> eviction_lock(eviction_mutex);
+
+    for (size_t n_evicted = 0; !fits() && n_evicted < cache_params.max_evict;) {
+        auto victim = boost::optional<size_t>();
+        {
+            std::lock_guard<std::mutex> lock(policy_mutex);
+            victim = policy->select_victim(query_count);
+        }
 
-    auto n_evict = std::min(cache_params.max_evict, loaded_subtree_ids.size());
-    for (size_t k = 0; k < n_evict; ++k) {
-        size_t i = loaded_subtree_ids[k];
-        auto it = subtrees.find(i);
-        if (it == subtrees.end()) {
-            throw std::runtime_error("Failed to find a supposedly loaded subtree.");
+        if (!victim || victim == keep) {
+            return;
         }
 
-        meta_data[i].on_evict(query_count);
-        subtrees.erase(it);
+        auto& shard = shard_of(*victim);
+
+        // Freeing the subtree can take a while, it's done outside the lock; or
+        // by the last thread still querying it.
+        subtree_ptr evicted = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+
+            if (shard.subtrees.count(*victim) == 0) {
+                continue;
+            }
+
+            // Once the policy no longer holds the subtree, its meta data may
+            // be modified freely.
+            evicted = uncache_subtree(shard, *victim, query_count);
+            on_evict(shard.meta_data[*victim], query_count);
+        }
+
+        ++n_evicted;
     }
 }
 
 
-template <class Storage>
-inline std::vector<size_t>
-UsageRateCache<Storage>::subtree_ids_sorted_by_usage_rate(size_t query_count) {
-    std::vector<size_t> loaded_subtree_ids;
-    loaded_subtree_ids.reserve(subtrees.size());
+namespace detail {
 
-    for (const auto& [id, _]: subtrees) {
-        loaded_subtree_ids.push_back(id);
+/// \brief Subtrees loaded by the I/O threads, waiting to be visited.
+template <class SubtreeHandle>
+class SubtreeArrivals {
+  public:
+    inline void push(SubtreeHandle subtree, std::exception_ptr error) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            arrived_.emplace(std::move(subtree), std::move(error));
+        }
+        cv_.notify_one();
     }
 
-    std::sort(loaded_subtree_ids.begin(),
-              loaded_subtree_ids.end(),
-              [&](const auto& il, const auto& ir) {
-                  auto usage_rate_left = meta_data[il].usage_rate(query_count);
-                  auto usage_rate_right = meta_data[ir].usage_rate(query_count);
+    /// \brief Waits for the next subtree to arrive.
+    inline std::pair<SubtreeHandle, std::exception_ptr> pop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return !arrived_.empty(); });
 
-                  return usage_rate_left < usage_rate_right;
-              });
+        auto arrival = std::move(arrived_.front());
+        arrived_.pop();
+        return arrival;
+    }
 
-    return loaded_subtree_ids;
-}
+  private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::queue<std::pair<SubtreeHandle, std::exception_ptr>> arrived_;
+};
+
+}  // namespace detail
 
 
 template <class SubtreeCache>
@@ -292,6 +540,18 @@ MultiIndexTreeBase<SubtreeCache>::MultiIndexTreeBase(const storage_type& storage
                                                      SubtreeCache subtree_cache)
     : top_rtree(storage.load_top_tree())
     , subtree_cache(std::move(subtree_cache)) {
+    set_io_threads(default_io_threads);
+}
+
+
+template <class SubtreeCache>
+inline void
+MultiIndexTreeBase<SubtreeCache>::set_io_threads(size_t n_io_threads) {
+    if (n_io_threads == 0) {
+        io_pool = nullptr;
+    } else {
+        io_pool = std::make_unique<ThreadPool>(n_io_threads);
+    }
 }
 
 
@@ -303,24 +563,183 @@ MultiIndexTreeBase<SubtreeCache>::query(const Predicates& predicates,
     auto to_query = std::vector<typename toptree_type::value_type>();
     top_rtree.query(predicates, std::back_inserter(to_query));
 
-    for (const auto& value: to_query) {
+    for_each_subtree(to_query, [&predicates, &it](const subtree_type& subtree) {
+        subtree.query(predicates, it);
+    });
+
+    ++query_count;
+}
+
+
+template <class SubtreeCache>
+template <class SubtreeIDs, class F>
+inline void
+MultiIndexTreeBase<SubtreeCache>::for_each_subtree(const SubtreeIDs& subtree_ids,
+                                                   F&& f) const {
+    using subtree_id_type = typename SubtreeIDs::value_type;
+
+    prefetch_along_trajectory(subtree_ids);
+
+    if (io_pool == nullptr || subtree_ids.size() <= 1) {
+        for (const auto& subtree_id : subtree_ids) {
+            util::check_signals();
+            f(*load_subtree(subtree_id));
+        }
+        return;
+    }
+
+    auto resident = std::vector<subtree_handle>();
+    auto missing = std::vector<subtree_id_type>();
+    for (const auto& subtree_id : subtree_ids) {
+        if (auto subtree = subtree_cache.find_subtree(subtree_id, query_count)) {
+            resident.push_back(std::move(subtree));
+        } else {
+            missing.push_back(subtree_id);
+        }
+    }
+
+    // Shared with the I/O threads, such that an exception thrown by `f`
+    // doesn't need to wait for the outstanding loads.
+    auto arrivals = std::make_shared<detail::SubtreeArrivals<subtree_handle>>();
+
+    size_t n_submitted = 0;
+    auto submit_next = [&]() {
+        const auto& subtree_id = missing[n_submitted++];
+        io_pool->submit([this, subtree_id, arrivals]() {
+            try {
+                arrivals->push(load_subtree(subtree_id), nullptr);
+            } catch (...) {
+                arrivals->push(nullptr, std::current_exception());
+            }
+        });
+    };
+
+    auto max_submitted = std::min(2 * io_pool->size(), missing.size());
+    while (n_submitted < max_submitted) {
+        submit_next();
+    }
+
+    for (auto& subtree : resident) {
         util::check_signals();
-        query_subtree(value, predicates, it);
+        f(*subtree);
+        subtree = nullptr;
     }
 
-    ++query_count;
+    std::exception_ptr error = nullptr;
+    for (size_t n_arrived = 0; n_arrived < n_submitted; ++n_arrived) {
+        auto [subtree, subtree_error] = arrivals->pop();
+        if (subtree_error != nullptr) {
+            error = error == nullptr ? subtree_error : error;
+            continue;
+        }
+
+        if (error == nullptr) {
+            if (n_submitted < missing.size()) {
+                submit_next();
+            }
+
+            util::check_signals();
+            f(*subtree);
+        }
+    }
+
+    if (error != nullptr) {
+        std::rethrow_exception(error);
+    }
+}
+
+
+template <class SubtreeCache>
+inline void
+MultiIndexTreeBase<SubtreeCache>::prefetch(const Box3D& region) const {
+    if (io_pool == nullptr) {
+        return;
+    }
+
+    auto subtree_ids = std::vector<typename toptree_type::value_type>();
+    top_rtree.query(bgi::intersects(region), std::back_inserter(subtree_ids));
+
+    for (const auto& subtree_id : subtree_ids) {
+        if (subtree_cache.is_cached(subtree_id)) {
+            continue;
+        }
+
+        {
+            // Leave the I/O threads to the queries, rather than queueing up
+            // prefetches that might not be needed. Checked and incremented
+            // together, such that concurrent callers can't exceed the limit.
+            std::lock_guard<std::mutex> lock(prefetch_mutex);
+            if (n_prefetches_in_flight >= io_pool->size()) {
+                return;
+            }
+
+            ++n_prefetches_in_flight;
+        }
+
+        io_pool->submit([this, subtree_id]() {
+            try {
+                subtree_cache.prefetch_subtree(subtree_id, query_count);
+            } catch (...) {
+                // The query needing the subtree will report the error.
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(prefetch_mutex);
+                --n_prefetches_in_flight;
+            }
+            prefetches_finished.notify_all();
+        });
+    }
 }
 
 
 template <class SubtreeCache>
-template <class SubtreeID, class Predicates, class OutIt>
 inline void
-MultiIndexTreeBase<SubtreeCache>::query_subtree(const SubtreeID& subtree_id,
-                                                const Predicates& predicates,
-                                                const OutIt& it) const {
+MultiIndexTreeBase<SubtreeCache>::wait_for_prefetches() const {
+    std::unique_lock<std::mutex> lock(prefetch_mutex);
+    prefetches_finished.wait(lock, [this]() { return n_prefetches_in_flight == 0; });
+}
+
 
-    const auto& subtree = load_subtree(subtree_id);
-    subtree.query(predicates, it);
+template <class SubtreeCache>
+template <class SubtreeIDs>
+inline void
+MultiIndexTreeBase<SubtreeCache>::prefetch_along_trajectory(
+    const SubtreeIDs& subtree_ids) const {
+
+    if (prefetch_mode != PrefetchMode::trajectory || subtree_ids.empty()) {
+        return;
+    }
+
+    auto footprint = Box3D(subtree_ids.front());
+    for (const auto& subtree_id : subtree_ids) {
+        bg::expand(footprint, Box3D(subtree_id));
+    }
+
+    auto predicted = boost::optional<Box3D>();
+    {
+        std::lock_guard<std::mutex> lock(trajectory_mutex);
+        if (previous_footprint && bg::equals(*previous_footprint, footprint)) {
+            return;
+        }
+
+        if (previous_footprint) {
+            auto step = bg::return_centroid<Point3D>(footprint);
+            bg::subtract_point(step, bg::return_centroid<Point3D>(*previous_footprint));
+
+            auto min_corner = footprint.min_corner();
+            auto max_corner = footprint.max_corner();
+            bg::add_point(min_corner, step);
+            bg::add_point(max_corner, step);
+            predicted = Box3D(min_corner, max_corner);
+        }
+
+        previous_footprint = footprint;
+    }
+
+    if (predicted) {
+        prefetch(*predicted);
+    }
 }
 
 
@@ -328,53 +747,50 @@ template <class SubtreeCache>
 template <class SubtreeID>
 inline auto
 MultiIndexTreeBase<SubtreeCache>::load_subtree(const SubtreeID& subtree_id) const
-        -> const subtree_type& {
+        -> subtree_handle {
     return subtree_cache.load_subtree(subtree_id, query_count);
 }
 
-template <typename T>
-MultiIndexTree<T>::MultiIndexTree(const std::string& output_dir, size_t max_cached_bytes)
+template <typename T, class SubtreeCache>
+MultiIndexTree<T, SubtreeCache>::MultiIndexTree(const std::string& output_dir,
+                                                size_t max_cached_bytes,
+                                                EvictionPolicyKind eviction_policy)
+    : MultiIndexTree(output_dir, UsageRateCacheParams(max_cached_bytes, eviction_policy))
+{}
+
+
+template <typename T, class SubtreeCache>
+MultiIndexTree<T, SubtreeCache>::MultiIndexTree(const std::string& output_dir,
+                                                const cache_params_type& params)
     : MultiIndexTree(
         NativeStorageT<T>(
             resolve_heavy_data_path(output_dir, MetaDataConstants::multi_index_key)
         ),
-        UsageRateCacheParams(max_cached_bytes / sizeof(value_type)))
+        params)
 {}
 
 
-template <typename T>
-MultiIndexTree<T>::MultiIndexTree(
-    const NativeStorage<MultiIndexTopTreeT, MultiIndexSubTreeT<T>>& storage,
-    const UsageRateCacheParams& params)
-    : MultiIndexTree(storage, UsageRateCacheT<T>(params, storage))
+template <typename T, class SubtreeCache>
+MultiIndexTree<T, SubtreeCache>::MultiIndexTree(const NativeStorageT<T>& storage,
+                                                const cache_params_type& params)
+    : MultiIndexTree(storage, SubtreeCache(params, storage))
 {}
 
 
-template <typename T>
+template <typename T, class SubtreeCache>
 template <typename GeometryMode, typename ShapeT>
 inline bool
-MultiIndexTree<T>::is_intersecting(const ShapeT& shape) const {
+MultiIndexTree<T, SubtreeCache>::is_intersecting(const ShapeT& shape) const {
     auto inner_sweep = [&shape](const auto &tree) {
-        auto it = tree.qbegin(
-            bgi::intersects(bgi::indexable<ShapeT>{}(shape))
-            && bgi::satisfies([&shape](const auto& v) {
-                return geometry_intersects(shape, v, GeometryMode{});
-            })
-        );
-
+        auto it = tree.qbegin(detail::intersects_predicate<GeometryMode>(shape));
         return it != tree.qend();
     };
 
-    auto it = this->top_rtree.qbegin(
-        bgi::intersects(bgi::indexable<ShapeT>{}(shape))
-        && bgi::satisfies([&shape](const auto& v) {
-            return geometry_intersects(shape, v, GeometryMode{});
-        })
-    );
+    auto it = this->top_rtree.qbegin(detail::intersects_predicate<GeometryMode>(shape));
     for(; it != this->top_rtree.qend(); ++it) {
-        const auto &tree = this->load_subtree(*it);
+        auto tree = this->load_subtree(*it);
 
-        if(inner_sweep(tree)) {
+        if(inner_sweep(*tree)) {
             return true;
         }
     }
@@ -383,10 +799,42 @@ MultiIndexTree<T>::is_intersecting(const ShapeT& shape) const {
 }
 
 
-template <typename T>
+template <typename T, class SubtreeCache>
+template <typename GeometryMode, typename ShapeT>
+inline size_t
+MultiIndexTree<T, SubtreeCache>::count_intersecting(const ShapeT& shape) const {
+    auto predicates = detail::intersects_predicate<GeometryMode>(shape);
+    auto subtree_ids = std::vector<IndexedSubtreeBox>();
+    this->top_rtree.query(predicates, std::back_inserter(subtree_ids));
+
+    size_t count = 0;
+    auto counter = boost::make_function_output_iterator(
+        [&count](const auto&) { ++count; }
+    );
+
+    auto to_query = std::vector<IndexedSubtreeBox>();
+    for(const auto& subtree_id : subtree_ids) {
+        // All elements of the subtree intersect, no need to load it.
+        if(detail::box_covered_by(Box3D(subtree_id), shape)) {
+            count += subtree_id.n_elements;
+        } else {
+            to_query.push_back(subtree_id);
+        }
+    }
+
+    this->for_each_subtree(to_query, [&predicates, &counter](const auto& subtree) {
+        subtree.query(predicates, counter);
+    });
+
+    ++this->query_count;
+    return count;
+}
+
+
+template <typename T, class SubtreeCache>
 template <typename GeometryMode, typename ShapeT>
 inline auto
-MultiIndexTree<T>::find_intersecting_objs(const ShapeT& shape) const
+MultiIndexTree<T, SubtreeCache>::find_intersecting_objs(const ShapeT& shape) const
     -> std::vector<value_type> {
 
     std::vector<value_type> results;
@@ -395,22 +843,80 @@ MultiIndexTree<T>::find_intersecting_objs(const ShapeT& shape) const
 }
 
 
-template <size_t dim, typename Value>
-inline CoordType get_centroid_coordinate(const Value& value) {
-    return value.template get_centroid_coord<dim>();
+namespace detail {
+
+/// \brief The order of `points`, grouped by the subtree nearest to the point.
+template <class TopTree>
+inline std::vector<size_t> order_by_nearest_subtree(const TopTree& top_rtree,
+                                                    const std::vector<Point3D>& points) {
+    auto n_queries = points.size();
+    auto nearest_subtree = std::vector<identifier_t>(n_queries, 0);
+    for (size_t i = 0; i < n_queries; ++i) {
+        top_rtree.query(
+            bgi::nearest(points[i], 1u),
+            boost::make_function_output_iterator([&nearest_subtree, i](const auto& subtree) {
+                nearest_subtree[i] = subtree.id;
+            })
+        );
+    }
+
+    auto order = std::vector<size_t>(n_queries);
+    std::iota(order.begin(), order.end(), size_t(0));
+    std::stable_sort(order.begin(), order.end(), [&nearest_subtree](size_t i, size_t j) {
+        return nearest_subtree[i] < nearest_subtree[j];
+    });
+
+    return order;
 }
 
+}  // namespace detail
 
-template<size_t dim, typename... VariantArgs>
-inline CoordType get_centroid_coordinate(boost::variant<VariantArgs...> const& value) {
-    return boost::apply_visitor(
-        [](const auto& value) {
-            return value.template get_centroid_coord<dim>();
-        },
-        value
+
+template <typename T, class SubtreeCache>
+inline decltype(auto)
+MultiIndexTree<T, SubtreeCache>::find_nearest_exact_batch(const std::vector<Point3D>& points,
+                                                          unsigned k_neighbors,
+                                                          CoordType max_distance) const {
+    auto order = detail::order_by_nearest_subtree(this->top_rtree, points);
+
+    auto batch = detail::make_nearest_batch<T>(points.size(), k_neighbors);
+    detail::find_nearest_exact_rows<T>(
+        *this, points, order.begin(), order.end(), k_neighbors, max_distance, batch
     );
+
+    return batch;
 }
 
+
+template <typename T, class SubtreeCache>
+inline decltype(auto)
+MultiIndexTree<T, SubtreeCache>::find_nearest_exact_batch(const std::vector<Point3D>& points,
+                                                          unsigned k_neighbors,
+                                                          CoordType max_distance,
+                                                          ThreadPool& pool,
+                                                          size_t n_threads) const {
+    auto order = detail::order_by_nearest_subtree(this->top_rtree, points);
+
+    // Every query writes to its own row, hence the chunks need no merging.
+    auto n_queries = points.size();
+    auto n_chunks = std::min(n_queries, 8 * std::max(n_threads, size_t(1)));
+    auto batch = detail::make_nearest_batch<T>(n_queries, k_neighbors);
+
+    parallel_for(pool, n_chunks, n_threads, [&](size_t k) {
+        auto range = util::balanced_chunks(n_queries, n_chunks, k);
+        detail::find_nearest_exact_rows<T>(*this,
+                                           points,
+                                           order.begin() + std::ptrdiff_t(range.low),
+                                           order.begin() + std::ptrdiff_t(range.high),
+                                           k_neighbors,
+                                           max_distance,
+                                           batch);
+    });
+
+    return batch;
+}
+
+
 #if SI_MPI == 1
 
 template <class Value>
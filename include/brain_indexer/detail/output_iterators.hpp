@@ -7,6 +7,16 @@
 
 #include "../index.hpp"
 
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
 #include <boost/container/vector.hpp>
 
 namespace brain_indexer {
@@ -40,6 +50,16 @@ inline identifier_t get_id_from(boost::variant<S...> const& obj) {
     return boost::apply_visitor([](const auto& t) { return t.gid(); }, obj);
 }
 
+/// \brief The gid of the neuron `obj` belongs to; for synapses the post-synaptic gid.
+template <typename T>
+inline identifier_t get_gid_from(T const& obj) {
+    if constexpr (std::is_base_of<SynapseId, T>::value) {
+        return obj.post_gid();
+    } else {
+        return get_id_from(obj);
+    }
+}
+
 
 // To automatically extract id / {id, segm_id} we map types to the id getter class
 // Since we don't want to inherit from b::variant to just set id_getter_t
@@ -55,6 +75,11 @@ struct id_getter_for<boost::variant<S1, S...>> {
     using type = typename id_getter_for<S1>::type;
 };
 
+template <typename S>
+struct id_getter_for<CachedBoxEntry<S>> {
+    using type = typename id_getter_for<S>::type;
+};
+
 // Overloaded functions to export endpoints.
 // These are added mainly to allow export as numpy.
 // Depending on the object they can return a quiet_NaN
@@ -112,6 +137,17 @@ struct query_result<MorphoEntry> {
     std::vector<Point3D> endpoint2;
     std::vector<SectionType> section_type;
     boost::container::vector<bool> is_soma;
+
+    /// \brief The names of the columns, in declaration order.
+    static constexpr std::array<const char*, 10> field_names{
+        "gid", "section_id", "segment_id", "ids", "centroid", "radius",
+        "endpoint1", "endpoint2", "section_type", "is_soma"};
+
+    /// \brief All columns, in declaration order.
+    inline auto fields() {
+        return std::tie(gid, section_id, segment_id, ids, centroid, radius,
+                        endpoint1, endpoint2, section_type, is_soma);
+    }
 };
 
 template<>
@@ -120,19 +156,272 @@ struct query_result<Synapse> {
     std::vector<identifier_t> pre_gid;
     std::vector<identifier_t> post_gid;
     std::vector<Point3D> position;
+
+    /// \brief The names of the columns, in declaration order.
+    static constexpr std::array<const char*, 4> field_names{
+        "id", "pre_gid", "post_gid", "position"};
+
+    /// \brief All columns, in declaration order.
+    inline auto fields() {
+        return std::tie(id, pre_gid, post_gid, position);
+    }
 };
 
+template<>
+struct query_result<PointSynapse> : public query_result<Synapse> {};
+
 template<>
 struct query_result<IndexedSphere> {
     std::vector<identifier_t> id;
     std::vector<Point3D> centroid;
     std::vector<CoordType> radius;
+
+    /// \brief The names of the columns, in declaration order.
+    static constexpr std::array<const char*, 3> field_names{"id", "centroid", "radius"};
+
+    /// \brief All columns, in declaration order.
+    inline auto fields() {
+        return std::tie(id, centroid, radius);
+    }
 };
 
 template <>
 struct query_result<IndexedPoint> {
     std::vector<identifier_t> id;
     std::vector<Point3D> position;
+
+    /// \brief The names of the columns, in declaration order.
+    static constexpr std::array<const char*, 2> field_names{"id", "position"};
+
+    /// \brief All columns, in declaration order.
+    inline auto fields() {
+        return std::tie(id, position);
+    }
+};
+
+
+/// \brief The bit of `field_mask_t` which selects the column called `name`.
+template <typename Result>
+constexpr field_mask_t field_bit(std::string_view name) {
+    for (size_t i = 0; i < Result::field_names.size(); ++i) {
+        if (name == Result::field_names[i]) {
+            return field_mask_t(1) << i;
+        }
+    }
+
+    throw std::invalid_argument("Unknown field: " + std::string(name) + ".");
+}
+
+/// \brief The mask which selects exactly the columns called `names`.
+template <typename Result>
+inline field_mask_t make_field_mask(const std::vector<std::string>& names) {
+    field_mask_t mask = 0;
+    for (const auto& name : names) {
+        mask |= field_bit<Result>(name);
+    }
+
+    return mask;
+}
+
+
+template <typename Dst, typename Src, size_t... I>
+inline void append_fields(Dst&& dst, Src&& src, std::index_sequence<I...>) {
+    (std::get<I>(dst).insert(std::get<I>(dst).end(),
+                             std::get<I>(src).begin(),
+                             std::get<I>(src).end()), ...);
+}
+
+/// \brief Appends every column of `src` to the same column of `dst`.
+template <typename Result>
+inline void append_query_result(Result& dst, Result& src) {
+    auto dst_fields = dst.fields();
+    constexpr auto n_fields = std::tuple_size<decltype(dst_fields)>::value;
+    append_fields(dst_fields, src.fields(), std::make_index_sequence<n_fields>{});
+}
+
+
+/** \brief The results of several queries, in CSR format.
+ *
+ * The results of the `i`-th query are the entries `[offsets[i], offsets[i+1])`
+ * of every field of `results`.
+ */
+template <typename Result>
+struct batch_query_result {
+    std::vector<size_t> offsets;
+    Result results;
+};
+
+/**
+ * \brief The ids of the nearest elements and their distances.
+ *
+ * For a single query, both are ordered by increasing distance. For `n`
+ * queries, row `i` of the `n x k` row-major arrays contains the neighbours
+ * of the `i`-th query. Rows with fewer than `k` neighbours are padded with
+ * `Id{}` and an infinite distance.
+ */
+template <typename Id>
+struct nearest_result {
+    std::vector<Id> ids;
+    std::vector<CoordType> distances;
+};
+
+/// \brief The pairs found by `join_within`, pair `i` is `(lhs_ids[i], rhs_ids[i])`.
+template <typename IdA, typename IdB>
+struct join_result {
+    std::vector<IdA> lhs_ids;
+    std::vector<IdB> rhs_ids;
+};
+
+/// \brief The distinct gids, in increasing order, and how many elements have that gid.
+struct unique_gids_result {
+    std::vector<identifier_t> gids;
+    std::vector<size_t> counts;
+
+    /// \brief All columns, in declaration order.
+    inline auto fields() {
+        return std::tie(gids, counts);
+    }
+};
+
+/// \brief Appends the gids in `counts`, in increasing order, to `result` and clears `counts`.
+inline void append_unique_gids(std::unordered_map<identifier_t, size_t>& counts,
+                               unique_gids_result& result) {
+    auto first = result.gids.size();
+    for (const auto& kv : counts) {
+        result.gids.push_back(kv.first);
+    }
+
+    auto gids_begin = result.gids.begin() + std::ptrdiff_t(first);
+    std::sort(gids_begin, result.gids.end());
+    for (auto it = gids_begin; it != result.gids.end(); ++it) {
+        result.counts.push_back(counts[*it]);
+    }
+
+    counts.clear();
+}
+
+/**
+ * \brief The number of synapses per group.
+ *
+ * Only the columns of the key are filled, i.e. `pre_gids` is empty when
+ * grouping by `post_gid` and vice versa.
+ */
+struct grouped_counts_result {
+    std::vector<identifier_t> pre_gids;
+    std::vector<identifier_t> post_gids;
+    std::vector<size_t> counts;
+
+    /// \brief All columns, in declaration order.
+    inline auto fields() {
+        return std::tie(pre_gids, post_gids, counts);
+    }
+};
+
+/**
+ * \brief Accumulates the synapses of one query into groups.
+ *
+ * The keys are buffered and counted once the query is done. If the gids
+ * span a compact range, they're counted in a dense array, otherwise they're
+ * sorted. Either way, no hash map is needed and the groups come out in
+ * increasing order. The buffers are reused from one query to the next.
+ */
+class GroupedCounter {
+  public:
+    inline explicit GroupedCounter(GroupBy group_by)
+        : group_by_(group_by) {}
+
+    template <typename Synapse>
+    inline void add(const Synapse& synapse) {
+        switch (group_by_) {
+        case GroupBy::post_gid:
+            keys_.push_back(synapse.post_gid());
+            break;
+        case GroupBy::pre_gid:
+            keys_.push_back(synapse.pre_gid());
+            break;
+        case GroupBy::pre_post_gid:
+            pairs_.emplace_back(synapse.pre_gid(), synapse.post_gid());
+            break;
+        }
+    }
+
+    /// \brief Appends the groups, in increasing order, to `result` and resets the counter.
+    inline void flush(grouped_counts_result& result) {
+        if (group_by_ == GroupBy::pre_post_gid) {
+            flush_pairs(result);
+        } else {
+            auto& gids = group_by_ == GroupBy::pre_gid ? result.pre_gids : result.post_gids;
+            flush_keys(gids, result.counts);
+        }
+    }
+
+  private:
+    // Dense counting needs to zero and scan the whole range.
+    static constexpr size_t dense_factor = 8;
+
+    inline void flush_keys(std::vector<identifier_t>& gids, std::vector<size_t>& counts) {
+        if (keys_.empty()) {
+            return;
+        }
+
+        auto [min_it, max_it] = std::minmax_element(keys_.begin(), keys_.end());
+        auto low = *min_it;
+
+        // The range of keys is `max - low + 1`, which overflows for the full range.
+        auto max_offset = static_cast<size_t>(*max_it - low);
+
+        if (max_offset < dense_factor * keys_.size()) {
+            auto span = max_offset + 1;
+            dense_.assign(span, 0);
+            for (auto key : keys_) {
+                ++dense_[key - low];
+            }
+
+            for (size_t i = 0; i < span; ++i) {
+                if (dense_[i] != 0) {
+                    gids.push_back(low + i);
+                    counts.push_back(dense_[i]);
+                }
+            }
+        } else {
+            std::sort(keys_.begin(), keys_.end());
+            append_runs(keys_, gids, counts);
+        }
+
+        keys_.clear();
+    }
+
+    inline void flush_pairs(grouped_counts_result& result) {
+        std::sort(pairs_.begin(), pairs_.end());
+        for (size_t i = 0; i < pairs_.size(); ++i) {
+            if (i == 0 || pairs_[i] != pairs_[i - 1]) {
+                result.pre_gids.push_back(pairs_[i].first);
+                result.post_gids.push_back(pairs_[i].second);
+                result.counts.push_back(0);
+            }
+            ++result.counts.back();
+        }
+
+        pairs_.clear();
+    }
+
+    template <typename Key>
+    static inline void append_runs(const std::vector<Key>& sorted_keys,
+                                   std::vector<Key>& keys,
+                                   std::vector<size_t>& counts) {
+        for (size_t i = 0; i < sorted_keys.size(); ++i) {
+            if (i == 0 || sorted_keys[i] != sorted_keys[i - 1]) {
+                keys.push_back(sorted_keys[i]);
+                counts.push_back(0);
+            }
+            ++counts.back();
+        }
+    }
+
+    GroupBy group_by_;
+    std::vector<identifier_t> keys_;
+    std::vector<std::pair<identifier_t, identifier_t>> pairs_;
+    std::vector<size_t> dense_;
 };
 
 }  // namespace detail
@@ -181,7 +470,7 @@ struct iter_gid_segm_getter: public detail::iter_append_only<iter_gid_segm_gette
 
     template <typename S>
     inline iter_gid_segm_getter& operator=(const IndexedShape<S, MorphPartId>& result_entry) {
-        output_.emplace_back(result_entry.gid(), result_entry.section_id(), result_entry.segment_id());
+        output_.push_back(gid_segm_t{result_entry.gid(), result_entry.section_id(), result_entry.segment_id()});
         return *this;
     }
 
@@ -201,39 +490,92 @@ struct iter_gid_segm_getter: public detail::iter_append_only<iter_gid_segm_gette
 
 // Iterators to fetch all data from the payload of segments, soma and synapses.
 // Exports all the fields of the payload as query result object i.e. a struct of arrays.
-// Used to fetch data to export as numpy arrays.
+// Used to fetch data to export as numpy arrays. Columns which aren't selected
+// by the `field_mask_t` are neither computed nor filled, i.e. remain empty.
 
 template<typename Entry>
 struct iter_entry_getter;
 
+/// \brief The cached bounding box isn't exported, hence the getter of `T` is reused.
+template <typename T>
+struct iter_entry_getter<CachedBoxEntry<T>> : public iter_entry_getter<T> {
+    using iter_entry_getter<T>::iter_entry_getter;
+};
+
 template<>
 struct iter_entry_getter<MorphoEntry> : public detail::iter_append_only<iter_entry_getter<MorphoEntry>> {
     using element_t = MorphoEntry;
     using result_t = detail::query_result<MorphoEntry>;
 
-    iter_entry_getter(result_t& output)
-        : output_(output) {}
+    iter_entry_getter(result_t& output, field_mask_t fields = all_fields)
+        : output_(output)
+        , fields_(fields) {}
 
     inline iter_entry_getter& operator=(const element_t& element) { 
-        boost::apply_visitor(
-            [this](const auto& t) {
-                output_.gid.push_back(t.gid());
-                output_.section_id.push_back(t.section_id());
-                output_.segment_id.push_back(t.segment_id());
-                output_.ids.push_back(gid_segm_t{t.gid(), t.section_id(), t.segment_id()});
-                output_.centroid.push_back(t.get_centroid());
-                output_.radius.push_back(t.radius);
-                output_.endpoint1.push_back(detail::get_endpoint(t, 1));
-                output_.endpoint2.push_back(detail::get_endpoint(t, 0));
-                output_.section_type.push_back(detail::get_section_type(t));
-                output_.is_soma.push_back(detail::get_is_soma(t));
-            },
-            element);
+        boost::apply_visitor([this](const auto& t) { push_back(t); }, element);
+        return *this;
+    }
+
+    /// \brief Indexes which store somas and segments separately avoid the variant.
+    inline iter_entry_getter& operator=(const Soma& soma) {
+        push_back(soma);
+        return *this;
+    }
+
+    inline iter_entry_getter& operator=(const Segment& segment) {
+        push_back(segment);
         return *this;
     }
 
   private:
+    template <typename T>
+    inline void push_back(const T& t) {
+        using detail::field_bit;
+        constexpr auto gid = field_bit<result_t>("gid");
+        constexpr auto section_id = field_bit<result_t>("section_id");
+        constexpr auto segment_id = field_bit<result_t>("segment_id");
+        constexpr auto ids = field_bit<result_t>("ids");
+        constexpr auto centroid = field_bit<result_t>("centroid");
+        constexpr auto radius = field_bit<result_t>("radius");
+        constexpr auto endpoint1 = field_bit<result_t>("endpoint1");
+        constexpr auto endpoint2 = field_bit<result_t>("endpoint2");
+        constexpr auto section_type = field_bit<result_t>("section_type");
+        constexpr auto is_soma = field_bit<result_t>("is_soma");
+
+        if (fields_ & gid) {
+            output_.gid.push_back(t.gid());
+        }
+        if (fields_ & section_id) {
+            output_.section_id.push_back(t.section_id());
+        }
+        if (fields_ & segment_id) {
+            output_.segment_id.push_back(t.segment_id());
+        }
+        if (fields_ & ids) {
+            output_.ids.push_back(gid_segm_t{t.gid(), t.section_id(), t.segment_id()});
+        }
+        if (fields_ & centroid) {
+            output_.centroid.push_back(t.get_centroid());
+        }
+        if (fields_ & radius) {
+            output_.radius.push_back(t.radius);
+        }
+        if (fields_ & endpoint1) {
+            output_.endpoint1.push_back(detail::get_endpoint(t, 1));
+        }
+        if (fields_ & endpoint2) {
+            output_.endpoint2.push_back(detail::get_endpoint(t, 0));
+        }
+        if (fields_ & section_type) {
+            output_.section_type.push_back(detail::get_section_type(t));
+        }
+        if (fields_ & is_soma) {
+            output_.is_soma.push_back(detail::get_is_soma(t));
+        }
+    }
+
     result_t& output_;
+    field_mask_t fields_;
 };
 
 template<>
@@ -241,19 +583,73 @@ struct iter_entry_getter<Synapse> : public detail::iter_append_only<iter_entry_g
     using element_t = Synapse;
     using result_t = detail::query_result<element_t>;
 
-    iter_entry_getter(result_t& output)
-        : output_(output) {}
+    iter_entry_getter(result_t& output, field_mask_t fields = all_fields)
+        : output_(output)
+        , fields_(fields) {}
+
+    inline iter_entry_getter& operator=(const element_t& element) {
+        using detail::field_bit;
+        constexpr auto id = field_bit<result_t>("id");
+        constexpr auto pre_gid = field_bit<result_t>("pre_gid");
+        constexpr auto post_gid = field_bit<result_t>("post_gid");
+        constexpr auto position = field_bit<result_t>("position");
+
+        if (fields_ & id) {
+            output_.id.push_back(element.id);
+        }
+        if (fields_ & pre_gid) {
+            output_.pre_gid.push_back(element.pre_gid_);
+        }
+        if (fields_ & post_gid) {
+            output_.post_gid.push_back(element.post_gid_);
+        }
+        if (fields_ & position) {
+            output_.position.push_back(element.get_centroid());
+        }
+        return *this;
+    }
+
+  private:
+    result_t& output_;
+    field_mask_t fields_;
+};
+
+
+template<>
+struct iter_entry_getter<PointSynapse>
+    : public detail::iter_append_only<iter_entry_getter<PointSynapse>> {
+    using element_t = PointSynapse;
+    using result_t = detail::query_result<element_t>;
+
+    iter_entry_getter(result_t& output, field_mask_t fields = all_fields)
+        : output_(output)
+        , fields_(fields) {}
 
     inline iter_entry_getter& operator=(const element_t& element) {
-        output_.id.push_back(element.id);
-        output_.pre_gid.push_back(element.pre_gid_);
-        output_.post_gid.push_back(element.post_gid_);
-        output_.position.push_back(element.get_centroid());
+        using detail::field_bit;
+        constexpr auto id = field_bit<result_t>("id");
+        constexpr auto pre_gid = field_bit<result_t>("pre_gid");
+        constexpr auto post_gid = field_bit<result_t>("post_gid");
+        constexpr auto position = field_bit<result_t>("position");
+
+        if (fields_ & id) {
+            output_.id.push_back(element.id);
+        }
+        if (fields_ & pre_gid) {
+            output_.pre_gid.push_back(element.pre_gid_);
+        }
+        if (fields_ & post_gid) {
+            output_.post_gid.push_back(element.post_gid_);
+        }
+        if (fields_ & position) {
+            output_.position.push_back(element.get_centroid());
+        }
         return *this;
     }
 
   private:
     result_t& output_;
+    field_mask_t fields_;
 };
 
 
@@ -262,18 +658,31 @@ struct iter_entry_getter<IndexedSphere> : public detail::iter_append_only<iter_e
     using element_t = IndexedSphere;
     using result_t = detail::query_result<element_t>;
 
-    iter_entry_getter(result_t& output)
-        : output_(output) {}
+    iter_entry_getter(result_t& output, field_mask_t fields = all_fields)
+        : output_(output)
+        , fields_(fields) {}
 
     inline iter_entry_getter& operator=(const element_t& element) {
-        output_.id.push_back(element.id);
-        output_.centroid.push_back(element.centroid);
-        output_.radius.push_back(element.radius);
+        using detail::field_bit;
+        constexpr auto id = field_bit<result_t>("id");
+        constexpr auto centroid = field_bit<result_t>("centroid");
+        constexpr auto radius = field_bit<result_t>("radius");
+
+        if (fields_ & id) {
+            output_.id.push_back(element.id);
+        }
+        if (fields_ & centroid) {
+            output_.centroid.push_back(element.centroid);
+        }
+        if (fields_ & radius) {
+            output_.radius.push_back(element.radius);
+        }
         return *this;
     }
 
   private:
     result_t& output_;
+    field_mask_t fields_;
 };
 
 template <>
@@ -282,17 +691,27 @@ struct iter_entry_getter<IndexedPoint>
     using element_t = IndexedPoint;
     using result_t = detail::query_result<element_t>;
 
-    iter_entry_getter(result_t& output)
-        : output_(output) { }
+    iter_entry_getter(result_t& output, field_mask_t fields = all_fields)
+        : output_(output)
+        , fields_(fields) { }
 
     inline iter_entry_getter& operator=(const element_t& element) {
-        output_.id.push_back(element.id);
-        output_.position.push_back(element);
+        using detail::field_bit;
+        constexpr auto id = field_bit<result_t>("id");
+        constexpr auto position = field_bit<result_t>("position");
+
+        if (fields_ & id) {
+            output_.id.push_back(element.id);
+        }
+        if (fields_ & position) {
+            output_.position.push_back(element);
+        }
         return *this;
     }
 
   private:
     result_t& output_;
+    field_mask_t fields_;
 };
 
 }  // namespace brain_indexer
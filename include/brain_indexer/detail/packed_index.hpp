@@ -0,0 +1,526 @@
+#pragma once
+
+#include "../packed_index.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <queue>
+#include <type_traits>
+
+namespace brain_indexer {
+
+namespace detail {
+
+inline size_t packed_ceil_div(size_t n, size_t k) {
+    return (n + k - 1) / k;
+}
+
+struct PackedEntry {
+    std::array<CoordType, 3> center;
+    size_t index;
+};
+
+/** \brief Reorders `[first, last)` such that each subtree is contiguous.
+ *
+ * This is the top-down packing of Boost's R-Tree, see
+ * `boost/geometry/index/detail/rtree/pack_create.hpp`. The range is split
+ * along the longest extent of the centers into two halves, such that the
+ * left half contains a multiple of `subtree_size` elements. This is repeated
+ * until each part fits into a single subtree, which is then packed with
+ * `subtree_size / fanout`.
+ *
+ * As a consequence, all subtrees, except the last one on each level, are full.
+ */
+template <typename Iterator>
+inline void packed_partition(Iterator first, Iterator last, size_t subtree_size, size_t fanout) {
+    auto n = static_cast<size_t>(std::distance(first, last));
+
+    if (n <= subtree_size) {
+        if (subtree_size > 1) {
+            packed_partition(first, last, subtree_size / fanout, fanout);
+        }
+        return;
+    }
+
+    std::array<CoordType, 3> min_c = first->center;
+    std::array<CoordType, 3> max_c = first->center;
+    for (auto it = first; it != last; ++it) {
+        for (size_t d = 0; d < 3; ++d) {
+            min_c[d] = std::min(min_c[d], it->center[d]);
+            max_c[d] = std::max(max_c[d], it->center[d]);
+        }
+    }
+
+    size_t axis = 0;
+    for (size_t d = 1; d < 3; ++d) {
+        if (max_c[d] - min_c[d] > max_c[axis] - min_c[axis]) {
+            axis = d;
+        }
+    }
+
+    auto n_subtrees = packed_ceil_div(n, subtree_size);
+    auto mid = first + static_cast<std::ptrdiff_t>((n_subtrees / 2) * subtree_size);
+
+    std::nth_element(first, mid, last, [axis](const PackedEntry& a, const PackedEntry& b) {
+        return a.center[axis] < b.center[axis];
+    });
+
+    packed_partition(first, mid, subtree_size, fanout);
+    packed_partition(mid, last, subtree_size, fanout);
+}
+
+/// \brief The bounding box of `boxes[first, last)`.
+inline Box3D packed_envelope(const PackedBoxes& boxes, size_t first, size_t last) {
+    Box3D envelope;
+    bg::assign_inverse(envelope);
+
+    for (size_t i = first; i < last; ++i) {
+        bg::expand(envelope, boxes.get(i));
+    }
+
+    return envelope;
+}
+
+/// \brief Can the elements be stored as capsules, i.e. are they spheres or cylinders?
+template <typename T>
+struct has_packed_capsule
+    : std::integral_constant<bool, shape_matches_any_of<T, Sphere, Cylinder>()> {};
+
+template <typename... VariantArgs>
+struct has_packed_capsule<boost::variant<VariantArgs...>>
+    : std::conjunction<has_packed_capsule<VariantArgs>...> {};
+
+template <typename T>
+struct has_packed_capsule<CachedBoxEntry<T>> : has_packed_capsule<T> {};
+
+
+inline void set_packed_capsule(PackedCapsules& capsules, size_t i, const Sphere& sphere) {
+    capsules.set(i, sphere.centroid, sphere.centroid, sphere.radius);
+}
+
+inline void set_packed_capsule(PackedCapsules& capsules, size_t i, const Cylinder& cylinder) {
+    capsules.set(i, cylinder.p1, cylinder.p2, cylinder.radius);
+}
+
+template <typename... VariantArgs>
+inline void set_packed_capsule(PackedCapsules& capsules,
+                               size_t i,
+                               const boost::variant<VariantArgs...>& element) {
+    boost::apply_visitor([&capsules, i](const auto& e) { set_packed_capsule(capsules, i, e); },
+                         element);
+}
+
+
+/** \brief Selects the filters which are valid for the query.
+ *
+ * A filter may only reject elements which the exact test would reject as well:
+ *   - Every element lies inside its bounding box, hence the bounding box of
+ *     an element must intersect a query sphere.
+ *   - `Cylinder::intersects(Box3D)` treats the cylinder as a capsule. However,
+ *     in best-effort mode, a cylinder query is tested as a capsule against
+ *     cylinders, which can stick out of their bounding box. Hence, the filter
+ *     for cylinder queries is only valid in bounding box mode.
+ *   - In best-effort mode, spheres and cylinders lie inside their capsule.
+ *     Query boxes are approximated by their circumscribed sphere.
+ */
+template <typename GeometryMode, typename T, typename ShapeT>
+inline PackedQuery make_packed_query(const ShapeT& shape) {
+    constexpr bool is_best_effort = std::is_same<GeometryMode, BestEffortGeometry>::value;
+
+    PackedQuery query;
+    query.box = bg::return_envelope<Box3D>(bgi::indexable<ShapeT>{}(shape));
+
+    if constexpr (shape_matches_any_of<ShapeT, Sphere>()) {
+        const Sphere& sphere = shape;
+        query.filter = PackedQuery::Filter::sphere;
+        query.p1 = sphere.centroid;
+        query.radius = sphere.radius;
+    } else if constexpr (shape_matches_any_of<ShapeT, Cylinder>() && !is_best_effort) {
+        const Cylinder& cylinder = shape;
+        query.filter = PackedQuery::Filter::capsule;
+        query.p1 = cylinder.p1;
+        query.p2 = cylinder.p2;
+        query.radius = cylinder.radius;
+    }
+
+    if constexpr (is_best_effort && has_packed_capsule<T>::value) {
+        if constexpr (shape_matches_any_of<ShapeT, Sphere>()) {
+            query.filter_capsules = true;
+            query.capsule_center = query.p1;
+            query.capsule_radius = query.radius;
+        } else if constexpr (shape_matches_any_of<ShapeT, Box3D>()) {
+            auto half_diagonal = (Point3Dx(query.box.max_corner()) - query.box.min_corner()) / 2;
+
+            query.filter_capsules = true;
+            query.capsule_center = Point3Dx(query.box.min_corner()) + half_diagonal;
+            query.capsule_radius = half_diagonal.norm();
+        }
+    }
+
+    return query;
+}
+
+/** \brief Tests the block of boxes starting at `first` against `query`.
+ *
+ * Since the arrays are padded with empty boxes, the lanes past the end are
+ * never set.
+ */
+inline packed_mask_t packed_filter_boxes(const PackedKernels& kernels,
+                                         const PackedBoxes& boxes,
+                                         size_t first,
+                                         const PackedQuery& query) {
+    auto block = boxes.block(first);
+    auto mask = kernels.box(block, query.box);
+
+    if (mask != 0 && query.filter == PackedQuery::Filter::sphere) {
+        mask &= kernels.box_sphere(block, query.p1, query.radius);
+    } else if (mask != 0 && query.filter == PackedQuery::Filter::capsule) {
+        mask &= kernels.box_capsule(block, query.p1, query.p2, query.radius);
+    }
+
+    return mask;
+}
+
+}  // namespace detail
+
+
+inline void PackedBoxes::resize(size_t n_boxes) {
+    constexpr auto inf = std::numeric_limits<CoordType>::infinity();
+    auto n_padded = detail::packed_ceil_div(n_boxes, detail::packed_block_size)
+                    * detail::packed_block_size;
+
+    n_boxes_ = n_boxes;
+    for (size_t d = 0; d < 3; ++d) {
+        min_corner[d].assign(n_padded, inf);
+        max_corner[d].assign(n_padded, -inf);
+    }
+}
+
+
+inline void PackedBoxes::set(size_t i, const Box3D& box) {
+    const auto& min_c = box.min_corner();
+    const auto& max_c = box.max_corner();
+
+    min_corner[0][i] = min_c.get<0>();
+    min_corner[1][i] = min_c.get<1>();
+    min_corner[2][i] = min_c.get<2>();
+    max_corner[0][i] = max_c.get<0>();
+    max_corner[1][i] = max_c.get<1>();
+    max_corner[2][i] = max_c.get<2>();
+}
+
+
+inline Box3D PackedBoxes::get(size_t i) const {
+    return Box3D{Point3D{min_corner[0][i], min_corner[1][i], min_corner[2][i]},
+                 Point3D{max_corner[0][i], max_corner[1][i], max_corner[2][i]}};
+}
+
+
+inline bool PackedBoxes::intersects(size_t i, const Box3D& box) const {
+    const auto& min_c = box.min_corner();
+    const auto& max_c = box.max_corner();
+
+    return min_corner[0][i] <= max_c.get<0>() && max_corner[0][i] >= min_c.get<0>()
+        && min_corner[1][i] <= max_c.get<1>() && max_corner[1][i] >= min_c.get<1>()
+        && min_corner[2][i] <= max_c.get<2>() && max_corner[2][i] >= min_c.get<2>();
+}
+
+
+inline detail::PackedBoxBlock PackedBoxes::block(size_t first) const {
+    return {{min_corner[0].data() + first, min_corner[1].data() + first, min_corner[2].data() + first},
+            {max_corner[0].data() + first, max_corner[1].data() + first, max_corner[2].data() + first}};
+}
+
+
+inline void PackedCapsules::resize(size_t n_capsules) {
+    constexpr auto nan = std::numeric_limits<CoordType>::quiet_NaN();
+    auto n_padded = detail::packed_ceil_div(n_capsules, detail::packed_block_size)
+                    * detail::packed_block_size;
+
+    n_capsules_ = n_capsules;
+    for (size_t d = 0; d < 3; ++d) {
+        p1[d].assign(n_padded, nan);
+        p2[d].assign(n_padded, nan);
+    }
+    radius.assign(n_padded, nan);
+}
+
+
+inline void PackedCapsules::set(size_t i, const Point3D& a, const Point3D& b, CoordType r) {
+    p1[0][i] = a.get<0>();
+    p1[1][i] = a.get<1>();
+    p1[2][i] = a.get<2>();
+    p2[0][i] = b.get<0>();
+    p2[1][i] = b.get<1>();
+    p2[2][i] = b.get<2>();
+    radius[i] = r;
+}
+
+
+inline detail::PackedCapsuleBlock PackedCapsules::block(size_t first) const {
+    return {{p1[0].data() + first, p1[1].data() + first, p1[2].data() + first},
+            {p2[0].data() + first, p2[1].data() + first, p2[2].data() + first},
+            radius.data() + first};
+}
+
+
+template <typename T>
+inline PackedIndexTree<T>::PackedIndexTree(std::vector<T> values) {
+    auto n_values = values.size();
+    if (n_values == 0) {
+        return;
+    }
+
+    // The smallest complete tree with enough room for all values.
+    size_t n_node_levels = 1;
+    size_t subtree_size = 1;
+    while (subtree_size * fanout < n_values) {
+        subtree_size *= fanout;
+        ++n_node_levels;
+    }
+
+    std::vector<detail::PackedEntry> entries(n_values);
+    for (size_t i = 0; i < n_values; ++i) {
+        Box3D box = bgi::indexable<T>{}(values[i]);
+        Point3D center;
+        bg::centroid(box, center);
+
+        entries[i] = {{center.get<0>(), center.get<1>(), center.get<2>()}, i};
+    }
+
+    detail::packed_partition(entries.begin(), entries.end(), subtree_size, fanout);
+
+    values_.reserve(n_values);
+    value_boxes_.resize(n_values);
+    for (size_t i = 0; i < n_values; ++i) {
+        values_.push_back(std::move(values[entries[i].index]));
+        value_boxes_.set(i, bgi::indexable<T>{}(values_.back()));
+    }
+
+    if constexpr (detail::has_packed_capsule<T>::value) {
+        value_capsules_.resize(n_values);
+        for (size_t i = 0; i < n_values; ++i) {
+            detail::set_packed_capsule(value_capsules_, i, values_[i]);
+        }
+    }
+
+    // Number of nodes on each level, bottom-up.
+    level_sizes_ = {detail::packed_ceil_div(n_values, fanout)};
+    while (level_sizes_.back() > 1) {
+        level_sizes_.push_back(detail::packed_ceil_div(level_sizes_.back(), fanout));
+    }
+    std::reverse(level_sizes_.begin(), level_sizes_.end());
+
+    if (level_sizes_.size() != n_node_levels) {
+        throw std::runtime_error("Inconsistent height of the packed tree.");
+    }
+
+    // Every level is padded to full blocks.
+    level_offsets_.resize(n_node_levels + 1, 0);
+    for (size_t level = 0; level < n_node_levels; ++level) {
+        level_offsets_[level + 1] = level_offsets_[level]
+                                    + detail::packed_ceil_div(level_sizes_[level], fanout) * fanout;
+    }
+
+    node_boxes_.resize(level_offsets_.back());
+    for (size_t level = n_node_levels; level-- > 0;) {
+        const auto& child_boxes = level + 1 == n_node_levels ? value_boxes_ : node_boxes_;
+        auto child_offset = level + 1 == n_node_levels ? 0 : level_offsets_[level + 1];
+
+        for (size_t i = 0; i < level_sizes_[level]; ++i) {
+            auto [first, last] = children(level, i);
+            node_boxes_.set(
+                level_offsets_[level] + i,
+                detail::packed_envelope(child_boxes, child_offset + first, child_offset + last)
+            );
+        }
+    }
+}
+
+
+template <typename T>
+template <typename Visitor>
+inline void PackedIndexTree<T>::visit_candidates(const detail::PackedQuery& query,
+                                                 Visitor&& visitor) const {
+    if (empty()) {
+        return;
+    }
+
+    const auto& kernels = detail::packed_kernels();
+
+    auto filter_boxes = [&kernels, &query](const PackedBoxes& boxes, size_t first) {
+        return detail::packed_filter_boxes(kernels, boxes, first, query);
+    };
+
+    if ((filter_boxes(node_boxes_, 0) & 1u) == 0) {
+        return;
+    }
+
+    auto leaf_level = n_levels() - 1;
+
+    // Depth-first traversal, the stack holds pairs of (level, node). At most
+    // `fanout - 1` siblings are waiting on each level, and the number of
+    // levels is bounded since `size_t` can't count more than `fanout^16`
+    // elements. Hence, the stack fits on the stack.
+    std::array<std::pair<size_t, size_t>, fanout * 16> stack;
+    size_t stack_size = 0;
+    stack[stack_size++] = {0, 0};
+
+    while (stack_size != 0) {
+        auto [level, node] = stack[--stack_size];
+
+        auto first = node * fanout;
+
+        if (level == leaf_level) {
+            auto mask = filter_boxes(value_boxes_, first);
+            if (mask != 0 && query.filter_capsules) {
+                mask &= kernels.capsule_sphere(value_capsules_.block(first),
+                                               query.capsule_center,
+                                               query.capsule_radius);
+            }
+
+            for (; mask != 0; mask &= mask - 1) {
+                if (!visitor(first + size_t(__builtin_ctz(mask)))) {
+                    return;
+                }
+            }
+        } else {
+            auto mask = filter_boxes(node_boxes_, level_offsets_[level + 1] + first);
+
+            // Push in reverse, such that the children are visited in order.
+            while (mask != 0) {
+                auto i = size_t(31 - __builtin_clz(mask));
+                mask ^= detail::packed_mask_t(1) << i;
+                stack[stack_size++] = {level + 1, first + i};
+            }
+        }
+    }
+}
+
+
+template <typename T>
+template <typename GeometryMode, typename ShapeT, typename OutputIt>
+inline void PackedIndexTree<T>::find_intersecting(const ShapeT& shape,
+                                                  const OutputIt& iter) const {
+    auto query = detail::make_packed_query<GeometryMode, T>(shape);
+    auto out = iter;
+
+    visit_candidates(query, [this, &shape, &out](size_t i) {
+        if (geometry_intersects(shape, values_[i], GeometryMode{})) {
+            *out = values_[i];
+            ++out;
+        }
+        return true;
+    });
+}
+
+
+template <typename T>
+template <typename GeometryMode, typename ShapeT>
+inline bool PackedIndexTree<T>::is_intersecting(const ShapeT& shape) const {
+    auto query = detail::make_packed_query<GeometryMode, T>(shape);
+
+    bool found = false;
+    visit_candidates(query, [this, &shape, &found](size_t i) {
+        found = geometry_intersects(shape, values_[i], GeometryMode{});
+        return !found;
+    });
+
+    return found;
+}
+
+
+template <typename T>
+template <typename ShapeT>
+inline decltype(auto) PackedIndexTree<T>::find_nearest(const ShapeT& shape,
+                                                       unsigned k_neighbors) const {
+    using ids_getter = typename detail::id_getter_for<T>::type;
+    std::vector<typename ids_getter::value_type> ids;
+
+    if (empty() || k_neighbors == 0) {
+        return ids;
+    }
+
+    // Best-first search. Values are on level `n_levels()`, all other entries
+    // are nodes.
+    struct Candidate {
+        double distance;
+        size_t level;
+        size_t index;
+
+        bool operator>(const Candidate& other) const {
+            return distance > other.distance;
+        }
+    };
+
+    auto distance = [&shape](const Box3D& box) {
+        return static_cast<double>(bg::comparable_distance(shape, box));
+    };
+
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> queue;
+    queue.push({distance(node_boxes_.get(0)), 0, 0});
+
+    auto out = ids_getter(ids);
+    while (!queue.empty() && ids.size() < k_neighbors) {
+        auto candidate = queue.top();
+        queue.pop();
+
+        if (candidate.level == n_levels()) {
+            *out = values_[candidate.index];
+            ++out;
+            continue;
+        }
+
+        auto [first, last] = children(candidate.level, candidate.index);
+        auto child_level = candidate.level + 1;
+
+        for (size_t i = first; i < last; ++i) {
+            auto box = child_level == n_levels()
+                ? value_boxes_.get(i)
+                : node_boxes_.get(level_offsets_[child_level] + i);
+
+            queue.push({distance(box), child_level, i});
+        }
+    }
+
+    return ids;
+}
+
+
+template <typename T>
+template <typename GeometryMode, typename ShapeT>
+inline std::vector<typename PackedIndexTree<T>::cref_t>
+PackedIndexTree<T>::find_intersecting_objs(const ShapeT& shape) const {
+    std::vector<cref_t> results;
+    find_intersecting<GeometryMode>(shape, std::back_inserter(results));
+    return results;
+}
+
+
+template <typename T>
+inline Box3D PackedIndexTree<T>::bounds() const {
+    if (empty()) {
+        Box3D box;
+        bg::assign_inverse(box);
+        return box;
+    }
+
+    return node_boxes_.get(0);
+}
+
+
+template <typename T>
+inline std::ostream& operator<<(std::ostream& os, const PackedIndexTree<T>& index) {
+    int n_obj = 50;   // display the first 50 objects
+    os << "PackedIndexTree([\n";
+    for (const auto& item : index) {
+        if (n_obj-- == 0) {
+            os << "  ...\n";
+            break;
+        }
+        os << "  " << item << '\n';
+    }
+    return os << "])";
+}
+
+}  // namespace brain_indexer
@@ -0,0 +1,201 @@
+#pragma once
+
+// Kernels which test one block of 16 packed boxes, or capsules, against a
+// single query. They're written with the vector extensions of GCC/Clang and
+// compiled several times for different instruction sets, see
+// `packed_kernels_impl.hpp`. The best one supported by the CPU is selected at
+// runtime.
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include <brain_indexer/geometries.hpp>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define BRAIN_INDEXER_PACKED_KERNELS_X86 1
+#else
+#define BRAIN_INDEXER_PACKED_KERNELS_X86 0
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define BRAIN_INDEXER_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define BRAIN_INDEXER_ALWAYS_INLINE inline
+#endif
+
+namespace brain_indexer {
+
+namespace detail {
+
+/// \brief The number of boxes processed by one call of a kernel.
+constexpr size_t packed_block_size = 16;
+
+/// \brief A mask with one bit per box in a block.
+using packed_mask_t = std::uint32_t;
+
+constexpr packed_mask_t packed_full_mask = (packed_mask_t(1) << packed_block_size) - 1;
+
+
+/// \brief Pointers to the first box of a block of boxes.
+struct PackedBoxBlock {
+    const CoordType* min_corner[3];
+    const CoordType* max_corner[3];
+};
+
+/// \brief Pointers to the first capsule of a block of capsules.
+struct PackedCapsuleBlock {
+    const CoordType* p1[3];
+    const CoordType* p2[3];
+    const CoordType* radius;
+};
+
+
+/** \brief The relative tolerance of the filters.
+ *
+ * Filters must never reject an element which the exact, scalar test accepts.
+ * Since the kernels compute distances in a different order than the exact
+ * tests, they accept anything which is within a small tolerance.
+ */
+constexpr CoordType packed_filter_tolerance = CoordType(1e-5);
+
+
+/// \brief The instruction sets for which the kernels are compiled.
+enum class PackedKernelsISA {
+    scalar,
+    vector,  //< The vector width of the baseline, e.g. SSE2 or NEON.
+    avx2,
+    avx512
+};
+
+
+/// \brief One version of all kernels.
+struct PackedKernels {
+    PackedKernelsISA isa;
+
+    packed_mask_t (*box)(const PackedBoxBlock&, const Box3D&);
+    packed_mask_t (*box_sphere)(const PackedBoxBlock&, const Point3D&, CoordType);
+    packed_mask_t (*box_capsule)(const PackedBoxBlock&, const Point3D&, const Point3D&, CoordType);
+    packed_mask_t (*capsule_sphere)(const PackedCapsuleBlock&, const Point3D&, CoordType);
+};
+
+
+// The instruction set is selected by the target of the function into which
+// the vector code is inlined, and generic vectors are lowered according to
+// the target of the function that contains them. Hence, every version of the
+// kernels is compiled in its own namespace, with the target set for the
+// entire namespace.
+namespace packed_scalar {
+constexpr auto packed_isa = PackedKernelsISA::scalar;
+constexpr size_t packed_width = 1;
+#include "packed_kernels_impl.hpp"
+}  // namespace packed_scalar
+
+namespace packed_vector {
+constexpr auto packed_isa = PackedKernelsISA::vector;
+constexpr size_t packed_width = 4;
+#include "packed_kernels_impl.hpp"
+}  // namespace packed_vector
+
+#if BRAIN_INDEXER_PACKED_KERNELS_X86
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+namespace packed_avx2 {
+constexpr auto packed_isa = PackedKernelsISA::avx2;
+constexpr size_t packed_width = 8;
+#include "packed_kernels_impl.hpp"
+}  // namespace packed_avx2
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx512f"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#endif
+namespace packed_avx512 {
+constexpr auto packed_isa = PackedKernelsISA::avx512;
+constexpr size_t packed_width = 16;
+#include "packed_kernels_impl.hpp"
+}  // namespace packed_avx512
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#endif
+
+
+/// \brief Is `isa` supported by the CPU?
+inline bool is_supported(PackedKernelsISA isa) {
+    switch (isa) {
+    case PackedKernelsISA::scalar:
+    case PackedKernelsISA::vector:
+        return true;
+#if BRAIN_INDEXER_PACKED_KERNELS_X86
+    case PackedKernelsISA::avx2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    case PackedKernelsISA::avx512:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+        return false;
+    }
+}
+
+
+/** \brief The kernels for the instruction set `isa`.
+ *
+ * Throws if `isa` isn't supported by the CPU.
+ */
+inline const PackedKernels& packed_kernels(PackedKernelsISA isa) {
+    if (!is_supported(isa)) {
+        throw std::runtime_error("Instruction set not supported by the CPU.");
+    }
+
+    switch (isa) {
+#if BRAIN_INDEXER_PACKED_KERNELS_X86
+    case PackedKernelsISA::avx512:
+        return packed_avx512::kernels();
+    case PackedKernelsISA::avx2:
+        return packed_avx2::kernels();
+#endif
+    case PackedKernelsISA::vector:
+        return packed_vector::kernels();
+    default:
+        return packed_scalar::kernels();
+    }
+}
+
+
+/// \brief The fastest kernels supported by the CPU, detected once.
+inline const PackedKernels& packed_kernels() {
+    static const PackedKernels& kernels = []() -> const PackedKernels& {
+        for (auto isa : {PackedKernelsISA::avx512, PackedKernelsISA::avx2}) {
+            if (is_supported(isa)) {
+                return packed_kernels(isa);
+            }
+        }
+        return packed_kernels(PackedKernelsISA::vector);
+    }();
+
+    return kernels;
+}
+
+}  // namespace detail
+
+}  // namespace brain_indexer
+
+#undef BRAIN_INDEXER_ALWAYS_INLINE
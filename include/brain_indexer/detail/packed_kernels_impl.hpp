@@ -0,0 +1,214 @@
+// The kernels of `packed_kernels.hpp` for one instruction set.
+//
+// This file is included once per instruction set, inside the namespace of
+// that instruction set, with the target of the compiler set accordingly. The
+// namespace must define `packed_width`, the number of lanes of a vector.
+//
+// Note: There is no include guard, and this file must not include anything.
+
+/// \brief A vector of `packed_width` coordinates.
+typedef CoordType vec __attribute__((vector_size(packed_width * sizeof(CoordType))));
+
+/// \brief The result of comparing two `vec`.
+typedef decltype(vec{} < vec{}) vec_mask;
+
+
+BRAIN_INDEXER_ALWAYS_INLINE vec load(const CoordType* ptr) {
+    vec v;
+    std::memcpy(&v, ptr, sizeof(vec));
+    return v;
+}
+
+BRAIN_INDEXER_ALWAYS_INLINE vec splat(CoordType x) {
+    vec v;
+    for (size_t i = 0; i < packed_width; ++i) {
+        v[i] = x;
+    }
+    return v;
+}
+
+/** \brief Converts the result of a comparison into a bitmask.
+ *
+ * Written as a bitwise and followed by a reduction, which the compiler turns
+ * into a few vector instructions. Extracting the lanes one by one is much
+ * slower.
+ */
+BRAIN_INDEXER_ALWAYS_INLINE packed_mask_t to_bitmask(const vec_mask& hit, size_t offset) {
+    vec_mask bits;
+    for (size_t i = 0; i < packed_width; ++i) {
+        bits[i] = 1 << i;
+    }
+    bits &= hit;
+
+    packed_mask_t mask = 0;
+    for (size_t i = 0; i < packed_width; ++i) {
+        mask |= packed_mask_t(bits[i]);
+    }
+    return mask << offset;
+}
+
+
+/// \brief Same semantics as `bg::intersects` of two boxes.
+inline packed_mask_t box(const PackedBoxBlock& block, const Box3D& query) {
+    const CoordType q_min[3] = {query.min_corner().get<0>(),
+                                query.min_corner().get<1>(),
+                                query.min_corner().get<2>()};
+    const CoordType q_max[3] = {query.max_corner().get<0>(),
+                                query.max_corner().get<1>(),
+                                query.max_corner().get<2>()};
+
+    packed_mask_t mask = 0;
+    for (size_t k = 0; k < packed_block_size; k += packed_width) {
+        vec_mask hit = load(block.min_corner[0] + k) <= q_max[0];
+        hit &= load(block.max_corner[0] + k) >= q_min[0];
+        hit &= load(block.min_corner[1] + k) <= q_max[1];
+        hit &= load(block.max_corner[1] + k) >= q_min[1];
+        hit &= load(block.min_corner[2] + k) <= q_max[2];
+        hit &= load(block.max_corner[2] + k) >= q_min[2];
+
+        mask |= to_bitmask(hit, k);
+    }
+
+    return mask;
+}
+
+
+/// \brief Conservative version of `Sphere::intersects(Box3D)`.
+inline packed_mask_t box_sphere(const PackedBoxBlock& block,
+                                const Point3D& center,
+                                CoordType radius) {
+    const CoordType c[3] = {center.get<0>(), center.get<1>(), center.get<2>()};
+    const CoordType max_dist_sq = radius * radius * (1 + packed_filter_tolerance);
+
+    packed_mask_t mask = 0;
+    for (size_t k = 0; k < packed_block_size; k += packed_width) {
+        vec dist_sq = splat(0);
+
+        for (size_t d = 0; d < 3; ++d) {
+            vec below = load(block.min_corner[d] + k) - c[d];
+            vec above = c[d] - load(block.max_corner[d] + k);
+
+            vec delta = splat(0);
+            delta = below > delta ? below : delta;
+            delta = above > delta ? above : delta;
+
+            dist_sq += delta * delta;
+        }
+
+        mask |= to_bitmask(dist_sq <= max_dist_sq, k);
+    }
+
+    return mask;
+}
+
+
+/** \brief Squared distance of `x` to the segments `[p1, p1 + v]`.
+ *
+ * Also computes a tolerance which accounts for roundoff.
+ */
+BRAIN_INDEXER_ALWAYS_INLINE void segment_distance_sq(const vec (&x)[3],
+                                                     const vec (&p1)[3],
+                                                     const vec (&v)[3],
+                                                     vec& dist_sq,
+                                                     vec& tolerance) {
+    vec w[3] = {x[0] - p1[0], x[1] - p1[1], x[2] - p1[2]};
+
+    vec w_dot_v = w[0] * v[0] + w[1] * v[1] + w[2] * v[2];
+    vec v_dot_v = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+    vec w_dot_w = w[0] * w[0] + w[1] * w[1] + w[2] * w[2];
+
+    vec zero = splat(0);
+    vec one = splat(1);
+
+    vec t = v_dot_v > zero ? w_dot_v / v_dot_v : zero;
+    t = t < zero ? zero : t;
+    t = t > one ? one : t;
+
+    dist_sq = zero;
+    for (size_t d = 0; d < 3; ++d) {
+        vec delta = w[d] - t * v[d];
+        dist_sq += delta * delta;
+    }
+
+    tolerance = packed_filter_tolerance * (w_dot_w + v_dot_v);
+}
+
+
+/** \brief Conservative test of a capsule against the circumscribed spheres of boxes.
+ *
+ * Since `Cylinder::intersects(Box3D)` treats the cylinder as a capsule, this
+ * is a conservative version of it.
+ */
+inline packed_mask_t box_capsule(const PackedBoxBlock& block,
+                                 const Point3D& p1,
+                                 const Point3D& p2,
+                                 CoordType radius) {
+    const vec q1[3] = {splat(p1.get<0>()), splat(p1.get<1>()), splat(p1.get<2>())};
+    const vec v[3] = {splat(p2.get<0>() - p1.get<0>()),
+                      splat(p2.get<1>() - p1.get<1>()),
+                      splat(p2.get<2>() - p1.get<2>())};
+
+    packed_mask_t mask = 0;
+    for (size_t k = 0; k < packed_block_size; k += packed_width) {
+        vec center[3];
+        vec half_diagonal_sq = splat(0);
+
+        for (size_t d = 0; d < 3; ++d) {
+            vec lo = load(block.min_corner[d] + k);
+            vec hi = load(block.max_corner[d] + k);
+
+            center[d] = CoordType(0.5) * (lo + hi);
+            vec half_extent = CoordType(0.5) * (hi - lo);
+            half_diagonal_sq += half_extent * half_extent;
+        }
+
+        vec dist_sq, tolerance;
+        segment_distance_sq(center, q1, v, dist_sq, tolerance);
+
+        // Compare squared distances, i.e. `|x| <= r + h` iff
+        // `|x|^2 <= r^2 + 2 r h + h^2`, where `2 r h <= r^2 + h^2`.
+        vec max_dist_sq = CoordType(2) * (radius * radius + half_diagonal_sq);
+        mask |= to_bitmask(
+            dist_sq <= max_dist_sq * (1 + packed_filter_tolerance) + tolerance, k);
+    }
+
+    return mask;
+}
+
+
+/** \brief Conservative test of capsules against a sphere.
+ *
+ * A capsule contains the cylinder with the same axis and radius. Hence, this
+ * is a conservative version of `Sphere::intersects(Cylinder)` and
+ * `Sphere::intersects(Sphere)`, if the sphere is stored as a capsule of
+ * length zero.
+ */
+inline packed_mask_t capsule_sphere(const PackedCapsuleBlock& block,
+                                    const Point3D& center,
+                                    CoordType radius) {
+    const vec x[3] = {splat(center.get<0>()), splat(center.get<1>()), splat(center.get<2>())};
+
+    packed_mask_t mask = 0;
+    for (size_t k = 0; k < packed_block_size; k += packed_width) {
+        vec p1[3], v[3];
+        for (size_t d = 0; d < 3; ++d) {
+            p1[d] = load(block.p1[d] + k);
+            v[d] = load(block.p2[d] + k) - p1[d];
+        }
+
+        vec dist_sq, tolerance;
+        segment_distance_sq(x, p1, v, dist_sq, tolerance);
+
+        vec max_dist = radius + load(block.radius + k);
+        mask |= to_bitmask(
+            dist_sq <= max_dist * max_dist * (1 + packed_filter_tolerance) + tolerance, k);
+    }
+
+    return mask;
+}
+
+
+inline const PackedKernels& kernels() {
+    static const PackedKernels kernels{packed_isa, &box, &box_sphere, &box_capsule, &capsule_sphere};
+    return kernels;
+}
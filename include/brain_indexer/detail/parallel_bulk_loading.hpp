@@ -0,0 +1,252 @@
+#pragma once
+
+#include "../parallel_bulk_loading.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace brain_indexer {
+namespace detail {
+
+template <class Key, class Value>
+inline void partition_balanced(std::vector<Value>& values,
+                               size_t begin,
+                               size_t end,
+                               size_t n_parts) {
+    if (n_parts <= 1 || end - begin <= 1) {
+        return;
+    }
+
+    auto n_left = n_parts / 2;
+    auto middle = begin + util::balanced_chunks(end - begin, n_parts, n_left).low;
+
+    std::nth_element(
+        values.begin() + begin,
+        values.begin() + middle,
+        values.begin() + end,
+        [](const Value& a, const Value& b) {
+            return Key::compare(a, b);
+        }
+    );
+
+    partition_balanced<Key>(values, begin, middle, n_left);
+    partition_balanced<Key>(values, middle, end, n_parts - n_left);
+}
+
+
+inline SerialSTRParams parallel_bulk_loading_params(size_t n_values,
+                                                    size_t max_elements,
+                                                    size_t n_parts_min) {
+    // Subtrees have at least two levels, the capacity is then increased for
+    // as long as there are enough parts.
+    size_t capacity = max_elements * max_elements;
+    if (n_values / capacity < n_parts_min) {
+        return {n_values, {0, 0, 0}};
+    }
+
+    while (n_values / (capacity * max_elements) >= n_parts_min) {
+        capacity *= max_elements;
+    }
+
+    // Since `n_parts >= n_parts_min` rounding up the number of parts per
+    // dimension leaves the parts large enough to not lose a level.
+    auto n_parts = (n_values + capacity - 1) / capacity;
+    auto n0 = size_t(std::ceil(std::cbrt(double(n_parts))));
+    auto n1 = size_t(std::ceil(std::sqrt(double((n_parts + n0 - 1) / n0))));
+    auto n2 = (n_parts + n0 * n1 - 1) / (n0 * n1);
+
+    return {n_values, {n0, n1, n2}};
+}
+
+
+/** \brief Adds the internal nodes above `subtrees` until there's a single root.
+ *
+ * Consecutive subtrees are grouped into the same node. Ownership of the
+ * subtrees is transferred to the returned root, or, if an exception is
+ * thrown, they're destroyed.
+ */
+template <class MembersHolder, class InternalElement>
+inline InternalElement stitch_subtrees(std::vector<InternalElement> subtrees,
+                                       typename MembersHolder::size_type& leafs_level,
+                                       size_t max_elements,
+                                       typename MembersHolder::allocators_type& allocators) {
+    namespace bgid = bgi::detail::rtree;
+
+    using internal_node = typename MembersHolder::internal_node;
+    using node_pointer = typename MembersHolder::node_pointer;
+    using subtree_destroyer = bgid::subtree_destroyer<MembersHolder>;
+
+    std::vector<InternalElement> nodes;
+    size_t n_stitched = 0;
+
+    try {
+        while (subtrees.size() > 1) {
+            auto n_nodes = (subtrees.size() + max_elements - 1) / max_elements;
+            nodes.reserve(n_nodes);
+
+            for (size_t i = 0; i < n_nodes; ++i) {
+                auto chunk = util::balanced_chunks(subtrees.size(), n_nodes, i);
+
+                node_pointer node = bgid::create_node<
+                    typename MembersHolder::allocators_type, internal_node
+                >::apply(allocators);
+
+                auto& elements = bgid::elements(bgid::get<internal_node>(*node));
+                auto box = subtrees[chunk.low].first;
+                for (size_t j = chunk.low; j < chunk.high; ++j) {
+                    elements.push_back(subtrees[j]);
+                    bg::expand(box, subtrees[j].first);
+                }
+
+                nodes.emplace_back(box, node);
+                n_stitched = chunk.high;
+            }
+
+            subtrees = std::move(nodes);
+            nodes.clear();
+            n_stitched = 0;
+            ++leafs_level;
+        }
+    } catch (...) {
+        for (const auto& node : nodes) {
+            subtree_destroyer destroyer(node.second, allocators);
+        }
+
+        for (size_t i = n_stitched; i < subtrees.size(); ++i) {
+            subtree_destroyer destroyer(subtrees[i].second, allocators);
+        }
+
+        throw;
+    }
+
+    return subtrees[0];
+}
+
+}  // namespace detail
+
+
+template <class T>
+inline IndexTree<T> parallel_bulk_load(std::vector<T>& values,
+                                       ThreadPool& pool,
+                                       size_t n_threads) {
+    namespace bgid = bgi::detail::rtree;
+
+    using view_type = bgid::private_view<IndexTreeBaseT<T>>;
+    using members_holder = typename view_type::members_holder;
+    using internal_node = typename members_holder::internal_node;
+    using node_pointer = typename members_holder::node_pointer;
+    using size_type = typename members_holder::size_type;
+    using box_type = typename members_holder::box_type;
+    using internal_element =
+        typename bgid::elements_type<internal_node>::type::value_type;
+    using pack = bgid::pack<members_holder>;
+    using subtree_destroyer = bgid::subtree_destroyer<members_holder>;
+
+    using GetCoordinate = GetCenterCoordinate<T>;
+
+    if (n_threads <= 1) {
+        return IndexTree<T>(values);
+    }
+
+    auto index = IndexTree<T>();
+    auto view = view_type(index);
+    auto& members = view.members();
+    auto& allocators = members.allocators();
+    auto max_elements = members.parameters().get_max_elements();
+
+    auto str_params = detail::parallel_bulk_loading_params(
+        values.size(), max_elements, 4 * n_threads
+    );
+
+    auto n_parts = str_params.n_parts();
+    if (n_parts == 0) {
+        return IndexTree<T>(values);
+    }
+
+    // 1. Partition the values.
+    const auto& n_parts_per_dim = str_params.n_parts_per_dim;
+    detail::partition_balanced<STRKey<GetCoordinate, 0>>(
+        values, 0, values.size(), n_parts_per_dim[0]
+    );
+
+    parallel_for(pool, n_parts_per_dim[0], n_threads, [&](size_t i) {
+        auto slab = util::balanced_chunks(values.size(), n_parts_per_dim[0], i);
+        detail::partition_balanced<STRKey<GetCoordinate, 1>>(
+            values, slab.low, slab.high, n_parts_per_dim[1]
+        );
+    });
+
+    auto n_columns = n_parts_per_dim[0] * n_parts_per_dim[1];
+    parallel_for(pool, n_columns, n_threads, [&](size_t ij) {
+        auto i = ij / n_parts_per_dim[1];
+        auto j = ij % n_parts_per_dim[1];
+        auto slab = util::balanced_chunks(values.size(), n_parts_per_dim[0], i);
+        auto column = util::balanced_chunks(slab, n_parts_per_dim[1], j);
+
+        SerialSortTileRecursion<T, GetCoordinate, 2>::apply(
+            values, column.low, column.high, str_params
+        );
+    });
+
+    // 2. Pack each part into a subtree.
+    auto boundaries = str_params.partition_boundaries();
+    auto roots = std::vector<node_pointer>(n_parts, node_pointer(0));
+    auto boxes = std::vector<box_type>(n_parts);
+    auto leafs_levels = std::vector<size_type>(n_parts, 0);
+
+    try {
+        parallel_for(pool, n_parts, n_threads, [&](size_t k) {
+            size_type values_count = 0;
+            roots[k] = pack::apply(values.begin() + boundaries[k],
+                                   values.begin() + boundaries[k + 1],
+                                   values_count,
+                                   leafs_levels[k],
+                                   members.parameters(),
+                                   members.translator(),
+                                   allocators);
+
+            const auto& elements = bgid::elements(bgid::get<internal_node>(*roots[k]));
+            boxes[k] = elements[0].first;
+            for (const auto& element : elements) {
+                bg::expand(boxes[k], element.first);
+            }
+        });
+
+        auto is_same_level = [&leafs_levels](size_type level) {
+            return level == leafs_levels[0];
+        };
+
+        if (!std::all_of(leafs_levels.begin(), leafs_levels.end(), is_same_level)) {
+            throw std::logic_error("Subtrees must all have the same height.");
+        }
+    } catch (...) {
+        for (auto root : roots) {
+            if (root) {
+                subtree_destroyer destroyer(root, allocators);
+            }
+        }
+
+        throw;
+    }
+
+    // 3. Stitch the subtrees together.
+    auto subtrees = std::vector<internal_element>();
+    subtrees.reserve(n_parts);
+    for (size_t k = 0; k < n_parts; ++k) {
+        subtrees.emplace_back(boxes[k], roots[k]);
+    }
+
+    size_type leafs_level = leafs_levels[0];
+    auto root = detail::stitch_subtrees<members_holder>(
+        std::move(subtrees), leafs_level, max_elements, allocators
+    );
+
+    members.root = root.second;
+    members.values_count = values.size();
+    members.leafs_level = leafs_level;
+
+    return index;
+}
+
+}  // namespace brain_indexer
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "../query_cursor.hpp"
+
+#include "output_iterators.hpp"
+
+namespace brain_indexer {
+
+/////////////////////////////////////////
+// class QueryCursor
+/////////////////////////////////////////
+
+template <typename RTree, typename GeometryMode, typename ShapeT>
+inline QueryCursor<RTree, GeometryMode, ShapeT>::QueryCursor(const RTree& rtree,
+                                                             const ShapeT& shape)
+    : shape_(std::make_unique<ShapeT>(shape))
+    , it_(rtree.qbegin(detail::intersects_predicate<GeometryMode>(*shape_)))
+    , end_(rtree.qend()) {
+}
+
+
+template <typename RTree, typename GeometryMode, typename ShapeT>
+template <typename OutputIt>
+inline size_t QueryCursor<RTree, GeometryMode, ShapeT>::next_chunk(size_t max_elements,
+                                                                   OutputIt out) {
+    size_t n_elements = 0;
+    for (; n_elements < max_elements && it_ != end_; ++n_elements, ++it_) {
+        *out = *it_;
+        ++out;
+    }
+
+    return n_elements;
+}
+
+
+template <typename RTree, typename GeometryMode, typename ShapeT>
+inline auto QueryCursor<RTree, GeometryMode, ShapeT>::next_chunk(size_t max_elements)
+    -> result_type {
+    result_type result;
+    next_chunk(max_elements, iter_entry_getter<value_type>(result));
+    return result;
+}
+
+
+template <typename RTree, typename GeometryMode, typename ShapeT>
+inline bool QueryCursor<RTree, GeometryMode, ShapeT>::done() const {
+    return it_ == end_;
+}
+
+
+/////////////////////////////////////////
+// class MultiIndexQueryCursor
+/////////////////////////////////////////
+
+template <typename T, typename GeometryMode, typename ShapeT, typename SubtreeCache>
+inline MultiIndexQueryCursor<T, GeometryMode, ShapeT, SubtreeCache>::MultiIndexQueryCursor(
+    const MultiIndexTree<T, SubtreeCache>& index, const ShapeT& shape)
+    : index_(&index)
+    , shape_(shape) {
+
+    // The top-level tree is small, hence all subtrees are found upfront.
+    index.top_tree().query(detail::intersects_predicate<GeometryMode>(shape_),
+                           std::back_inserter(subtree_ids_));
+}
+
+
+template <typename T, typename GeometryMode, typename ShapeT, typename SubtreeCache>
+inline auto MultiIndexQueryCursor<T, GeometryMode, ShapeT, SubtreeCache>::next_chunk(size_t max_elements)
+    -> result_type {
+    result_type result;
+    auto out = iter_entry_getter<value_type>(result);
+
+    size_t n_elements = 0;
+    while (n_elements < max_elements) {
+        if (subtree_cursor_ == nullptr || subtree_cursor_->done()) {
+            if (next_subtree_ == subtree_ids_.size()) {
+                subtree_cursor_ = nullptr;
+                subtree_ = nullptr;
+                break;
+            }
+
+            next_subtree();
+        }
+
+        n_elements += subtree_cursor_->next_chunk(max_elements - n_elements, out);
+    }
+
+    return result;
+}
+
+
+template <typename T, typename GeometryMode, typename ShapeT, typename SubtreeCache>
+inline bool MultiIndexQueryCursor<T, GeometryMode, ShapeT, SubtreeCache>::done() const {
+    return (subtree_cursor_ == nullptr || subtree_cursor_->done())
+           && next_subtree_ == subtree_ids_.size();
+}
+
+
+template <typename T, typename GeometryMode, typename ShapeT, typename SubtreeCache>
+inline void MultiIndexQueryCursor<T, GeometryMode, ShapeT, SubtreeCache>::next_subtree() {
+    util::check_signals();
+
+    // The cursor refers to the subtree, hence it goes first.
+    subtree_cursor_ = nullptr;
+    subtree_ = nullptr;
+    subtree_ = index_->load_subtree(subtree_ids_[next_subtree_]);
+    subtree_cursor_ = std::make_unique<subtree_cursor_type>(*subtree_, shape_);
+
+    ++next_subtree_;
+}
+
+}  // namespace brain_indexer
@@ -0,0 +1,370 @@
+#pragma once
+
+#include "../rasterize.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+
+#include <boost/function_output_iterator.hpp>
+#include <boost/math/constants/constants.hpp>
+
+namespace brain_indexer {
+
+/////////////////////////////////////////
+// struct VoxelGrid
+/////////////////////////////////////////
+
+inline size_t VoxelGrid::n_voxels() const {
+    auto n = size_t(1);
+    for (auto n_i : shape) {
+        if (n_i != 0 && n > std::numeric_limits<size_t>::max() / n_i) {
+            throw std::invalid_argument("The number of voxels overflows.");
+        }
+        n *= n_i;
+    }
+    return n;
+}
+
+inline Box3D VoxelGrid::bounding_box() const {
+    auto n = Point3Dx{CoordType(shape[0]), CoordType(shape[1]), CoordType(shape[2])};
+    return Box3D(origin, Point3Dx(origin) + n * voxel_size);
+}
+
+inline Box3D VoxelGrid::voxel_box(size_t i, size_t j, size_t k) const {
+    auto lo = Point3Dx(origin) + Point3Dx{CoordType(i), CoordType(j), CoordType(k)} * voxel_size;
+    return Box3D(lo, lo + voxel_size);
+}
+
+
+namespace detail {
+
+/// \brief The length of the part of the segment from `p1` to `p2` inside `box`.
+inline double clipped_length(const Point3D& p1, const Point3D& p2, const Box3D& box) {
+    const double x1[3] = {p1.get<0>(), p1.get<1>(), p1.get<2>()};
+    const double x2[3] = {p2.get<0>(), p2.get<1>(), p2.get<2>()};
+    const double lo[3] = {box.min_corner().get<0>(),
+                          box.min_corner().get<1>(),
+                          box.min_corner().get<2>()};
+    const double hi[3] = {box.max_corner().get<0>(),
+                          box.max_corner().get<1>(),
+                          box.max_corner().get<2>()};
+
+    // Liang-Barsky: intersect the parameter range [0, 1] with every slab.
+    double t0 = 0.0, t1 = 1.0;
+    double length_sq = 0.0;
+    for (size_t d = 0; d < 3; ++d) {
+        auto delta = x2[d] - x1[d];
+        length_sq += delta * delta;
+
+        if (delta == 0.0) {
+            if (x1[d] < lo[d] || x1[d] > hi[d]) {
+                return 0.0;
+            }
+            continue;
+        }
+
+        auto ta = (lo[d] - x1[d]) / delta;
+        auto tb = (hi[d] - x1[d]) / delta;
+        t0 = std::max(t0, std::min(ta, tb));
+        t1 = std::min(t1, std::max(ta, tb));
+    }
+
+    return t1 > t0 ? (t1 - t0) * std::sqrt(length_sq) : 0.0;
+}
+
+
+/** \brief Adds the contribution of single elements to a grid.
+ *
+ * The values are accumulated into a caller provided array of
+ * `grid.n_voxels()` doubles, which allows one array per thread.
+ */
+class Rasterizer {
+  public:
+    inline Rasterizer(const VoxelGrid& grid, RasterQuantity quantity)
+        : grid_(grid), quantity_(quantity) {}
+
+    template <typename... V>
+    inline void add(const boost::variant<V...>& element, double* voxels) const {
+        boost::apply_visitor([this, voxels](const auto& e) { add(e, voxels); }, element);
+    }
+
+    inline void add(const Cylinder& cylinder, double* voxels) const {
+        if (quantity_ == RasterQuantity::count) {
+            for_each_voxel(cylinder.bounding_box(), [&](size_t index, const Box3D& voxel) {
+                if (cylinder.intersects(voxel)) {
+                    voxels[index] += 1.0;
+                }
+            });
+            return;
+        }
+
+        auto weight = 1.0;
+        if (quantity_ == RasterQuantity::volume) {
+            weight = boost::math::double_constants::pi * cylinder.radius * cylinder.radius;
+        }
+
+        auto axis_box = Box3D(min(cylinder.p1, cylinder.p2), max(cylinder.p1, cylinder.p2));
+        for_each_voxel(axis_box, [&](size_t index, const Box3D& voxel) {
+            voxels[index] += weight * clipped_length(cylinder.p1, cylinder.p2, voxel);
+        });
+    }
+
+    inline void add(const Sphere& sphere, double* voxels) const {
+        if (quantity_ == RasterQuantity::count) {
+            for_each_voxel(sphere.bounding_box(), [&](size_t index, const Box3D& voxel) {
+                if (sphere.intersects(voxel)) {
+                    voxels[index] += 1.0;
+                }
+            });
+        } else if (quantity_ == RasterQuantity::volume) {
+            auto r = double(sphere.radius);
+            auto volume = 4.0 / 3.0 * boost::math::double_constants::pi * r * r * r;
+            add_at(sphere.centroid, volume, voxels);
+        }
+    }
+
+    inline void add(const Point3D& point, double* voxels) const {
+        if (quantity_ == RasterQuantity::count) {
+            add_at(point, 1.0, voxels);
+        }
+    }
+
+    /// \brief The voxel index along `dim` of the coordinate `x`, possibly outside the grid.
+    inline double voxel_coord(CoordType x, size_t dim) const {
+        auto x0 = dim == 0 ? grid_.origin.get<0>()
+                : dim == 1 ? grid_.origin.get<1>()
+                           : grid_.origin.get<2>();
+        return std::floor((double(x) - double(x0)) / double(grid_.voxel_size));
+    }
+
+  private:
+    inline void add_at(const Point3D& point, double value, double* voxels) const {
+        auto i = voxel_coord(point.get<0>(), 0);
+        auto j = voxel_coord(point.get<1>(), 1);
+        auto k = voxel_coord(point.get<2>(), 2);
+
+        if (i < 0 || j < 0 || k < 0
+            || i >= double(grid_.shape[0])
+            || j >= double(grid_.shape[1])
+            || k >= double(grid_.shape[2])) {
+            return;
+        }
+
+        voxels[index(size_t(i), size_t(j), size_t(k))] += value;
+    }
+
+    /// \brief Calls `f(index, voxel_box)` for every voxel of the grid overlapping `box`.
+    template <typename F>
+    inline void for_each_voxel(const Box3D& box, F&& f) const {
+        std::array<size_t, 3> lo, hi;
+        const auto& min_corner = box.min_corner();
+        const auto& max_corner = box.max_corner();
+        const CoordType box_lo[3] = {min_corner.get<0>(), min_corner.get<1>(), min_corner.get<2>()};
+        const CoordType box_hi[3] = {max_corner.get<0>(), max_corner.get<1>(), max_corner.get<2>()};
+
+        for (size_t d = 0; d < 3; ++d) {
+            auto n = double(grid_.shape[d]);
+            auto a = std::max(voxel_coord(box_lo[d], d), 0.0);
+            auto b = std::min(voxel_coord(box_hi[d], d), n - 1.0);
+            if (a > b) {
+                return;
+            }
+
+            lo[d] = size_t(a);
+            hi[d] = size_t(b);
+        }
+
+        for (size_t i = lo[0]; i <= hi[0]; ++i) {
+            for (size_t j = lo[1]; j <= hi[1]; ++j) {
+                for (size_t k = lo[2]; k <= hi[2]; ++k) {
+                    f(index(i, j, k), grid_.voxel_box(i, j, k));
+                }
+            }
+        }
+    }
+
+    inline size_t index(size_t i, size_t j, size_t k) const {
+        return (i * grid_.shape[1] + j) * grid_.shape[2] + k;
+    }
+
+    VoxelGrid grid_;
+    RasterQuantity quantity_;
+};
+
+
+/** \brief Rasterizes R-Trees into per-thread grids.
+ *
+ * Several trees can be added, e.g. the subtrees of a multi index. The
+ * per-thread grids are reused from one tree to the next and only added up
+ * by `finalize`.
+ */
+class RasterAccumulator {
+  public:
+    inline RasterAccumulator(const VoxelGrid& grid, RasterQuantity quantity)
+        : grid_(grid), rasterizer_(grid, quantity) {
+        if (grid_.n_voxels() > std::vector<double>().max_size()) {
+            throw std::invalid_argument("The grid has too many voxels.");
+        }
+    }
+
+    /** \brief Adds every element of `rtree`, on `n_threads` threads.
+     *
+     * The grid is split into slabs along the first axis. An element belongs to
+     * the slab containing the lower corner of its bounding box; hence every
+     * element is added exactly once, even if it overlaps several slabs.
+     */
+    template <typename RTree>
+    inline void add_tree(const RTree& rtree, ThreadPool& pool, size_t n_threads) {
+        if (rtree.empty() || grid_.n_voxels() == 0) {
+            return;
+        }
+
+        auto nx = grid_.shape[0];
+        auto n_slabs = n_threads <= 1 ? size_t(1) : std::min(nx, 4 * n_threads);
+        auto n_workers = std::min(std::max(n_threads, size_t(1)), n_slabs);
+        while (grids_.size() < n_workers) {
+            free_grids_.push_back(grids_.size());
+            grids_.emplace_back();
+        }
+
+        parallel_for(pool, n_slabs, n_threads, [&](size_t k) {
+            auto g = acquire_grid();
+            add_slab(rtree, util::balanced_chunks(nx, n_slabs, k), grids_[g].data());
+            release_grid(g);
+        });
+    }
+
+    /// \brief The sum of all per-thread grids.
+    inline std::vector<double> finalize(ThreadPool& pool, size_t n_threads) {
+        // Grids which were never used, weren't allocated.
+        grids_.erase(std::remove_if(grids_.begin(), grids_.end(),
+                                    [](const auto& g) { return g.empty(); }),
+                     grids_.end());
+
+        if (grids_.empty()) {
+            return std::vector<double>(grid_.n_voxels(), 0.0);
+        }
+
+        auto result = std::move(grids_[0]);
+        auto n_voxels = result.size();
+        auto n_chunks = std::min(n_voxels, std::max(n_threads, size_t(1)));
+
+        parallel_for(pool, n_chunks, n_threads, [&](size_t c) {
+            auto range = util::balanced_chunks(n_voxels, n_chunks, c);
+            for (size_t g = 1; g < grids_.size(); ++g) {
+                for (auto i = range.low; i < range.high; ++i) {
+                    result[i] += grids_[g][i];
+                }
+            }
+        });
+
+        grids_.clear();
+        free_grids_.clear();
+        return result;
+    }
+
+  private:
+    template <typename RTree>
+    inline void add_slab(const RTree& rtree, const util::Range& slab, double* voxels) const {
+        using value_type = typename RTree::value_type;
+
+        // The slab is widened by half a voxel, the owner is decided below.
+        auto h = grid_.voxel_size;
+        auto grid_box = grid_.bounding_box();
+        auto x0 = grid_.origin.get<0>();
+        auto slab_box = grid_box;
+        slab_box.min_corner().set<0>(x0 + (CoordType(slab.low) - CoordType(0.5)) * h);
+        slab_box.max_corner().set<0>(x0 + (CoordType(slab.high) + CoordType(0.5)) * h);
+
+        auto nx = double(grid_.shape[0]);
+        auto indexable = bgi::indexable<value_type>{};
+        auto add = boost::make_function_output_iterator(
+            [&](const value_type& element) {
+                auto x = indexable(element).min_corner().template get<0>();
+                auto owner = std::min(std::max(rasterizer_.voxel_coord(x, 0), 0.0), nx - 1.0);
+                if (owner >= double(slab.low) && owner < double(slab.high)) {
+                    rasterizer_.add(element, voxels);
+                }
+            }
+        );
+
+        rtree.query(bgi::intersects(slab_box), add);
+    }
+
+    inline size_t acquire_grid() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto g = free_grids_.back();
+        free_grids_.pop_back();
+
+        // Allocated on first use, only as many grids as threads are needed.
+        if (grids_[g].empty()) {
+            grids_[g].assign(grid_.n_voxels(), 0.0);
+        }
+        return g;
+    }
+
+    inline void release_grid(size_t g) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_grids_.push_back(g);
+    }
+
+    VoxelGrid grid_;
+    Rasterizer rasterizer_;
+
+    std::vector<std::vector<double>> grids_;
+    std::vector<size_t> free_grids_;
+    std::mutex mutex_;
+};
+
+}  // namespace detail
+
+
+template <typename T, typename A>
+inline std::vector<double> rasterize(const IndexTree<T, A>& index,
+                                     const VoxelGrid& grid,
+                                     RasterQuantity quantity) {
+    return rasterize(index, grid, quantity, ThreadPool::global(), 1);
+}
+
+template <typename T, typename A>
+inline std::vector<double> rasterize(const IndexTree<T, A>& index,
+                                     const VoxelGrid& grid,
+                                     RasterQuantity quantity,
+                                     ThreadPool& pool,
+                                     size_t n_threads) {
+    detail::RasterAccumulator accumulator(grid, quantity);
+    accumulator.add_tree(static_cast<const IndexTreeBaseT<T, A>&>(index), pool, n_threads);
+    return accumulator.finalize(pool, n_threads);
+}
+
+template <typename T>
+inline std::vector<double> rasterize(const MemoryMappedIndexTree<T>& index,
+                                     const VoxelGrid& grid,
+                                     RasterQuantity quantity,
+                                     ThreadPool& pool,
+                                     size_t n_threads) {
+    return rasterize(index.rtree(), grid, quantity, pool, n_threads);
+}
+
+template <typename T, typename SubtreeCache>
+inline std::vector<double> rasterize(const MultiIndexTree<T, SubtreeCache>& index,
+                                     const VoxelGrid& grid,
+                                     RasterQuantity quantity,
+                                     ThreadPool& pool,
+                                     size_t n_threads) {
+    auto subtree_ids = std::vector<IndexedSubtreeBox>();
+    index.top_tree().query(bgi::intersects(grid.bounding_box()),
+                           std::back_inserter(subtree_ids));
+
+    detail::RasterAccumulator accumulator(grid, quantity);
+    index.for_each_subtree(subtree_ids, [&](const auto& subtree) {
+        accumulator.add_tree(subtree, pool, n_threads);
+    });
+
+    return accumulator.finalize(pool, n_threads);
+}
+
+}  // namespace brain_indexer
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "../robust_mutex.hpp"
+
+#include <cerrno>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+
+#include <signal.h>
+
+// Robust mutexes are part of POSIX.1-2008, but not available everywhere.
+#if defined(__linux__)
+#define SI_HAS_ROBUST_MUTEX 1
+#else
+#define SI_HAS_ROBUST_MUTEX 0
+#endif
+
+namespace brain_indexer {
+
+namespace detail {
+
+inline void check_pthread_error(int error, const char* what) {
+    if (error != 0) {
+        throw std::runtime_error(
+            std::string(what) + " failed with error " + std::to_string(error) + "."
+        );
+    }
+}
+
+}  // namespace detail
+
+
+/////////////////////////////////////////
+// class RobustMutex
+/////////////////////////////////////////
+
+inline RobustMutex::RobustMutex()
+    : RobustMutex(PTHREAD_MUTEX_DEFAULT) { }
+
+inline RobustMutex::RobustMutex(int type) {
+    pthread_mutexattr_t attr;
+    detail::check_pthread_error(pthread_mutexattr_init(&attr), "pthread_mutexattr_init");
+    pthread_mutexattr_settype(&attr, type);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+#if SI_HAS_ROBUST_MUTEX == 1
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+#endif
+
+    auto error = pthread_mutex_init(&mutex_, &attr);
+    pthread_mutexattr_destroy(&attr);
+    detail::check_pthread_error(error, "pthread_mutex_init");
+}
+
+inline RobustMutex::~RobustMutex() {
+    pthread_mutex_destroy(&mutex_);
+}
+
+inline void RobustMutex::lock() {
+    recover(pthread_mutex_lock(&mutex_));
+}
+
+inline void RobustMutex::unlock() {
+    pthread_mutex_unlock(&mutex_);
+}
+
+inline bool RobustMutex::owner_died() {
+    auto died = owner_died_;
+    owner_died_ = false;
+    return died;
+}
+
+inline void RobustMutex::recover(int error) {
+#if SI_HAS_ROBUST_MUTEX == 1
+    if (error == EOWNERDEAD) {
+        // We own the mutex; without this, it's unusable once we unlock it.
+        pthread_mutex_consistent(&mutex_);
+        owner_died_ = true;
+        return;
+    }
+#endif
+
+    detail::check_pthread_error(error, "pthread_mutex_lock");
+}
+
+
+/////////////////////////////////////////
+// class RobustRecursiveMutex
+/////////////////////////////////////////
+
+inline RobustRecursiveMutex::RobustRecursiveMutex()
+    : RobustMutex(PTHREAD_MUTEX_RECURSIVE) { }
+
+
+/////////////////////////////////////////
+// class RobustCondition
+/////////////////////////////////////////
+
+inline RobustCondition::RobustCondition() {
+    pthread_condattr_t attr;
+    detail::check_pthread_error(pthread_condattr_init(&attr), "pthread_condattr_init");
+    pthread_condattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+
+    auto error = pthread_cond_init(&cond_, &attr);
+    pthread_condattr_destroy(&attr);
+    detail::check_pthread_error(error, "pthread_cond_init");
+}
+
+inline RobustCondition::~RobustCondition() {
+    pthread_cond_destroy(&cond_);
+}
+
+inline void RobustCondition::wait_for(RobustMutex& mutex, std::chrono::nanoseconds timeout) {
+    // The default clock of a condition variable is the realtime clock.
+    timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+
+    auto ns = std::chrono::nanoseconds(deadline.tv_nsec) + timeout;
+    auto s = std::chrono::duration_cast<std::chrono::seconds>(ns);
+    deadline.tv_sec += static_cast<time_t>(s.count());
+    deadline.tv_nsec = static_cast<long>((ns - s).count());
+
+    auto error = pthread_cond_timedwait(&cond_, &mutex.mutex_, &deadline);
+    if (error != ETIMEDOUT) {
+        mutex.recover(error);
+    }
+}
+
+inline void RobustCondition::notify_all() {
+    pthread_cond_broadcast(&cond_);
+}
+
+
+inline bool is_process_alive(pid_t pid) {
+    // Without permission to signal it, the process still exists.
+    return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+}  // namespace brain_indexer
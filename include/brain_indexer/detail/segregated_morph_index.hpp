@@ -0,0 +1,127 @@
+#pragma once
+
+#include "../segregated_morph_index.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace brain_indexer {
+
+template <typename Iterator>
+inline SegregatedMorphIndexTree::SegregatedMorphIndexTree(Iterator begin, Iterator end) {
+    std::vector<Segment> segments;
+    std::vector<Soma> somas;
+
+    for (auto it = begin; it != end; ++it) {
+        const MorphoEntry& entry = *it;
+        if (const auto* segment = boost::get<Segment>(&entry)) {
+            segments.push_back(*segment);
+        } else {
+            somas.push_back(boost::get<Soma>(entry));
+        }
+    }
+
+    segments_ = IndexTree<Segment>(segments);
+    somas_ = IndexTree<Soma>(somas);
+}
+
+
+template <typename GeometryMode, typename ShapeT, typename OutputIt>
+inline void SegregatedMorphIndexTree::find_intersecting(const ShapeT& shape,
+                                                        const OutputIt& iter) const {
+    segments_.template find_intersecting<GeometryMode>(shape, iter);
+    somas_.template find_intersecting<GeometryMode>(shape, iter);
+}
+
+
+template <typename GeometryMode, typename ShapeT>
+inline bool SegregatedMorphIndexTree::is_intersecting(const ShapeT& shape) const {
+    return segments_.template is_intersecting<GeometryMode>(shape)
+           || somas_.template is_intersecting<GeometryMode>(shape);
+}
+
+
+template <typename ShapeT>
+inline std::vector<gid_segm_t>
+SegregatedMorphIndexTree::find_nearest(const ShapeT& shape, unsigned k_neighbors) const {
+    // The nearest `k` elements are among the nearest `k` segments and the
+    // nearest `k` somas. Both are ordered by the distance to the bounding
+    // box, like the nearest query of the R-Tree, and then merged.
+    std::vector<Segment> segments;
+    std::vector<Soma> somas;
+    segments_.query(bgi::nearest(shape, k_neighbors), std::back_inserter(segments));
+    somas_.query(bgi::nearest(shape, k_neighbors), std::back_inserter(somas));
+
+    auto distance = [&shape](const auto& element) {
+        using element_t = std::decay_t<decltype(element)>;
+        return bg::comparable_distance(shape, bgi::indexable<element_t>{}(element));
+    };
+
+    auto by_distance = [&distance](const auto& a, const auto& b) {
+        return distance(a) < distance(b);
+    };
+
+    std::sort(segments.begin(), segments.end(), by_distance);
+    std::sort(somas.begin(), somas.end(), by_distance);
+
+    std::vector<gid_segm_t> ids;
+    auto out = iter_gid_segm_getter(ids);
+
+    auto segment = segments.begin();
+    auto soma = somas.begin();
+    while (ids.size() < k_neighbors && (segment != segments.end() || soma != somas.end())) {
+        if (soma == somas.end()
+            || (segment != segments.end() && distance(*segment) <= distance(*soma))) {
+            *out = *segment++;
+        } else {
+            *out = *soma++;
+        }
+    }
+
+    return ids;
+}
+
+
+template <typename GeometryMode, typename ShapeT>
+inline std::vector<MorphoEntry>
+SegregatedMorphIndexTree::find_intersecting_objs(const ShapeT& shape) const {
+    std::vector<MorphoEntry> results;
+    find_intersecting<GeometryMode>(shape, std::back_inserter(results));
+    return results;
+}
+
+
+inline Box3D SegregatedMorphIndexTree::bounds() const {
+    auto box = segments_.bounds();
+    if (!somas_.empty()) {
+        if (segments_.empty()) {
+            return somas_.bounds();
+        }
+        bg::expand(box, somas_.bounds());
+    }
+
+    return box;
+}
+
+
+inline std::ostream& operator<<(std::ostream& os, const SegregatedMorphIndexTree& index) {
+    int n_obj = 50;   // display the first 50 objects
+    os << "SegregatedMorphIndexTree([\n";
+    for (const auto& item : index.somas()) {
+        if (n_obj-- == 0) {
+            os << "  ...\n";
+            return os << "])";
+        }
+        os << "  " << item << '\n';
+    }
+    for (const auto& item : index.segments()) {
+        if (n_obj-- == 0) {
+            os << "  ...\n";
+            break;
+        }
+        os << "  " << item << '\n';
+    }
+    return os << "])";
+}
+
+}  // namespace brain_indexer
@@ -0,0 +1,524 @@
+#pragma once
+
+#include "../shared_subtree_cache.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include <unistd.h>
+
+namespace brain_indexer {
+
+template <class Storage>
+SharedSubtreeCache<Storage>::SharedSubtreeCache(const SharedSubtreeCacheParams& params,
+                                                Storage storage)
+    : storage(std::move(storage))
+    , arena(std::make_shared<Arena>()) {
+
+    arena->segment = SharedMemorySegment(bip::open_or_create,
+                                         params.name.c_str(),
+                                         params.max_cached_bytes);
+
+    // Atomic, only the first process constructs the bookkeeping.
+    arena->control = arena->segment.template find_or_construct<Control>("control")(
+        arena->segment.get_segment_manager()
+    );
+
+    if (arena->control->value_size != sizeof(value_type)) {
+        throw std::runtime_error(
+            "The shared subtree cache '" + params.name + "' holds a different index."
+        );
+    }
+}
+
+
+template <class Storage>
+template <class SubtreeID>
+inline auto
+SharedSubtreeCache<Storage>::load_subtree(const SubtreeID& subtree_id,
+                                          size_t /* query_count */) -> subtree_handle {
+    auto id = subtree_id.id;
+    auto& control = *arena->control;
+
+    size_t n_bytes = 0;
+    {
+        auto lock = lock_control(*arena);
+        if (auto subtree = wait_and_pin(id)) {
+            return subtree;
+        }
+
+        // It's cached, but every other subtree is pinned.
+        n_bytes = estimated_bytes(subtree_id.n_elements);
+        if (control.entries.count(id) != 0
+            || !begin_loading(id, /* pin = */ true, /* may_evict = */ true)) {
+            lock.unlock();
+            return load_private(id, n_bytes);
+        }
+    }
+
+    subtree_type* subtree = nullptr;
+    try {
+        subtree = load_into_segment(id, n_bytes, /* may_evict = */ true);
+    } catch (...) {
+        abort_loading(id);
+        throw;
+    }
+
+    if (subtree == nullptr) {
+        // Everything else is pinned.
+        abort_loading(id);
+        return load_private(id, n_bytes);
+    }
+
+    return finish_loading(id, subtree, /* pin = */ true);
+}
+
+
+template <class Storage>
+template <class SubtreeID>
+inline auto
+SharedSubtreeCache<Storage>::find_subtree(const SubtreeID& subtree_id,
+                                          size_t /* query_count */) -> subtree_handle {
+    auto& control = *arena->control;
+
+    auto lock = lock_control(*arena);
+    auto it = control.entries.find(subtree_id.id);
+    if (it == control.entries.end() || it->second.subtree == nullptr) {
+        return nullptr;
+    }
+
+    return pin(it->second, subtree_id.id);
+}
+
+
+template <class Storage>
+template <class SubtreeID>
+inline bool
+SharedSubtreeCache<Storage>::is_cached(const SubtreeID& subtree_id) {
+    auto& control = *arena->control;
+
+    auto lock = lock_control(*arena);
+    return control.entries.count(subtree_id.id) != 0;
+}
+
+
+template <class Storage>
+template <class SubtreeID>
+inline bool
+SharedSubtreeCache<Storage>::prefetch_subtree(const SubtreeID& subtree_id,
+                                              size_t /* query_count */) {
+    auto id = subtree_id.id;
+    auto& control = *arena->control;
+
+    size_t n_bytes = 0;
+    {
+        auto lock = lock_control(*arena);
+        if (control.entries.count(id) != 0) {
+            return false;
+        }
+
+        n_bytes = estimated_bytes(subtree_id.n_elements);
+        if (control.n_cached_bytes + n_bytes > arena->segment.get_size()) {
+            return false;
+        }
+
+        if (!begin_loading(id, /* pin = */ false, /* may_evict = */ false)) {
+            return false;
+        }
+    }
+
+    subtree_type* subtree = nullptr;
+    try {
+        subtree = load_into_segment(id, n_bytes, /* may_evict = */ false);
+    } catch (...) {
+        abort_loading(id);
+        throw;
+    }
+
+    if (subtree == nullptr) {
+        abort_loading(id);
+        return false;
+    }
+
+    finish_loading(id, subtree, /* pin = */ false);
+    return true;
+}
+
+
+template <class Storage>
+inline PrefetchStats
+SharedSubtreeCache<Storage>::prefetch_stats() const {
+    auto& control = *arena->control;
+
+    auto lock = lock_control(*arena);
+    return control.prefetch_stats;
+}
+
+
+template <class Storage>
+inline size_t
+SharedSubtreeCache<Storage>::cached_bytes() const {
+    auto& control = *arena->control;
+
+    auto lock = lock_control(*arena);
+    return control.n_cached_bytes;
+}
+
+
+template <class Storage>
+inline void
+SharedSubtreeCache<Storage>::remove(const std::string& name) {
+    bip::shared_memory_object::remove(name.c_str());
+}
+
+
+template <class Storage>
+inline auto
+SharedSubtreeCache<Storage>::lock_control(Arena& arena) -> lock_type {
+    auto lock = lock_type(arena.control->mutex);
+    repair_after_owner_died(*arena.control);
+    return lock;
+}
+
+
+template <class Storage>
+inline void
+SharedSubtreeCache<Storage>::repair_after_owner_died(Control& control) {
+    if (control.mutex.owner_died()) {
+        reclaim_dead_processes(control);
+    }
+}
+
+
+template <class Storage>
+inline bool
+SharedSubtreeCache<Storage>::reclaim_dead_processes(Control& control) {
+    bool reclaimed = false;
+
+    // The pins are ordered by process.
+    auto pin = control.pins.begin();
+    while (pin != control.pins.end()) {
+        auto pid = pin->first.first;
+        auto last = control.pins.upper_bound({pid, std::numeric_limits<size_t>::max()});
+        if (is_process_alive(pid)) {
+            pin = last;
+            continue;
+        }
+
+        while (pin != last) {
+            auto entry = control.entries.find(pin->first.second);
+            if (entry != control.entries.end()) {
+                entry->second.n_pins -= pin->second;
+            }
+            pin = control.pins.erase(pin);
+        }
+        reclaimed = true;
+    }
+
+    // The memory the loader allocated for the subtree is lost.
+    auto entry = control.entries.begin();
+    while (entry != control.entries.end()) {
+        if (entry->second.subtree == nullptr && !is_process_alive(entry->second.loader)) {
+            entry = control.entries.erase(entry);
+            reclaimed = true;
+        } else {
+            ++entry;
+        }
+    }
+
+    if (reclaimed) {
+        control.loaded.notify_all();
+    }
+
+    return reclaimed;
+}
+
+
+template <class Storage>
+inline auto
+SharedSubtreeCache<Storage>::wait_and_pin(size_t id) -> subtree_handle {
+    auto& control = *arena->control;
+
+    while (true) {
+        auto it = control.entries.find(id);
+        if (it == control.entries.end()) {
+            return nullptr;
+        }
+
+        if (it->second.subtree != nullptr) {
+            return pin(it->second, id);
+        }
+
+        // Another thread, or process, is loading it. If that process dies,
+        // nobody notifies us.
+        auto loader = it->second.loader;
+        control.loaded.wait_for(control.mutex, liveness_check_interval);
+        repair_after_owner_died(control);
+
+        if (!is_process_alive(loader)) {
+            reclaim_dead_processes(control);
+        }
+    }
+}
+
+
+template <class Storage>
+inline bool
+SharedSubtreeCache<Storage>::begin_loading(size_t id, bool pin, bool may_evict) {
+    auto& control = *arena->control;
+
+    auto entry = Entry{};
+    entry.loader = getpid();
+
+    while (true) {
+        try {
+            control.entries.emplace(id, entry);
+            if (pin) {
+                control.pins.emplace(PinKey{entry.loader, id}, 0);
+            }
+            return true;
+        } catch (const bip::bad_alloc&) {
+            if (!may_evict || !evict_one()) {
+                control.entries.erase(id);
+                return false;
+            }
+        }
+    }
+}
+
+
+template <class Storage>
+inline auto
+SharedSubtreeCache<Storage>::load_into_segment(size_t id, size_t n_bytes, bool may_evict)
+    -> subtree_type* {
+
+    auto& control = *arena->control;
+    auto& segment = arena->segment;
+
+    if (may_evict) {
+        auto lock = lock_control(*arena);
+        while (control.n_cached_bytes + n_bytes > segment.get_size() && evict_one()) {
+        }
+    }
+
+    // The estimate is only an average; and the free memory is fragmented.
+    while (true) {
+        subtree_type* subtree = nullptr;
+        try {
+            subtree = construct_subtree(segment);
+            storage.load_subtree_into(id, *subtree);
+            return subtree;
+        } catch (const bip::bad_alloc&) {
+            if (subtree != nullptr) {
+                segment.destroy_ptr(subtree);
+            }
+
+            auto lock = lock_control(*arena);
+            if (!may_evict || !evict_one()) {
+                return nullptr;
+            }
+        } catch (...) {
+            if (subtree != nullptr) {
+                segment.destroy_ptr(subtree);
+            }
+            throw;
+        }
+    }
+}
+
+
+template <class Storage>
+inline auto
+SharedSubtreeCache<Storage>::finish_loading(size_t id, subtree_type* subtree, bool pin)
+    -> subtree_handle {
+
+    auto& control = *arena->control;
+    auto n_bytes = detail::rtree_allocated_bytes(*subtree);
+
+    auto lock = lock_control(*arena);
+    auto& entry = control.entries.find(id)->second;
+    entry.subtree = subtree;
+    entry.bytes = n_bytes;
+    entry.last_used = ++control.clock;
+    entry.loader = 0;
+
+    control.n_cached_bytes += n_bytes;
+    control.n_read_bytes += n_bytes;
+    control.n_read_elements += subtree->size();
+    control.loaded.notify_all();
+
+    if (!pin) {
+        entry.unused_prefetch = true;
+        ++control.prefetch_stats.n_prefetched;
+        return nullptr;
+    }
+
+    // The pin was reserved by `begin_loading`, hence this doesn't fail.
+    return this->pin(entry, id);
+}
+
+
+template <class Storage>
+inline void
+SharedSubtreeCache<Storage>::abort_loading(size_t id) {
+    auto& control = *arena->control;
+
+    auto lock = lock_control(*arena);
+    control.entries.erase(id);
+    control.pins.erase(PinKey{getpid(), id});
+    control.loaded.notify_all();
+}
+
+
+template <class Storage>
+inline auto
+SharedSubtreeCache<Storage>::load_private(size_t id, size_t n_bytes) const
+    -> subtree_handle {
+
+    // Room for the bookkeeping of the heap, if the estimate is (close to) zero.
+    auto heap_size = std::max<size_t>(2 * n_bytes, 1ul << 16);
+
+    while (true) {
+        auto heap = std::make_shared<private_heap>(heap_size);
+        try {
+            auto subtree = construct_subtree(*heap);
+            storage.load_subtree_into(id, *subtree);
+
+            return subtree_handle(subtree, [heap](const subtree_type* subtree) {
+                heap->destroy_ptr(subtree);
+            });
+        } catch (const bip::bad_alloc&) {
+            heap_size *= 2;
+        }
+    }
+}
+
+
+template <class Storage>
+inline auto
+SharedSubtreeCache<Storage>::pin(Entry& entry, size_t id) -> subtree_handle {
+    auto& control = *arena->control;
+    auto pid = getpid();
+
+    // Recording the pin might need memory; `entry` itself isn't evicted.
+    while (true) {
+        try {
+            ++control.pins[PinKey{pid, id}];
+            break;
+        } catch (const bip::bad_alloc&) {
+            if (!evict_one(id)) {
+                return nullptr;
+            }
+        }
+    }
+
+    if (entry.unused_prefetch) {
+        entry.unused_prefetch = false;
+        ++control.prefetch_stats.n_hits;
+    }
+
+    ++entry.n_pins;
+    entry.last_used = ++control.clock;
+
+    return subtree_handle(entry.subtree.get(), [arena = arena, pid, id](const subtree_type*) {
+        unpin(*arena, pid, id);
+    });
+}
+
+
+template <class Storage>
+inline void
+SharedSubtreeCache<Storage>::unpin(Arena& arena, pid_t pid, size_t id) {
+    auto& control = *arena.control;
+
+    auto lock = lock_control(arena);
+    auto pin = control.pins.find(PinKey{pid, id});
+    if (pin != control.pins.end() && --pin->second == 0) {
+        control.pins.erase(pin);
+    }
+
+    auto it = control.entries.find(id);
+    if (it != control.entries.end()) {
+        --it->second.n_pins;
+        it->second.last_used = ++control.clock;
+    }
+}
+
+
+template <class Storage>
+inline bool
+SharedSubtreeCache<Storage>::evict_one(boost::optional<size_t> keep) {
+    auto& control = *arena->control;
+
+    auto select_victim = [&control, keep]() {
+        auto victim = control.entries.end();
+        for (auto it = control.entries.begin(); it != control.entries.end(); ++it) {
+            const auto& entry = it->second;
+            if (entry.subtree == nullptr || entry.n_pins != 0 || it->first == keep) {
+                continue;
+            }
+
+            if (victim == control.entries.end()) {
+                victim = it;
+                continue;
+            }
+
+            const auto& best = victim->second;
+            if (std::make_pair(!entry.unused_prefetch, entry.last_used)
+                < std::make_pair(!best.unused_prefetch, best.last_used)) {
+                victim = it;
+            }
+        }
+        return victim;
+    };
+
+    auto victim = select_victim();
+    if (victim == control.entries.end() && reclaim_dead_processes(control)) {
+        victim = select_victim();
+    }
+
+    if (victim == control.entries.end()) {
+        return false;
+    }
+
+    if (victim->second.unused_prefetch) {
+        ++control.prefetch_stats.n_wasted;
+    }
+
+    arena->segment.destroy_ptr(victim->second.subtree.get());
+    control.n_cached_bytes -= victim->second.bytes;
+    control.entries.erase(victim);
+
+    return true;
+}
+
+
+template <class Storage>
+inline size_t
+SharedSubtreeCache<Storage>::estimated_bytes(size_t n_elements) const {
+    const auto& control = *arena->control;
+    if (control.n_read_elements == 0) {
+        return 0;
+    }
+
+    return size_t(double(n_elements) * double(control.n_read_bytes)
+                  / double(control.n_read_elements));
+}
+
+
+template <class Storage>
+template <class Memory>
+inline auto
+SharedSubtreeCache<Storage>::construct_subtree(Memory& memory) -> subtree_type* {
+    auto allocator = SharedMemoryAllocator<value_type>(memory.get_segment_manager());
+
+    return memory.template construct<subtree_type>(bip::anonymous_instance)(
+        bgi::linear<16, 2>(),
+        bgi::indexable<value_type>(),
+        bgi::equal_to<value_type>(),
+        allocator
+    );
+}
+
+}  // namespace brain_indexer
@@ -91,6 +91,23 @@ void SerialSortTileRecursion<Value, GetCoordinate, dim>::apply(std::vector<Value
 }
 
 
+template <size_t dim, typename Value>
+inline CoordType get_centroid_coordinate(const Value& value) {
+    return value.template get_centroid_coord<dim>();
+}
+
+
+template<size_t dim, typename... VariantArgs>
+inline CoordType get_centroid_coordinate(boost::variant<VariantArgs...> const& value) {
+    return boost::apply_visitor(
+        [](const auto& value) {
+            return value.template get_centroid_coord<dim>();
+        },
+        value
+    );
+}
+
+
 template <typename Value, typename GetCoordinate>
 void serial_sort_tile_recursion(std::vector<Value>& values, const SerialSTRParams& str_params) {
 
@@ -0,0 +1,468 @@
+#pragma once
+
+#include "../spatial_join.hpp"
+
+#include <algorithm>
+#include <map>
+#include <type_traits>
+
+#include "output_iterators.hpp"
+
+namespace brain_indexer {
+namespace detail {
+
+// The shape of an element grown by `distance`, for `BestEffortGeometry`.
+inline Sphere grown_shape(const Point3D& point, CoordType distance) {
+    return Sphere{point, distance};
+}
+
+inline Sphere grown_shape(const Sphere& sphere, CoordType distance) {
+    return Sphere{sphere.centroid, sphere.radius + distance};
+}
+
+inline Cylinder grown_shape(const Cylinder& cylinder, CoordType distance) {
+    return Cylinder{cylinder.p1, cylinder.p2, cylinder.radius + distance};
+}
+
+inline Box3D grown_shape(const Box3D& box, CoordType distance) {
+    auto d = Point3Dx{distance, distance, distance};
+    return Box3D{Point3Dx(box.min_corner()) - d, Point3Dx(box.max_corner()) + d};
+}
+
+
+/** \brief Are `lhs` and `rhs` within `distance`, see `join_within`.
+ *
+ * This is only called for pairs whose bounding boxes are within `distance`.
+ */
+template <typename T, typename U>
+inline bool is_within(const T&, const U&, CoordType, BoundingBoxGeometry) {
+    return true;
+}
+
+template <typename T, typename U>
+inline bool is_within(const T& lhs, const U& rhs, CoordType distance, BestEffortGeometry geo) {
+    return geometry_intersects(grown_shape(lhs, distance), rhs, geo);
+}
+
+template <typename... VarT, typename U>
+inline bool is_within(const boost::variant<VarT...>& lhs,
+                      const U& rhs,
+                      CoordType distance,
+                      BestEffortGeometry geo) {
+    return boost::apply_visitor(
+        [&rhs, distance, geo](const auto& l) { return is_within(l, rhs, distance, geo); },
+        lhs);
+}
+
+template <typename T, typename U>
+inline bool is_within(const CachedBoxEntry<T>& lhs,
+                      const U& rhs,
+                      CoordType distance,
+                      BestEffortGeometry geo) {
+    return is_within(lhs.element(), rhs, distance, geo);
+}
+
+
+/** \brief Descends two R-Trees together, see `join_within`.
+ *
+ * Uses the internals of Boost.Geometry's R-Tree. Every task is a pair of
+ * nodes, one from each tree, whose boxes are within `distance`. Tasks are
+ * split into the pairs of children, until both nodes are leaves. For
+ * self-joins, `same` marks tasks where both nodes are the same node; only
+ * half of their children are paired.
+ */
+template <class RtreeA, class RtreeB>
+class DualTreeJoin {
+    template <class Rtree>
+    struct tree_types {
+        using members_holder =
+            typename bgi::detail::rtree::const_private_view<Rtree>::members_holder;
+        using node_pointer = typename members_holder::node_pointer;
+        using internal_node = typename members_holder::internal_node;
+        using leaf = typename members_holder::leaf;
+    };
+
+    using types_a = tree_types<RtreeA>;
+    using types_b = tree_types<RtreeB>;
+
+  public:
+    struct Task {
+        typename types_a::node_pointer lhs;
+        typename types_b::node_pointer rhs;
+        size_t lhs_level;
+        size_t rhs_level;
+        Box3D lhs_box;
+        Box3D rhs_box;
+        bool same;
+    };
+
+    inline DualTreeJoin(const RtreeA& lhs, const RtreeB& rhs, CoordType distance)
+        : lhs_(lhs)
+        , rhs_(rhs)
+        , distance_sq_(distance * distance) {}
+
+    /// \brief The root task, if both trees are non-empty.
+    inline std::vector<Task> root_tasks(bool self) const;
+
+    /// \brief Splits the tasks until there are at least `n_tasks` or only leaves.
+    inline std::vector<Task> split(std::vector<Task> tasks, size_t n_tasks) const;
+
+    /// \brief Calls `f(a, b)` for all pairs of values of `task` within `distance`.
+    template <class F>
+    inline void run(const Task& task, F& f) const;
+
+  private:
+    inline bool is_leaf_task(const Task& task) const {
+        return task.lhs_level == lhs_leafs_level() && task.rhs_level == rhs_leafs_level();
+    }
+
+    inline size_t lhs_leafs_level() const {
+        return bgi::detail::rtree::const_private_view<RtreeA>(lhs_).members().leafs_level;
+    }
+
+    inline size_t rhs_leafs_level() const {
+        return bgi::detail::rtree::const_private_view<RtreeB>(rhs_).members().leafs_level;
+    }
+
+    template <class BoxA, class BoxB>
+    inline bool is_near(const BoxA& a, const BoxB& b) const {
+        return bg::comparable_distance(a, b) <= distance_sq_;
+    }
+
+    /// \brief Calls `f(child_task)` for the pairs of children of `task`.
+    template <class F>
+    inline void for_each_child_task(const Task& task, F&& f) const;
+
+    const RtreeA& lhs_;
+    const RtreeB& rhs_;
+    CoordType distance_sq_;
+};
+
+
+template <class RtreeA, class RtreeB>
+inline auto DualTreeJoin<RtreeA, RtreeB>::root_tasks(bool self) const -> std::vector<Task> {
+    namespace bgid = bgi::detail::rtree;
+
+    if (lhs_.empty() || rhs_.empty()) {
+        return {};
+    }
+
+    auto lhs_box = Box3D(lhs_.bounds());
+    auto rhs_box = Box3D(rhs_.bounds());
+    if (!is_near(lhs_box, rhs_box)) {
+        return {};
+    }
+
+    return {Task{bgid::const_private_view<RtreeA>(lhs_).members().root,
+                 bgid::const_private_view<RtreeB>(rhs_).members().root,
+                 0,
+                 0,
+                 lhs_box,
+                 rhs_box,
+                 self}};
+}
+
+
+template <class RtreeA, class RtreeB>
+inline auto DualTreeJoin<RtreeA, RtreeB>::split(std::vector<Task> tasks, size_t n_tasks) const
+    -> std::vector<Task> {
+    auto is_leaf_task = [this](const Task& task) { return this->is_leaf_task(task); };
+
+    while (tasks.size() < n_tasks && !std::all_of(tasks.begin(), tasks.end(), is_leaf_task)) {
+        std::vector<Task> children;
+        for (const auto& task : tasks) {
+            if (is_leaf_task(task)) {
+                children.push_back(task);
+            } else {
+                for_each_child_task(task, [&children](const Task& child) {
+                    children.push_back(child);
+                });
+            }
+        }
+        tasks = std::move(children);
+    }
+
+    return tasks;
+}
+
+
+template <class RtreeA, class RtreeB>
+template <class F>
+inline void DualTreeJoin<RtreeA, RtreeB>::for_each_child_task(const Task& task, F&& f) const {
+    namespace bgid = bgi::detail::rtree;
+
+    auto lhs_is_leaf = task.lhs_level == lhs_leafs_level();
+    auto rhs_is_leaf = task.rhs_level == rhs_leafs_level();
+
+    if (!lhs_is_leaf && !rhs_is_leaf) {
+        const auto& lhs_children =
+            bgid::elements(bgid::get<typename types_a::internal_node>(*task.lhs));
+        const auto& rhs_children =
+            bgid::elements(bgid::get<typename types_b::internal_node>(*task.rhs));
+
+        for (size_t i = 0; i < lhs_children.size(); ++i) {
+            const auto& a = lhs_children[i];
+            for (size_t j = task.same ? i : 0; j < rhs_children.size(); ++j) {
+                const auto& b = rhs_children[j];
+                if (is_near(a.first, b.first)) {
+                    f(Task{a.second, b.second,
+                           task.lhs_level + 1, task.rhs_level + 1,
+                           Box3D(a.first), Box3D(b.first),
+                           task.same && i == j});
+                }
+            }
+        }
+    } else if (!lhs_is_leaf) {
+        const auto& lhs_children =
+            bgid::elements(bgid::get<typename types_a::internal_node>(*task.lhs));
+        for (const auto& a : lhs_children) {
+            if (is_near(a.first, task.rhs_box)) {
+                f(Task{a.second, task.rhs,
+                       task.lhs_level + 1, task.rhs_level,
+                       Box3D(a.first), task.rhs_box,
+                       false});
+            }
+        }
+    } else {
+        const auto& rhs_children =
+            bgid::elements(bgid::get<typename types_b::internal_node>(*task.rhs));
+        for (const auto& b : rhs_children) {
+            if (is_near(task.lhs_box, b.first)) {
+                f(Task{task.lhs, b.second,
+                       task.lhs_level, task.rhs_level + 1,
+                       task.lhs_box, Box3D(b.first),
+                       false});
+            }
+        }
+    }
+}
+
+
+template <class RtreeA, class RtreeB>
+template <class F>
+inline void DualTreeJoin<RtreeA, RtreeB>::run(const Task& task, F& f) const {
+    namespace bgid = bgi::detail::rtree;
+
+    if (!is_leaf_task(task)) {
+        for_each_child_task(task, [this, &f](const Task& child) { run(child, f); });
+        return;
+    }
+
+    const auto& lhs_members = bgid::const_private_view<RtreeA>(lhs_).members();
+    const auto& rhs_members = bgid::const_private_view<RtreeB>(rhs_).members();
+
+    const auto& lhs_values = bgid::elements(bgid::get<typename types_a::leaf>(*task.lhs));
+    const auto& rhs_values = bgid::elements(bgid::get<typename types_b::leaf>(*task.rhs));
+
+    for (size_t i = 0; i < lhs_values.size(); ++i) {
+        const auto& a = lhs_values[i];
+        const auto& a_indexable = lhs_members.translator()(a);
+        for (size_t j = task.same ? i + 1 : 0; j < rhs_values.size(); ++j) {
+            const auto& b = rhs_values[j];
+            if (is_near(a_indexable, rhs_members.translator()(b))) {
+                f(a, b);
+            }
+        }
+    }
+}
+
+
+template <typename T, typename U>
+using join_result_for = join_result<typename id_getter_for<T>::type::value_type,
+                                    typename id_getter_for<U>::type::value_type>;
+
+/// \brief Appends the pairs of `tasks` within `distance` to `result`.
+template <typename GeometryMode, typename T, typename U, typename Join, typename Tasks>
+inline void run_join_tasks(const Join& join,
+                           const Tasks& tasks,
+                           CoordType distance,
+                           join_result_for<T, U>& result) {
+    auto lhs_ids = typename id_getter_for<T>::type(result.lhs_ids);
+    auto rhs_ids = typename id_getter_for<U>::type(result.rhs_ids);
+    auto emit = [&](const T& a, const U& b) {
+        if (is_within(a, b, distance, GeometryMode{})) {
+            *lhs_ids = a;
+            *rhs_ids = b;
+        }
+    };
+
+    for (const auto& task : tasks) {
+        join.run(task, emit);
+    }
+}
+
+/// \brief Joins two R-Trees, on `n_threads` of `pool`.
+template <typename GeometryMode, typename T, typename U, typename RtreeA, typename RtreeB>
+inline void join_trees(const RtreeA& lhs,
+                       const RtreeB& rhs,
+                       CoordType distance,
+                       bool self,
+                       ThreadPool& pool,
+                       size_t n_threads,
+                       join_result_for<T, U>& result) {
+    auto join = DualTreeJoin<RtreeA, RtreeB>(lhs, rhs, distance);
+    auto tasks = join.root_tasks(self);
+
+    if (n_threads <= 1) {
+        run_join_tasks<GeometryMode, T, U>(join, tasks, distance, result);
+        return;
+    }
+
+    // More tasks than threads, since the number of pairs varies a lot.
+    tasks = join.split(std::move(tasks), 8 * n_threads);
+
+    auto n_tasks = tasks.size();
+    auto n_chunks = std::min(n_tasks, 8 * n_threads);
+    std::vector<join_result_for<T, U>> chunks(n_chunks);
+
+    parallel_for(pool, n_chunks, n_threads, [&](size_t k) {
+        auto range = util::balanced_chunks(n_tasks, n_chunks, k);
+        auto chunk_tasks = std::vector<typename DualTreeJoin<RtreeA, RtreeB>::Task>(
+            tasks.begin() + std::ptrdiff_t(range.low),
+            tasks.begin() + std::ptrdiff_t(range.high)
+        );
+        run_join_tasks<GeometryMode, T, U>(join, chunk_tasks, distance, chunks[k]);
+    });
+
+    // Concatenate the chunks in order.
+    for (const auto& chunk : chunks) {
+        result.lhs_ids.insert(result.lhs_ids.end(), chunk.lhs_ids.begin(), chunk.lhs_ids.end());
+        result.rhs_ids.insert(result.rhs_ids.end(), chunk.rhs_ids.begin(), chunk.rhs_ids.end());
+    }
+}
+
+/// \brief Joins two multi indexes, or a multi index with itself if `self`.
+template <typename GeometryMode, typename T, typename C, typename U, typename D>
+inline auto join_multi_index(const MultiIndexTree<T, C>& lhs,
+                             const MultiIndexTree<U, D>& rhs,
+                             CoordType distance,
+                             bool self,
+                             ThreadPool& pool,
+                             size_t n_threads) {
+    // Pairs of subtrees, grouped by the subtree of `lhs`.
+    std::map<size_t, std::vector<IndexedSubtreeBox>> subtree_pairs;
+    std::map<size_t, IndexedSubtreeBox> lhs_subtrees;
+
+    auto top_join = DualTreeJoin<MultiIndexTopTreeT, MultiIndexTopTreeT>(
+        lhs.top_tree(), rhs.top_tree(), distance
+    );
+
+    auto add_pair = [&](const IndexedSubtreeBox& a, const IndexedSubtreeBox& b) {
+        lhs_subtrees.emplace(a.id, a);
+        subtree_pairs[a.id].push_back(b);
+    };
+
+    for (const auto& task : top_join.root_tasks(self)) {
+        top_join.run(task, add_pair);
+    }
+
+    // The self-join of the top-level tree doesn't pair a subtree with itself.
+    if (self) {
+        for (const auto& subtree : lhs.top_tree()) {
+            lhs_subtrees.emplace(subtree.id, subtree);
+            subtree_pairs[subtree.id].push_back(subtree);
+        }
+    }
+
+    join_result_for<T, U> result;
+    for (const auto& kv : subtree_pairs) {
+        util::check_signals();
+
+        // The handle keeps the subtree alive, even if loading a subtree of
+        // `rhs` evicts it from the cache.
+        const auto lhs_subtree = lhs.load_subtree(lhs_subtrees.at(kv.first));
+        for (const auto& rhs_box : kv.second) {
+            auto is_same = self && rhs_box.id == kv.first;
+            if (is_same) {
+                join_trees<GeometryMode, T, U>(
+                    *lhs_subtree, *lhs_subtree, distance, true, pool, n_threads, result
+                );
+            } else {
+                const auto rhs_subtree = rhs.load_subtree(rhs_box);
+                join_trees<GeometryMode, T, U>(
+                    *lhs_subtree, *rhs_subtree, distance, false, pool, n_threads, result
+                );
+            }
+        }
+    }
+
+    return result;
+}
+
+}  // namespace detail
+
+
+template <typename GeometryMode, typename T, typename A, typename U, typename B>
+inline auto join_within(const IndexTree<T, A>& lhs,
+                        const IndexTree<U, B>& rhs,
+                        CoordType distance) {
+    detail::join_result_for<T, U> result;
+    detail::join_trees<GeometryMode, T, U>(
+        static_cast<const IndexTreeBaseT<T, A>&>(lhs),
+        static_cast<const IndexTreeBaseT<U, B>&>(rhs),
+        distance, false, ThreadPool::global(), 1, result
+    );
+    return result;
+}
+
+
+template <typename GeometryMode, typename T, typename A, typename U, typename B>
+inline auto join_within(const IndexTree<T, A>& lhs,
+                        const IndexTree<U, B>& rhs,
+                        CoordType distance,
+                        ThreadPool& pool,
+                        size_t n_threads) {
+    detail::join_result_for<T, U> result;
+    detail::join_trees<GeometryMode, T, U>(
+        static_cast<const IndexTreeBaseT<T, A>&>(lhs),
+        static_cast<const IndexTreeBaseT<U, B>&>(rhs),
+        distance, false, pool, n_threads, result
+    );
+    return result;
+}
+
+
+template <typename GeometryMode, typename T, typename A>
+inline auto join_within(const IndexTree<T, A>& index, CoordType distance) {
+    const auto& rtree = static_cast<const IndexTreeBaseT<T, A>&>(index);
+
+    detail::join_result_for<T, T> result;
+    detail::join_trees<GeometryMode, T, T>(
+        rtree, rtree, distance, true, ThreadPool::global(), 1, result
+    );
+    return result;
+}
+
+
+template <typename GeometryMode, typename T, typename A>
+inline auto join_within(const IndexTree<T, A>& index,
+                        CoordType distance,
+                        ThreadPool& pool,
+                        size_t n_threads) {
+    const auto& rtree = static_cast<const IndexTreeBaseT<T, A>&>(index);
+
+    detail::join_result_for<T, T> result;
+    detail::join_trees<GeometryMode, T, T>(rtree, rtree, distance, true, pool, n_threads, result);
+    return result;
+}
+
+
+template <typename GeometryMode, typename T, typename C, typename U, typename D>
+inline auto join_within(const MultiIndexTree<T, C>& lhs,
+                        const MultiIndexTree<U, D>& rhs,
+                        CoordType distance,
+                        ThreadPool& pool,
+                        size_t n_threads) {
+    return detail::join_multi_index<GeometryMode>(lhs, rhs, distance, false, pool, n_threads);
+}
+
+
+template <typename GeometryMode, typename T, typename C>
+inline auto join_within(const MultiIndexTree<T, C>& index,
+                        CoordType distance,
+                        ThreadPool& pool,
+                        size_t n_threads) {
+    return detail::join_multi_index<GeometryMode>(index, index, distance, true, pool, n_threads);
+}
+
+}  // namespace brain_indexer
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "../thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+
+namespace brain_indexer {
+
+inline ThreadPool::ThreadPool(size_t n_threads) {
+    n_threads = std::max(n_threads, size_t(1));
+
+    workers_.reserve(n_threads);
+    for (size_t i = 0; i < n_threads; ++i) {
+        workers_.emplace_back([this]() { work(); });
+    }
+}
+
+
+inline ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+
+template <class F>
+inline std::future<std::invoke_result_t<F>> ThreadPool::submit(F&& f) {
+    using result_t = std::invoke_result_t<F>;
+
+    // `std::function` must be copyable, `std::packaged_task` isn't.
+    auto task = std::make_shared<std::packaged_task<result_t()>>(std::forward<F>(f));
+    auto future = task->get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            throw std::runtime_error("Can't submit tasks to a stopping thread pool.");
+        }
+        tasks_.emplace([task]() { (*task)(); });
+    }
+    cv_.notify_one();
+
+    return future;
+}
+
+
+inline ThreadPool& ThreadPool::global() {
+    static ThreadPool pool(std::thread::hardware_concurrency());
+    return pool;
+}
+
+
+inline void ThreadPool::work() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+
+            if (tasks_.empty()) {
+                return;
+            }
+
+            task = std::move(tasks_.front());
+            tasks_.pop();
+        }
+
+        task();
+    }
+}
+
+
+template <class F>
+inline void parallel_for(ThreadPool& pool, size_t n_tasks, size_t n_threads, F&& f) {
+    if (n_threads <= 1 || n_tasks <= 1) {
+        for (size_t k = 0; k < n_tasks; ++k) {
+            f(k);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next_task{0};
+    std::atomic<bool> failed{false};
+
+    auto worker = [&]() {
+        for (size_t k = next_task++; k < n_tasks && !failed; k = next_task++) {
+            try {
+                f(k);
+            } catch (...) {
+                failed = true;
+                throw;
+            }
+        }
+    };
+
+    auto n_workers = std::min(n_threads, n_tasks);
+    std::vector<std::future<void>> futures;
+    futures.reserve(n_workers);
+    for (size_t i = 0; i < n_workers; ++i) {
+        futures.push_back(pool.submit(worker));
+    }
+
+    // Wait for every worker before rethrowing, they reference this frame.
+    std::exception_ptr error = nullptr;
+    for (auto& future : futures) {
+        try {
+            future.get();
+        } catch (...) {
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+}  // namespace brain_indexer
@@ -0,0 +1,295 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+
+namespace brain_indexer {
+
+/** \brief The meta data required to compute usage rate.
+ *
+ * The assumption is that there's a global query counter. It increases on
+ * every query of the spatial index.
+ *
+ * The current value query counter at time of loading the subtree is stored as
+ * the `load_generation`. The `current_access_count` is increased everytime
+ * the subtree is requested.
+ *
+ * On eviction `previous_*` are increased such that they reflect the historic usage
+ * rate.
+ */
+class UsageRateMetaData {
+  public:
+    double usage_rate(size_t query_count) const;
+    size_t access_count() const;
+    size_t eviction_count() const;
+    size_t incache_count(size_t query_count) const;
+
+    /// \brief The number of bytes the subtree occupied when it was last loaded.
+    size_t bytes() const {
+        return bytes_;
+    }
+
+    /// \brief The time it took to load the subtree, in seconds.
+    double load_seconds() const {
+        return load_seconds_;
+    }
+
+
+    /// \brief To be called every time the subtree is queries while residing cache.
+    inline void on_query();
+
+    /// \brief To be called every time the subtree is loaded into cache.
+    inline void on_load(size_t query_count);
+
+    /// \brief To be called immediately before evicting the subtree.
+    inline void on_evict(size_t query_count);
+
+    /// \brief To be called after `on_load` if the subtree was prefetched.
+    inline void on_prefetch();
+
+    /// \brief To be called once the subtree has been read from disk.
+    inline void on_read(size_t bytes, double load_seconds);
+
+    /// \brief Was the subtree prefetched, and not queried since?
+    inline bool is_unused_prefetch() const;
+
+  private:
+    size_t load_generation_ = 0;
+    size_t current_access_count_ = 0;
+
+    size_t previous_access_count_ = 0;
+    size_t previous_age_ = 0;
+
+    size_t eviction_count_ = 0;
+
+    size_t bytes_ = 0;
+    double load_seconds_ = 0.0;
+
+    bool unused_prefetch_ = false;
+};
+
+
+/** \brief Decides which subtree of a `UsageRateCache` is evicted next.
+ *
+ * The cache informs the policy about every subtree entering, being used
+ * and leaving the cache. Events for subtrees the policy doesn't hold, e.g.
+ * because they've been removed already, are ignored.
+ *
+ * Policies aren't thread-safe, the cache serializes all calls. The meta data
+ * passed to `on_insert` is the cache's own; the policy may keep a reference
+ * to it until `on_remove`. While the policy holds the subtree, the cache only
+ * modifies the meta data with the calls to the policy serialized.
+ */
+class EvictionPolicy {
+  public:
+    virtual ~EvictionPolicy() = default;
+
+    /** \brief The subtree `id` entered the cache.
+     *
+     * \param md  The usage of the subtree, including its size, the time it
+     *            took to load and whether it was prefetched.
+     */
+    virtual void on_insert(size_t id, const UsageRateMetaData& md, size_t query_count) = 0;
+
+    /// \brief The cached subtree `id` is used by a query.
+    virtual void on_access(size_t id, size_t query_count) = 0;
+
+    /// \brief The subtree `id` was evicted from the cache.
+    virtual void on_remove(size_t id, size_t query_count) = 0;
+
+    /** \brief The subtree that should be evicted next.
+     *
+     * The subtree remains part of the policy until `on_remove` is called.
+     * Returns `boost::none` if the policy holds no subtrees.
+     */
+    virtual boost::optional<size_t> select_victim(size_t query_count) = 0;
+};
+
+
+/** \brief Evicts the subtree with the lowest usage rate.
+ *
+ * See `UsageRateMetaData`, the usage rate is read from the meta data the
+ * cache keeps anyway. Since the usage rate of every subtree changes with each
+ * query, there's no fixed order; the victim is found by a linear scan over
+ * the cached subtrees.
+ */
+class UsageRatePolicy : public EvictionPolicy {
+  public:
+    inline void on_insert(size_t id, const UsageRateMetaData& md, size_t query_count) override;
+
+    inline void on_access(size_t id, size_t query_count) override;
+    inline void on_remove(size_t id, size_t query_count) override;
+    inline boost::optional<size_t> select_victim(size_t query_count) override;
+
+  private:
+    std::unordered_map<size_t, const UsageRateMetaData*> cached_;
+};
+
+
+/// \brief Evicts the least recently used subtree.
+class LRUPolicy : public EvictionPolicy {
+  public:
+    inline void on_insert(size_t id, const UsageRateMetaData& md, size_t query_count) override;
+
+    inline void on_access(size_t id, size_t query_count) override;
+    inline void on_remove(size_t id, size_t query_count) override;
+    inline boost::optional<size_t> select_victim(size_t query_count) override;
+
+  private:
+    // The most recently used subtree is at the front.
+    std::list<size_t> recency_;
+    std::unordered_map<size_t, std::list<size_t>::iterator> position_;
+};
+
+
+/** \brief The CLOCK, or second chance, approximation of LRU.
+ *
+ * Every subtree has a reference bit, which is set when it's used. The hand
+ * sweeps over the subtrees, clearing the bits, until it finds one that isn't
+ * set. Unlike LRU, a use of a subtree doesn't reorder anything.
+ */
+class ClockPolicy : public EvictionPolicy {
+  public:
+    inline void on_insert(size_t id, const UsageRateMetaData& md, size_t query_count) override;
+
+    inline void on_access(size_t id, size_t query_count) override;
+    inline void on_remove(size_t id, size_t query_count) override;
+    inline boost::optional<size_t> select_victim(size_t query_count) override;
+
+  private:
+    struct Slot {
+        size_t id = 0;
+        bool referenced = false;
+        bool occupied = false;
+    };
+
+    std::vector<Slot> slots_;
+    std::vector<size_t> free_slots_;
+    std::unordered_map<size_t, size_t> slot_of_;
+    size_t hand_ = 0;
+};
+
+
+/** \brief Adaptive Replacement Cache.
+ *
+ * Subtrees used once are kept in `T1`, those used repeatedly in `T2`. The
+ * recently evicted subtrees of each are remembered in the ghost lists `B1` and
+ * `B2`. When a ghost is loaded again, the target size of `T1` is adapted in
+ * favour of the list it was evicted from. Hence, the policy balances between
+ * recency and frequency, e.g. a single sweep through the index doesn't evict
+ * the subtrees that are used over and over.
+ *
+ * The lists count subtrees, rather than bytes; the ghost lists remember at
+ * most as many subtrees as are cached.
+ */
+class ARCPolicy : public EvictionPolicy {
+  public:
+    inline void on_insert(size_t id, const UsageRateMetaData& md, size_t query_count) override;
+
+    inline void on_access(size_t id, size_t query_count) override;
+    inline void on_remove(size_t id, size_t query_count) override;
+    inline boost::optional<size_t> select_victim(size_t query_count) override;
+
+  private:
+    enum ListID { t1 = 0, t2 = 1, b1 = 2, b2 = 3 };
+
+    struct Entry {
+        ListID list;
+        std::list<size_t>::iterator position;
+    };
+
+    /// \brief Moves `id` to the front of `list`.
+    inline void move_to(size_t id, ListID list);
+
+    inline void erase(size_t id);
+
+    inline size_t n_cached() const {
+        return lists_[t1].size() + lists_[t2].size();
+    }
+
+    /// \brief Forgets the oldest ghosts exceeding the capacity of the ghost lists.
+    inline void trim_ghosts();
+
+    // In every list, the most recent subtree is at the front.
+    std::list<size_t> lists_[4];
+    std::unordered_map<size_t, Entry> entries_;
+
+    // The target size of `T1`.
+    double p_ = 0.0;
+};
+
+
+/** \brief Evicts the subtree that's cheapest to load again, per byte.
+ *
+ * This is GreedyDual-Size-Frequency: every subtree has the priority
+ *
+ *     H = L + frequency * load_seconds / bytes,
+ *
+ * and the one with the lowest `H` is evicted. `L` is raised to the priority
+ * of every removed subtree; hence subtrees which aren't used lose their advantage over
+ * time. Large subtrees that load quickly are evicted before small subtrees that
+ * take long to load, e.g. because of their position on disk.
+ *
+ * The subtrees are kept ordered by priority, i.e. all operations are
+ * logarithmic.
+ */
+class CostAwarePolicy : public EvictionPolicy {
+  public:
+    inline void on_insert(size_t id, const UsageRateMetaData& md, size_t query_count) override;
+
+    inline void on_access(size_t id, size_t query_count) override;
+    inline void on_remove(size_t id, size_t query_count) override;
+    inline boost::optional<size_t> select_victim(size_t query_count) override;
+
+  private:
+    struct Entry {
+        double priority;
+        double cost_per_byte;
+        size_t frequency;
+    };
+
+    inline void set_priority(size_t id, Entry& entry);
+
+    std::set<std::pair<double, size_t>> by_priority_;
+    std::unordered_map<size_t, Entry> entries_;
+    double inflation_ = 0.0;
+};
+
+
+/// \brief The eviction policies available to `UsageRateCache`.
+enum class EvictionPolicyKind {
+    /// See `UsageRatePolicy`.
+    usage_rate,
+
+    /// See `LRUPolicy`.
+    lru,
+
+    /// See `ClockPolicy`.
+    clock,
+
+    /// See `ARCPolicy`.
+    arc,
+
+    /// See `CostAwarePolicy`.
+    cost_aware
+};
+
+/// \brief Creates a new, empty, eviction policy of kind `kind`.
+inline std::unique_ptr<EvictionPolicy> make_eviction_policy(EvictionPolicyKind kind);
+
+/** \brief The policy with name `name`.
+ *
+ * The names are those of the enumerators, e.g. `"lru"` or `"cost_aware"`.
+ */
+inline EvictionPolicyKind eviction_policy_kind(const std::string& name);
+
+}  // namespace brain_indexer
+
+#include "detail/eviction_policy.hpp"
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 #include <boost/serialization/serialization.hpp>
 
 #include "point3d.hpp"
@@ -224,6 +226,43 @@ struct Cylinder {
     }
 };
 
+/**
+ * \brief A path of segments with a radius, i.e. a chain of capsules.
+ *
+ * The shape is the set of all points within `radius` of the path through
+ * `points`, i.e. the union of the capsules around every segment. A capsule is
+ * a polyline with two points. Polylines are meant as query shapes; they must
+ * consist of at least one point.
+ */
+struct Polyline {
+    using box_type = Box3D;
+
+    std::vector<Point3D> points;
+    CoordType radius;
+
+    Polyline() = default;
+    inline Polyline(std::vector<Point3D> points, CoordType radius)
+        : points(std::move(points)), radius(radius) {}
+
+    /// \brief The number of segments, a single point is a segment of length zero.
+    inline size_t n_segments() const noexcept {
+        return points.size() <= 1 ? points.size() : points.size() - 1;
+    }
+
+    /// \brief The `i`-th segment, as a capsule.
+    inline Cylinder segment(size_t i) const {
+        return Cylinder(points[i], points[std::min(i + 1, points.size() - 1)], radius);
+    }
+
+    inline Box3D bounding_box() const;
+
+    /// The predicates are true if any of the segments intersects the shape.
+    inline bool intersects(Box3D const& b) const;
+    inline bool intersects(Sphere const& s) const;
+    inline bool intersects(Cylinder const& c) const;
+    inline bool intersects(Point3D const& p) const;
+};
+
 inline CoordType characteristic_length(const Sphere &sph) {
     return 2*sph.radius;
 }
@@ -278,7 +317,7 @@ inline bool geometry_intersects(const Box3D& query_shape, const Point3D& element
 
 template <class QueryShape,
           class ElementShape,
-          std::enable_if_t<shape_matches_any_of<QueryShape, Sphere, Cylinder>() &&
+          std::enable_if_t<shape_matches_any_of<QueryShape, Sphere, Cylinder, Polyline>() &&
                                shape_matches_any_of<ElementShape, Point3D, Box3D>(),
                            int> SFINAE = 0>
 inline bool geometry_intersects(const QueryShape& query_shape,
@@ -289,7 +328,7 @@ inline bool geometry_intersects(const QueryShape& query_shape,
 
 template <class QueryShape,
           class ElementShape,
-          std::enable_if_t<shape_matches_any_of<QueryShape, Box3D, Sphere, Cylinder>() &&
+          std::enable_if_t<shape_matches_any_of<QueryShape, Box3D, Sphere, Cylinder, Polyline>() &&
                                shape_matches_any_of<ElementShape, Sphere, Cylinder>(),
                            int> SFINAE = 0>
 inline bool geometry_intersects(const QueryShape& query_shape,
@@ -312,7 +351,7 @@ inline bool geometry_intersects(const Box3D& query_shape,
 template <
     class QueryShape,
     class ElementShape,
-    std::enable_if_t<shape_matches_any_of<QueryShape, Sphere, Cylinder>() &&
+    std::enable_if_t<shape_matches_any_of<QueryShape, Sphere, Cylinder, Polyline>() &&
                          shape_matches_any_of<ElementShape, Point3D, Box3D, Sphere, Cylinder>(),
                      int> SFINAE = 0>
 inline bool geometry_intersects(const QueryShape& query_shape,
@@ -321,9 +360,27 @@ inline bool geometry_intersects(const QueryShape& query_shape,
     return query_shape.intersects(element_shape);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Exact Distance
+///////////////////////////////////////////////////////////////////////////////
+
+/** \brief The distance between `point` and the element, zero if it's inside.
+ *
+ * Unlike `bgi::nearest`, which ranks elements by the distance to their
+ * bounding box, this is the distance to the shape itself. Cylinders are
+ * cylinders with flat caps, i.e. the same shape as `Cylinder::contains`.
+ * Therefore, the distance is never less than the distance to the bounding box
+ * of the element.
+ */
+inline CoordType geometry_distance(const Point3D& point, const Point3D& element_shape);
+inline CoordType geometry_distance(const Point3D& point, const Box3D& element_shape);
+inline CoordType geometry_distance(const Point3D& point, const Sphere& element_shape);
+inline CoordType geometry_distance(const Point3D& point, const Cylinder& element_shape);
+
 
 inline std::ostream& operator<<(std::ostream& os, const Sphere& s);
 inline std::ostream& operator<<(std::ostream& os, const Cylinder& c);
+inline std::ostream& operator<<(std::ostream& os, const Polyline& p);
 
 }  // namespace brain_indexer
 
@@ -3,6 +3,7 @@
 #ifndef BOOST_GEOMETRY_INDEX_DETAIL_EXPERIMENTAL
 #error "BrainIndexer requires definition BOOST_GEOMETRY_INDEX_DETAIL_EXPERIMENTAL"
 #endif
+#include <cstdint>
 #include <cstdio>
 #include <functional>
 #include <iostream>
@@ -22,6 +23,7 @@
 #include <brain_indexer/geometries.hpp>
 #include <brain_indexer/util.hpp>
 #include <brain_indexer/logging.hpp>
+#include <brain_indexer/thread_pool.hpp>
 #include <brain_indexer/version.hpp>
 
 namespace brain_indexer {
@@ -71,6 +73,23 @@ struct iter_gid_segm_getter;
 template<typename Element>
 struct iter_entry_getter;
 
+/** \brief Selects which columns of a query result are filled.
+ *
+ * Bit `i` selects the `i`-th column of `detail::query_result<T>::fields()`,
+ * see `detail::make_field_mask` to create a mask from the names of columns.
+ */
+using field_mask_t = std::uint32_t;
+
+/// \brief The mask which selects all columns.
+constexpr field_mask_t all_fields = ~field_mask_t(0);
+
+/// \brief The key by which `count_intersecting_grouped` groups synapses.
+enum class GroupBy {
+    post_gid,
+    pre_gid,
+    pre_post_gid
+};
+
 /**
  * \brief ShapeId adds an 'id' field to the underlying struct
  */
@@ -276,6 +295,56 @@ class Synapse : public IndexedShape<Sphere, SynapseId> {
 };
 
 
+/**
+ * \brief A synapse which is only a point.
+ *
+ * Synapses are indexed with a radius of zero. `Synapse` nevertheless stores a
+ * `Sphere`, computes its bounding box from the radius and is tested with
+ * sphere predicates. The bounding box of a `PointSynapse` is the degenerate
+ * box `{p, p}` and the queries use point predicates. Therefore, an index of
+ * `PointSynapse` returns the same synapses as one of `Synapse` with radius
+ * zero.
+ *
+ * Note: because of the alignment of the ids, the element still takes 40 bytes.
+ */
+class PointSynapse : public IndexedShape<Point3D, SynapseId> {
+    using super = IndexedShape<Point3D, SynapseId>;
+
+  public:
+    PointSynapse() = default;
+
+    // Deprecate and rework: historically everything needs to be able to pretend
+    // to be a sphere.
+    inline PointSynapse(identifier_t id, Point3D const& point, CoordType) noexcept
+        : super(super::id_type{id}, super::geometry_type{point}) { }
+
+    inline PointSynapse(identifier_t id,
+                        identifier_t post_gid,
+                        identifier_t pre_gid,
+                        Point3D const& point) noexcept
+        : super(super::id_type{id, post_gid, pre_gid}, super::geometry_type{point}) { }
+
+    inline const Point3D& get_centroid() const noexcept {
+        return *this;
+    }
+
+    template <size_t dim>
+    inline CoordType get_centroid_coord() const noexcept {
+        return this->template get<dim>();
+    }
+
+  private:
+    friend class boost::serialization::access;
+
+    template <class Archive>
+    void serialize(Archive& ar, const unsigned int version) {
+        if(version == 0) { throw std::runtime_error("Invalid version 0 for PointSynapse."); }
+
+        ar & boost::serialization::base_object<super>(*this);
+    }
+};
+
+
 class Soma: public IndexedShape<Sphere, MorphPartId> {
     using super = IndexedShape<Sphere, MorphPartId>;
 
@@ -463,6 +532,70 @@ typedef boost::variant<Sphere, Cylinder> GeometryEntry;
 typedef boost::variant<Soma, Segment> MorphoEntry;
 
 
+/**
+ * \brief An index element which stores its bounding box next to the payload.
+ *
+ * The R-Tree needs the bounding box of an element every time a leaf is
+ * visited. For cylinders, computing it involves a `sqrt` per axis and for
+ * variants it additionally goes through `boost::apply_visitor`. Wrapping the
+ * element type, e.g. `IndexTree<CachedBoxEntry<MorphoEntry>>`, trades 24 bytes
+ * per element for leaf checks that are pure box-box tests.
+ *
+ * The wrapper derives from `T`, all accessors of the element are available.
+ * Only elements with a `bounding_box()` are supported, i.e. not points.
+ */
+template <typename T>
+class CachedBoxEntry : public T {
+  public:
+    using element_type = T;
+
+    inline CachedBoxEntry() = default;
+
+    /// \brief Implicitly wraps anything `T` can be constructed from, e.g. a `Soma`.
+    template <typename U,
+              std::enable_if_t<std::is_constructible<T, U&&>::value &&
+                                   !std::is_same<std::decay_t<U>, CachedBoxEntry>::value,
+                               int> SFINAE = 0>
+    inline CachedBoxEntry(U&& element)
+        : T(std::forward<U>(element))
+        , box_(compute_bounding_box()) {}
+
+    /// \brief The cached bounding box, computed when the entry was created.
+    inline const Box3D& bounding_box() const noexcept {
+        return box_;
+    }
+
+    inline const T& element() const noexcept {
+        return static_cast<const T&>(*this);
+    }
+
+  private:
+    inline Box3D compute_bounding_box() const;
+
+    Box3D box_;
+
+    friend class boost::serialization::access;
+
+    // The box isn't stored, it's recomputed when loading.
+    template <class Archive>
+    void save(Archive& ar, const unsigned int /*version*/) const {
+        ar << boost::serialization::base_object<T>(*this);
+    }
+
+    template <class Archive>
+    void load(Archive& ar, const unsigned int version) {
+        if(version == 0) { throw std::runtime_error("Invalid version 0 for CachedBoxEntry."); }
+
+        ar >> boost::serialization::base_object<T>(*this);
+        box_ = compute_bounding_box();
+    }
+
+    BOOST_SERIALIZATION_SPLIT_MEMBER()
+};
+
+typedef CachedBoxEntry<MorphoEntry> CachedMorphoEntry;
+
+
 /// A shorthand for a default IndexTree with potentially custom allocator
 template <typename T, typename A = boost::container::new_allocator<T>>
 using IndexTreeBaseT = bgi::rtree<T, bgi::linear<16, 2>, bgi::indexable<T>, bgi::equal_to<T>, A>;
@@ -491,10 +624,41 @@ class IndexTreeMixin {
 
     /**
      * \brief Finds & return objects which intersect, numpy version.
+     *
+     * Only the columns selected by `fields` are computed and filled, the
+     * other columns are left empty.
+     *
      * \returns A vector of POD objects, to be exposed as numpy arrays(dtype)
      */
     template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
-    inline decltype(auto) find_intersecting_np(const ShapeT& shape) const;
+    inline decltype(auto) find_intersecting_np(const ShapeT& shape,
+                                               field_mask_t fields = all_fields) const;
+
+    /**
+     * \brief Finds the objects which intersect any of the shapes, numpy version.
+     *
+     * All queries are run in one go, and their results are concatenated. The
+     * results of the `i`-th query are `[offsets[i], offsets[i+1])`, i.e. CSR
+     * format.
+     *
+     * \returns The offsets and the results, see `detail::batch_query_result`.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline decltype(auto) find_intersecting_batch_np(const std::vector<ShapeT>& shapes) const;
+
+    /**
+     * \brief Same as above, but the queries are distributed over `n_threads` threads.
+     *
+     * The workers are taken from `pool`. The results are identical to those
+     * of the serial version, in particular they're in the same order.
+     *
+     * Requires that the index can be queried concurrently, see
+     * `supports_concurrent_queries`.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline decltype(auto) find_intersecting_batch_np(const std::vector<ShapeT>& shapes,
+                                                     ThreadPool& pool,
+                                                     size_t n_threads) const;
 
     /**
      * \brief Gets the ids of the the nearest K objects
@@ -503,6 +667,52 @@ class IndexTreeMixin {
     template <typename ShapeT>
     inline decltype(auto) find_nearest(const ShapeT& shape, unsigned k_neighbors) const;
 
+    /**
+     * \brief Gets the nearest K objects, by their exact distance to the point.
+     *
+     * `find_nearest` ranks the objects by the distance to their bounding box,
+     * which for long, oblique cylinders can be far from the distance to the
+     * cylinder. Here the objects are ranked by `geometry_distance`.
+     *
+     * The search first finds `k_neighbors` candidates by the distance to
+     * their bounding box. The `k`-th distance to these candidates limits the
+     * distance of the nearest K objects. Then, all objects within this
+     * distance are ranked by their exact distance.
+     *
+     * Requires that `query` supports `bgi::nearest`.
+     *
+     * \param max_distance Objects further away are ignored, hence fewer than
+     *   `k_neighbors` objects may be found.
+     * \returns The ids and distances, see `detail::nearest_result`.
+     */
+    inline decltype(auto) find_nearest_exact(
+        const Point3D& point,
+        unsigned k_neighbors,
+        CoordType max_distance = std::numeric_limits<CoordType>::infinity()) const;
+
+    /**
+     * \brief Runs `find_nearest_exact` for every point.
+     *
+     * \returns The `points.size() x k_neighbors` ids and distances, see
+     *   `detail::nearest_result`.
+     */
+    inline decltype(auto) find_nearest_exact_batch(
+        const std::vector<Point3D>& points,
+        unsigned k_neighbors,
+        CoordType max_distance = std::numeric_limits<CoordType>::infinity()) const;
+
+    /**
+     * \brief Same as above, but the queries are distributed over `n_threads` threads.
+     *
+     * Requires that the index can be queried concurrently, see
+     * `supports_concurrent_queries`.
+     */
+    inline decltype(auto) find_nearest_exact_batch(const std::vector<Point3D>& points,
+                                                   unsigned k_neighbors,
+                                                   CoordType max_distance,
+                                                   ThreadPool& pool,
+                                                   size_t n_threads) const;
+
     /// \brief Counts objects intersecting the given region deliminted by the shape
     template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
     inline size_t count_intersecting(const ShapeT& shape) const;
@@ -511,8 +721,66 @@ class IndexTreeMixin {
     template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
     inline std::unordered_map<identifier_t, size_t> count_intersecting_agg_gid(
         const ShapeT& shape) const;
+
+    /**
+     * \brief Counts the synapses intersecting every shape, grouped by gid.
+     *
+     * The groups are keyed by `post_gid`, `pre_gid` or the pair of both,
+     * see `GroupBy`. Groups without synapses are omitted.
+     *
+     * \returns The groups of every shape, in increasing order, in CSR
+     *   format, see `detail::grouped_counts_result`.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline decltype(auto) count_intersecting_grouped(const std::vector<ShapeT>& shapes,
+                                                     GroupBy group_by) const;
+
+    /// \brief Same as above, but on `n_threads` threads, see `find_intersecting_batch_np`.
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline decltype(auto) count_intersecting_grouped(const std::vector<ShapeT>& shapes,
+                                                     GroupBy group_by,
+                                                     ThreadPool& pool,
+                                                     size_t n_threads) const;
+
+    /**
+     * \brief The distinct gids of the objects which intersect the shape.
+     *
+     * The gids are deduplicated while traversing the tree, hence the
+     * intersecting objects are never materialized. The gid of a synapse is
+     * its post-synaptic gid; spheres and points use their id.
+     *
+     * \returns The gids in increasing order, and for every gid the number of
+     *   intersecting objects, see `detail::unique_gids_result`.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline decltype(auto) find_unique_gids(const ShapeT& shape) const;
+
+    /**
+     * \brief The distinct gids for every shape, see `find_unique_gids`.
+     *
+     * \returns The results in CSR format, see `detail::batch_query_result`.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline decltype(auto) find_unique_gids_batch(const std::vector<ShapeT>& shapes) const;
+
+    /// \brief Same as above, but on `n_threads` threads, see `find_intersecting_batch_np`.
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline decltype(auto) find_unique_gids_batch(const std::vector<ShapeT>& shapes,
+                                                 ThreadPool& pool,
+                                                 size_t n_threads) const;
 };
 
+/**
+ * \brief Can `Index` be queried from several threads at the same time?
+ *
+ * This is the case for indexes that aren't modified by queries, or that
+ * synchronize the modifications, e.g. the subtree cache of `MultiIndexTree`.
+ * Indexes must not call into Python while querying. Note that inserting
+ * elements while other threads query the index isn't safe.
+ */
+template <typename Index>
+struct supports_concurrent_queries : std::true_type {};
+
 /**
  * \brief IndexTree is a Boost::rtree spatial index tree with helper methods
  *    for finding intersections and serialization.
@@ -3,6 +3,8 @@
 #include <vector>
 #include <boost/optional.hpp>
 
+#include <brain_indexer/parallel_bulk_loading.hpp>
+
 namespace brain_indexer {
 
 template<class Value>
@@ -31,7 +33,13 @@ class IndexBulkBuilderBase {
 template<class Index, class Value = typename Index::value_type>
 class IndexBulkBuilder : public IndexBulkBuilderBase<Value> {
   public:
-    inline void finalize();
+    /** \brief Build the index from all inserted elements.
+     *
+     * An `IndexTree` is packed using `n_threads` threads of the global
+     * thread pool, see `parallel_bulk_load`. Other indexes are always
+     * built serially.
+     */
+    inline void finalize(size_t n_threads = 1);
 
     /// \brief Obtain the index after it's been built.
     inline Index index() const;
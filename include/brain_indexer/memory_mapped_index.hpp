@@ -0,0 +1,112 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/interprocess/allocators/allocator.hpp>
+#include <boost/interprocess/managed_mapped_file.hpp>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/meta_data.hpp>
+
+namespace brain_indexer {
+
+namespace bip = boost::interprocess;
+
+/// \brief The allocator used to place an R-Tree inside a memory mapped file.
+template <typename T>
+using MemoryMappedAllocator = bip::allocator<T, bip::managed_mapped_file::segment_manager>;
+
+
+/**
+ * \brief An `IndexTree` which is queried in place from a memory mapped file.
+ *
+ * The R-Tree, i.e. its nodes and values, is allocated directly inside a
+ * memory mapped file using Boost.Interprocess. Therefore, opening the index
+ * doesn't deserialize anything, it merely maps the file; and the pages are
+ * loaded lazily by the OS the first time a query touches them. Since the file
+ * is mapped read-only, all processes on a node that open the same index share
+ * the same physical pages through the page cache.
+ *
+ * The index is immutable. It's created once, from an iterator range, through
+ * `MemoryMappedIndexTree::create`.
+ */
+template <typename T>
+class MemoryMappedIndexTree: public IndexTreeMixin<MemoryMappedIndexTree<T>, T> {
+  public:
+    using value_type = T;
+    using cref_t = std::reference_wrapper<const T>;
+    using rtree_type = IndexTree<T, MemoryMappedAllocator<T>>;
+
+    /** \brief Opens a memory mapped index, read-only.
+     *
+     * The `index_path` is the path to the directory containing the meta data
+     * file, or the path of the meta data file itself.
+     */
+    inline explicit MemoryMappedIndexTree(const std::string& index_path);
+
+    /** \brief Writes the elements `[begin, end)` as a memory mapped index.
+     *
+     * The R-Tree is built with the packing algorithm directly inside the
+     * mapped file, the file is then shrunk to its minimal size. Additionally,
+     * the meta data file is written.
+     */
+    template <typename Iterator>
+    static inline void create(const std::string& index_path, Iterator begin, Iterator end);
+
+    /// \brief Forwards queries to the mapped R-Tree.
+    template <typename Predicates, typename OutputIt>
+    inline void query(const Predicates& predicates, const OutputIt& iter) const {
+        rtree_->query(predicates, iter);
+    }
+
+    /// \brief Checks whether a given shape intersects any object in the tree
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline bool is_intersecting(const ShapeT& shape) const {
+        return rtree_->template is_intersecting<GeometryMode>(shape);
+    }
+
+    /**
+     * \brief Finds & return objects which intersect.
+     * \returns A vector of references to objects inside the mapped file.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline std::vector<cref_t> find_intersecting_objs(const ShapeT& shape) const;
+
+    inline size_t size() const {
+        return rtree_->size();
+    }
+
+    inline Box3D bounds() const {
+        return rtree_->bounds();
+    }
+
+    /// \brief The mapped R-Tree, e.g. for query cursors.
+    inline const rtree_type& rtree() const {
+        return *rtree_;
+    }
+
+    inline decltype(auto) begin() const {
+        return rtree_->begin();
+    }
+
+    inline decltype(auto) end() const {
+        return rtree_->end();
+    }
+
+  private:
+    /// The name of the R-Tree object inside the mapped file.
+    static constexpr auto rtree_name = "rtree";
+
+    std::unique_ptr<bip::managed_mapped_file> mapped_file_;
+    const rtree_type* rtree_ = nullptr;
+};
+
+
+template <typename T>
+inline std::ostream& operator<<(std::ostream& os, const MemoryMappedIndexTree<T>& index);
+
+}  // namespace brain_indexer
+
+#include "detail/memory_mapped_index.hpp"
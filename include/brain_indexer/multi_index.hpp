@@ -1,5 +1,11 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 
 #include <boost/serialization/utility.hpp>
@@ -8,10 +14,12 @@
 
 #include <nlohmann/json.hpp>
 
+#include <brain_indexer/eviction_policy.hpp>
 #include <brain_indexer/geometries.hpp>
 #include <brain_indexer/index.hpp>
 #include <brain_indexer/index_bulk_builder.hpp>
 #include <brain_indexer/sort_tile_recursion.hpp>
+#include <brain_indexer/thread_pool.hpp>
 #include <brain_indexer/util.hpp>
 
 #if SI_MPI == 1
@@ -71,9 +79,24 @@ class MultiIndexStorage {
     inline SubTree load_subtree(size_t subtree_id) const;
     inline static SubTree load_subtree(const std::string& output_dir, size_t subtree_id);
 
+    /** \brief Loads the subtree into the empty R-tree `subtree`.
+     *
+     * The nodes are allocated by the allocator of `subtree`, which may differ
+     * from the one of `SubTree`, e.g. to load directly into shared memory.
+     */
+    template <class RTree>
+    inline void load_subtree_into(size_t subtree_id, RTree& subtree) const;
+
     inline TopTree load_top_tree() const;
     inline static TopTree load_top_tree(const std::string& output_dir);
 
+    /** \brief The memory occupied by `subtree`, in bytes.
+     *
+     * This counts the nodes of the R-tree, which contain the values. The
+     * bookkeeping of the memory allocator isn't included.
+     */
+    inline static size_t allocated_bytes(const SubTree& subtree);
+
   private:
     std::string output_dir;
 };
@@ -113,6 +136,10 @@ class NativeStorage : public MultiIndexStorage<
     template <class RTree>
     inline static RTree load_tree(const std::string& filename);
 
+    /// \brief Loads the R-tree in `filename` into the empty `rtree`.
+    template <class RTree>
+    inline static void load_tree_into(RTree& rtree, const std::string& filename);
+
   private:
     template <class ...Args>
     inline static void load_tree_impl(bgi::rtree<Args...> &tree, const std::string& filename);
@@ -134,12 +161,31 @@ using NativeStorageT = NativeStorage<MultiIndexTopTreeT, MultiIndexSubTreeT<T>>;
 struct UsageRateCacheParams {
     UsageRateCacheParams() = default;
 
-    explicit UsageRateCacheParams(size_t max_cached_elements)
-        : max_cached_elements(max_cached_elements) { }
+    explicit UsageRateCacheParams(
+        size_t max_cached_bytes,
+        EvictionPolicyKind eviction_policy = EvictionPolicyKind::usage_rate)
+        : max_cached_bytes(max_cached_bytes)
+        , eviction_policy(eviction_policy) { }
+
+    /// The memory all cached subtrees may occupy, see `MultiIndexStorage::allocated_bytes`.
+    size_t max_cached_bytes = 1ul;
+
+    /// The maximum number of subtrees evicted to make room for one subtree.
+    size_t max_evict = std::numeric_limits<size_t>::max();
+
+    EvictionPolicyKind eviction_policy = EvictionPolicyKind::usage_rate;
+};
+
+/// \brief Counters of the subtrees loaded ahead of the queries needing them.
+struct PrefetchStats {
+    /// The number of subtrees loaded by the prefetcher.
+    size_t n_prefetched = 0;
 
-    size_t max_cached_elements = 1ul;
-    size_t max_evict = 1ul;
-    size_t current_cached_subtrees = 0ul;
+    /// The number of prefetched subtrees used by a query.
+    size_t n_hits = 0;
+
+    /// The number of prefetched subtrees evicted without being used.
+    size_t n_wasted = 0;
 };
 
 /** \brief A cache for loading and keeping R-trees in memory.
@@ -148,10 +194,29 @@ struct UsageRateCacheParams {
  *  subtrees as they are needed and decide which trees should be evicted once
  *  there is insufficient memory to load further subtrees.
  *
- *  The eviction policy is the following: For each subtree the number of times
- *  the subtree is accessed per query that occurs while this tree is loaded can
- *  be computed. This number is called "usage rate". The subtrees with the lowest
- *  usage rate is evicted.
+ *  The memory of every subtree is measured once it's loaded, see
+ *  `Storage::allocated_bytes`. Before loading, the size of a subtree is
+ *  estimated from its number of elements and the average size per element of
+ *  the subtrees loaded so far. Subtrees are evicted until the new one fits
+ *  into `max_cached_bytes`.
+ *
+ *  The subtree to evict is chosen by an `EvictionPolicy`. By default, this is
+ *  `UsageRatePolicy`: For each subtree the number of times the subtree is
+ *  accessed per query that occurs while this tree is loaded can be computed.
+ *  This number is called "usage rate". The subtrees with the lowest usage rate
+ *  is evicted. See `EvictionPolicyKind` for the other policies.
+ *
+ *  The cache can be used by several threads concurrently. The subtrees are
+ *  distributed over shards, each protected by its own mutex, such that threads
+ *  requesting different subtrees rarely wait for each other. Subtrees are
+ *  handed out as pinned handles, i.e. reference counted pointers. Evicting a
+ *  subtree only drops the reference held by the cache; a subtree that's being
+ *  queried is freed once the last handle is gone. If several threads request
+ *  the same missing subtree, it's loaded once and the others wait for it.
+ *
+ *  Subtrees being loaded concurrently aren't accounted for until they've been
+ *  loaded. Hence, the cache may exceed `max_cached_bytes` by up to one
+ *  subtree per thread.
  * 
  *  See `UsageRateCacheT` for a convenient alias in the context of building a
  *  `MultiIndexTree`.
@@ -160,89 +225,177 @@ struct UsageRateCacheParams {
  */
 template <class Storage>
 class UsageRateCache {
-    /** \brief The meta data required to compute usage rate.
-     *
-     * The assumption is that there's a global query counter. It increases on
-     * every query of the spatial index.
-     *
-     * The current value query counter at time of loading the subtree is stored as
-     * the `load_generation`. The `current_access_count` is increased everytime
-     * the subtree is requested.
-     *
-     * On eviction `previous_*` are increased such that they reflect the historic usage
-     * rate.
-     */
-    class MetaData {
-      public:
-        double usage_rate(size_t query_count) const;
-        size_t access_count() const;
-        size_t eviction_count() const;
-        size_t incache_count(size_t query_count) const;
-
-
-        /// \brief To be called every time the subtree is queries while residing cache.
-        inline void on_query();
-
-        /// \brief To be called every time the subtree is loaded into cache.
-        inline void on_load(size_t query_count);
-
-        /// \brief To be called immediately before evicting the subtree.
-        inline void on_evict(size_t query_count);
-
-      private:
-        size_t load_generation_ = 0;
-        size_t current_access_count_ = 0;
-
-        size_t previous_access_count_ = 0;
-        size_t previous_age_ = 0;
-
-        size_t eviction_count_ = 0;
-    };
+    using MetaData = UsageRateMetaData;
 
   public:
     using storage_type = Storage;
     using subtree_type = typename storage_type::subtree_type;
+    using params_type = UsageRateCacheParams;
+
+    /// \brief A pinned subtree, it's kept alive while the handle exists.
+    using subtree_handle = std::shared_ptr<const subtree_type>;
+
+    /// \brief The number of shards the subtrees are distributed over.
+    static constexpr size_t n_shards = 16;
 
   public:
-    UsageRateCache() = default;
+    UsageRateCache()
+        : shards(n_shards)
+        , policy(make_eviction_policy(cache_params.eviction_policy)) { }
 
     UsageRateCache(const UsageRateCacheParams& cache_params, Storage storage)
         : storage(std::move(storage))
-        , cache_params(cache_params) { }
+        , cache_params(cache_params)
+        , shards(n_shards)
+        , policy(make_eviction_policy(cache_params.eviction_policy)) { }
+
+    UsageRateCache(UsageRateCache&& other) noexcept
+        : storage(std::move(other.storage))
+        , cache_params(other.cache_params)
+        , shards(std::move(other.shards))
+        , policy(std::move(other.policy))
+        , n_cached_bytes(other.n_cached_bytes.load())
+        , n_read_bytes(other.n_read_bytes.load())
+        , n_read_elements(other.n_read_elements.load())
+        , n_prefetched(other.n_prefetched.load())
+        , n_prefetch_hits(other.n_prefetch_hits.load())
+        , n_prefetch_wasted(other.n_prefetch_wasted.load())
+        , most_recent_query_count(other.most_recent_query_count.load()) { }
 
     ~UsageRateCache();
 
     /** \brief Return the subtree with id `subtree_id`.
+     *
+     * The subtree isn't freed while the returned handle exists, even if it's
+     * evicted from the cache in the meantime.
      *
      * \param query_count The query count increses on every query to the spatial index.
      */
     template<class SubtreeID>
-    inline const subtree_type& load_subtree(const SubtreeID& subtree_id, size_t query_count);
+    inline subtree_handle load_subtree(const SubtreeID& subtree_id, size_t query_count);
 
-  protected:
-    /// \brief Total number of elements across all subtrees loaded.
-    size_t cached_elements() const;
+    /** \brief Returns the subtree if it's in the cache; and `nullptr` otherwise.
+     *
+     * Unlike `load_subtree`, this never loads or evicts a subtree.
+     */
+    template<class SubtreeID>
+    inline subtree_handle find_subtree(const SubtreeID& subtree_id, size_t query_count);
 
+    /// \brief Is the subtree in the cache, or being loaded into it?
     template<class SubtreeID>
-    inline void evict_subtrees(const SubtreeID& subtree_id, size_t query_count);
+    inline bool is_cached(const SubtreeID& subtree_id);
+
+    /** \brief Loads the subtree into the cache, if there's room for it.
+     *
+     * Unlike `load_subtree`, this never evicts a subtree. Nothing is done if
+     * the subtree is cached, or being loaded, already.
+     *
+     * \returns Whether the subtree was loaded.
+     */
+    template<class SubtreeID>
+    inline bool prefetch_subtree(const SubtreeID& subtree_id, size_t query_count);
+
+    /// \brief How many prefetched subtrees were used, and how many weren't.
+    inline PrefetchStats prefetch_stats() const;
+
+    /// \brief The memory occupied by the cached subtrees, in bytes.
+    inline size_t cached_bytes() const {
+        return n_cached_bytes.load();
+    }
+
+  protected:
+    /// \brief The expected memory of a subtree with `n_elements` elements.
+    inline size_t estimated_bytes(size_t n_elements) const;
 
-    inline std::vector<size_t> subtree_ids_sorted_by_usage_rate(size_t query_count);
+    /** \brief Evicts subtrees until another `n_bytes` fit into the cache.
+     *
+     * Stops early if the next victim would be `keep`.
+     */
+    inline void evict_subtrees(size_t n_bytes,
+                               size_t query_count,
+                               boost::optional<size_t> keep = boost::none);
 
 
   private:
-    Storage storage;
+    using subtree_ptr = subtree_handle;
+
+    /** \brief A part of the cache, protected by `mutex`.
+     *
+     * `pending` contains the subtrees currently being loaded, threads
+     * requesting one of those wait for the future.
+     */
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<size_t, subtree_ptr> subtrees;
+        std::unordered_map<size_t, MetaData> meta_data;
+        std::unordered_map<size_t, std::shared_future<subtree_handle>> pending;
+    };
+
+    inline Shard& shard_of(size_t id) {
+        return shards[id % shards.size()];
+    }
+
+    /** \brief Loads the subtree `id`, which the caller registered as pending.
+     *
+     * Once loaded, the subtree is cached; and passed to the threads waiting
+     * for it through `promise`.
+     */
+    inline subtree_handle load_pending(Shard& shard,
+                                       size_t id,
+                                       std::promise<subtree_handle>& promise,
+                                       size_t query_count);
+
+    /// \brief Adds the subtree to `shard`, which the caller must have locked.
+    inline void cache_subtree(Shard& shard,
+                                size_t id,
+                                subtree_ptr subtree,
+                                size_t query_count);
+
+    /// \brief Removes the subtree from `shard`, which the caller must have locked.
+    inline subtree_ptr uncache_subtree(Shard& shard, size_t id, size_t query_count);
 
-    std::unordered_map<size_t, subtree_type> subtrees;
-    std::unordered_map<size_t, MetaData> meta_data;
+    /// \brief Records that `md`'s subtree is queried, and whether it was prefetched.
+    inline void on_query(size_t id, MetaData& md, size_t query_count);
+
+    /// \brief Records that `md`'s subtree is evicted, and whether it was wasted.
+    inline void on_evict(MetaData& md, size_t query_count);
+
+    Storage storage;
     UsageRateCacheParams cache_params;
 
-    size_t most_recent_query_count = 0;
+    // Lock order: a shard, then `policy_mutex`.
+    std::vector<Shard> shards;
+    std::mutex eviction_mutex;
+    std::mutex policy_mutex;
+    std::unique_ptr<EvictionPolicy> policy;
+
+    std::atomic<size_t> n_cached_bytes{0};
+
+    // All subtrees ever read, used to estimate the size of the next one.
+    std::atomic<size_t> n_read_bytes{0};
+    std::atomic<size_t> n_read_elements{0};
+
+    std::atomic<size_t> n_prefetched{0};
+    std::atomic<size_t> n_prefetch_hits{0};
+    std::atomic<size_t> n_prefetch_wasted{0};
+
+    std::atomic<size_t> most_recent_query_count{0};
 };
 
 template<typename T>
 using UsageRateCacheT = UsageRateCache<NativeStorageT<T>>;
 
 
+/// \brief How a multi index predicts which subtrees will be needed next.
+enum class PrefetchMode {
+    /// Only the regions passed to `MultiIndexTreeBase::prefetch` are prefetched.
+    hint,
+
+    /// Additionally, the path of the recent queries is extrapolated.
+    trajectory
+};
+
+
 /** \brief Implements core querying functionality of a spatial index.
  *
  * This class only provides the core functionality for loading parts of a multi
@@ -254,9 +407,11 @@ using UsageRateCacheT = UsageRateCache<NativeStorageT<T>>;
 template <class SubtreeCache>
 class MultiIndexTreeBase {
   public:
+    using subtree_cache_type = SubtreeCache;
     using storage_type = typename SubtreeCache::storage_type;
     using toptree_type = typename storage_type::toptree_type;
-    using subtree_type = typename storage_type::subtree_type;
+    using subtree_type = typename SubtreeCache::subtree_type;
+    using subtree_handle = typename SubtreeCache::subtree_handle;
 
   public:
     MultiIndexTreeBase() = default;
@@ -269,18 +424,101 @@ class MultiIndexTreeBase {
       return top_rtree.bounds();
     }
 
-  protected:
-    template <class SubtreeID, class Predicates, class OutIt>
-    inline void query_subtree(const SubtreeID& subtree_id,
-                       const Predicates& predicates,
-                       const OutIt& it) const;
+    /// \brief The top-level tree, its values are the boxes of the subtrees.
+    inline const toptree_type& top_tree() const {
+      return top_rtree;
+    }
 
+    /** \brief Returns the subtree `subtree_id`, loading it if needed.
+     *
+     * The subtree stays alive while the handle exists, even if it's evicted
+     * from the cache by a concurrent query.
+     */
     template <class SubtreeID>
-    inline auto load_subtree(const SubtreeID& subtree_id) const -> const subtree_type&;
+    inline auto load_subtree(const SubtreeID& subtree_id) const -> subtree_handle;
+
+    /** \brief Calls `f(subtree)` for every subtree of `subtree_ids`.
+     *
+     * Subtrees in the cache are visited first. Meanwhile, the missing subtrees
+     * are loaded concurrently by the I/O threads; and visited in the order in
+     * which they arrive. Hence, the time spent waiting for a query spanning
+     * several cold subtrees is closer to that of loading one subtree.
+     *
+     * At most `2 * io_threads()` loaded subtrees wait to be visited at any
+     * time, which bounds the memory held outside of the cache. `f` is always
+     * called on the calling thread. If loading a subtree fails, the exception
+     * is rethrown once the outstanding loads have finished.
+     */
+    template <class SubtreeIDs, class F>
+    inline void for_each_subtree(const SubtreeIDs& subtree_ids, F&& f) const;
+
+    /** \brief Sets the number of threads loading subtrees concurrently.
+     *
+     * Without I/O threads, subtrees are loaded one after the other by the
+     * querying thread, in the order of the query; and nothing is prefetched.
+     * Must not be called while the index is queried.
+     */
+    inline void set_io_threads(size_t n_io_threads);
+
+    /// \brief The number of threads loading subtrees concurrently.
+    inline size_t io_threads() const {
+        return io_pool == nullptr ? 0 : io_pool->size();
+    }
+
+    /** \brief The number of I/O threads of a newly opened multi index.
+     *
+     * None, such that opening an index doesn't start threads and subtrees are
+     * visited in a deterministic order.
+     */
+    static constexpr size_t default_io_threads = 0;
+
+    /** \brief Loads the subtrees intersecting `region` in the background.
+     *
+     * This announces the region of upcoming queries. The subtrees are loaded
+     * by the I/O threads, but only if they fit into the cache without evicting
+     * other subtrees. Without I/O threads, nothing is prefetched.
+     */
+    inline void prefetch(const Box3D& region) const;
+
+    /// \brief Blocks until the subtrees being prefetched have been loaded.
+    inline void wait_for_prefetches() const;
+
+    /** \brief Selects how subtrees are prefetched.
+     *
+     * With `PrefetchMode::trajectory` every query records the box around the
+     * subtrees it needs. Once that box moves, e.g. in a sweep through the
+     * index, it's moved by the same step once more; and the subtrees
+     * intersecting the result are prefetched. The default is
+     * `PrefetchMode::hint`. Must not be called while the index is queried.
+     */
+    inline void set_prefetch_mode(PrefetchMode mode) {
+        prefetch_mode = mode;
+    }
+
+    /// \brief How many prefetched subtrees were used, and how many weren't.
+    inline PrefetchStats prefetch_stats() const {
+        return subtree_cache.prefetch_stats();
+    }
+
+  protected:
+    /// \brief Extrapolates the path of the queries, see `PrefetchMode::trajectory`.
+    template <class SubtreeIDs>
+    inline void prefetch_along_trajectory(const SubtreeIDs& subtree_ids) const;
 
     toptree_type top_rtree;
     mutable SubtreeCache subtree_cache;
-    mutable size_t query_count = 0;
+    mutable std::atomic<size_t> query_count{0};
+
+    PrefetchMode prefetch_mode = PrefetchMode::hint;
+    mutable std::mutex trajectory_mutex;
+    mutable boost::optional<Box3D> previous_footprint;
+    mutable std::mutex prefetch_mutex;
+    // Guarded by `prefetch_mutex`.
+    mutable size_t n_prefetches_in_flight = 0;
+    mutable std::condition_variable prefetches_finished;
+
+    // Must be destroyed first, its threads use the cache.
+    std::unique_ptr<ThreadPool> io_pool;
 };
 
 template<class T>
@@ -307,30 +545,50 @@ using MultiIndexTreeBaseT = MultiIndexTreeBase<UsageRateCacheT<T>>;
  *  a similar region of the indexed area.
  * 
  *  The available caches policies are:
- *   - `UsageRateCache` which evicts the least used subtree.
+ *   - `UsageRateCache` which evicts subtrees according to an
+ *     `EvictionPolicy`, by default the least used subtree.
+ *   - `SharedSubtreeCache` which keeps the subtrees in shared memory, such
+ *     that all processes on a node share them, see `SharedMultiIndexTree`.
+ *
+ *  Queries may run concurrently, e.g. the batched queries of `IndexTreeMixin`
+ *  with a thread pool. Subtrees are loaded and evicted by the cache, which
+ *  ensures that no subtree is freed while it's being queried.
  */
-template <typename T>
-class MultiIndexTree: public IndexTreeMixin<MultiIndexTree<T>, T>,
-                      public MultiIndexTreeBaseT<T> {
+template <typename T, class SubtreeCache = UsageRateCacheT<T>>
+class MultiIndexTree: public IndexTreeMixin<MultiIndexTree<T, SubtreeCache>, T>,
+                      public MultiIndexTreeBase<SubtreeCache> {
   private:
-    using multi_index_base = MultiIndexTreeBaseT<T>;
+    using multi_index_base = MultiIndexTreeBase<SubtreeCache>;
 
   public:
     using value_type = T;
+    using cache_params_type = typename SubtreeCache::params_type;
 
   public:
     inline MultiIndexTree() = default;
     using multi_index_base::multi_index_base;
 
-    MultiIndexTree(const std::string& output_dir, size_t max_cached_bytes);
+    /// \brief Opens the multi index in `output_dir` with a `UsageRateCache`.
+    MultiIndexTree(const std::string& output_dir,
+                   size_t max_cached_bytes,
+                   EvictionPolicyKind eviction_policy = EvictionPolicyKind::usage_rate);
 
-    MultiIndexTree(const NativeStorageT<T>& storage,
-                   const UsageRateCacheParams& params);
+    MultiIndexTree(const std::string& output_dir, const cache_params_type& params);
+
+    MultiIndexTree(const NativeStorageT<T>& storage, const cache_params_type& params);
 
     /// \brief Checks whether a given shape intersects any object in the tree
     template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
     inline bool is_intersecting(const ShapeT& shape) const;
 
+    /** \brief Counts the objects intersecting the shape.
+     *
+     * Subtrees whose bounding box is contained in the shape contribute their
+     * number of elements without being loaded, see `detail::box_covered_by`.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline size_t count_intersecting(const ShapeT& shape) const;
+
 
     /**
      * \brief Finds & return objects which intersect. To be used mainly with id-less objects
@@ -339,6 +597,32 @@ class MultiIndexTree: public IndexTreeMixin<MultiIndexTree<T>, T>,
     template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
     inline auto find_intersecting_objs(const ShapeT& shape) const -> std::vector<value_type>;
 
+    /**
+     * \brief Runs `find_nearest_exact` for every point.
+     *
+     * The queries are grouped by the subtree nearest to the point, and run
+     * one group after the other. Hence, a subtree needed by several queries
+     * is usually loaded only once.
+     *
+     * \returns The results in the order of `points`, see
+     *   `IndexTreeMixin::find_nearest_exact_batch`.
+     */
+    inline decltype(auto) find_nearest_exact_batch(
+        const std::vector<Point3D>& points,
+        unsigned k_neighbors,
+        CoordType max_distance = std::numeric_limits<CoordType>::infinity()) const;
+
+    /**
+     * \brief Same as above, but the queries are distributed over `n_threads` threads.
+     *
+     * Each thread runs a contiguous range of the grouped queries.
+     */
+    inline decltype(auto) find_nearest_exact_batch(const std::vector<Point3D>& points,
+                                                   unsigned k_neighbors,
+                                                   CoordType max_distance,
+                                                   ThreadPool& pool,
+                                                   size_t n_threads) const;
+
     /** \brief Total number of index elements.
      */
     inline size_t size() const {
@@ -352,19 +636,6 @@ class MultiIndexTree: public IndexTreeMixin<MultiIndexTree<T>, T>,
     }
 };
 
-template<size_t dim, typename Value>
-inline CoordType get_centroid_coordinate(const Value &value);
-
-
-template<typename Value>
-struct GetCenterCoordinate {
-public:
-    template<size_t dim>
-    inline static CoordType apply(const Value &value) {
-        return get_centroid_coordinate<dim>(value);
-    }
-};
-
 #if SI_MPI == 1
 
 /** \brief Build the multi index in bulk.
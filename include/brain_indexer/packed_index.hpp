@@ -0,0 +1,246 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/detail/packed_kernels.hpp>
+
+namespace brain_indexer {
+
+/**
+ * \brief A list of boxes stored as a structure of arrays.
+ *
+ * Each coordinate of the min and max corners is stored in its own contiguous
+ * array. Testing many boxes against a single query box therefore only streams
+ * through six arrays of `CoordType`, which is friendly to the caches and
+ * SIMD instructions.
+ *
+ * The arrays are padded to a multiple of the block size with empty boxes,
+ * i.e. boxes which don't intersect anything. Hence, the kernels can always
+ * process full blocks.
+ */
+class PackedBoxes {
+  public:
+    inline PackedBoxes() = default;
+    inline explicit PackedBoxes(size_t n_boxes) {
+        resize(n_boxes);
+    }
+
+    inline void resize(size_t n_boxes);
+
+    inline size_t size() const {
+        return n_boxes_;
+    }
+
+    inline void set(size_t i, const Box3D& box);
+
+    inline Box3D get(size_t i) const;
+
+    /// \brief Same semantics as `bg::intersects` for two boxes, i.e. closed boxes.
+    inline bool intersects(size_t i, const Box3D& box) const;
+
+    /// \brief The block of boxes starting at `first`.
+    inline detail::PackedBoxBlock block(size_t first) const;
+
+    std::array<std::vector<CoordType>, 3> min_corner;
+    std::array<std::vector<CoordType>, 3> max_corner;
+
+  private:
+    size_t n_boxes_ = 0;
+};
+
+
+/**
+ * \brief A list of capsules stored as a structure of arrays.
+ *
+ * Spheres are stored as capsules of length zero. The arrays are padded with
+ * NaNs, such that padding never intersects anything.
+ */
+class PackedCapsules {
+  public:
+    inline void resize(size_t n_capsules);
+
+    inline size_t size() const {
+        return n_capsules_;
+    }
+
+    inline void set(size_t i, const Point3D& p1, const Point3D& p2, CoordType radius);
+
+    /// \brief The block of capsules starting at `first`.
+    inline detail::PackedCapsuleBlock block(size_t first) const;
+
+    std::array<std::vector<CoordType>, 3> p1;
+    std::array<std::vector<CoordType>, 3> p2;
+    std::vector<CoordType> radius;
+
+  private:
+    size_t n_capsules_ = 0;
+};
+
+
+namespace detail {
+
+/// \brief The filters of a query that can be evaluated by the packed kernels.
+struct PackedQuery {
+    enum class Filter { none, sphere, capsule };
+
+    /// The bounding box of the query shape, always tested.
+    Box3D box;
+
+    /// Additional filter for the boxes, a sphere `(p1, radius)` or a capsule.
+    Filter filter = Filter::none;
+    Point3D p1, p2;
+    CoordType radius = 0;
+
+    /// Filter for the capsules of the values, a sphere.
+    bool filter_capsules = false;
+    Point3D capsule_center;
+    CoordType capsule_radius = 0;
+};
+
+}  // namespace detail
+
+
+/**
+ * \brief An immutable R-Tree stored in a few flat arrays.
+ *
+ * `IndexTree` is a pointer based R-Tree, with every node allocated separately
+ * on the heap. However, most indexes are built once and then only queried.
+ * This index is meant for such workloads. It's built once with the same
+ * top-down packing algorithm as `IndexTree`, and is read-only afterwards.
+ *
+ * The tree is complete, every node, except the last one on each level, has
+ * exactly `fanout` children. Therefore, the tree can be stored implicitly:
+ *   - The values are stored in a single array, such that the values of any
+ *     subtree are contiguous.
+ *   - The bounding boxes of all nodes are stored in a single array in
+ *     breadth-first order, level by level starting at the root.
+ *   - The children of node `i` on a level are the nodes (or values)
+ *     `[fanout*i, fanout*(i+1))` on the next level.
+ *
+ * Hence, there are no pointers, and the bounding boxes of siblings are
+ * adjacent in memory. All bounding boxes, including those of the values, are
+ * stored as a structure of arrays, see `PackedBoxes`.
+ *
+ * The children of a node are tested all at once by SIMD kernels, see
+ * `detail/packed_kernels.hpp`. For sphere and cylinder queries the kernels
+ * also filter by distance; and for elements that are spheres or cylinders, a
+ * copy of their geometry is stored as capsules, such that the best-effort
+ * tests can be filtered too. The filters are conservative, the candidates
+ * that pass are checked with the exact, scalar `geometry_intersects`.
+ * Therefore, the semantics of the queries are identical to those of
+ * `IndexTree`.
+ */
+template <typename T>
+class PackedIndexTree: public IndexTreeMixin<PackedIndexTree<T>, T> {
+  public:
+    using value_type = T;
+    using cref_t = std::reference_wrapper<const T>;
+
+    /// \brief The maximum number of children of each node.
+    static constexpr size_t fanout = detail::packed_block_size;
+
+    inline PackedIndexTree() = default;
+
+    /// \brief Builds the index from the elements `[begin, end)`.
+    template <typename Iterator>
+    inline PackedIndexTree(Iterator begin, Iterator end)
+        : PackedIndexTree(std::vector<T>(begin, end)) {}
+
+    /// \brief Builds the index from the elements in `values`.
+    inline explicit PackedIndexTree(std::vector<T> values);
+
+    /**
+     * \brief Find elements in tree that intersect with the given shape.
+     *
+     * See `IndexTreeMixin::find_intersecting`.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT, typename OutputIt>
+    inline void find_intersecting(const ShapeT& shape, const OutputIt& iter) const;
+
+    /**
+     * \brief Gets the ids of the the nearest K objects
+     * \returns The ids, ordered by increasing distance to the shape.
+     */
+    template <typename ShapeT>
+    inline decltype(auto) find_nearest(const ShapeT& shape, unsigned k_neighbors) const;
+
+    /// \brief Checks whether a given shape intersects any object in the tree
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline bool is_intersecting(const ShapeT& shape) const;
+
+    /**
+     * \brief Finds & return objects which intersect. To be used mainly with id-less objects
+     * \returns A vector of references to tree objects
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline std::vector<cref_t> find_intersecting_objs(const ShapeT& shape) const;
+
+    inline size_t size() const {
+        return values_.size();
+    }
+
+    inline bool empty() const {
+        return values_.empty();
+    }
+
+    /// \brief The bounding box of all elements.
+    inline Box3D bounds() const;
+
+    /// \brief The number of levels of nodes, excluding the values.
+    inline size_t n_levels() const {
+        return level_sizes_.size();
+    }
+
+    inline decltype(auto) begin() const {
+        return values_.begin();
+    }
+
+    inline decltype(auto) end() const {
+        return values_.end();
+    }
+
+  private:
+    /// \brief The number of nodes on `level`, or the number of values.
+    inline size_t level_size(size_t level) const {
+        return level == n_levels() ? values_.size() : level_sizes_[level];
+    }
+
+    /// \brief The range of children of node `i` on `level`.
+    inline std::pair<size_t, size_t> children(size_t level, size_t i) const {
+        auto first = i * fanout;
+        return {first, std::min(first + fanout, level_size(level + 1))};
+    }
+
+    /**
+     * \brief Calls `visitor(i)` for every value that passes the filters of `query`.
+     *
+     * The traversal stops early if the visitor returns `false`.
+     */
+    template <typename Visitor>
+    inline void visit_candidates(const detail::PackedQuery& query, Visitor&& visitor) const;
+
+    std::vector<T> values_;
+    PackedBoxes value_boxes_;
+
+    /// Only used if the elements are spheres or cylinders.
+    PackedCapsules value_capsules_;
+
+    /// All nodes in breadth-first order.
+    PackedBoxes node_boxes_;
+
+    /// The nodes on level `l` start at `level_offsets_[l]`, a multiple of `fanout`.
+    std::vector<size_t> level_offsets_;
+    std::vector<size_t> level_sizes_;
+};
+
+
+template <typename T>
+inline std::ostream& operator<<(std::ostream& os, const PackedIndexTree<T>& index);
+
+}  // namespace brain_indexer
+
+#include "detail/packed_index.hpp"
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/sort_tile_recursion.hpp>
+#include <brain_indexer/thread_pool.hpp>
+
+
+namespace brain_indexer {
+
+/** \brief Bulk loads an `IndexTree` using several threads.
+ *
+ * The packing algorithm of Boost.Geometry is single-threaded, which makes it
+ * the bottleneck when building large in-memory indexes. Instead, the build is
+ * split into three phases:
+ *
+ *   1. Sort Tile Recursion partitions the values into parts, such that every
+ *      part fills a subtree of the same height. The first two dimensions are
+ *      partitioned by selection, the last one by `SerialSortTileRecursion`.
+ *
+ *   2. Each part is packed into a subtree, using the packing algorithm of
+ *      Boost.Geometry, independently of the other parts.
+ *
+ *   3. The subtrees are stitched together by adding the nodes above them.
+ *
+ * Phases one and two run on `n_threads` threads of `pool`. The result is an
+ * ordinary `IndexTree`, which contains the same values as `IndexTree(values)`.
+ * However, the nodes of the tree differ.
+ *
+ * If `n_threads <= 1`, or there are too few values to be worth the effort,
+ * the tree is packed serially.
+ *
+ * \note The order of `values` is modified.
+ */
+template <class T>
+inline IndexTree<T> parallel_bulk_load(std::vector<T>& values,
+                                       ThreadPool& pool,
+                                       size_t n_threads);
+
+namespace detail {
+
+/** \brief Partitions `values[begin, end)` into `n_parts` balanced chunks along `Key`.
+ *
+ * After partitioning, the elements of chunk `k` compare less or equal to the
+ * elements of chunk `k+1`. The chunks are the same as those of
+ * `util::balanced_chunks`. The elements within a chunk aren't sorted.
+ */
+template <class Key, class Value>
+inline void partition_balanced(std::vector<Value>& values,
+                               size_t begin,
+                               size_t end,
+                               size_t n_parts);
+
+/** \brief STR parameters for parallel bulk loading.
+ *
+ * The parts are chosen such that every part has more than `max_elements^h`
+ * and at most `max_elements^(h+1)` values, for some `h >= 1`. Hence, all
+ * parts are packed into subtrees of the same height. There are at least
+ * `n_parts_min` parts. If there are too few values, the returned parameters
+ * have zero parts.
+ */
+inline SerialSTRParams parallel_bulk_loading_params(size_t n_values,
+                                                    size_t max_elements,
+                                                    size_t n_parts_min);
+
+}  // namespace detail
+
+}  // namespace brain_indexer
+
+#include "detail/parallel_bulk_loading.hpp"
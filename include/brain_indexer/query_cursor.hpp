@@ -0,0 +1,141 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/memory_mapped_index.hpp>
+#include <brain_indexer/multi_index.hpp>
+
+
+namespace brain_indexer {
+
+/** \brief A query whose results are returned in chunks.
+ *
+ * Unlike `find_intersecting_np`, which collects all results before
+ * returning, the cursor resumes the traversal of the R-Tree on every call to
+ * `next_chunk`. Therefore, the memory needed is bounded by the size of a chunk,
+ * regardless of how many elements intersect the query shape. The results are
+ * the same as those of `find_intersecting_np`, and in the same order.
+ *
+ * The cursor refers to the R-Tree, which must outlive it and must not be
+ * modified while the cursor is in use.
+ *
+ * \tparam RTree  The R-Tree, e.g. `IndexTree<T>`.
+ */
+template <typename RTree, typename GeometryMode, typename ShapeT>
+class QueryCursor {
+  public:
+    using value_type = typename RTree::value_type;
+    using result_type = typename iter_entry_getter<value_type>::result_t;
+
+  public:
+    inline QueryCursor(const RTree& rtree, const ShapeT& shape);
+
+    /** \brief The next (at most) `max_elements` results.
+     *
+     * A chunk with fewer than `max_elements` results is only returned once
+     * all results have been returned, subsequent chunks are empty.
+     */
+    inline result_type next_chunk(size_t max_elements);
+
+    /// \brief Writes the next (at most) `max_elements` results to `out`.
+    template <typename OutputIt>
+    inline size_t next_chunk(size_t max_elements, OutputIt out);
+
+    /// \brief True if all results have been returned.
+    inline bool done() const;
+
+  private:
+    using iterator_type = decltype(std::declval<const RTree&>().qbegin(
+        detail::intersects_predicate<GeometryMode>(std::declval<const ShapeT&>())));
+
+    // The predicate refers to the shape, hence it must not move.
+    std::unique_ptr<ShapeT> shape_;
+    iterator_type it_;
+    iterator_type end_;
+};
+
+
+/** \brief A query cursor for multi indexes.
+ *
+ * The subtrees intersecting the query shape are traversed one after the
+ * other. The cursor holds a handle of the subtree it's traversing, which
+ * keeps the subtree alive while the cursor is suspended; it stays in the
+ * cache and other queries may use it. Hence, the cursor holds on to at most
+ * one subtree.
+ *
+ * Several cursors may query the same index concurrently. However, a cursor
+ * must only be advanced by one thread at a time.
+ */
+template <typename T,
+          typename GeometryMode,
+          typename ShapeT,
+          typename SubtreeCache = UsageRateCacheT<T>>
+class MultiIndexQueryCursor {
+  public:
+    using value_type = T;
+    using result_type = typename iter_entry_getter<value_type>::result_t;
+
+  public:
+    inline MultiIndexQueryCursor(const MultiIndexTree<T, SubtreeCache>& index,
+                                 const ShapeT& shape);
+
+    MultiIndexQueryCursor(const MultiIndexQueryCursor&) = delete;
+    MultiIndexQueryCursor& operator=(const MultiIndexQueryCursor&) = delete;
+
+    /// \brief See `QueryCursor::next_chunk`.
+    inline result_type next_chunk(size_t max_elements);
+
+    /// \brief True if all results have been returned.
+    inline bool done() const;
+
+  private:
+    using index_type = MultiIndexTree<T, SubtreeCache>;
+    using subtree_type = typename index_type::subtree_type;
+    using subtree_cursor_type = QueryCursor<subtree_type, GeometryMode, ShapeT>;
+
+    /// \brief Moves on from the current subtree to the next one.
+    inline void next_subtree();
+
+    const index_type* index_;
+    ShapeT shape_;
+
+    std::vector<IndexedSubtreeBox> subtree_ids_;
+    size_t next_subtree_ = 0;
+
+    typename index_type::subtree_handle subtree_;
+    std::unique_ptr<subtree_cursor_type> subtree_cursor_;
+};
+
+
+/// \brief Creates a cursor for a query of `index` with `shape`.
+template <typename GeometryMode = BoundingBoxGeometry,
+          typename ShapeT, typename T, typename A>
+inline auto make_query_cursor(const IndexTree<T, A>& index, const ShapeT& shape) {
+    return QueryCursor<IndexTree<T, A>, GeometryMode, ShapeT>(index, shape);
+}
+
+/// \brief Creates a cursor for a query of the memory mapped `index` with `shape`.
+template <typename GeometryMode = BoundingBoxGeometry, typename ShapeT, typename T>
+inline auto make_query_cursor(const MemoryMappedIndexTree<T>& index, const ShapeT& shape) {
+    using rtree_type = typename MemoryMappedIndexTree<T>::rtree_type;
+    return QueryCursor<rtree_type, GeometryMode, ShapeT>(index.rtree(), shape);
+}
+
+/** \brief Creates a cursor for a query of the multi index `index` with `shape`.
+ *
+ * Returns a `std::unique_ptr`, since the subtree cursor refers to the shape.
+ */
+template <typename GeometryMode = BoundingBoxGeometry,
+          typename ShapeT, typename T, typename SubtreeCache>
+inline auto make_query_cursor(const MultiIndexTree<T, SubtreeCache>& index,
+                              const ShapeT& shape) {
+    return std::make_unique<MultiIndexQueryCursor<T, GeometryMode, ShapeT, SubtreeCache>>(
+        index, shape
+    );
+}
+
+}  // namespace brain_indexer
+
+#include "detail/query_cursor.hpp"
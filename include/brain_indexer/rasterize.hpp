@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/memory_mapped_index.hpp>
+#include <brain_indexer/multi_index.hpp>
+#include <brain_indexer/thread_pool.hpp>
+
+
+namespace brain_indexer {
+
+/** \brief A regular grid of cubic voxels.
+ *
+ * Voxel `(i, j, k)` spans `origin + voxel_size * [i, i+1) x [j, j+1) x [k, k+1)`,
+ * and is stored at `(i * shape[1] + j) * shape[2] + k`, i.e. in C order.
+ * The origin must be finite and the voxel size finite and positive.
+ */
+struct VoxelGrid {
+    Point3D origin;
+    CoordType voxel_size;
+    std::array<size_t, 3> shape;
+
+    /// \brief The number of voxels; throws `std::invalid_argument` on overflow.
+    inline size_t n_voxels() const;
+
+    /// \brief The box covered by all voxels.
+    inline Box3D bounding_box() const;
+
+    /// \brief The box covered by voxel `(i, j, k)`.
+    inline Box3D voxel_box(size_t i, size_t j, size_t k) const;
+};
+
+/// \brief The quantity `rasterize` computes per voxel.
+enum class RasterQuantity {
+    /// The number of elements intersecting the voxel.
+    count,
+    /// The length of the axis of the segments inside the voxel.
+    length,
+    /// The volume of the segments and spheres inside the voxel.
+    volume
+};
+
+/** \brief Computes `quantity` for every voxel of `grid`.
+ *
+ * Every element is visited once and its contribution is added to all voxels
+ * it overlaps; rather than running one query per voxel.
+ *
+ *  - `count` uses the same test as `BestEffortGeometry` queries. A point is
+ *    counted in the voxel containing it.
+ *  - `length` clips the axis of each segment exactly to the voxels. Spheres
+ *    and points have no length.
+ *  - `volume` is the clipped length times the cross-section of the segment,
+ *    which neglects the caps. The volume of a sphere, e.g. a soma, is added
+ *    to the voxel containing its center. Points have no volume.
+ *
+ * Elements, or parts thereof, outside of the grid are ignored. Grids with
+ * more voxels than a `std::vector<double>` can hold are rejected with
+ * `std::invalid_argument`, before anything is allocated.
+ *
+ * \returns The values of all voxels, see `VoxelGrid`.
+ */
+template <typename T, typename A>
+inline std::vector<double> rasterize(const IndexTree<T, A>& index,
+                                     const VoxelGrid& grid,
+                                     RasterQuantity quantity);
+
+/** \brief Same as above, but on `n_threads` threads.
+ *
+ * The grid is split into slabs, which are rasterized concurrently. Each thread
+ * accumulates into its own grid, the grids are added up at the end.
+ */
+template <typename T, typename A>
+inline std::vector<double> rasterize(const IndexTree<T, A>& index,
+                                     const VoxelGrid& grid,
+                                     RasterQuantity quantity,
+                                     ThreadPool& pool,
+                                     size_t n_threads);
+
+/// \brief Rasterizes a memory mapped index, see `rasterize`.
+template <typename T>
+inline std::vector<double> rasterize(const MemoryMappedIndexTree<T>& index,
+                                     const VoxelGrid& grid,
+                                     RasterQuantity quantity,
+                                     ThreadPool& pool = ThreadPool::global(),
+                                     size_t n_threads = 1);
+
+/** \brief Rasterizes a multi index, see `rasterize`.
+ *
+ * The subtrees overlapping the grid are rasterized one after the other, each
+ * on `n_threads` threads; while the next ones are loaded by the I/O threads,
+ * see `MultiIndexTreeBase::for_each_subtree`. Hence, subtrees are streamed
+ * through the cache, rather than all being loaded at the same time.
+ */
+template <typename T, typename SubtreeCache>
+inline std::vector<double> rasterize(const MultiIndexTree<T, SubtreeCache>& index,
+                                     const VoxelGrid& grid,
+                                     RasterQuantity quantity,
+                                     ThreadPool& pool = ThreadPool::global(),
+                                     size_t n_threads = 1);
+
+}  // namespace brain_indexer
+
+#include "detail/rasterize.hpp"
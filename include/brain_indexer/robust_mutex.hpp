@@ -0,0 +1,104 @@
+#pragma once
+
+#include <chrono>
+
+#include <pthread.h>
+#include <sys/types.h>
+
+namespace brain_indexer {
+
+/** \brief A mutex shared by processes, which survives the death of its owner.
+ *
+ * It's placed in shared memory, e.g. a Boost.Interprocess segment, and
+ * constructed by exactly one process. If a process dies while holding it,
+ * the next `lock` succeeds rather than blocking forever; and `owner_died`
+ * tells the new owner that the data protected by the mutex might need to be
+ * repaired.
+ *
+ * Where robust mutexes aren't available, e.g. on macOS, it's a plain process
+ * shared mutex; and the death of its owner blocks the other processes.
+ */
+class RobustMutex {
+  public:
+    inline RobustMutex();
+
+    RobustMutex(const RobustMutex&) = delete;
+    RobustMutex& operator=(const RobustMutex&) = delete;
+
+    inline ~RobustMutex();
+
+    inline void lock();
+    inline void unlock();
+
+    /** \brief Did a previous owner die while holding the mutex?
+     *
+     * Resets the flag, i.e. only the first caller after the death is told. Must
+     * be called while holding the mutex.
+     */
+    inline bool owner_died();
+
+  protected:
+    inline explicit RobustMutex(int type);
+
+    /// \brief Restores the mutex after `pthread_mutex_*lock` returned `error`.
+    inline void recover(int error);
+
+  private:
+    friend class RobustCondition;
+
+    pthread_mutex_t mutex_;
+    bool owner_died_ = false;
+};
+
+
+/// \brief A recursive `RobustMutex`.
+class RobustRecursiveMutex : public RobustMutex {
+  public:
+    inline RobustRecursiveMutex();
+};
+
+
+/** \brief Makes Boost.Interprocess segments use `RobustMutex`.
+ *
+ * Pass it to the memory algorithm, e.g. `bip::rbtree_best_fit`, such that a
+ * process killed while allocating doesn't block the other processes.
+ */
+struct RobustMutexFamily {
+    using mutex_type = RobustMutex;
+    using recursive_mutex_type = RobustRecursiveMutex;
+};
+
+
+/// \brief A condition variable, shared by processes, to be used with `RobustMutex`.
+class RobustCondition {
+  public:
+    inline RobustCondition();
+
+    RobustCondition(const RobustCondition&) = delete;
+    RobustCondition& operator=(const RobustCondition&) = delete;
+
+    inline ~RobustCondition();
+
+    /** \brief Waits until notified, or at most `timeout`.
+     *
+     * Spurious wake-ups are possible. The caller must hold `mutex`, which is
+     * held again on return, see `RobustMutex::owner_died`.
+     */
+    inline void wait_for(RobustMutex& mutex, std::chrono::nanoseconds timeout);
+
+    inline void notify_all();
+
+  private:
+    pthread_cond_t cond_;
+};
+
+
+/** \brief Is the process `pid`, on this node, still running?
+ *
+ * Note that the ID of a process that died can be reused by a new process.
+ */
+inline bool is_process_alive(pid_t pid);
+
+}  // namespace brain_indexer
+
+#include "detail/robust_mutex.hpp"
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <vector>
+
+#include <brain_indexer/index.hpp>
+
+namespace brain_indexer {
+
+/**
+ * \brief A morphology index which stores segments and somas separately.
+ *
+ * `IndexTree<MorphoEntry>` stores `boost::variant<Soma, Segment>`, every
+ * element takes the space of the largest alternative plus the discriminator,
+ * and every bounding box or intersection test dispatches on the type. Since
+ * somas are only a tiny fraction of the elements, this index keeps the
+ * segments and somas in two separate trees, each of which only contains
+ * elements of a single type.
+ *
+ * The elements passed to the output iterators are `Segment`s and `Soma`s,
+ * rather than `MorphoEntry`. Iterators that accept a `MorphoEntry` convert
+ * implicitly; the iterators of the library, e.g. the one used by
+ * `find_intersecting_np`, accept both directly. Therefore, the queries have
+ * the same results as those of `IndexTree<MorphoEntry>`, only the order of
+ * the results differs.
+ */
+class SegregatedMorphIndexTree
+    : public IndexTreeMixin<SegregatedMorphIndexTree, MorphoEntry> {
+  public:
+    using value_type = MorphoEntry;
+
+    inline SegregatedMorphIndexTree() = default;
+
+    /// \brief Builds the index from the segments and somas.
+    inline SegregatedMorphIndexTree(const std::vector<Segment>& segments,
+                                    const std::vector<Soma>& somas)
+        : segments_(segments)
+        , somas_(somas) {}
+
+    /// \brief Builds the index from the `MorphoEntry`s `[begin, end)`.
+    template <typename Iterator>
+    inline SegregatedMorphIndexTree(Iterator begin, Iterator end);
+
+    /// \brief Builds the index from the `MorphoEntry`s in `entries`.
+    inline explicit SegregatedMorphIndexTree(const std::vector<MorphoEntry>& entries)
+        : SegregatedMorphIndexTree(entries.begin(), entries.end()) {}
+
+    inline void insert(const Segment& segment) {
+        segments_.insert(segment);
+    }
+
+    inline void insert(const Soma& soma) {
+        somas_.insert(soma);
+    }
+
+    inline void insert(const MorphoEntry& entry) {
+        boost::apply_visitor([this](const auto& e) { insert(e); }, entry);
+    }
+
+    /**
+     * \brief Find elements in tree that intersect with the given shape.
+     *
+     * See `IndexTreeMixin::find_intersecting`. The segments are reported
+     * before the somas.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT, typename OutputIt>
+    inline void find_intersecting(const ShapeT& shape, const OutputIt& iter) const;
+
+    /**
+     * \brief Gets the ids of the the nearest K objects
+     * \returns The ids, ordered by increasing distance to the shape.
+     */
+    template <typename ShapeT>
+    inline std::vector<gid_segm_t> find_nearest(const ShapeT& shape, unsigned k_neighbors) const;
+
+    /// \brief Checks whether a given shape intersects any object in the tree
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline bool is_intersecting(const ShapeT& shape) const;
+
+    /**
+     * \brief Finds & return objects which intersect.
+     * \returns A vector of copies of the objects.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline std::vector<MorphoEntry> find_intersecting_objs(const ShapeT& shape) const;
+
+    inline size_t size() const {
+        return segments_.size() + somas_.size();
+    }
+
+    inline bool empty() const {
+        return segments_.empty() && somas_.empty();
+    }
+
+    /// \brief The bounding box of all elements.
+    inline Box3D bounds() const;
+
+    inline const IndexTree<Segment>& segments() const {
+        return segments_;
+    }
+
+    inline const IndexTree<Soma>& somas() const {
+        return somas_;
+    }
+
+  private:
+    IndexTree<Segment> segments_;
+    IndexTree<Soma> somas_;
+};
+
+
+inline std::ostream& operator<<(std::ostream& os, const SegregatedMorphIndexTree& index);
+
+}  // namespace brain_indexer
+
+#include "detail/segregated_morph_index.hpp"
@@ -0,0 +1,299 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include <boost/interprocess/allocators/allocator.hpp>
+#include <boost/interprocess/containers/map.hpp>
+#include <boost/interprocess/managed_heap_memory.hpp>
+#include <boost/interprocess/managed_shared_memory.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <boost/optional.hpp>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/multi_index.hpp>
+#include <brain_indexer/robust_mutex.hpp>
+
+namespace brain_indexer {
+
+namespace bip = boost::interprocess;
+
+/// \brief A POSIX shared memory segment, a process dying while allocating doesn't block it.
+using SharedMemorySegment = bip::basic_managed_shared_memory<
+    char,
+    bip::rbtree_best_fit<RobustMutexFamily>,
+    bip::iset_index
+>;
+
+/// \brief The allocator used to place an R-Tree inside POSIX shared memory.
+template <typename T>
+using SharedMemoryAllocator = bip::allocator<T, SharedMemorySegment::segment_manager>;
+
+
+/// \brief The parameters of `SharedSubtreeCache`.
+struct SharedSubtreeCacheParams {
+    SharedSubtreeCacheParams() = default;
+
+    SharedSubtreeCacheParams(size_t max_cached_bytes, std::string name)
+        : max_cached_bytes(max_cached_bytes)
+        , name(std::move(name)) { }
+
+    /// The size of the shared memory segment, for all processes together.
+    size_t max_cached_bytes = 1ul;
+
+    /// The name of the shared memory segment, e.g. derived from the index path.
+    std::string name;
+};
+
+
+/** \brief A subtree cache shared by all processes on a node.
+ *
+ *  Every process using a `UsageRateCache` loads its own copy of the subtrees
+ *  it needs. With many processes querying the same multi index, the memory
+ *  used by the node is a multiple of the working set. This cache keeps the
+ *  subtrees in a named POSIX shared memory segment instead. A subtree is
+ *  deserialized, directly into the segment, by the first process that needs
+ *  it; all other processes opening a cache with the same `name` map it too.
+ *
+ *  The segment is created by the first process with `max_cached_bytes`,
+ *  processes opening the cache later use the existing segment regardless of
+ *  their `max_cached_bytes`. Hence, the budget applies to the node, not to a
+ *  process. It includes the bookkeeping of the cache.
+ *
+ *  The bookkeeping lives in the segment too, and is protected by an
+ *  interprocess mutex. For every subtree it counts the handles of each
+ *  process, i.e. the pins. Only subtrees that aren't pinned are evicted, the
+ *  least recently used first; prefetched subtrees nobody used are evicted
+ *  before all others. The victim is found by a linear scan, which is cheap
+ *  compared to loading a subtree. If a subtree doesn't fit, even after
+ *  evicting everything that can be evicted, it's loaded into memory private to
+ *  the process; and freed once the last handle is gone.
+ *
+ *  The cache can be used by several threads of each process concurrently. If
+ *  several threads or processes request the same missing subtree, it's loaded
+ *  once and the others wait for it.
+ *
+ *  The segment outlives the processes, until it's removed with `remove`, e.g.
+ *  after the index has been rebuilt.
+ *
+ *  Processes may be killed while using the cache. The pins and the subtrees
+ *  being loaded are recorded with the ID of the process. The state of dead
+ *  processes is reclaimed once nothing can be evicted; or when waiting for a
+ *  subtree whose loader died, which is checked every
+ *  `liveness_check_interval`. The mutexes are robust, i.e. the next process
+ *  locking them after their owner died reclaims its state, too. However, the
+ *  memory of a partially loaded subtree is lost; and a process killed in the
+ *  middle of updating the bookkeeping or the allocator, which takes a few
+ *  instructions, can leave them inconsistent. Where robust mutexes aren't
+ *  available, e.g. on macOS, a process dying while holding a mutex still
+ *  blocks the others. Then, the segment must be removed.
+ *
+ *  \tparam Storage  A policy for loading subtrees from disk, see
+ *                   `MultiIndexStorage::load_subtree_into`.
+ */
+template <class Storage>
+class SharedSubtreeCache {
+  public:
+    using storage_type = Storage;
+    using value_type = typename storage_type::subtree_type::value_type;
+    using subtree_type = IndexTreeBaseT<value_type, SharedMemoryAllocator<value_type>>;
+    using params_type = SharedSubtreeCacheParams;
+
+    /// \brief A pinned subtree, it's not evicted while the handle exists.
+    using subtree_handle = std::shared_ptr<const subtree_type>;
+
+  public:
+    SharedSubtreeCache() = default;
+
+    /// \brief Opens, or creates, the shared memory segment `params.name`.
+    SharedSubtreeCache(const SharedSubtreeCacheParams& params, Storage storage);
+
+    /// \brief Return the subtree with id `subtree_id`, loading it if needed.
+    template<class SubtreeID>
+    inline subtree_handle load_subtree(const SubtreeID& subtree_id, size_t query_count);
+
+    /// \brief Returns the subtree if it's in the cache; and `nullptr` otherwise.
+    template<class SubtreeID>
+    inline subtree_handle find_subtree(const SubtreeID& subtree_id, size_t query_count);
+
+    /// \brief Is the subtree in the cache, or being loaded into it?
+    template<class SubtreeID>
+    inline bool is_cached(const SubtreeID& subtree_id);
+
+    /** \brief Loads the subtree into the cache, if there's room for it.
+     *
+     * See `UsageRateCache::prefetch_subtree`, this never evicts a subtree.
+     */
+    template<class SubtreeID>
+    inline bool prefetch_subtree(const SubtreeID& subtree_id, size_t query_count);
+
+    /// \brief The prefetch counters of all processes sharing the cache.
+    inline PrefetchStats prefetch_stats() const;
+
+    /// \brief The memory occupied by the subtrees in the segment, in bytes.
+    inline size_t cached_bytes() const;
+
+    /// \brief Removes the shared memory segment `name`, processes using it keep it mapped.
+    static inline void remove(const std::string& name);
+
+    /// \brief How often a process waiting for a subtree checks that its loader is alive.
+    static constexpr auto liveness_check_interval = std::chrono::milliseconds(100);
+
+  private:
+    using segment_manager = SharedMemorySegment::segment_manager;
+
+    // A process private heap, with the same segment manager as the segment.
+    using private_heap = bip::basic_managed_heap_memory<char,
+                                                        bip::rbtree_best_fit<RobustMutexFamily>,
+                                                        bip::iset_index>;
+
+    /** \brief A subtree in the segment; `subtree` is null while it's being loaded.
+     *
+     * `n_pins` is the total of the pins of all processes, see `PinMap`.
+     */
+    struct Entry {
+        bip::offset_ptr<subtree_type> subtree;
+        size_t bytes = 0;
+        size_t n_pins = 0;
+        size_t last_used = 0;
+        bool unused_prefetch = false;
+
+        // The process loading the subtree, while `subtree` is null.
+        pid_t loader = 0;
+    };
+
+    using EntryMap = bip::map<size_t,
+                              Entry,
+                              std::less<size_t>,
+                              SharedMemoryAllocator<std::pair<const size_t, Entry>>>;
+
+    /** \brief The pins of every process, by process and subtree.
+     *
+     * The process loading a subtree for a query reserves its pin, with a count
+     * of zero, such that publishing the subtree doesn't need memory.
+     */
+    using PinKey = std::pair<pid_t, size_t>;
+    using PinMap = bip::map<PinKey,
+                            size_t,
+                            std::less<PinKey>,
+                            SharedMemoryAllocator<std::pair<const PinKey, size_t>>>;
+
+    /// \brief The bookkeeping shared by all processes, protected by `mutex`.
+    struct Control {
+        explicit Control(segment_manager* manager)
+            : entries(manager)
+            , pins(manager) { }
+
+        RobustMutex mutex;
+
+        // Notified whenever a subtree finished loading, or failed to load.
+        RobustCondition loaded;
+
+        EntryMap entries;
+        PinMap pins;
+        size_t n_cached_bytes = 0;
+        size_t clock = 0;
+        size_t value_size = sizeof(value_type);
+
+        // All subtrees ever read, used to estimate the size of the next one.
+        size_t n_read_bytes = 0;
+        size_t n_read_elements = 0;
+
+        PrefetchStats prefetch_stats;
+    };
+
+    using lock_type = bip::scoped_lock<RobustMutex>;
+
+    /// \brief The mapped segment; kept alive by the handles.
+    struct Arena {
+        SharedMemorySegment segment;
+        Control* control = nullptr;
+    };
+
+    /// \brief Locks the bookkeeping, and repairs it if the previous owner died.
+    static inline lock_type lock_control(Arena& arena);
+
+    /** \brief Reclaims the state of processes which died, if the owner of the
+     *  mutex was one of them. The caller must hold the mutex.
+     */
+    static inline void repair_after_owner_died(Control& control);
+
+    /** \brief Drops the pins and unfinished loads of processes which died.
+     *
+     * Returns whether anything was reclaimed. The caller must hold the mutex.
+     */
+    static inline bool reclaim_dead_processes(Control& control);
+
+    /** \brief Waits for the subtree, if it's being loaded, and pins it.
+     *
+     * Returns `nullptr` if the subtree isn't in the cache; or if there's no
+     * room to record the pin. The caller must hold the mutex.
+     */
+    inline subtree_handle wait_and_pin(size_t id);
+
+    /** \brief Marks the subtree as being loaded by the caller.
+     *
+     * If `pin`, the pin of the calling process is reserved too. Returns false
+     * if there's no room for the marker, even after evicting subtrees if
+     * `may_evict`. The caller must hold the mutex.
+     */
+    inline bool begin_loading(size_t id, bool pin, bool may_evict);
+
+    /** \brief Deserializes the subtree, of about `n_bytes`, into the segment.
+     *
+     * Subtrees are evicted to make room for it if `may_evict`. Returns `nullptr`
+     * if the subtree doesn't fit.
+     */
+    inline subtree_type* load_into_segment(size_t id, size_t n_bytes, bool may_evict);
+
+    /// \brief Publishes the subtree the caller was loading, and pins it if `pin`.
+    inline subtree_handle finish_loading(size_t id, subtree_type* subtree, bool pin);
+
+    /// \brief Forgets the subtree the caller failed to load.
+    inline void abort_loading(size_t id);
+
+    /// \brief Loads the subtree into memory private to this process.
+    inline subtree_handle load_private(size_t id, size_t n_bytes) const;
+
+    /** \brief Pins the loaded subtree of `entry`, the caller must hold the mutex.
+     *
+     * Returns `nullptr` if there's no room to record the pin, even after
+     * evicting other subtrees.
+     */
+    inline subtree_handle pin(Entry& entry, size_t id);
+
+    /// \brief Drops a pin of process `pid`, called by the handles.
+    static inline void unpin(Arena& arena, pid_t pid, size_t id);
+
+    /** \brief Evicts the least recently used unpinned subtree, other than `keep`.
+     *
+     * If every subtree is pinned, the pins of dead processes are reclaimed
+     * first. The caller must hold the mutex.
+     */
+    inline bool evict_one(boost::optional<size_t> keep = boost::none);
+
+    /// \brief The expected memory of a subtree, the caller must hold the mutex.
+    inline size_t estimated_bytes(size_t n_elements) const;
+
+    template <class Memory>
+    static inline subtree_type* construct_subtree(Memory& memory);
+
+    Storage storage;
+    std::shared_ptr<Arena> arena;
+};
+
+template <class T>
+using SharedSubtreeCacheT = SharedSubtreeCache<NativeStorageT<T>>;
+
+/** \brief A multi index whose subtrees are shared by all processes on a node.
+ *
+ *  Open it with `SharedSubtreeCacheParams`, see `SharedSubtreeCache`.
+ */
+template <class T>
+using SharedMultiIndexTree = MultiIndexTree<T, SharedSubtreeCacheT<T>>;
+
+}  // namespace brain_indexer
+
+#include "detail/shared_subtree_cache.hpp"
@@ -141,6 +141,19 @@ public:
 template <typename Value, typename GetCoordinate>
 void serial_sort_tile_recursion(std::vector<Value> &values, const SerialSTRParams&str_params);
 
+template<size_t dim, typename Value>
+inline CoordType get_centroid_coordinate(const Value &value);
+
+
+template<typename Value>
+struct GetCenterCoordinate {
+public:
+    template<size_t dim>
+    inline static CoordType apply(const Value &value) {
+        return get_centroid_coordinate<dim>(value);
+    }
+};
+
 inline bool is_power_of_two(int n) { return (n & (n - 1)) == 0; }
 inline int int_log2(int n) { return int(std::round(std::log2(n))); }
 inline int int_pow2(int k) { return 1 << k; }
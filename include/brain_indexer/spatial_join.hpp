@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/multi_index.hpp>
+#include <brain_indexer/thread_pool.hpp>
+
+
+namespace brain_indexer {
+
+/** \brief Finds all pairs of elements within `distance` of each other.
+ *
+ * The result contains the pair `(a, b)` for every element `a` of `lhs` and
+ * every element `b` of `rhs` which are within `distance` of each other. The
+ * `GeometryMode` selects what "within" means:
+ *
+ *   - `BoundingBoxGeometry`: the distance between the bounding boxes of the
+ *     two elements is at most `distance`.
+ *
+ *   - `BestEffortGeometry`: the shape of `a`, grown by `distance`, intersects
+ *     `b` in the sense of `geometry_intersects`. Spheres and cylinders grow
+ *     their radius, points become spheres and boxes grow on every side.
+ *     Note that the flat caps of cylinders don't grow.
+ *
+ * Instead of one query per element, both trees are descended together.
+ * Pairs of nodes whose bounding boxes are further than `distance` apart are
+ * pruned together with all their descendants. The pairs are returned as two
+ * arrays of ids, pair `i` is `(lhs_ids[i], rhs_ids[i])`. The order of the
+ * pairs is deterministic, but otherwise unspecified.
+ */
+template <typename GeometryMode = BoundingBoxGeometry,
+          typename T, typename A, typename U, typename B>
+inline auto join_within(const IndexTree<T, A>& lhs,
+                        const IndexTree<U, B>& rhs,
+                        CoordType distance);
+
+/** \brief Finds all pairs within `distance`, using `n_threads` of `pool`.
+ *
+ * Returns the same pairs in the same order as the serial overload. The
+ * traversal is split into many pairs of subtrees, which are joined
+ * concurrently.
+ */
+template <typename GeometryMode = BoundingBoxGeometry,
+          typename T, typename A, typename U, typename B>
+inline auto join_within(const IndexTree<T, A>& lhs,
+                        const IndexTree<U, B>& rhs,
+                        CoordType distance,
+                        ThreadPool& pool,
+                        size_t n_threads);
+
+/** \brief Finds all pairs of distinct elements of `index` within `distance`.
+ *
+ * This is the self-join. Every unordered pair is reported once, and an
+ * element is never paired with itself.
+ */
+template <typename GeometryMode = BoundingBoxGeometry, typename T, typename A>
+inline auto join_within(const IndexTree<T, A>& index, CoordType distance);
+
+/// \brief The self-join, using `n_threads` of `pool`.
+template <typename GeometryMode = BoundingBoxGeometry, typename T, typename A>
+inline auto join_within(const IndexTree<T, A>& index,
+                        CoordType distance,
+                        ThreadPool& pool,
+                        size_t n_threads);
+
+/** \brief Finds all pairs within `distance` of two multi indexes.
+ *
+ * First the top-level trees are joined, which results in the pairs of
+ * subtrees that can contain pairs. Then these subtrees are loaded, grouped
+ * by the subtree of `lhs`, and joined. Hence, every subtree of `lhs` is
+ * loaded once and the subtrees of `rhs` as needed.
+ *
+ * The pairs of subtrees are joined on `n_threads` of `pool`; the subtrees
+ * are loaded by the calling thread.
+ */
+template <typename GeometryMode = BoundingBoxGeometry, typename T, typename C, typename U, typename D>
+inline auto join_within(const MultiIndexTree<T, C>& lhs,
+                        const MultiIndexTree<U, D>& rhs,
+                        CoordType distance,
+                        ThreadPool& pool = ThreadPool::global(),
+                        size_t n_threads = 1);
+
+/// \brief The self-join of a multi index, see the in-memory self-join.
+template <typename GeometryMode = BoundingBoxGeometry, typename T, typename C>
+inline auto join_within(const MultiIndexTree<T, C>& index,
+                        CoordType distance,
+                        ThreadPool& pool = ThreadPool::global(),
+                        size_t n_threads = 1);
+
+}  // namespace brain_indexer
+
+#include "detail/spatial_join.hpp"
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace brain_indexer {
+
+/**
+ * \brief A fixed number of worker threads executing submitted tasks.
+ *
+ * Tasks are executed in the order they're submitted. The workers are joined
+ * when the pool is destroyed, after all pending tasks have run.
+ *
+ * Tasks must not call into Python, since the workers don't hold the GIL. The
+ * exception is `util::check_signals`, which does nothing in threads that
+ * weren't started by Python.
+ */
+class ThreadPool {
+  public:
+    /// \brief Starts `n_threads` workers, at least one.
+    inline explicit ThreadPool(size_t n_threads);
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    inline ~ThreadPool();
+
+    /// \brief The number of worker threads.
+    inline size_t size() const {
+        return workers_.size();
+    }
+
+    /** \brief Enqueues `f` to be called by one of the workers.
+     *
+     * Exceptions thrown by `f` are rethrown by `std::future::get`.
+     */
+    template <class F>
+    inline std::future<std::invoke_result_t<F>> submit(F&& f);
+
+    /** \brief A pool shared by the entire process.
+     *
+     * It has one worker per hardware thread and is created on first use.
+     */
+    inline static ThreadPool& global();
+
+  private:
+    inline void work();
+
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+};
+
+
+/** \brief Calls `f(k)` for every `k` in `[0, n_tasks)` concurrently.
+ *
+ * At most `n_threads` workers of `pool` are used. The tasks are handed out
+ * dynamically, hence `f(k)` may be called from any thread and in any order.
+ * The call blocks until all tasks have finished. If any task throws, the
+ * first exception is rethrown after all workers have stopped.
+ *
+ * If `n_threads <= 1` the tasks are run, in order, on the calling thread.
+ *
+ * Note: Don't call this from a task running on `pool`, the workers would
+ * wait for each other.
+ */
+template <class F>
+inline void parallel_for(ThreadPool& pool, size_t n_tasks, size_t n_threads, F&& f);
+
+}  // namespace brain_indexer
+
+#include "detail/thread_pool.hpp"
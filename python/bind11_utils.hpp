@@ -38,6 +38,26 @@ inline auto as_pyarray(Sequence&& seq) {
 }
 
 
+/**
+ * \brief Same as `as_pyarray`, but each element becomes a row of `NCols` scalars.
+ *
+ * E.g. a vector of points becomes an `n x 3` array, without copies.
+ */
+template <typename Scalar, std::size_t NCols, typename Sequence>
+inline auto as_pyarray_2d(Sequence&& seq) {
+    static_assert(sizeof(typename Sequence::value_type) == NCols * sizeof(Scalar),
+                  "The elements must consist of exactly `NCols` scalars.");
+
+    Sequence* seq_ptr = new Sequence(std::move(seq));
+    auto capsule = py::capsule(seq_ptr,
+                               [](void* p) { delete reinterpret_cast<Sequence*>(p); });
+
+    return py::array_t<Scalar>({seq_ptr->size(), NCols},
+                               reinterpret_cast<const Scalar*>(seq_ptr->data()),
+                               capsule);
+}
+
+
 /**
  * \brief Converts and STL Sequence to numpy array by copying i
  */
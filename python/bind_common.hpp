@@ -1,7 +1,13 @@
 #pragma once
 
+#include <brain_indexer/aggregate_counts.hpp>
 #include <brain_indexer/index.hpp>
 #include "brain_indexer/multi_index.hpp"
+#include <brain_indexer/memory_mapped_index.hpp>
+#include <brain_indexer/query_cursor.hpp>
+#include <brain_indexer/rasterize.hpp>
+#include <brain_indexer/shared_subtree_cache.hpp>
+#include <brain_indexer/spatial_join.hpp>
 #include <brain_indexer/util.hpp>
 
 
@@ -11,6 +11,21 @@ namespace si_python = si::py_bindings;
 namespace brain_indexer { namespace py_bindings {
 
 void check_signals() {
+    if (PyGILState_Check()) {
+        if (PyErr_CheckSignals() != 0) {
+            throw py::error_already_set();
+        }
+        return;
+    }
+
+    // Worker threads were never known to Python, signals are handled by the
+    // main thread.
+    if (PyGILState_GetThisThreadState() == nullptr) {
+        return;
+    }
+
+    // A Python thread running a query with the GIL released.
+    py::gil_scoped_acquire acquire;
     if (PyErr_CheckSignals() != 0) {
         throw py::error_already_set();
     }
@@ -77,6 +92,8 @@ PYBIND11_MODULE(_brain_indexer, m) {
     );
 
     si_python::create_MetaDataConstants_bindings(m);
+    si_python::create_QueryCursor_bindings(m);
+    si_python::create_AggregateCounts_bindings(m);
 
     using namespace pybind11::literals;
     m.attr("SectionType") = py::module::import("enum").attr("IntEnum")(
@@ -95,23 +112,47 @@ PYBIND11_MODULE(_brain_indexer, m) {
     si_python::create_IndexedPoint_bindings(m);
     si_python::create_Sphere_bindings(m);
     si_python::create_Synapse_bindings(m);
+    si_python::create_Synapse_bindings<si::PointSynapse>(m, "PointSynapse");
     si_python::create_MorphoEntry_bindings(m);
 
     si_python::create_PointIndex_bindings(m, "PointIndex");
     si_python::create_SphereIndex_bindings(m, "SphereIndex");
     si_python::create_SynapseIndex_bindings(m, "SynapseIndex");
+    si_python::create_PointSynapseIndex_bindings(m, "PointSynapseIndex");
     si_python::create_MorphIndex_bindings(m, "MorphIndex");
 
+    // Memory mapped R-trees, queried in place.
+    si_python::create_PointMemoryMappedIndex_bindings(m, "PointMemoryMappedIndex");
+    si_python::create_SphereMemoryMappedIndex_bindings(m, "SphereMemoryMappedIndex");
+    si_python::create_SynapseMemoryMappedIndex_bindings(m, "SynapseMemoryMappedIndex");
+    si_python::create_SynapseMemoryMappedIndex_bindings<si::MemoryMappedIndexTree<si::PointSynapse>>(
+        m, "PointSynapseMemoryMappedIndex");
+    si_python::create_MorphMemoryMappedIndex_bindings(m, "MorphMemoryMappedIndex");
+
     si_python::create_SynapseIndexBulkBuilder_bindings(m, "SynapseIndexBulkBuilder");
+    si_python::create_SynapseIndexBulkBuilder_bindings<si::PointSynapse>(
+        m, "PointSynapseIndexBulkBuilder");
     si_python::create_MorphIndexBulkBuilder_bindings(m, "MorphIndexBulkBuilder");
 
     // Distributed/lazy R-trees, multi-indexes.
     si_python::create_MorphMultiIndex_bindings(m, "MorphMultiIndex");
     si_python::create_SynapseMultiIndex_bindings(m, "SynapseMultiIndex");
+    si_python::create_SynapseMultiIndex_bindings<si::MultiIndexTree<si::PointSynapse>>(
+        m, "PointSynapseMultiIndex");
+
+    // Multi-indexes with subtrees shared by all processes on a node.
+    si_python::create_MorphMultiIndex_bindings<si::SharedMultiIndexTree<si::MorphoEntry>>(
+        m, "MorphSharedMultiIndex");
+    si_python::create_SynapseMultiIndex_bindings<si::SharedMultiIndexTree<si::Synapse>>(
+        m, "SynapseSharedMultiIndex");
+    si_python::create_SynapseMultiIndex_bindings<si::SharedMultiIndexTree<si::PointSynapse>>(
+        m, "PointSynapseSharedMultiIndex");
 
 #if SI_MPI == 1
     si_python::create_MorphMultiIndexBulkBuilder_bindings(m, "MorphMultiIndexBulkBuilder");
     si_python::create_SynapseMultiIndexBulkBuilder_bindings(m, "SynapseMultiIndexBulkBuilder");
+    si_python::create_SynapseMultiIndexBulkBuilder_bindings<si::PointSynapse>(
+        m, "PointSynapseMultiIndexBulkBuilder");
 
     si_python::create_call_some_mpi_from_cxx_bindings(m);
     si_python::create_analysis_bindings(m);
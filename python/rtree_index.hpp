@@ -1,6 +1,9 @@
 #pragma once
 #include "bind_common.hpp"
+#include <cmath>
 #include <iostream>
+#include <mutex>
+#include <optional>
 #include <pybind11/eval.h>
 
 #include <brain_indexer/logging.hpp>
@@ -187,74 +190,422 @@ inline void add_IndexTree_add_points_bindings(py::class_<Class>& c) {
 
 namespace detail {
 
+/** \brief Can Python modify the index, e.g. through `_insert`?
+ *
+ * The GIL is what prevents Python from modifying such an index while it's
+ * being queried. Hence, queries of mutable indexes keep it.
+ */
+template <typename Class>
+struct is_mutable_index : std::false_type {};
+
+template <typename T, typename A>
+struct is_mutable_index<si::IndexTree<T, A>> : std::true_type {};
+
+/** \brief Calls `f` with the GIL released, if `Class` can be queried concurrently.
+ *
+ * Indexes which can't be queried concurrently may call into Python. Hence, for
+ * those the GIL is kept; and for mutable indexes, see `is_mutable_index`.
+ * Signals are still checked without the GIL, e.g. while a multi index loads
+ * subtrees, see `util::check_signals`.
+ *
+ * Batched queries of mutable indexes still run on several threads, only the
+ * calling thread holds the GIL while waiting for them.
+ */
+template <typename Class, typename F>
+inline decltype(auto) release_gil_if_concurrent(F&& f) {
+    if constexpr (supports_concurrent_queries<Class>::value && !is_mutable_index<Class>::value) {
+        py::gil_scoped_release release;
+        return f();
+    } else {
+        return f();
+    }
+}
+
 template<typename Class, typename Shape>
 inline decltype(auto)
 is_intersecting(Class& obj, const Shape& query_shape, const std::string& geometry) {
-    if(geometry == "bounding_box") {
-        return obj.template is_intersecting<BoundingBoxGeometry>(query_shape);
-    }
+    return release_gil_if_concurrent<Class>([&]() {
+        if(geometry == "bounding_box") {
+            return obj.template is_intersecting<BoundingBoxGeometry>(query_shape);
+        }
 
-    if(geometry == "best_effort") {
-        return obj.template is_intersecting<BestEffortGeometry>(query_shape);
-    }
+        if(geometry == "best_effort") {
+            return obj.template is_intersecting<BestEffortGeometry>(query_shape);
+        }
 
-    throw std::runtime_error("Invalid geometry: " + geometry + ".");
+        throw std::runtime_error("Invalid geometry: " + geometry + ".");
+    });
 }
 
 template<typename Class, typename Shape>
 inline decltype(auto)
 find_intersecting_objs(Class& obj, const Shape& query_shape, const std::string& geometry) {
-    if(geometry == "bounding_box") {
-        return obj.template find_intersecting_objs<BoundingBoxGeometry>(query_shape);
+    return release_gil_if_concurrent<Class>([&]() {
+        if(geometry == "bounding_box") {
+            return obj.template find_intersecting_objs<BoundingBoxGeometry>(query_shape);
+        }
+
+        if(geometry == "best_effort") {
+            return obj.template find_intersecting_objs<BestEffortGeometry>(query_shape);
+        }
+
+        throw std::runtime_error("Invalid geometry: " + geometry + ".");
+    });
+}
+
+/** \brief The mask which selects the columns needed for the Python `fields`.
+ *
+ * `None` selects all columns. The field "endpoints" consists of the two
+ * columns "endpoint1" and "endpoint2".
+ */
+template <typename Result>
+inline field_mask_t make_field_mask(const std::optional<std::vector<std::string>>& fields) {
+    if (!fields) {
+        return all_fields;
     }
 
-    if(geometry == "best_effort") {
-        return obj.template find_intersecting_objs<BestEffortGeometry>(query_shape);
+    field_mask_t mask = 0;
+    for (const auto& name : *fields) {
+        if (name == "endpoints") {
+            mask |= si::detail::make_field_mask<Result>({"endpoint1", "endpoint2"});
+        } else {
+            mask |= si::detail::field_bit<Result>(name);
+        }
     }
 
-    throw std::runtime_error("Invalid geometry: " + geometry + ".");
+    return mask;
+}
+
+/// \brief Only the columns needed for `fields` are filled, see `make_field_mask`.
+template<typename Class, typename Shape>
+inline decltype(auto)
+find_intersecting_np(Class& obj,
+                     const Shape& query_shape,
+                     const std::string& geometry,
+                     const std::optional<std::vector<std::string>>& fields = std::nullopt) {
+    using result_t = std::decay_t<
+        decltype(obj.template find_intersecting_np<BoundingBoxGeometry>(query_shape))>;
+    auto mask = make_field_mask<result_t>(fields);
+
+    return release_gil_if_concurrent<Class>([&]() {
+        if(geometry == "bounding_box") {
+            return obj.template find_intersecting_np<BoundingBoxGeometry>(query_shape, mask);
+        }
+
+        if(geometry == "best_effort") {
+            return obj.template find_intersecting_np<BestEffortGeometry>(query_shape, mask);
+        }
+
+        throw std::runtime_error("Invalid geometry: " + geometry + ".");
+    });
+}
+
+/** \brief Runs all queries, on `n_threads` threads if the index supports it.
+ *
+ * Indexes which can't be queried concurrently ignore `n_threads`.
+ */
+template<typename Class, typename Shape>
+inline decltype(auto)
+find_intersecting_batch_np(Class& obj,
+                           const std::vector<Shape>& query_shapes,
+                           const std::string& geometry,
+                           size_t n_threads) {
+    return release_gil_if_concurrent<Class>([&]() {
+        auto run = [&](auto geometry_mode) {
+            using GeometryMode = decltype(geometry_mode);
+            if constexpr (supports_concurrent_queries<Class>::value) {
+                return obj.template find_intersecting_batch_np<GeometryMode>(
+                    query_shapes, ThreadPool::global(), n_threads
+                );
+            } else {
+                return obj.template find_intersecting_batch_np<GeometryMode>(query_shapes);
+            }
+        };
+
+        if(geometry == "bounding_box") {
+            return run(BoundingBoxGeometry{});
+        }
+
+        if(geometry == "best_effort") {
+            return run(BestEffortGeometry{});
+        }
+
+        throw std::runtime_error("Invalid geometry: " + geometry + ".");
+    });
 }
 
 template<typename Class, typename Shape>
 inline decltype(auto)
-find_intersecting_np(Class& obj, const Shape& query_shape, const std::string& geometry) {
+find_unique_gids(Class& obj, const Shape& query_shape, const std::string& geometry) {
+    return release_gil_if_concurrent<Class>([&]() {
+        if(geometry == "bounding_box") {
+            return obj.template find_unique_gids<BoundingBoxGeometry>(query_shape);
+        }
+
+        if(geometry == "best_effort") {
+            return obj.template find_unique_gids<BestEffortGeometry>(query_shape);
+        }
+
+        throw std::runtime_error("Invalid geometry: " + geometry + ".");
+    });
+}
+
+/// \brief Same as `find_intersecting_batch_np`, but for `find_unique_gids`.
+template<typename Class, typename Shape>
+inline decltype(auto)
+find_unique_gids_batch(Class& obj,
+                       const std::vector<Shape>& query_shapes,
+                       const std::string& geometry,
+                       size_t n_threads) {
+    return release_gil_if_concurrent<Class>([&]() {
+        auto run = [&](auto geometry_mode) {
+            using GeometryMode = decltype(geometry_mode);
+            if constexpr (supports_concurrent_queries<Class>::value) {
+                return obj.template find_unique_gids_batch<GeometryMode>(
+                    query_shapes, ThreadPool::global(), n_threads
+                );
+            } else {
+                return obj.template find_unique_gids_batch<GeometryMode>(query_shapes);
+            }
+        };
+
+        if(geometry == "bounding_box") {
+            return run(BoundingBoxGeometry{});
+        }
+
+        if(geometry == "best_effort") {
+            return run(BestEffortGeometry{});
+        }
+
+        throw std::runtime_error("Invalid geometry: " + geometry + ".");
+    });
+}
+
+/// \brief The boxes spanned by `corners[i]` and `opposite_corners[i]`.
+inline std::vector<si::Box3D> make_query_boxes(const array_t& corners,
+                                               const array_t& opposite_corners) {
+    auto corners_ptr = extract_points_ptr(corners);
+    auto opposite_corners_ptr = extract_points_ptr(opposite_corners);
+
+    if (corners.shape(0) != opposite_corners.shape(0)) {
+        throw std::invalid_argument("Please provide exactly one opposite corner per corner.");
+    }
+
+    auto n_queries = util::safe_integer_cast<size_t>(corners.shape(0));
+    std::vector<si::Box3D> boxes;
+    boxes.reserve(n_queries);
+    for (size_t i = 0; i < n_queries; ++i) {
+        boxes.push_back(si::make_query_box(corners_ptr[i], opposite_corners_ptr[i]));
+    }
+
+    return boxes;
+}
+
+/// \brief The spheres with center `centers[i]` and radius `radii[i]`.
+inline std::vector<si::Sphere> make_query_spheres(const array_t& centers, const array_t& radii) {
+    auto [centers_ptr, radii_ptr] = extract_points_radii_ptrs(centers, radii);
+
+    if (radii.ndim() != 1 || centers.shape(0) != radii.shape(0)) {
+        throw std::invalid_argument("Please provide exactly one radius per center.");
+    }
+
+    auto n_queries = util::safe_integer_cast<size_t>(centers.shape(0));
+    std::vector<si::Sphere> spheres;
+    spheres.reserve(n_queries);
+    for (size_t i = 0; i < n_queries; ++i) {
+        spheres.push_back(si::Sphere{centers_ptr[i], radii_ptr[i]});
+    }
+
+    return spheres;
+}
+
+/** \brief A query cursor, the type of the index and query shape are erased.
+ *
+ * `next_chunk` returns the next chunk of results as a dictionary of arrays,
+ * or `None` once all results have been returned. The cursor may advance
+ * without the GIL, hence it's protected by a mutex of its own.
+ */
+struct PyQueryCursor {
+    std::function<py::object(size_t)> next_chunk;
+};
+
+template <typename GeometryMode, typename Class, typename Shape>
+inline auto make_shared_query_cursor(const Class& obj, const Shape& shape) {
+    auto cursor = si::make_query_cursor<GeometryMode>(obj, shape);
+    return std::make_shared<decltype(cursor)>(std::move(cursor));
+}
+
+template <typename GeometryMode, typename T, typename SubtreeCache, typename Shape>
+inline auto make_shared_query_cursor(const si::MultiIndexTree<T, SubtreeCache>& obj,
+                                     const Shape& shape) {
+    using cursor_t = typename decltype(
+        si::make_query_cursor<GeometryMode>(obj, shape)
+    )::element_type;
+
+    return std::shared_ptr<cursor_t>(si::make_query_cursor<GeometryMode>(obj, shape));
+}
+
+template <typename Class, typename Shape, typename WrapAsDict>
+inline PyQueryCursor make_query_cursor(const Class& obj,
+                                       const Shape& shape,
+                                       const std::string& geometry,
+                                       const WrapAsDict& wrap_as_dict) {
+    auto make = [&](auto geometry_mode) {
+        using GeometryMode = decltype(geometry_mode);
+        auto cursor = make_shared_query_cursor<GeometryMode>(obj, shape);
+        auto mutex = std::make_shared<std::mutex>();
+
+        return PyQueryCursor{[cursor, mutex, wrap_as_dict](size_t max_elements) -> py::object {
+            if (max_elements == 0) {
+                throw std::invalid_argument("The chunk size must be positive.");
+            }
+
+            auto chunk = release_gil_if_concurrent<Class>([&]() {
+                std::lock_guard<std::mutex> lock(*mutex);
+                return cursor->next_chunk(max_elements);
+            });
+
+            if (std::get<0>(chunk.fields()).empty()) {
+                return py::none();
+            }
+
+            return wrap_as_dict(std::move(chunk));
+        }};
+    };
+
     if(geometry == "bounding_box") {
-        return obj.template find_intersecting_np<BoundingBoxGeometry>(query_shape);
+        return make(BoundingBoxGeometry{});
     }
 
     if(geometry == "best_effort") {
-        return obj.template find_intersecting_np<BestEffortGeometry>(query_shape);
+        return make(BestEffortGeometry{});
     }
 
     throw std::runtime_error("Invalid geometry: " + geometry + ".");
 }
 
+/// \brief Type erased `AggregateCounts`, the index must outlive it.
+struct PyAggregateCounts {
+    std::function<size_t(const si::Box3D&, const std::string&)> count_box;
+    std::function<size_t(const si::Sphere&, const std::string&)> count_sphere;
+    size_t size;
+};
+
+template <typename Class>
+inline PyAggregateCounts make_aggregate_counts(const Class& obj) {
+    auto counts = std::make_shared<decltype(si::make_aggregate_counts(obj))>(
+        release_gil_if_concurrent<Class>([&obj]() { return si::make_aggregate_counts(obj); })
+    );
+
+    auto count = [counts](const auto& shape, const std::string& geometry) {
+        return release_gil_if_concurrent<Class>([&]() {
+            if(geometry == "bounding_box") {
+                return counts->template count_intersecting<BoundingBoxGeometry>(shape);
+            }
+
+            if(geometry == "best_effort") {
+                return counts->template count_intersecting<BestEffortGeometry>(shape);
+            }
+
+            throw std::runtime_error("Invalid geometry: " + geometry + ".");
+        });
+    };
+
+    return PyAggregateCounts{count, count, counts->size()};
+}
+
+/// \brief The path through `points`, with radius `radius`.
+inline si::Polyline make_query_polyline(const array_t& points, coord_t radius) {
+    auto points_ptr = extract_points_ptr(points);
+
+    if (points.shape(0) == 0) {
+        throw std::invalid_argument("A polyline needs at least one point.");
+    }
+
+    auto n_points = util::safe_integer_cast<size_t>(points.shape(0));
+    return si::Polyline{std::vector<si::Point3D>(points_ptr, points_ptr + n_points), radius};
+}
+
 template<typename Class, typename Shape>
 inline decltype(auto)
 count_intersecting(Class& obj, const Shape& query_shape, const std::string& geometry) {
-    if(geometry == "bounding_box") {
-        return obj.template count_intersecting<BoundingBoxGeometry>(query_shape);
-    }
+    return release_gil_if_concurrent<Class>([&]() {
+        if(geometry == "bounding_box") {
+            return obj.template count_intersecting<BoundingBoxGeometry>(query_shape);
+        }
 
-    if(geometry == "best_effort") {
-        return obj.template count_intersecting<BestEffortGeometry>(query_shape);
-    }
+        if(geometry == "best_effort") {
+            return obj.template count_intersecting<BestEffortGeometry>(query_shape);
+        }
 
-    throw std::runtime_error("Invalid geometry: " + geometry + ".");
+        throw std::runtime_error("Invalid geometry: " + geometry + ".");
+    });
 }
 
 template<typename Class, typename Shape>
 inline decltype(auto)
 count_intersecting_agg_gid(Class& obj, const Shape& query_shape, const std::string& geometry) {
-    if(geometry == "bounding_box") {
-        return obj.template count_intersecting_agg_gid<BoundingBoxGeometry>(query_shape);
+    return release_gil_if_concurrent<Class>([&]() {
+        if(geometry == "bounding_box") {
+            return obj.template count_intersecting_agg_gid<BoundingBoxGeometry>(query_shape);
+        }
+
+        if(geometry == "best_effort") {
+            return obj.template count_intersecting_agg_gid<BestEffortGeometry>(query_shape);
+        }
+
+        throw std::runtime_error("Invalid geometry: " + geometry + ".");
+    });
+}
+
+inline si::GroupBy make_group_by(const std::string& group_by) {
+    if(group_by == "post_gid") {
+        return si::GroupBy::post_gid;
     }
 
-    if(geometry == "best_effort") {
-        return obj.template count_intersecting_agg_gid<BestEffortGeometry>(query_shape);
+    if(group_by == "pre_gid") {
+        return si::GroupBy::pre_gid;
     }
 
-    throw std::runtime_error("Invalid geometry: " + geometry + ".");
+    if(group_by == "pre_post_gid") {
+        return si::GroupBy::pre_post_gid;
+    }
+
+    throw std::runtime_error("Invalid group_by: " + group_by + ".");
+}
+
+/// \brief Same as `find_intersecting_batch_np`, but for `count_intersecting_grouped`.
+template<typename Class, typename Shape>
+inline decltype(auto)
+count_intersecting_grouped(Class& obj,
+                           const std::vector<Shape>& query_shapes,
+                           const std::string& group_by,
+                           const std::string& geometry,
+                           size_t n_threads) {
+    auto key = make_group_by(group_by);
+
+    return release_gil_if_concurrent<Class>([&]() {
+        auto run = [&](auto geometry_mode) {
+            using GeometryMode = decltype(geometry_mode);
+            if constexpr (supports_concurrent_queries<Class>::value) {
+                return obj.template count_intersecting_grouped<GeometryMode>(
+                    query_shapes, key, ThreadPool::global(), n_threads
+                );
+            } else {
+                return obj.template count_intersecting_grouped<GeometryMode>(query_shapes, key);
+            }
+        };
+
+        if(geometry == "bounding_box") {
+            return run(BoundingBoxGeometry{});
+        }
+
+        if(geometry == "best_effort") {
+            return run(BestEffortGeometry{});
+        }
+
+        throw std::runtime_error("Invalid geometry: " + geometry + ".");
+    });
 }
 
 }
@@ -282,6 +633,33 @@ inline void add_IndexTree_is_intersecting_bindings(py::class_<Class>& c) {
          py::arg("opposite_corner"),
          py::arg("geometry")
     );
+
+    c
+    .def("_is_intersecting_cylinder",
+         [](Class& obj,
+            const array_t& p1, const array_t& p2, coord_t radius,
+            const std::string& geometry) {
+             return detail::is_intersecting(
+                 obj, si::Cylinder{mk_point(p1), mk_point(p2), radius}, geometry
+             );
+         },
+         py::arg("p1"),
+         py::arg("p2"),
+         py::arg("radius"),
+         py::arg("geometry")
+    );
+
+    c
+    .def("_is_intersecting_polyline",
+         [](Class& obj, const array_t& points, coord_t radius, const std::string& geometry) {
+             return detail::is_intersecting(
+                 obj, detail::make_query_polyline(points, radius), geometry
+             );
+         },
+         py::arg("points"),
+         py::arg("radius"),
+         py::arg("geometry")
+    );
 }
 
 
@@ -298,6 +676,33 @@ inline void add_IndexTree_find_intersecting_objs_bindings(py::class_<Class>& c)
         py::arg("radius"),
         py::arg("geometry")
     );
+
+    c
+    .def("_find_intersecting_cylinder_objs",
+        [](Class& obj,
+           const array_t& p1, const array_t& p2, coord_t radius,
+           const std::string& geometry) {
+            return detail::find_intersecting_objs(
+                obj, si::Cylinder{mk_point(p1), mk_point(p2), radius}, geometry
+            );
+        },
+        py::arg("p1"),
+        py::arg("p2"),
+        py::arg("radius"),
+        py::arg("geometry")
+    );
+
+    c
+    .def("_find_intersecting_polyline_objs",
+        [](Class& obj, const array_t& points, coord_t radius, const std::string& geometry) {
+            return detail::find_intersecting_objs(
+                obj, detail::make_query_polyline(points, radius), geometry
+            );
+        },
+        py::arg("points"),
+        py::arg("radius"),
+        py::arg("geometry")
+    );
 }
 
 template<typename Class>
@@ -319,24 +724,22 @@ inline void add_IndexTree_find_intersecting_box_objs_bindings(py::class_<Class>&
 
 template<typename Class>
 inline void add_MorphIndex_find_intersecting_box_np(py::class_<Class>& c) {
-    auto wrap_results_in_dict = [](const auto& results) {
-        auto centroid = py::array_t<CoordType>({results.centroid.size(), 3ul},
-                                                (CoordType*)results.endpoint1.data());
-        auto endpoint1 = py::array_t<CoordType>({results.endpoint1.size(), 3ul},
-                                                (CoordType*)results.endpoint1.data());
-        auto endpoint2 = py::array_t<CoordType>({results.endpoint2.size(), 3ul},
-                                                (CoordType*)results.endpoint2.data());
+    // The columns are moved into the numpy arrays, hence `results` by value.
+    auto wrap_results_in_dict = [](auto results) {
+        auto centroid = pyutil::as_pyarray_2d<CoordType, 3>(std::move(results.centroid));
+        auto endpoint1 = pyutil::as_pyarray_2d<CoordType, 3>(std::move(results.endpoint1));
+        auto endpoint2 = pyutil::as_pyarray_2d<CoordType, 3>(std::move(results.endpoint2));
 
         return py::dict(
-            "gid"_a=pyutil::to_pyarray(results.gid), 
-            "section_id"_a=pyutil::to_pyarray(results.section_id),
-            "segment_id"_a=pyutil::to_pyarray(results.segment_id),
-            "ids"_a=pyutil::to_pyarray(results.ids),
+            "gid"_a=pyutil::as_pyarray(std::move(results.gid)),
+            "section_id"_a=pyutil::as_pyarray(std::move(results.section_id)),
+            "segment_id"_a=pyutil::as_pyarray(std::move(results.segment_id)),
+            "ids"_a=pyutil::as_pyarray(std::move(results.ids)),
             "centroid"_a=centroid,
-            "radius"_a=pyutil::to_pyarray(results.radius),
+            "radius"_a=pyutil::as_pyarray(std::move(results.radius)),
             "endpoints"_a=py::make_tuple(endpoint1, endpoint2),
-            "section_type"_a=pyutil::to_pyarray(results.section_type),
-            "is_soma"_a=pyutil::to_pyarray(results.is_soma)
+            "section_type"_a=pyutil::as_pyarray(std::move(results.section_type)),
+            "is_soma"_a=pyutil::as_pyarray(std::move(results.is_soma))
         );
     };
 
@@ -367,6 +770,31 @@ inline void add_IndexTree_count_intersecting_bindings(py::class_<Class>& c) {
          py::arg("center"),
          py::arg("radius"),
          py::arg("geometry")
+    )
+    .def("_count_intersecting_cylinder",
+         [](Class& obj,
+            const array_t& p1, const array_t& p2, CoordType radius,
+            const std::string& geometry) {
+             return detail::count_intersecting(
+                obj,
+                si::Cylinder{mk_point(p1), mk_point(p2), radius},
+                geometry);
+         },
+         py::arg("p1"),
+         py::arg("p2"),
+         py::arg("radius"),
+         py::arg("geometry")
+    )
+    .def("_count_intersecting_polyline",
+         [](Class& obj, const array_t& points, CoordType radius, const std::string& geometry) {
+             return detail::count_intersecting(
+                obj,
+                detail::make_query_polyline(points, radius),
+                geometry);
+         },
+         py::arg("points"),
+         py::arg("radius"),
+         py::arg("geometry")
     );
 }
 
@@ -375,9 +803,220 @@ inline void add_IndexTree_find_nearest_bindings(py::class_<Class>& c) {
     c
     .def("_find_nearest",
         [](Class& obj, const array_t& point, const int k_neighbors) {
-            const auto& vec = obj.find_nearest(mk_point(point), k_neighbors);
-            return pyutil::to_pyarray(vec);
+            auto vec = obj.find_nearest(mk_point(point), k_neighbors);
+            return pyutil::as_pyarray(std::move(vec));
+        }
+    )
+
+    .def("_find_nearest_exact",
+        [](Class& obj, const array_t& point, unsigned k_neighbors, CoordType max_distance) {
+            auto nearest = detail::release_gil_if_concurrent<Class>([&]() {
+                return obj.find_nearest_exact(mk_point(point), k_neighbors, max_distance);
+            });
+
+            return py::make_tuple(pyutil::as_pyarray(std::move(nearest.ids)),
+                                  pyutil::as_pyarray(std::move(nearest.distances)));
+        },
+        py::arg("point"),
+        py::arg("k_neighbors"),
+        py::arg("max_distance") = std::numeric_limits<CoordType>::infinity(),
+        R"(
+        Finds the `k_neighbors` elements closest to `point`.
+
+        Unlike `_find_nearest`, the distance is the distance to the element
+        itself, not to its bounding box. Only elements within `max_distance`
+        are returned. Returns the ids and the distances, ordered by
+        increasing distance.
+        )"
+    )
+
+    .def("_find_nearest_exact_batch",
+        [](Class& obj, const array_t& points, unsigned k_neighbors,
+           CoordType max_distance, size_t n_threads) {
+            auto const* const points_ptr = extract_points_ptr(points);
+            auto n_queries = util::safe_integer_cast<size_t>(points.shape(0));
+            auto query_points = std::vector<Point3D>(points_ptr, points_ptr + n_queries);
+
+            auto batch = detail::release_gil_if_concurrent<Class>([&]() {
+                if constexpr (supports_concurrent_queries<Class>::value) {
+                    return obj.find_nearest_exact_batch(
+                        query_points, k_neighbors, max_distance, ThreadPool::global(), n_threads
+                    );
+                } else {
+                    return obj.find_nearest_exact_batch(query_points, k_neighbors, max_distance);
+                }
+            });
+
+            auto shape = py::make_tuple(n_queries, k_neighbors);
+            return py::make_tuple(
+                pyutil::as_pyarray(std::move(batch.ids)).attr("reshape")(shape),
+                pyutil::as_pyarray(std::move(batch.distances)).attr("reshape")(shape)
+            );
+        },
+        py::arg("points"),
+        py::arg("k_neighbors"),
+        py::arg("max_distance") = std::numeric_limits<CoordType>::infinity(),
+        py::arg("n_threads") = 1,
+        R"(
+        Runs `_find_nearest_exact` for every row of `points`.
+
+        Returns two arrays of shape `(len(points), k_neighbors)`, the ids
+        and the distances. Rows with fewer than `k_neighbors` results are
+        padded with an infinite distance. If the index supports it, the
+        queries are run on `n_threads` threads with the GIL released.
+        )"
+    );
+}
+
+namespace detail {
+
+/// \brief Joins `lhs` with `rhs`, or with itself if `rhs` is null.
+template<typename Class>
+inline py::tuple join_within(const Class& lhs,
+                             const Class* rhs,
+                             CoordType distance,
+                             const std::string& geometry,
+                             size_t n_threads) {
+    auto result = release_gil_if_concurrent<Class>([&]() {
+        auto run = [&](auto geometry_mode) {
+            using GeometryMode = decltype(geometry_mode);
+            auto& pool = ThreadPool::global();
+            if(rhs == nullptr) {
+                return si::join_within<GeometryMode>(lhs, distance, pool, n_threads);
+            }
+            return si::join_within<GeometryMode>(lhs, *rhs, distance, pool, n_threads);
+        };
+
+        if(geometry == "bounding_box") {
+            return run(BoundingBoxGeometry{});
+        }
+
+        if(geometry == "best_effort") {
+            return run(BestEffortGeometry{});
         }
+
+        throw std::runtime_error("Invalid geometry: " + geometry + ".");
+    });
+
+    return py::make_tuple(pyutil::as_pyarray(std::move(result.lhs_ids)),
+                          pyutil::as_pyarray(std::move(result.rhs_ids)));
+}
+
+}
+
+template<typename Class>
+inline void add_IndexTree_join_within_bindings(py::class_<Class>& c) {
+    c
+    .def("_join_within",
+        [](const Class& obj, const Class& other, CoordType distance,
+           const std::string& geometry, size_t n_threads) {
+            return detail::join_within(obj, &other, distance, geometry, n_threads);
+        },
+        py::arg("other"),
+        py::arg("distance"),
+        py::arg("geometry"),
+        py::arg("n_threads") = 1,
+        R"(
+        Finds all pairs `(a, b)` of an element `a` of this index and an
+        element `b` of `other` within `distance` of each other.
+
+        Both trees are descended together, pruning pairs of nodes that are
+        too far apart. Returns the ids of `a` and the ids of `b` as two
+        arrays of equal length.
+        )"
+    )
+
+    .def("_self_join_within",
+        [](const Class& obj, CoordType distance,
+           const std::string& geometry, size_t n_threads) {
+            return detail::join_within(obj, static_cast<const Class*>(nullptr),
+                                       distance, geometry, n_threads);
+        },
+        py::arg("distance"),
+        py::arg("geometry"),
+        py::arg("n_threads") = 1,
+        R"(
+        Finds all pairs of distinct elements within `distance` of each
+        other. Every unordered pair is returned once.
+        )"
+    );
+}
+
+namespace detail {
+
+inline si::RasterQuantity make_raster_quantity(const std::string& quantity) {
+    if(quantity == "count") {
+        return si::RasterQuantity::count;
+    }
+
+    if(quantity == "length") {
+        return si::RasterQuantity::length;
+    }
+
+    if(quantity == "volume") {
+        return si::RasterQuantity::volume;
+    }
+
+    throw std::runtime_error("Invalid quantity: " + quantity + ".");
+}
+
+}
+
+template<typename Class>
+inline void add_IndexTree_rasterize_bindings(py::class_<Class>& c) {
+    c
+    .def("_rasterize",
+        [](const Class& obj,
+           const array_t& origin, CoordType voxel_size, const array_ids& shape,
+           const std::string& quantity, size_t n_threads) {
+            if (shape.size() != 3) {
+                throw std::invalid_argument("The shape of the grid must have three entries.");
+            }
+
+            // Otherwise, the voxel coordinates are NaN or infinite.
+            if (!std::isfinite(voxel_size) || voxel_size <= 0) {
+                throw std::invalid_argument("The voxel size must be finite and positive.");
+            }
+
+            auto grid_origin = mk_point(origin);
+            if (!std::isfinite(grid_origin.get<0>()) || !std::isfinite(grid_origin.get<1>())
+                || !std::isfinite(grid_origin.get<2>())) {
+                throw std::invalid_argument("The origin of the grid must be finite.");
+            }
+
+            auto n = shape.unchecked<1>();
+            if (n(0) == 0 || n(1) == 0 || n(2) == 0) {
+                throw std::invalid_argument("The shape of the grid must be positive.");
+            }
+
+            auto grid = si::VoxelGrid{
+                grid_origin,
+                voxel_size,
+                {size_t(n(0)), size_t(n(1)), size_t(n(2))}
+            };
+            auto raster_quantity = detail::make_raster_quantity(quantity);
+
+            auto voxels = release_gil_if_concurrent<Class>([&]() {
+                return si::rasterize(obj, grid, raster_quantity, ThreadPool::global(), n_threads);
+            });
+
+            return pyutil::as_pyarray(std::move(voxels)).attr("reshape")(
+                py::make_tuple(grid.shape[0], grid.shape[1], grid.shape[2])
+            );
+        },
+        py::arg("origin"),
+        py::arg("voxel_size"),
+        py::arg("shape"),
+        py::arg("quantity"),
+        py::arg("n_threads") = 1,
+        R"(
+        Computes `quantity` for every voxel of a regular grid.
+
+        The grid consists of `shape` cubic voxels of side length `voxel_size`,
+        its lower corner is `origin`. Every element is visited once and added
+        to all voxels it overlaps. `quantity` is one of "count", "length" or
+        "volume". Returns a 3D array of doubles.
+        )"
     );
 }
 
@@ -422,6 +1061,7 @@ inline py::class_<Class> generic_IndexTree_bindings(py::module& m,
                                                     const char* class_name) {
     py::class_<Class> c = py::class_<Class, HolderT>(m, class_name);
     add_IndexTree_query_bindings(c);
+    add_IndexTree_rasterize_bindings(c);
 
     add_IndexTree_bounds_bindings(c);
     add_str_for_streamable_bindings<Class>(c);
@@ -449,7 +1089,10 @@ template <
 >
 inline py::class_<Class> create_IndexTree_bindings(py::module& m,
                                                    const char* class_name) {
-    return generic_IndexTree_bindings<T, SomaT, Class>(m, class_name)
+    auto c = generic_IndexTree_bindings<T, SomaT, Class>(m, class_name);
+    add_IndexTree_join_within_bindings(c);
+
+    return c
 
     .def(py::init<>(), "Constructor of an empty BrainIndexer.")
 
@@ -471,6 +1114,42 @@ inline py::class_<Class> create_IndexTree_bindings(py::module& m,
         Args:
             filename(str): The file path to write the spatial index to.
         )"
+    )
+
+    .def("_dump_memory_mapped",
+        [](const Class& obj, const std::string& index_path) {
+            si::MemoryMappedIndexTree<T>::create(index_path, obj.begin(), obj.end());
+        },
+        R"(
+        Save the spatial index as a memory mapped index.
+
+        A memory mapped index isn't loaded when opened. Instead it's queried
+        in place from the file.
+
+        Args:
+            index_path(str): The directory to write the spatial index to.
+        )"
+    );
+}
+
+
+/// Bindings for MemoryMappedIndexTree<T>, based on generic IndexTree<T> bindings
+
+template <typename T, typename SomaT = T, typename Class = si::MemoryMappedIndexTree<T>>
+inline py::class_<Class> create_MemoryMappedIndexTree_bindings(py::module& m,
+                                                               const char* class_name) {
+    return generic_IndexTree_bindings<T, SomaT, Class>(m, class_name)
+
+    .def(py::init<const std::string&>(),
+        R"(
+        Opens a memory mapped spatial index.
+
+        The index isn't loaded into memory. Instead the file is mapped
+        read-only and queried in place.
+
+        Args:
+            index_path(str): The path of the index.
+        )"
     );
 }
 
@@ -531,31 +1210,137 @@ inline void add_IndexTree_deprecated_ctors(py::class_<Class>& c) {
         Creates a BrainIndexer prefilled with spheres with explicit ids
         or points with explicit ids and radii = None.
 
-        Args:
-            centroids(np.array): A Nx3 array[float32] of the segments' end points
-            radii(np.array): An array[float32] with the segments' radii, or None
-            py_ids(np.array): An array[int64] with the ids of the spheres
-        )"
-    );
-}
+        Args:
+            centroids(np.array): A Nx3 array[float32] of the segments' end points
+            radii(np.array): An array[float32] with the segments' radii, or None
+            py_ids(np.array): An array[int64] with the ids of the spheres
+        )"
+    );
+}
+
+
+///
+/// 1.0 - Sphere index
+///
+
+template <typename Class>
+inline void add_SphereIndex_fields_bindings(py::class_<Class>& c) {
+    c.def_property_readonly_static(
+        "builtin_fields",
+        [](py::object& /* self */) {
+            return std::vector<std::string>{
+                "id",
+                "centroid",
+                "radius"
+            };
+        },
+        "List of fields that are builtin."
+    );
+}
+
+template<typename Class>
+inline void add_IndexTree_aggregate_counts_bindings(py::class_<Class>& c) {
+    c
+    .def("_aggregate_counts",
+        [](const Class& obj) {
+            return detail::make_aggregate_counts(obj);
+        },
+        py::keep_alive<0, 1>(),
+        R"(
+        Computes the number of elements below every node of the tree.
+
+        The returned object counts box and sphere queries without descending
+        into nodes that are contained in the query shape. It must be
+        recomputed after the index is modified.
+        )"
+    );
+}
+
+template<typename Class>
+inline void add_IndexTree_find_unique_gids_bindings(py::class_<Class>& c) {
+    c
+    .def("_find_unique_gids_box",
+        [](Class& obj,
+           const array_t& corner, const array_t& opposite_corner,
+           const std::string& geometry) {
+            auto result = detail::find_unique_gids(
+                obj,
+                si::make_query_box(mk_point(corner), mk_point(opposite_corner)),
+                geometry
+            );
+
+            return py::make_tuple(pyutil::as_pyarray(std::move(result.gids)),
+                                  pyutil::as_pyarray(std::move(result.counts)));
+        },
+        py::arg("corner"),
+        py::arg("opposite_corner"),
+        py::arg("geometry"),
+        R"(
+        The distinct gids of the elements intersecting the box.
+
+        Returns the gids, in increasing order, and the number of
+        intersecting elements of each gid. The elements themselves are
+        never materialized.
+        )"
+    )
+
+    .def("_find_unique_gids",
+        [](Class& obj, const array_t& center, CoordType radius, const std::string& geometry) {
+            auto result = detail::find_unique_gids(
+                obj, si::Sphere{mk_point(center), radius}, geometry
+            );
+
+            return py::make_tuple(pyutil::as_pyarray(std::move(result.gids)),
+                                  pyutil::as_pyarray(std::move(result.counts)));
+        },
+        py::arg("center"),
+        py::arg("radius"),
+        py::arg("geometry")
+    )
+
+    .def("_find_unique_gids_box_batch",
+        [](Class& obj,
+           const array_t& corners, const array_t& opposite_corners,
+           const std::string& geometry, size_t n_threads) {
+            auto batch = detail::find_unique_gids_batch(
+                obj,
+                detail::make_query_boxes(corners, opposite_corners),
+                geometry,
+                n_threads
+            );
 
+            return py::make_tuple(pyutil::as_pyarray(std::move(batch.offsets)),
+                                  pyutil::as_pyarray(std::move(batch.results.gids)),
+                                  pyutil::as_pyarray(std::move(batch.results.counts)));
+        },
+        py::arg("corners"),
+        py::arg("opposite_corners"),
+        py::arg("geometry"),
+        py::arg("n_threads") = 1,
+        R"(
+        Runs `_find_unique_gids_box` for every box, returns the results in CSR format.
+        )"
+    )
 
-///
-/// 1.0 - Sphere index
-///
+    .def("_find_unique_gids_batch",
+        [](Class& obj,
+           const array_t& centers, const array_t& radii,
+           const std::string& geometry, size_t n_threads) {
+            auto batch = detail::find_unique_gids_batch(
+                obj,
+                detail::make_query_spheres(centers, radii),
+                geometry,
+                n_threads
+            );
 
-template <typename Class>
-inline void add_SphereIndex_fields_bindings(py::class_<Class>& c) {
-    c.def_property_readonly_static(
-        "builtin_fields",
-        [](py::object& /* self */) {
-            return std::vector<std::string>{
-                "id",
-                "centroid",
-                "radius"
-            };
+            return py::make_tuple(pyutil::as_pyarray(std::move(batch.offsets)),
+                                  pyutil::as_pyarray(std::move(batch.results.gids)),
+                                  pyutil::as_pyarray(std::move(batch.results.counts)));
         },
-        "List of fields that are builtin."
+        py::arg("centers"),
+        py::arg("radii"),
+        py::arg("geometry"),
+        py::arg("n_threads") = 1
     );
 }
 
@@ -568,48 +1353,216 @@ inline void add_IndexTree_find_intersecting_box_np(
     .def("_find_intersecting_box_np",
             [wrap_as_dict](Class& obj,
                            const array_t& corner, const array_t& opposite_corner,
-                           const std::string& geometry) {
+                           const std::string& geometry,
+                           const std::optional<std::vector<std::string>>& fields) {
 
-                const auto& results = detail::find_intersecting_np(
+                auto results = detail::find_intersecting_np(
                     obj,
                     si::make_query_box(mk_point(corner), mk_point(opposite_corner)),
-                    geometry
+                    geometry,
+                    fields
                 );
-                return wrap_as_dict(results);
+                return wrap_as_dict(std::move(results));
             },
             py::arg("corner"),
             py::arg("opposite_corner"),
-            py::arg("geometry")
+            py::arg("geometry"),
+            py::arg("fields") = py::none(),
+            R"(
+        Finds all elements intersecting the box, as a dict of numpy arrays.
+
+        Only the columns needed for ``fields`` are computed, all other
+        entries of the dict are empty arrays. ``None`` computes everything.
+        The same holds for the other ``_find_intersecting_*_np`` methods.
+        )"
         );
 
     c
     .def("_find_intersecting_np",
             [wrap_as_dict](Class& obj,
                            const array_t& center, CoordType radius,
-                           const std::string& geometry) {
-                const auto& results = detail::find_intersecting_np(
+                           const std::string& geometry,
+                           const std::optional<std::vector<std::string>>& fields) {
+                auto results = detail::find_intersecting_np(
                     obj,
                     si::Sphere{mk_point(center), radius},
-                    geometry
+                    geometry,
+                    fields
+                );
+
+                return wrap_as_dict(std::move(results));
+            },
+            py::arg("center"),
+            py::arg("radius"),
+            py::arg("geometry"),
+            py::arg("fields") = py::none()
+        );
+
+    c
+    .def("_find_intersecting_cylinder_np",
+            [wrap_as_dict](Class& obj,
+                           const array_t& p1, const array_t& p2, CoordType radius,
+                           const std::string& geometry,
+                           const std::optional<std::vector<std::string>>& fields) {
+                auto results = detail::find_intersecting_np(
+                    obj,
+                    si::Cylinder{mk_point(p1), mk_point(p2), radius},
+                    geometry,
+                    fields
+                );
+
+                return wrap_as_dict(std::move(results));
+            },
+            py::arg("p1"),
+            py::arg("p2"),
+            py::arg("radius"),
+            py::arg("geometry"),
+            py::arg("fields") = py::none()
+        );
+
+    c
+    .def("_find_intersecting_polyline_np",
+            [wrap_as_dict](Class& obj,
+                           const array_t& points, CoordType radius,
+                           const std::string& geometry,
+                           const std::optional<std::vector<std::string>>& fields) {
+                auto results = detail::find_intersecting_np(
+                    obj,
+                    detail::make_query_polyline(points, radius),
+                    geometry,
+                    fields
+                );
+
+                return wrap_as_dict(std::move(results));
+            },
+            py::arg("points"),
+            py::arg("radius"),
+            py::arg("geometry"),
+            py::arg("fields") = py::none(),
+            R"(
+        Finds all elements within `radius` of the path through `points`.
+
+        The tree is traversed once; nodes are pruned unless they are near
+        one of the segments of the path.
+        )"
+        );
+
+    c
+    .def("_find_intersecting_box_cursor",
+            [wrap_as_dict](const Class& obj,
+                           const array_t& corner, const array_t& opposite_corner,
+                           const std::string& geometry) {
+                return detail::make_query_cursor(
+                    obj,
+                    si::make_query_box(mk_point(corner), mk_point(opposite_corner)),
+                    geometry,
+                    wrap_as_dict
                 );
+            },
+            py::arg("corner"),
+            py::arg("opposite_corner"),
+            py::arg("geometry"),
+            // The cursor refers to the index.
+            py::keep_alive<0, 1>(),
+            R"(
+        Returns a cursor which returns the results of the box query in chunks.
+
+        Multi indexes keep the subtree the cursor is traversing from being
+        evicted, until the cursor moves on to the next one.
+        )"
+        );
 
-                return wrap_as_dict(results); 
+    c
+    .def("_find_intersecting_cursor",
+            [wrap_as_dict](const Class& obj,
+                           const array_t& center, CoordType radius,
+                           const std::string& geometry) {
+                return detail::make_query_cursor(
+                    obj,
+                    si::Sphere{mk_point(center), radius},
+                    geometry,
+                    wrap_as_dict
+                );
             },
             py::arg("center"),
             py::arg("radius"),
-            py::arg("geometry")
+            py::arg("geometry"),
+            py::keep_alive<0, 1>(),
+            R"(
+        Returns a cursor which returns the results of the sphere query in chunks.
+        )"
+        );
+
+    c
+    .def("_find_intersecting_box_np_batch",
+            [wrap_as_dict](Class& obj,
+                           const array_t& corners, const array_t& opposite_corners,
+                           const std::string& geometry, size_t n_threads) {
+                auto batch = detail::find_intersecting_batch_np(
+                    obj,
+                    detail::make_query_boxes(corners, opposite_corners),
+                    geometry,
+                    n_threads
+                );
+
+                return py::make_tuple(pyutil::as_pyarray(std::move(batch.offsets)),
+                                      wrap_as_dict(std::move(batch.results)));
+            },
+            py::arg("corners"),
+            py::arg("opposite_corners"),
+            py::arg("geometry"),
+            py::arg("n_threads") = 1,
+            R"(
+        Runs one box query per row of `corners` and `opposite_corners`.
+
+        Returns the offsets and the concatenated results. The results of
+        the `i`-th query are `offsets[i]:offsets[i+1]`.
+
+        If the index supports it, the queries are run on `n_threads`
+        threads with the GIL released.
+        )"
+        );
+
+    c
+    .def("_find_intersecting_np_batch",
+            [wrap_as_dict](Class& obj,
+                           const array_t& centers, const array_t& radii,
+                           const std::string& geometry, size_t n_threads) {
+                auto batch = detail::find_intersecting_batch_np(
+                    obj,
+                    detail::make_query_spheres(centers, radii),
+                    geometry,
+                    n_threads
+                );
+
+                return py::make_tuple(pyutil::as_pyarray(std::move(batch.offsets)),
+                                      wrap_as_dict(std::move(batch.results)));
+            },
+            py::arg("centers"),
+            py::arg("radii"),
+            py::arg("geometry"),
+            py::arg("n_threads") = 1,
+            R"(
+        Runs one sphere query per row of `centers` and `radii`.
+
+        Returns the offsets and the concatenated results. The results of
+        the `i`-th query are `offsets[i]:offsets[i+1]`.
+
+        If the index supports it, the queries are run on `n_threads`
+        threads with the GIL released.
+        )"
         );
-    
+
+    add_IndexTree_find_unique_gids_bindings(c);
 }
 
 template<typename Class>
 inline void add_SphereIndex_find_intersecting_box_np(py::class_<Class>& c) {
-    auto wrap_as_dict = [](const auto& results) {
+    auto wrap_as_dict = [](auto results) {
         return py::dict(
-            "id"_a=pyutil::to_pyarray(results.id),
-            "centroid"_a=py::array_t<CoordType>({results.centroid.size(), 3ul},
-                                                (CoordType*)results.centroid.data()),
-            "radius"_a=pyutil::to_pyarray(results.radius)
+            "id"_a=pyutil::as_pyarray(std::move(results.id)),
+            "centroid"_a=pyutil::as_pyarray_2d<CoordType, 3>(std::move(results.centroid)),
+            "radius"_a=pyutil::as_pyarray(std::move(results.radius))
         );
     };
 
@@ -620,6 +1573,7 @@ template <typename Class = si::IndexTree<si::IndexedSphere>>
 inline void create_SphereIndex_bindings(py::module& m, const char* class_name) {
     using value_type = typename Class::value_type;
     auto c = create_IndexTree_bindings<value_type, value_type, Class>(m, class_name);
+    add_IndexTree_aggregate_counts_bindings(c);
     add_IndexTree_insert_themed_bindings<value_type, value_type, Class>(c);
 
 
@@ -663,6 +1617,15 @@ inline void create_SphereIndex_bindings(py::module& m, const char* class_name) {
     add_IndexTree_add_spheres_bindings<value_type, value_type, Class>(c);
 }
 
+template <typename Class = si::MemoryMappedIndexTree<si::IndexedSphere>>
+inline void create_SphereMemoryMappedIndex_bindings(py::module& m, const char* class_name) {
+    using value_type = typename Class::value_type;
+    auto c = create_MemoryMappedIndexTree_bindings<value_type, value_type, Class>(m, class_name);
+
+    add_SphereIndex_find_intersecting_box_np(c);
+    add_SphereIndex_fields_bindings(c);
+}
+
 
 ///
 /// 1.0b - Point index
@@ -681,11 +1644,10 @@ inline void add_PointIndex_fields_bindings(py::class_<Class>& c) {
 
 template <typename Class>
 inline void add_PointIndex_find_intersecting_box_np(py::class_<Class>& c) {
-    auto wrap_as_dict = [](const auto& results) {
-        return py::dict("id"_a = pyutil::to_pyarray(results.id),
-                        "position"_a =
-                            py::array_t<CoordType>({results.position.size(), 3ul},
-                                                   (CoordType*) results.position.data()));
+    auto wrap_as_dict = [](auto results) {
+        return py::dict(
+            "id"_a = pyutil::as_pyarray(std::move(results.id)),
+            "position"_a = pyutil::as_pyarray_2d<CoordType, 3>(std::move(results.position)));
     };
 
     add_IndexTree_find_intersecting_box_np(c, wrap_as_dict);
@@ -696,6 +1658,7 @@ template <typename Class = si::IndexTree<si::IndexedPoint>>
 inline void create_PointIndex_bindings(py::module& m, const char* class_name) {
     using value_type = typename Class::value_type;
     auto c = create_IndexTree_bindings<value_type, value_type, Class>(m, class_name);
+    add_IndexTree_aggregate_counts_bindings(c);
 
     c.def(py::init([](const array_t& positions, const array_ids& ids) {
               if (positions.shape(0) == 0) {
@@ -726,14 +1689,23 @@ inline void create_PointIndex_bindings(py::module& m, const char* class_name) {
     add_PointIndex_fields_bindings(c);
 }
 
+template <typename Class = si::MemoryMappedIndexTree<si::IndexedPoint>>
+inline void create_PointMemoryMappedIndex_bindings(py::module& m, const char* class_name) {
+    using value_type = typename Class::value_type;
+    auto c = create_MemoryMappedIndexTree_bindings<value_type, value_type, Class>(m, class_name);
+
+    add_PointIndex_find_intersecting_box_np(c);
+    add_PointIndex_fields_bindings(c);
+}
+
 
 ///
 /// 1.1 - Synapse index
 ///
 
-inline void create_Synapse_bindings(py::module& m) {
-    using Class = Synapse;
-    py::class_<Class>(m, "Synapse")
+template <typename Class = Synapse>
+inline void create_Synapse_bindings(py::module& m, const char* class_name = "Synapse") {
+    py::class_<Class>(m, class_name)
         .def_property_readonly("centroid", [](Class& obj) {
                 return py::array(3, reinterpret_cast<const si::CoordType*>(&obj.get_centroid()));
             },
@@ -763,13 +1735,12 @@ inline void create_Synapse_bindings(py::module& m) {
 
 template<typename Class>
 inline void add_SynapseIndex_find_intersecting_box_np(py::class_<Class>& c) {
-    auto wrap_as_dict = [](const auto& results) {
+    auto wrap_as_dict = [](auto results) {
         return py::dict(
-            "id"_a=pyutil::to_pyarray(results.id),
-            "pre_gid"_a=pyutil::to_pyarray(results.pre_gid),
-            "post_gid"_a=pyutil::to_pyarray(results.post_gid),
-            "position"_a=py::array_t<CoordType>({results.position.size(), 3ul},
-                                                (CoordType*)results.position.data())
+            "id"_a=pyutil::as_pyarray(std::move(results.id)),
+            "pre_gid"_a=pyutil::as_pyarray(std::move(results.pre_gid)),
+            "post_gid"_a=pyutil::as_pyarray(std::move(results.post_gid)),
+            "position"_a=pyutil::as_pyarray_2d<CoordType, 3>(std::move(results.position))
         );
     };
 
@@ -794,7 +1765,7 @@ inline void add_SynapseIndex_fields_bindings(py::class_<Class>& c) {
 }
 
 
-template<class Class>
+template<class Class, class Value = Synapse>
 inline void add_SynapseIndex_add_synapses_bindings(py::class_<Class>& c) {
     c
     .def("_add_synapses",
@@ -803,7 +1774,7 @@ inline void add_SynapseIndex_add_synapses_bindings(py::class_<Class>& c) {
             const auto post_gids_ = post_gids.template unchecked<1>();
             const auto pre_gids_ = pre_gids.template unchecked<1>();
             auto const* const points_ptr_ = extract_points_ptr(points);
-            auto soa = si::util::make_soa_reader<Synapse>(syn_ids_, post_gids_, pre_gids_, points_ptr_);
+            auto soa = si::util::make_soa_reader<Value>(syn_ids_, post_gids_, pre_gids_, points_ptr_);
             obj.insert(soa.begin(), soa.end());
         },
         R"(
@@ -845,6 +1816,99 @@ inline void add_SynapseIndex_count_intersecting_agg_gid_bindings(py::class_<Clas
         py::arg("point"),
         py::arg("radius"),
         py::arg("geometry")
+    )
+
+    .def("_count_intersecting_cylinder_agg_gid",
+        [](Class& obj,
+           const array_t& p1, const array_t& p2, CoordType radius,
+           const std::string& geometry) {
+
+            return detail::count_intersecting_agg_gid(obj,
+                si::Cylinder{mk_point(p1), mk_point(p2), radius},
+                geometry
+            );
+        },
+        py::arg("p1"),
+        py::arg("p2"),
+        py::arg("radius"),
+        py::arg("geometry")
+    )
+
+    .def("_count_intersecting_polyline_agg_gid",
+        [](Class& obj,
+           const array_t& points, CoordType radius,
+           const std::string& geometry) {
+
+            return detail::count_intersecting_agg_gid(obj,
+                detail::make_query_polyline(points, radius),
+                geometry
+            );
+        },
+        py::arg("points"),
+        py::arg("radius"),
+        py::arg("geometry")
+    );
+}
+
+
+template<class Class>
+inline void add_SynapseIndex_count_intersecting_grouped_bindings(py::class_<Class>& c) {
+    c
+    .def("_count_intersecting_grouped_box_batch",
+        [](Class& obj,
+           const array_t& corners, const array_t& opposite_corners,
+           const std::string& group_by, const std::string& geometry,
+           size_t n_threads) {
+            auto batch = detail::count_intersecting_grouped(
+                obj,
+                detail::make_query_boxes(corners, opposite_corners),
+                group_by,
+                geometry,
+                n_threads
+            );
+
+            return py::make_tuple(pyutil::as_pyarray(std::move(batch.offsets)),
+                                  pyutil::as_pyarray(std::move(batch.results.pre_gids)),
+                                  pyutil::as_pyarray(std::move(batch.results.post_gids)),
+                                  pyutil::as_pyarray(std::move(batch.results.counts)));
+        },
+        py::arg("corners"),
+        py::arg("opposite_corners"),
+        py::arg("group_by"),
+        py::arg("geometry"),
+        py::arg("n_threads") = 1,
+        R"(
+        Counts the synapses in every box, grouped by `group_by`.
+
+        `group_by` is one of "post_gid", "pre_gid" or "pre_post_gid".
+        Returns the offsets, the pre gids, the post gids and the counts in
+        CSR format; the gid column not used for grouping is empty.
+        )"
+    )
+
+    .def("_count_intersecting_grouped_batch",
+        [](Class& obj,
+           const array_t& centers, const array_t& radii,
+           const std::string& group_by, const std::string& geometry,
+           size_t n_threads) {
+            auto batch = detail::count_intersecting_grouped(
+                obj,
+                detail::make_query_spheres(centers, radii),
+                group_by,
+                geometry,
+                n_threads
+            );
+
+            return py::make_tuple(pyutil::as_pyarray(std::move(batch.offsets)),
+                                  pyutil::as_pyarray(std::move(batch.results.pre_gids)),
+                                  pyutil::as_pyarray(std::move(batch.results.post_gids)),
+                                  pyutil::as_pyarray(std::move(batch.results.counts)));
+        },
+        py::arg("centers"),
+        py::arg("radii"),
+        py::arg("group_by"),
+        py::arg("geometry"),
+        py::arg("n_threads") = 1
     );
 }
 
@@ -853,16 +1917,45 @@ template <typename Class = si::IndexTree<si::Synapse>>
 inline void create_SynapseIndex_bindings(py::module& m, const char* class_name) {
     using value_type = typename Class::value_type;
     auto c = create_IndexTree_bindings<value_type, value_type, Class>(m, class_name);
+    add_IndexTree_aggregate_counts_bindings(c);
     add_IndexTree_insert_themed_bindings<value_type, value_type, Class>(c);
     add_IndexTree_deprecated_ctors<value_type>(c);
 
     add_SynapseIndex_count_intersecting_agg_gid_bindings(c);
+    add_SynapseIndex_count_intersecting_grouped_bindings(c);
     add_SynapseIndex_find_intersecting_box_np(c);
     add_SynapseIndex_fields_bindings(c);
 
     add_SynapseIndex_add_synapses_bindings(c);
 }
 
+template <typename Class = si::MemoryMappedIndexTree<si::Synapse>>
+inline void create_SynapseMemoryMappedIndex_bindings(py::module& m, const char* class_name) {
+    using value_type = typename Class::value_type;
+    auto c = create_MemoryMappedIndexTree_bindings<value_type, value_type, Class>(m, class_name);
+
+    add_SynapseIndex_count_intersecting_agg_gid_bindings(c);
+    add_SynapseIndex_count_intersecting_grouped_bindings(c);
+    add_SynapseIndex_find_intersecting_box_np(c);
+    add_SynapseIndex_fields_bindings(c);
+}
+
+/// Synapses without a radius, they're indexed as points.
+template <typename Class = si::IndexTree<si::PointSynapse>>
+inline void create_PointSynapseIndex_bindings(py::module& m, const char* class_name) {
+    using value_type = typename Class::value_type;
+    auto c = create_IndexTree_bindings<value_type, value_type, Class>(m, class_name);
+    add_IndexTree_aggregate_counts_bindings(c);
+    add_IndexTree_insert_bindings<value_type, value_type, Class>(c);
+
+    add_SynapseIndex_count_intersecting_agg_gid_bindings(c);
+    add_SynapseIndex_count_intersecting_grouped_bindings(c);
+    add_SynapseIndex_find_intersecting_box_np(c);
+    add_SynapseIndex_fields_bindings(c);
+
+    add_SynapseIndex_add_synapses_bindings<Class, value_type>(c);
+}
+
 
 ///
 /// 2 - MorphIndex tree
@@ -1229,6 +2322,7 @@ inline void add_MorphIndex_common_insert_bindings(py::class_<Class>& c) {
 template <typename Class = si::IndexTree<MorphoEntry>>
 inline void create_MorphIndex_bindings(py::module& m, const char* class_name) {
     auto c = create_IndexTree_bindings<MorphoEntry, si::Soma, Class>(m, class_name);
+    add_IndexTree_aggregate_counts_bindings(c);
     add_IndexTree_insert_themed_bindings<MorphoEntry, si::Soma, Class>(c);
 
     add_IndexTree_deprecated_ctors<si::Soma>(c);
@@ -1240,6 +2334,16 @@ inline void create_MorphIndex_bindings(py::module& m, const char* class_name) {
 }
 
 
+/// Bindings to index si::MemoryMappedIndexTree<MorphoEntry>
+template <typename Class = si::MemoryMappedIndexTree<MorphoEntry>>
+inline void create_MorphMemoryMappedIndex_bindings(py::module& m, const char* class_name) {
+    auto c = create_MemoryMappedIndexTree_bindings<MorphoEntry, si::Soma, Class>(m, class_name);
+
+    add_MorphIndex_find_intersecting_box_np<Class>(c);
+    add_MorphIndex_fields_bindings<Class>(c);
+}
+
+
 template<typename Class>
 inline void add_IndexBulkBuilder_reserve_bindings(py::class_<Class>& c) {
     c
@@ -1279,9 +2383,13 @@ create_IndexBulkBuilder_bindings(py::module& m, const char* class_name) {
     )
 
     .def("_finalize",
-         [](Class &obj) { obj.finalize(); },
+         [](Class &obj, size_t n_threads) { obj.finalize(n_threads); },
+         py::arg("n_threads") = 1,
          R"(
          This will trigger building the index in bulk.
+
+         Args:
+             n_threads(int): Number of threads used to pack the index.
          )"
     );
 
@@ -1306,12 +2414,12 @@ inline void create_MorphIndexBulkBuilder_bindings(py::module& m, const char* cla
     add_MorphIndex_common_insert_bindings<Class>(c);
 }
 
-template <typename Class = si::IndexBulkBuilder<si::IndexTree<Synapse>>>
+template <typename Value = Synapse, typename Class = si::IndexBulkBuilder<si::IndexTree<Value>>>
 inline void create_SynapseIndexBulkBuilder_bindings(py::module& m, const char* class_name) {
     py::class_<Class> c = create_IndexBulkBuilder_bindings<Class>(m, class_name);
 
-    add_IndexTree_insert_bindings<Synapse, Synapse, Class>(c);
-    add_SynapseIndex_add_synapses_bindings<Class>(c);
+    add_IndexTree_insert_bindings<Value, Value, Class>(c);
+    add_SynapseIndex_add_synapses_bindings<Class, Value>(c);
 }
 
 template <typename Class = si::IndexBulkBuilder<si::IndexTree<si::IndexedSphere>>>
@@ -1395,24 +2503,81 @@ inline void create_MorphMultiIndexBulkBuilder_bindings(py::module& m, const char
 }
 
 
-template <typename Class = si::MultiIndexBulkBuilder<Synapse>>
+template <typename Value = Synapse, typename Class = si::MultiIndexBulkBuilder<Value>>
 inline void create_SynapseMultiIndexBulkBuilder_bindings(py::module& m, const char* class_name) {
-    py::class_<Class> c = create_MultiIndexBulkBuilder_bindings<Synapse>(m, class_name);
+    py::class_<Class> c = create_MultiIndexBulkBuilder_bindings<Value>(m, class_name);
 
-    add_IndexTree_insert_bindings<Synapse, Synapse, Class>(c);
-    add_SynapseIndex_add_synapses_bindings<Class>(c);
+    add_IndexTree_insert_bindings<Value, Value, Class>(c);
+    add_SynapseIndex_add_synapses_bindings<Class, Value>(c);
 }
 
 #endif
 
-template <typename Value, typename Class = si::MultiIndexTree<Value>>
-inline py::class_<Class> create_MultiIndex_bindings(py::module& m, const char* class_name) {
-    py::class_<Class> c = py::class_<Class>(m, class_name);
+inline si::PrefetchMode make_prefetch_mode(const std::string& mode) {
+    if(mode == "hint") {
+        return si::PrefetchMode::hint;
+    }
+
+    if(mode == "trajectory") {
+        return si::PrefetchMode::trajectory;
+    }
+
+    throw std::runtime_error("Invalid prefetch mode: " + mode + ".");
+}
+
+template <typename Class>
+inline void add_MultiIndex_prefetch_bindings(py::class_<Class>& c) {
+    c
+    .def("_prefetch",
+        [](Class& obj, const array_t& min_corner, const array_t& max_corner) {
+            obj.prefetch(si::make_query_box(mk_point(min_corner), mk_point(max_corner)));
+        },
+        py::arg("min_corner"),
+        py::arg("max_corner"),
+        R"(
+        Loads the subtrees intersecting the box in the background.
+        )"
+    )
+    .def("_set_prefetch_mode",
+        [](Class& obj, const std::string& mode) {
+            obj.set_prefetch_mode(make_prefetch_mode(mode));
+        },
+        py::arg("mode")
+    )
+    .def("_set_io_threads",
+        [](Class& obj, size_t n_io_threads) {
+            obj.set_io_threads(n_io_threads);
+        },
+        py::arg("n_io_threads"),
+        R"(
+        Sets the number of threads loading subtrees concurrently.
+        )"
+    )
+    .def("_prefetch_stats",
+        [](Class& obj) {
+            auto stats = obj.prefetch_stats();
+            return py::dict(
+                "n_prefetched"_a=stats.n_prefetched,
+                "n_hits"_a=stats.n_hits,
+                "n_wasted"_a=stats.n_wasted
+            );
+        }
+    );
+}
 
+template <typename Class>
+inline void add_MultiIndex_init_bindings(py::class_<Class>& c) {
     c
-    .def(py::init<std::string, std::size_t>(),
+    .def(py::init([](const std::string& output_dir,
+                     std::size_t max_cached_bytes,
+                     const std::string& eviction_policy) {
+            return std::make_unique<Class>(output_dir,
+                                           max_cached_bytes,
+                                           si::eviction_policy_kind(eviction_policy));
+         }),
          py::arg("output_dir"),
          py::arg("max_cached_bytes"),
+         py::arg("eviction_policy") = "usage_rate",
          R"(
         Create a `MultiIndexBulkBuilder` that writes output to `output_dir`.
 
@@ -1425,15 +2590,73 @@ inline py::class_<Class> create_MultiIndex_bindings(py::module& m, const char* c
             output_dir(string):  The directory where the all files that make up
                 the multi index are stored.
 
-            max_cached_bytes(int):  The total size of the index should, up to a
-                log factor, not use more than `max_cached_bytes` bytes of memory.
+            max_cached_bytes(int):  The cached subtrees, including their nodes,
+                don't use more than `max_cached_bytes` bytes of memory.
+
+            eviction_policy(str):  Which subtree to evict once the cache is
+                full. One of "usage_rate", "lru", "clock", "arc" or
+                "cost_aware".
+        )"
+    );
+}
+
+template <typename Class>
+inline void add_SharedMultiIndex_init_bindings(py::class_<Class>& c) {
+    using cache_type = typename Class::subtree_cache_type;
+
+    c
+    .def(py::init([](const std::string& output_dir,
+                     std::size_t max_cached_bytes,
+                     const std::string& name) {
+            return std::make_unique<Class>(output_dir,
+                                           si::SharedSubtreeCacheParams(max_cached_bytes, name));
+         }),
+         py::arg("output_dir"),
+         py::arg("max_cached_bytes"),
+         py::arg("name"),
+         R"(
+        Open the multi index in `output_dir`, with subtrees shared by all
+        processes on the node.
+
+        Args:
+            output_dir(string):  The directory where the all files that make up
+                the multi index are stored.
+
+            max_cached_bytes(int):  The size of the shared memory segment. Only
+                the process creating the segment sets its size.
+
+            name(str):  The name of the shared memory segment. All processes
+                opening the index with the same name share the subtrees.
+        )"
+    )
+    .def_static("_remove_shared_cache",
+        [](const std::string& name) {
+            cache_type::remove(name);
+        },
+        py::arg("name"),
+        R"(
+        Removes the shared memory segment `name`.
         )"
     );
+}
+
+template <typename Value, typename Class = si::MultiIndexTree<Value>>
+inline py::class_<Class> create_MultiIndex_bindings(py::module& m, const char* class_name) {
+    py::class_<Class> c = py::class_<Class>(m, class_name);
+
+    if constexpr (std::is_same_v<Class, si::SharedMultiIndexTree<Value>>) {
+        add_SharedMultiIndex_init_bindings(c);
+    } else {
+        add_MultiIndex_init_bindings(c);
+    }
 
     add_IndexTree_query_bindings(c);
+    add_IndexTree_rasterize_bindings(c);
+    add_IndexTree_join_within_bindings(c);
 
     add_IndexTree_bounds_bindings(c);
     add_len_for_size_bindings(c);
+    add_MultiIndex_prefetch_bindings(c);
 
     return c;
 }
@@ -1442,7 +2665,7 @@ inline py::class_<Class> create_MultiIndex_bindings(py::module& m, const char* c
 template <typename Class = si::MultiIndexTree<MorphoEntry>>
 inline py::class_<Class> create_MorphMultiIndex_bindings(py::module& m, const char* class_name) {
     using value_type = typename Class::value_type;
-    auto c = create_MultiIndex_bindings<value_type>(m, class_name);
+    auto c = create_MultiIndex_bindings<value_type, Class>(m, class_name);
 
     add_MorphIndex_find_intersecting_box_np(c);
     add_MorphIndex_fields_bindings(c);
@@ -1454,14 +2677,61 @@ inline py::class_<Class> create_MorphMultiIndex_bindings(py::module& m, const ch
 template <typename Class = si::MultiIndexTree<Synapse>>
 inline py::class_<Class> create_SynapseMultiIndex_bindings(py::module& m, const char* class_name) {
     using value_type = typename Class::value_type;
-    auto c = create_MultiIndex_bindings<value_type>(m, class_name);
+    auto c = create_MultiIndex_bindings<value_type, Class>(m, class_name);
 
+    add_SynapseIndex_count_intersecting_grouped_bindings(c);
     add_SynapseIndex_find_intersecting_box_np(c);
     add_SynapseIndex_fields_bindings(c);
 
     return c;
 }
 
+inline void create_QueryCursor_bindings(py::module& m) {
+    py::class_<detail::PyQueryCursor>(m, "_QueryCursor")
+    .def("next_chunk",
+         [](detail::PyQueryCursor& cursor, size_t max_elements) {
+             return cursor.next_chunk(max_elements);
+         },
+         py::arg("max_elements"),
+         R"(
+        Returns the next (at most) `max_elements` results, as a dictionary
+        of arrays; or `None` once all results have been returned.
+        )"
+    );
+}
+
+inline void create_AggregateCounts_bindings(py::module& m) {
+    py::class_<detail::PyAggregateCounts>(m, "_AggregateCounts")
+    .def("_count_intersecting",
+         [](detail::PyAggregateCounts& counts,
+            const array_t& corner, const array_t& opposite_corner,
+            const std::string& geometry) {
+             return counts.count_box(
+                 si::make_query_box(mk_point(corner), mk_point(opposite_corner)), geometry
+             );
+         },
+         py::arg("corner"),
+         py::arg("opposite_corner"),
+         py::arg("geometry")
+    )
+    .def("_count_intersecting_sphere",
+         [](detail::PyAggregateCounts& counts,
+            const array_t& center, CoordType radius,
+            const std::string& geometry) {
+             return counts.count_sphere(si::Sphere{mk_point(center), radius}, geometry);
+         },
+         py::arg("center"),
+         py::arg("radius"),
+         py::arg("geometry")
+    )
+    .def_property_readonly("size",
+         [](const detail::PyAggregateCounts& counts) {
+             return counts.size;
+         },
+         "The number of elements of the index when the counts were computed."
+    );
+}
+
 inline void create_MetaDataConstants_bindings(py::module& m) {
     py::class_<MetaDataConstants> c = py::class_<MetaDataConstants>(m, "_MetaDataConstants");
 
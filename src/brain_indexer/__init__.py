@@ -29,6 +29,7 @@ from ._brain_indexer import SectionType # noqa
 try:
     from .morphology_builder import MorphMultiIndexBuilder  # noqa
     from .synapse_builder import SynapseMultiIndexBuilder  # noqa
+    from .synapse_builder import PointSynapseMultiIndexBuilder  # noqa
 except ImportError:
     import textwrap
     logger.warning(
@@ -43,14 +44,19 @@ except ImportError:
     )
 
 from .morphology_builder import MorphIndexBuilder  # noqa
-from .synapse_builder import SynapseIndexBuilder  # noqa
+from .synapse_builder import SynapseIndexBuilder, PointSynapseIndexBuilder  # noqa
 from .builder import SphereIndexBuilder, PointIndexBuilder  # noqa
 
 from .index import SynapseIndex, SynapseMultiIndex  # noqa
 from .index import MorphIndex, MorphMultiIndex  # noqa
 from .index import SphereIndex, PointIndex  # noqa
+from .index import SynapseMemoryMappedIndex, MorphMemoryMappedIndex  # noqa
+from .index import PointSynapseIndex, PointSynapseMultiIndex  # noqa
+from .index import PointSynapseMemoryMappedIndex  # noqa
+from .index import SphereMemoryMappedIndex, PointMemoryMappedIndex  # noqa
 from .index import MultiPopulationIndex  # noqa
 
 from .resolver import IndexResolver, SynapseIndexResolver, MorphIndexResolver  # noqa
 from .resolver import SphereIndexResolver, PointIndexResolver  # noqa
+from .resolver import PointSynapseIndexResolver  # noqa
 from .resolver import open_index  # noqa
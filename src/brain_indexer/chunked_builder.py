@@ -28,11 +28,20 @@ class ChunkedProcessingMixin(metaclass=ABCMeta):
             self.process_range(range_)
 
     @classmethod
-    def create(cls, *args, progress=False, output_dir=None, **kw):
-        """Interactively create, with some progress"""
+    def create(cls, *args, progress=False, output_dir=None, n_threads=None, **kw):
+        """Interactively create, with some progress
+
+        The index is packed using `n_threads` threads, by default one.
+        """
+        if n_threads is None:
+            n_threads = 1
+
+        if n_threads < 1:
+            raise ValueError(f"Invalid number of threads: n_threads = {n_threads}.")
+
         index_builder = cls(*args, **kw)
         index_builder.process_all(progress)
-        index_builder._core_builder._finalize()
+        index_builder._core_builder._finalize(n_threads=n_threads)
 
         index_builder._write_index_if_needed(output_dir)
         return index_builder._index_if_loaded
@@ -66,6 +66,207 @@ class IndexInterface(abc.ABC):
         """
         pass
 
+    @abc.abstractmethod
+    def cylinder_query(self, p1, p2, radius, *,
+                       fields=None, accuracy=None,
+                       populations=None, population_mode=None):
+        """Find all elements intersecting with the query cylinder.
+
+        The cylinder has flat caps centered at ``p1`` and ``p2``. Indexed
+        cylinders are treated as capsules, see the User Guide. The arguments
+        are the same as for ``sphere_query``.
+        """
+        pass
+
+    @abc.abstractmethod
+    def capsule_query(self, p1, p2, radius, *,
+                      fields=None, accuracy=None,
+                      populations=None, population_mode=None):
+        """Find all elements within ``radius`` of the segment from ``p1`` to ``p2``.
+
+        This is a ``polyline_query`` with two points. The arguments are the same
+        as for ``sphere_query``.
+        """
+        pass
+
+    @abc.abstractmethod
+    def polyline_query(self, points, radius, *,
+                       fields=None, accuracy=None,
+                       populations=None, population_mode=None):
+        """Find all elements within ``radius`` of the path through ``points``.
+
+        The query shape is the union of the capsules around every segment of
+        the path. The index is traversed once, and only the parts of it near
+        the path are visited; which is much faster than one ``capsule_query``
+        per segment.
+
+        A detailed explanation is available in the User Guide.
+
+        Arguments:
+            points(array):  The ``(n, 3)`` array of points of the path, with
+                ``n >= 1``.
+
+            radius(float):  The maximum distance from the path.
+
+            fields(str,list):  A string or iterable of strings specifying which
+                attributes of the index are to be returned.
+
+            accuracy(str):     Specifies the accuracy with which indexed
+                elements are treated. Allowed are either ``"bounding_box"`` or
+                ``"best_effort"``. Default: ``"best_effort"``
+
+            populations(str,list):  A string or list of strings specifying which
+                populations to query. Ignored by single-population indexes.
+
+            population_mode(str):  (advanced) Defines if the query uses the
+                single- or multi-population return type. Available: ``None``
+                (native), ``"single"`` (single-population), ``"multi"``
+                (multi-population). Please consult the User Guide for a detailed
+                explanation.
+        """
+        pass
+
+    @abc.abstractmethod
+    def box_query_batch(self, corners, opposite_corners, *,
+                        fields=None, accuracy=None, n_threads=None,
+                        populations=None, population_mode=None):
+        """Find all elements intersecting with each of the query boxes.
+
+        All queries are performed in a single call. Hence, this is much faster
+        than calling ``box_query`` in a loop, when there are many small
+        queries. The results are returned in CSR format, i.e. as a pair
+        ``(offsets, results)``. The results of the ``i``-th query are
+        ``results[offsets[i]:offsets[i+1]]``, and ``len(offsets)`` is the
+        number of queries plus one.
+
+        Arguments:
+            corners(np.array):  A Nx3 array with one corner of each box.
+
+            opposite_corners(np.array):  A Nx3 array with the opposite corner
+                of each box.
+
+            fields(str,list):  A string or iterable of strings specifying which
+                attributes of the index are to be returned. Only the builtin
+                fields are supported.
+
+            accuracy(str):     Specifies the accuracy with which indexed
+                elements are treated. Allowed are either ``"bounding_box"`` or
+                ``"best_effort"``. Default: ``"best_effort"``
+
+            n_threads(int):  The number of threads used to run the queries.
+                The GIL is released while the queries run, unless elements
+                can be added to the index. Default: ``1``
+
+            populations(str,list):  A string or list of strings specifying which
+                populations to query. Ignored by single-population indexes.
+
+            population_mode(str):  (advanced) Defines if the query uses the
+                single- or multi-population return type. Available: ``None``
+                (native), ``"single"`` (single-population), ``"multi"``
+                (multi-population). Please consult the User Guide for a detailed
+                explanation.
+        """
+        pass
+
+    @abc.abstractmethod
+    def sphere_query_batch(self, centers, radii, *,
+                           fields=None, accuracy=None, n_threads=None,
+                           populations=None, population_mode=None):
+        """Find all elements intersecting with each of the query spheres.
+
+        Returns the results of all queries in CSR format, see
+        ``box_query_batch``.
+
+        Arguments:
+            centers(np.array):  A Nx3 array with the center of each sphere.
+
+            radii(np.array):  An array with the radius of each sphere.
+
+            fields(str,list):  A string or iterable of strings specifying which
+                attributes of the index are to be returned. Only the builtin
+                fields are supported.
+
+            accuracy(str):     Specifies the accuracy with which indexed
+                elements are treated. Allowed are either ``"bounding_box"`` or
+                ``"best_effort"``. Default: ``"best_effort"``
+
+            n_threads(int):  The number of threads used to run the queries,
+                see ``box_query_batch``. Default: ``1``
+
+            populations(str,list):  A string or list of strings specifying which
+                populations to query. Ignored by single-population indexes.
+
+            population_mode(str):  (advanced) Defines if the query uses the
+                single- or multi-population return type. Available: ``None``
+                (native), ``"single"`` (single-population), ``"multi"``
+                (multi-population). Please consult the User Guide for a detailed
+                explanation.
+        """
+        pass
+
+    @abc.abstractmethod
+    def box_unique_gids(self, corner, opposite_corner, *,
+                        accuracy=None, return_counts=False,
+                        populations=None, population_mode=None):
+        """The distinct gids of the elements intersecting with the query box.
+
+        This is the same as ``np.unique(box_query(..., fields="gid"))``, but
+        the gids are deduplicated in C++ while traversing the index. Hence,
+        the intersecting elements are never materialized. For synapses the
+        gid is the post-synaptic gid, for spheres and points the id.
+
+        Arguments:
+            accuracy(str):  Specifies the accuracy with which indexed
+                elements are treated. Allowed are either ``"bounding_box"`` or
+                ``"best_effort"``. Default: ``"best_effort"``
+
+            return_counts(bool):  If ``True``, also return the number of
+                intersecting elements of each gid, i.e. a pair
+                ``(gids, counts)``.
+
+            populations(str,list):  A string or list of strings specifying which
+                populations to query. Ignored by single-population indexes.
+
+            population_mode(str):  (advanced) Defines if the query uses the
+                single- or multi-population return type. Available: ``None``
+                (native), ``"single"`` (single-population), ``"multi"``
+                (multi-population). Please consult the User Guide for a detailed
+                explanation.
+        """
+        pass
+
+    @abc.abstractmethod
+    def sphere_unique_gids(self, center, radius, *,
+                           accuracy=None, return_counts=False,
+                           populations=None, population_mode=None):
+        """The distinct gids of the elements intersecting with the query sphere.
+
+        See ``box_unique_gids``.
+        """
+        pass
+
+    @abc.abstractmethod
+    def box_unique_gids_batch(self, corners, opposite_corners, *,
+                              accuracy=None, return_counts=False, n_threads=None,
+                              populations=None, population_mode=None):
+        """The distinct gids for each of the query boxes.
+
+        Returns the results of all queries in CSR format, i.e.
+        ``(offsets, gids)`` or ``(offsets, gids, counts)``, see
+        ``box_query_batch`` and ``box_unique_gids``.
+        """
+        pass
+
+    @abc.abstractmethod
+    def sphere_unique_gids_batch(self, centers, radii, *,
+                                 accuracy=None, return_counts=False, n_threads=None,
+                                 populations=None, population_mode=None):
+        """The distinct gids for each of the query spheres.
+
+        See ``box_unique_gids_batch``.
+        """
+        pass
+
     @abc.abstractmethod
     def box_counts(self, corner, opposite_corner, *,
                    accuracy=None, group_by=None,
@@ -120,6 +321,84 @@ class IndexInterface(abc.ABC):
         """
         pass
 
+    @abc.abstractmethod
+    def cylinder_counts(self, p1, p2, radius, *,
+                        accuracy=None, group_by=None,
+                        populations=None, population_mode=None):
+        """Counts all elements intersecting with the query cylinder.
+
+        The arguments are the same as for ``sphere_counts``.
+        """
+        pass
+
+    @abc.abstractmethod
+    def capsule_counts(self, p1, p2, radius, *,
+                       accuracy=None, group_by=None,
+                       populations=None, population_mode=None):
+        """Counts all elements within ``radius`` of the segment from ``p1`` to ``p2``.
+
+        The arguments are the same as for ``sphere_counts``.
+        """
+        pass
+
+    @abc.abstractmethod
+    def polyline_counts(self, points, radius, *,
+                        accuracy=None, group_by=None,
+                        populations=None, population_mode=None):
+        """Counts all elements within ``radius`` of the path through ``points``.
+
+        The arguments are the same as for ``sphere_counts``, see
+        ``polyline_query`` for the query shape.
+        """
+        pass
+
+    @abc.abstractmethod
+    def box_counts_batch(self, corners, opposite_corners, *,
+                         group_by="post_gid", format="csr", accuracy=None,
+                         n_threads=None, populations=None, population_mode=None):
+        """Counts the synapses in each of the query boxes, grouped by gid.
+
+        Only synapse indexes support this query. All boxes are counted in
+        one call and the groups of every box are returned in increasing
+        order, as a dictionary of numpy arrays.
+
+        Arguments:
+            group_by(str,tuple):  The key of the groups, one of
+                ``"post_gid"``, ``"pre_gid"`` or ``("pre_gid", "post_gid")``.
+
+            format(str):  Either ``"csr"``, the groups of the ``i``-th box
+                are ``offsets[i]:offsets[i+1]`` of the column ``"offsets"``;
+                or ``"coo"``, the column ``"region"`` contains the index of
+                the box of every group.
+
+            accuracy(str):  Specifies the accuracy with which indexed
+                elements are treated. Allowed are either ``"bounding_box"`` or
+                ``"best_effort"``. Default: ``"best_effort"``
+
+            n_threads(int):  The number of threads used to run the queries,
+                if the index supports concurrent queries. Default: 1.
+
+            populations(str,list):  A string or list of strings specifying which
+                populations to query. Ignored by single-population indexes.
+
+            population_mode(str):  (advanced) Defines if the query uses the
+                single- or multi-population return type. Available: ``None``
+                (native), ``"single"`` (single-population), ``"multi"``
+                (multi-population). Please consult the User Guide for a detailed
+                explanation.
+        """
+        pass
+
+    @abc.abstractmethod
+    def sphere_counts_batch(self, centers, radii, *,
+                            group_by="post_gid", format="csr", accuracy=None,
+                            n_threads=None, populations=None, population_mode=None):
+        """Counts the synapses in each of the query spheres, grouped by gid.
+
+        See ``box_counts_batch``.
+        """
+        pass
+
     @abc.abstractmethod
     def box_empty(self, corner, opposite_corner, *,
                   accuracy=None, populations=None, population_mode=None):
@@ -178,6 +457,68 @@ class IndexInterface(abc.ABC):
         """
         pass
 
+    @abc.abstractmethod
+    def cylinder_empty(self, p1, p2, radius, *,
+                       accuracy=None, populations=None, population_mode=None):
+        """Checks whether the given cylinder intersects any object in the tree.
+
+        The arguments are the same as for ``sphere_empty``.
+        """
+        pass
+
+    @abc.abstractmethod
+    def capsule_empty(self, p1, p2, radius, *,
+                      accuracy=None, populations=None, population_mode=None):
+        """Checks whether any object is within ``radius`` of the segment ``p1``, ``p2``.
+
+        The arguments are the same as for ``sphere_empty``.
+        """
+        pass
+
+    @abc.abstractmethod
+    def polyline_empty(self, points, radius, *,
+                       accuracy=None, populations=None, population_mode=None):
+        """Checks whether any object is within ``radius`` of the path through ``points``.
+
+        The arguments are the same as for ``sphere_empty``, see
+        ``polyline_query`` for the query shape.
+        """
+        pass
+
+    @abc.abstractmethod
+    def rasterize(self, grid_origin, voxel_size, shape, quantity="count", *,
+                  n_threads=None, populations=None, population_mode=None):
+        """Computes ``quantity`` for every voxel of a regular grid.
+
+        The grid consists of ``shape`` cubic voxels with side length
+        ``voxel_size``, its lower corner is ``grid_origin``. Every element is
+        visited once and added to all voxels it overlaps, which is much faster
+        than one ``box_counts`` per voxel.
+
+        Arguments:
+            quantity(str):  One of ``"count"``, the number of elements
+                intersecting the voxel (as for ``accuracy="best_effort"``);
+                ``"length"``, the length of the axis of the segments inside
+                the voxel; or ``"volume"``, the clipped length times the
+                cross-section of the segments, plus the volume of spheres
+                added to the voxel containing their center.
+
+            n_threads(int):  The number of threads used. Default: 1.
+
+            populations(str,list):  A string or list of strings specifying which
+                populations to query. Ignored by single-population indexes.
+
+            population_mode(str):  (advanced) Defines if the query uses the
+                single- or multi-population return type. Available: ``None``
+                (native), ``"single"`` (single-population), ``"multi"``
+                (multi-population). Please consult the User Guide for a detailed
+                explanation.
+
+        Returns:
+            A numpy array of shape ``shape``, with one value per voxel.
+        """
+        pass
+
     @abc.abstractmethod
     def bounds(self, populations=None, population_mode=None):
         """The joint minimal bounding box of all elements in the index.
@@ -252,6 +593,11 @@ def _wrap_single_as_multi_population(func):
     return wrapped_func
 
 
+def _capsule_as_polyline(p1, p2):
+    """A capsule is the polyline consisting of a single segment."""
+    return np.stack([np.asarray(p1), np.asarray(p2)])
+
+
 class Index(IndexInterface):
     def __init__(self, core_index):
         self._core_index = core_index
@@ -266,6 +612,16 @@ class Index(IndexInterface):
             "raw_elements": self._core_index._find_intersecting_objs,
         }
 
+        self._cylinder_queries = {
+            "_np": self._core_index._find_intersecting_cylinder_np,
+            "raw_elements": self._core_index._find_intersecting_cylinder_objs,
+        }
+
+        self._polyline_queries = {
+            "_np": self._core_index._find_intersecting_polyline_np,
+            "raw_elements": self._core_index._find_intersecting_polyline_objs,
+        }
+
         self._box_counts = {
             None: self._core_index._count_intersecting,
         }
@@ -276,6 +632,8 @@ class Index(IndexInterface):
                 "_count_intersecting_agg_gid"
             )
 
+        self._aggregate_counts = None
+
         self._sphere_counts = {
             None: self._core_index._count_intersecting_sphere,
         }
@@ -286,6 +644,26 @@ class Index(IndexInterface):
                 "_count_intersecting_sphere_agg_gid"
             )
 
+        self._cylinder_counts = {
+            None: self._core_index._count_intersecting_cylinder,
+        }
+
+        if hasattr(self._core_index, "_count_intersecting_cylinder_agg_gid"):
+            self._cylinder_counts["post_gid"] = getattr(
+                self._core_index,
+                "_count_intersecting_cylinder_agg_gid"
+            )
+
+        self._polyline_counts = {
+            None: self._core_index._count_intersecting_polyline,
+        }
+
+        if hasattr(self._core_index, "_count_intersecting_polyline_agg_gid"):
+            self._polyline_counts["post_gid"] = getattr(
+                self._core_index,
+                "_count_intersecting_polyline_agg_gid"
+            )
+
     @_wrap_single_as_multi_population
     def box_query(self, corner, opposite_corner, *,
                   fields=None, accuracy=None):
@@ -306,6 +684,204 @@ class Index(IndexInterface):
             methods=self._sphere_queries
         )
 
+    @_wrap_single_as_multi_population
+    def cylinder_query(self, p1, p2, radius, *,
+                       fields=None, accuracy=None):
+        return self._query(
+            (p1, p2, radius),
+            fields=fields,
+            accuracy=accuracy,
+            methods=self._cylinder_queries
+        )
+
+    @_wrap_single_as_multi_population
+    def capsule_query(self, p1, p2, radius, *,
+                      fields=None, accuracy=None):
+        return self.polyline_query(
+            _capsule_as_polyline(p1, p2), radius, fields=fields, accuracy=accuracy
+        )
+
+    @_wrap_single_as_multi_population
+    def polyline_query(self, points, radius, *,
+                       fields=None, accuracy=None):
+        return self._query(
+            (points, radius),
+            fields=fields,
+            accuracy=accuracy,
+            methods=self._polyline_queries
+        )
+
+    @_wrap_single_as_multi_population
+    def box_query_batch(self, corners, opposite_corners, *,
+                        fields=None, accuracy=None, n_threads=None):
+        return self._batch_query(
+            (corners, opposite_corners),
+            fields=fields,
+            accuracy=accuracy,
+            n_threads=n_threads,
+            method=self._core_index._find_intersecting_box_np_batch,
+        )
+
+    @_wrap_single_as_multi_population
+    def sphere_query_batch(self, centers, radii, *,
+                           fields=None, accuracy=None, n_threads=None):
+        return self._batch_query(
+            (centers, radii),
+            fields=fields,
+            accuracy=accuracy,
+            n_threads=n_threads,
+            method=self._core_index._find_intersecting_np_batch,
+        )
+
+    @_wrap_single_as_multi_population
+    def box_unique_gids(self, corner, opposite_corner, *,
+                        accuracy=None, return_counts=False):
+        return self._unique_gids(
+            (corner, opposite_corner),
+            accuracy=accuracy,
+            return_counts=return_counts,
+            method=self._core_index._find_unique_gids_box,
+        )
+
+    @_wrap_single_as_multi_population
+    def sphere_unique_gids(self, center, radius, *,
+                           accuracy=None, return_counts=False):
+        return self._unique_gids(
+            (center, radius),
+            accuracy=accuracy,
+            return_counts=return_counts,
+            method=self._core_index._find_unique_gids,
+        )
+
+    @_wrap_single_as_multi_population
+    def box_unique_gids_batch(self, corners, opposite_corners, *,
+                              accuracy=None, return_counts=False, n_threads=None):
+        return self._unique_gids_batch(
+            (corners, opposite_corners),
+            accuracy=accuracy,
+            return_counts=return_counts,
+            n_threads=n_threads,
+            method=self._core_index._find_unique_gids_box_batch,
+        )
+
+    @_wrap_single_as_multi_population
+    def sphere_unique_gids_batch(self, centers, radii, *,
+                                 accuracy=None, return_counts=False, n_threads=None):
+        return self._unique_gids_batch(
+            (centers, radii),
+            accuracy=accuracy,
+            return_counts=return_counts,
+            n_threads=n_threads,
+            method=self._core_index._find_unique_gids_batch,
+        )
+
+    def box_query_chunks(self, corner, opposite_corner, *,
+                         fields=None, accuracy=None, chunk_size=None):
+        """Find all elements intersecting with the query box, in chunks.
+
+        This is a generator, which yields the results of ``box_query`` in
+        chunks of (at most) ``chunk_size`` elements. The query is resumed
+        for every chunk, therefore, the memory required is bounded by the
+        size of a chunk. This is intended for queries with very many results.
+
+        Arguments:
+            fields(str,list):  The builtin fields to return, see ``box_query``.
+
+            accuracy(str):  See ``box_query``.
+
+            chunk_size(int):  The maximum number of elements per chunk.
+                Default: ``2**20``
+
+        Yields:
+            The results of every chunk, in the format of ``box_query``.
+        """
+        return self._chunked_query(
+            (corner, opposite_corner),
+            fields=fields,
+            accuracy=accuracy,
+            chunk_size=chunk_size,
+            method=self._core_index._find_intersecting_box_cursor,
+        )
+
+    def sphere_query_chunks(self, center, radius, *,
+                            fields=None, accuracy=None, chunk_size=None):
+        """Find all elements intersecting with the query sphere, in chunks.
+
+        See ``box_query_chunks``.
+        """
+        return self._chunked_query(
+            (center, radius),
+            fields=fields,
+            accuracy=accuracy,
+            chunk_size=chunk_size,
+            method=self._core_index._find_intersecting_cursor,
+        )
+
+    def join_within(self, distance, other=None, *, accuracy=None, n_threads=None):
+        """Find all pairs of elements within ``distance`` of each other.
+
+        If ``other`` is an index, the pairs ``(a, b)`` of an element ``a`` of
+        this index and an element ``b`` of ``other`` are found. Otherwise, the
+        pairs of distinct elements of this index are found, each unordered
+        pair once. Both trees are descended together, which is much faster
+        than one query per element. Memory mapped indexes aren't supported.
+
+        Arguments:
+            distance(float):  The maximum distance between the two elements.
+
+            other(Index):  The index to join with, of the same type as this
+                index. Default: ``None``, i.e. join the index with itself.
+
+            accuracy(str):  With ``"bounding_box"`` the distance between the
+                bounding boxes is used. With ``"best_effort"`` the shape of
+                ``a`` is grown by ``distance`` and tested for intersection
+                with ``b``. Default: ``"best_effort"``
+
+            n_threads(int):  The number of threads used, see
+                ``box_query_batch``. Default: ``1``
+
+        Returns:
+            A pair of arrays ``(ids, other_ids)``, the ``i``-th pair consists
+            of ``ids[i]`` and ``other_ids[i]``.
+        """
+        accuracy = self._enforce_accuracy_default(accuracy)
+        n_threads = 1 if n_threads is None else n_threads
+
+        if n_threads < 1:
+            raise ValueError(f"Invalid number of threads: {n_threads}")
+
+        if other is None:
+            return self._core_index._self_join_within(
+                distance, geometry=accuracy, n_threads=n_threads
+            )
+
+        return self._core_index._join_within(
+            other._core_index, distance, geometry=accuracy, n_threads=n_threads
+        )
+
+    def build_aggregate_counts(self):
+        """Precompute the number of elements below every node of the index.
+
+        Afterwards, ``box_counts`` and ``sphere_counts`` without ``group_by``
+        don't descend into nodes contained in the query shape. The table
+        needs one integer per node and is kept until
+        ``drop_aggregate_counts`` is called. If elements are added to the
+        index, the counts fall back to visiting the elements until the table
+        is built again. Only supported by in-memory indexes.
+        """
+        if not hasattr(self._core_index, "_aggregate_counts"):
+            raise ValueError("Aggregate counts aren't supported by this index.")
+
+        self._aggregate_counts = self._core_index._aggregate_counts()
+        self._box_counts[None] = self._aggregate_box_counts
+        self._sphere_counts[None] = self._aggregate_sphere_counts
+
+    def drop_aggregate_counts(self):
+        """Release the table built by ``build_aggregate_counts``."""
+        self._aggregate_counts = None
+        self._box_counts[None] = self._core_index._count_intersecting
+        self._sphere_counts[None] = self._core_index._count_intersecting_sphere
+
     @_wrap_single_as_multi_population
     def box_counts(self, corner, opposite_corner, *,
                    group_by=None, accuracy=None):
@@ -326,6 +902,59 @@ class Index(IndexInterface):
             methods=self._sphere_counts
         )
 
+    @_wrap_single_as_multi_population
+    def cylinder_counts(self, p1, p2, radius, *,
+                        group_by=None, accuracy=None):
+        return self._counts(
+            (p1, p2, radius),
+            group_by=group_by,
+            accuracy=accuracy,
+            methods=self._cylinder_counts
+        )
+
+    @_wrap_single_as_multi_population
+    def capsule_counts(self, p1, p2, radius, *,
+                       group_by=None, accuracy=None):
+        return self.polyline_counts(
+            _capsule_as_polyline(p1, p2), radius, group_by=group_by, accuracy=accuracy
+        )
+
+    @_wrap_single_as_multi_population
+    def polyline_counts(self, points, radius, *,
+                        group_by=None, accuracy=None):
+        return self._counts(
+            (points, radius),
+            group_by=group_by,
+            accuracy=accuracy,
+            methods=self._polyline_counts
+        )
+
+    @_wrap_single_as_multi_population
+    def box_counts_batch(self, corners, opposite_corners, *,
+                         group_by="post_gid", format="csr", accuracy=None,
+                         n_threads=None):
+        return self._grouped_counts_batch(
+            (corners, opposite_corners),
+            group_by=group_by,
+            format=format,
+            accuracy=accuracy,
+            n_threads=n_threads,
+            method_name="_count_intersecting_grouped_box_batch",
+        )
+
+    @_wrap_single_as_multi_population
+    def sphere_counts_batch(self, centers, radii, *,
+                            group_by="post_gid", format="csr", accuracy=None,
+                            n_threads=None):
+        return self._grouped_counts_batch(
+            (centers, radii),
+            group_by=group_by,
+            format=format,
+            accuracy=accuracy,
+            n_threads=n_threads,
+            method_name="_count_intersecting_grouped_batch",
+        )
+
     @_wrap_single_as_multi_population
     def box_empty(self, corner, opposite_corner, *, accuracy=None):
         accuracy = self._enforce_accuracy_default(accuracy)
@@ -342,9 +971,53 @@ class Index(IndexInterface):
             geometry=accuracy
         )
 
+    @_wrap_single_as_multi_population
+    def cylinder_empty(self, p1, p2, radius, *, accuracy=None):
+        accuracy = self._enforce_accuracy_default(accuracy)
+        return not self._core_index._is_intersecting_cylinder(
+            p1, p2, radius,
+            geometry=accuracy
+        )
+
+    @_wrap_single_as_multi_population
+    def capsule_empty(self, p1, p2, radius, *, accuracy=None):
+        return self.polyline_empty(
+            _capsule_as_polyline(p1, p2), radius, accuracy=accuracy
+        )
+
+    @_wrap_single_as_multi_population
+    def polyline_empty(self, points, radius, *, accuracy=None):
+        accuracy = self._enforce_accuracy_default(accuracy)
+        return not self._core_index._is_intersecting_polyline(
+            points, radius,
+            geometry=accuracy
+        )
+
     def __len__(self):
         return len(self._core_index)
 
+    @_wrap_single_as_multi_population
+    def rasterize(self, grid_origin, voxel_size, shape, quantity="count", *,
+                  n_threads=None):
+        n_threads = 1 if n_threads is None else n_threads
+
+        if n_threads < 1:
+            raise ValueError(f"Invalid number of threads: {n_threads}")
+
+        # Negative entries would wrap around when cast to `uintp`.
+        shape = np.asarray(shape)
+        is_integral = np.issubdtype(shape.dtype, np.integer)
+        if shape.shape != (3,) or not is_integral or np.any(shape <= 0):
+            raise ValueError(f"Invalid shape of the grid: {shape}")
+
+        return self._core_index._rasterize(
+            np.asarray(grid_origin, dtype=np.float32),
+            voxel_size,
+            shape.astype(np.uintp),
+            quantity,
+            n_threads=n_threads,
+        )
+
     @_wrap_single_as_multi_population
     def bounds(self):
         return self._core_index.bounds()
@@ -384,7 +1057,9 @@ class Index(IndexInterface):
     def _multi_field_box_query(self, query_shape, *,
                                fields=None, accuracy=None, methods=None):
 
-        result = methods["_np"](*query_shape, geometry=accuracy)
+        # Only the requested columns are computed by the core index.
+        fields = list(fields)
+        result = methods["_np"](*query_shape, geometry=accuracy, fields=fields)
         return {k: result[k] for k in fields}
 
     def _single_field_box_query(self, query_shape, *,
@@ -394,9 +1069,120 @@ class Index(IndexInterface):
             return methods[field](*query_shape, geometry=accuracy)
 
         else:
-            result = methods["_np"](*query_shape, geometry=accuracy)
+            result = methods["_np"](*query_shape, geometry=accuracy, fields=[field])
             return result[field]
 
+    def _batch_query(self, query_shapes, *, fields=None, accuracy=None, n_threads=None,
+                     method=None):
+        fields = self._enforce_fields_default(fields)
+        accuracy = self._enforce_accuracy_default(accuracy)
+        n_threads = 1 if n_threads is None else n_threads
+
+        if n_threads < 1:
+            raise ValueError(f"Invalid number of threads: {n_threads}")
+
+        builtin_fields = self.builtin_fields
+        requested_fields = fields if is_non_string_iterable(fields) else [fields]
+        if any(f not in builtin_fields for f in requested_fields):
+            raise ValueError(f"Batched queries only support builtin fields: {fields}")
+
+        offsets, result = method(*query_shapes, geometry=accuracy, n_threads=n_threads)
+
+        if is_non_string_iterable(fields):
+            return offsets, {k: result[k] for k in fields}
+
+        else:
+            return offsets, result[fields]
+
+    def _unique_gids(self, query_shape, *, accuracy=None, return_counts=False,
+                     method=None):
+        accuracy = self._enforce_accuracy_default(accuracy)
+        gids, counts = method(*query_shape, geometry=accuracy)
+
+        return (gids, counts) if return_counts else gids
+
+    def _unique_gids_batch(self, query_shapes, *, accuracy=None, return_counts=False,
+                           n_threads=None, method=None):
+        accuracy = self._enforce_accuracy_default(accuracy)
+        n_threads = 1 if n_threads is None else n_threads
+
+        if n_threads < 1:
+            raise ValueError(f"Invalid number of threads: {n_threads}")
+
+        offsets, gids, counts = method(
+            *query_shapes, geometry=accuracy, n_threads=n_threads
+        )
+
+        return (offsets, gids, counts) if return_counts else (offsets, gids)
+
+    def _grouped_counts_batch(self, query_shapes, *, group_by="post_gid", format="csr",
+                              accuracy=None, n_threads=None, method_name=None):
+        if not hasattr(self._core_index, method_name):
+            raise ValueError("Grouped counts are only supported by synapse indexes.")
+
+        pair = ("pre_gid", "post_gid")
+        if is_non_string_iterable(group_by) and tuple(group_by) == pair:
+            key = "pre_post_gid"
+        elif group_by in ("pre_gid", "post_gid"):
+            key = group_by
+        else:
+            raise ValueError(f"Unsupported argument: group_by={group_by}")
+
+        if format not in ("csr", "coo"):
+            raise ValueError(f"Invalid format: {format}")
+
+        accuracy = self._enforce_accuracy_default(accuracy)
+        n_threads = 1 if n_threads is None else n_threads
+
+        if n_threads < 1:
+            raise ValueError(f"Invalid number of threads: {n_threads}")
+
+        method = getattr(self._core_index, method_name)
+        offsets, pre_gids, post_gids, counts = method(
+            *query_shapes, group_by=key, geometry=accuracy, n_threads=n_threads
+        )
+
+        if format == "csr":
+            result = {"offsets": offsets}
+        else:
+            n_queries = offsets.shape[0] - 1
+            result = {"region": np.repeat(np.arange(n_queries), np.diff(offsets))}
+
+        if key != "post_gid":
+            result["pre_gid"] = pre_gids
+
+        if key != "pre_gid":
+            result["post_gid"] = post_gids
+
+        result["count"] = counts
+        return result
+
+    def _chunked_query(self, query_shape, *, fields=None, accuracy=None,
+                       chunk_size=None, method=None):
+        fields = self._enforce_fields_default(fields)
+        accuracy = self._enforce_accuracy_default(accuracy)
+        chunk_size = 2**20 if chunk_size is None else chunk_size
+
+        if chunk_size < 1:
+            raise ValueError(f"Invalid chunk size: {chunk_size}")
+
+        builtin_fields = self.builtin_fields
+        requested_fields = fields if is_non_string_iterable(fields) else [fields]
+        if any(f not in builtin_fields for f in requested_fields):
+            raise ValueError(f"Chunked queries only support builtin fields: {fields}")
+
+        cursor = method(*query_shape, geometry=accuracy)
+
+        def chunks():
+            while (result := cursor.next_chunk(chunk_size)) is not None:
+                if is_non_string_iterable(fields):
+                    yield {k: result[k] for k in fields}
+
+                else:
+                    yield result[fields]
+
+        return chunks()
+
     def _enforce_accuracy_default(self, accuracy):
         if accuracy is None:
             return "best_effort"
@@ -432,6 +1218,36 @@ class Index(IndexInterface):
         accuracy = self._enforce_accuracy_default(accuracy)
         return method(*query_shape, geometry=accuracy)
 
+    def _aggregate_box_counts(self, corner, opposite_corner, *, geometry):
+        counts = self._valid_aggregate_counts()
+        if counts is None:
+            return self._core_index._count_intersecting(
+                corner, opposite_corner, geometry=geometry
+            )
+
+        return counts._count_intersecting(
+            corner, opposite_corner, geometry=geometry
+        )
+
+    def _aggregate_sphere_counts(self, center, radius, *, geometry):
+        counts = self._valid_aggregate_counts()
+        if counts is None:
+            return self._core_index._count_intersecting_sphere(
+                center, radius, geometry=geometry
+            )
+
+        return counts._count_intersecting_sphere(
+            center, radius, geometry=geometry
+        )
+
+    def _valid_aggregate_counts(self):
+        # The table is stale if elements were added after it was built.
+        counts = self._aggregate_counts
+        if counts is None or counts.size != len(self._core_index):
+            return None
+
+        return counts
+
     @classmethod
     def _open_core_from_meta_data(cls, meta_data, **kwargs):
         return brain_indexer.io.open_core_from_meta_data(
@@ -559,18 +1375,30 @@ class SynapseIndexBase(SONATAIndex):
         return brain_indexer.SynapseIndexResolver
 
 
+def _dump_in_memory_index(core_index, index_path, memory_mapped):
+    if memory_mapped:
+        core_index._dump_memory_mapped(index_path)
+    else:
+        core_index._dump(index_path)
+
+
 class _WriteSONATAInMemoryIndex:
-    def write(self, index_path, *, sonata_filename=None, population=None):
+    def write(self, index_path, *, sonata_filename=None, population=None,
+              memory_mapped=False):
         """Saves the index to disk.
 
         If both ``sonata_filename`` and ``population`` are passed, then the
         additional metadata needed to load an index supporting fetching
         attributes from SONATA is also saved.
 
+        If ``memory_mapped`` is ``True`` the index is saved as a memory mapped
+        index, which is queried in place from disk instead of being loaded
+        into memory when opened.
+
         No action is performed if ``index_path`` is ``None``.
         """
         if index_path is not None:
-            self._core_index._dump(index_path)
+            _dump_in_memory_index(self._core_index, index_path, memory_mapped)
 
             if sonata_filename is not None and population is not None:
                 write_sonata_meta_data_section(
@@ -578,11 +1406,86 @@ class _WriteSONATAInMemoryIndex:
                 )
 
 
+class _PrefetchMultiIndex:
+    def set_io_threads(self, n_io_threads):
+        """Sets the number of threads loading subtrees concurrently.
+
+        With ``0``, the default, the querying thread loads the subtrees one
+        after the other and nothing is prefetched. Must not be called while
+        the index is queried.
+        """
+        if n_io_threads < 0:
+            raise ValueError(f"Invalid number of I/O threads: {n_io_threads}")
+
+        self._core_index._set_io_threads(n_io_threads)
+
+    def prefetch(self, min_corner, max_corner):
+        """Loads the subtrees intersecting the box in the background.
+
+        This announces the region of upcoming queries. Subtrees are only
+        prefetched if they fit into the cache without evicting other subtrees.
+        """
+        self._core_index._prefetch(
+            np.asarray(min_corner, dtype=np.float32),
+            np.asarray(max_corner, dtype=np.float32),
+        )
+
+    def set_prefetch_mode(self, mode):
+        """Selects how subtrees are prefetched.
+
+        With ``"hint"``, the default, only the regions passed to ``prefetch``
+        are prefetched. With ``"trajectory"`` the path of the recent queries is
+        extrapolated, e.g. for sweeps through the index.
+        """
+        self._core_index._set_prefetch_mode(mode)
+
+    @property
+    def prefetch_stats(self):
+        """The number of prefetched subtrees; and how many were used or wasted.
+
+        Returns a dictionary with the keys ``"n_prefetched"``, ``"n_hits"``
+        and ``"n_wasted"``. Wasted subtrees were evicted without being used.
+        """
+        return self._core_index._prefetch_stats()
+
+
 class SynapseIndex(SynapseIndexBase, _WriteSONATAInMemoryIndex):
     pass
 
 
-class SynapseMultiIndex(SynapseIndexBase):
+class SynapseMultiIndex(SynapseIndexBase, _PrefetchMultiIndex):
+    pass
+
+
+class SynapseMemoryMappedIndex(SynapseIndexBase):
+    pass
+
+
+class PointSynapseIndexBase(SynapseIndexBase):
+    """Synapses indexed as points, i.e. without the radius.
+
+    The queries return the same synapses as those of a synapse index, the
+    bounding boxes of the elements are simply degenerate.
+    """
+
+    @property
+    def element_type(self):
+        return "point_synapse"
+
+    @classmethod
+    def _resolver(cls):
+        return brain_indexer.PointSynapseIndexResolver
+
+
+class PointSynapseIndex(PointSynapseIndexBase, _WriteSONATAInMemoryIndex):
+    pass
+
+
+class PointSynapseMultiIndex(PointSynapseIndexBase, _PrefetchMultiIndex):
+    pass
+
+
+class PointSynapseMemoryMappedIndex(PointSynapseIndexBase):
     pass
 
 
@@ -622,20 +1525,27 @@ class MorphIndexBase(SONATAIndex):
 
 
 class _WriteInMemoryIndex:
-    def write(self, index_path):
+    def write(self, index_path, *, memory_mapped=False):
         """Saves the index to disk.
 
+        If `memory_mapped` is `True` the index is saved as a memory mapped
+        index.
+
         No action is performed if `index_path` is `None`.
         """
         if index_path is not None:
-            self._core_index._dump(index_path)
+            _dump_in_memory_index(self._core_index, index_path, memory_mapped)
 
 
 class MorphIndex(MorphIndexBase, _WriteSONATAInMemoryIndex):
     pass
 
 
-class MorphMultiIndex(MorphIndexBase):
+class MorphMultiIndex(MorphIndexBase, _PrefetchMultiIndex):
+    pass
+
+
+class MorphMemoryMappedIndex(MorphIndexBase):
     pass
 
 
@@ -658,6 +1568,10 @@ class SphereIndex(SphereIndexBase, _WriteInMemoryIndex):
         self._core_index._add_spheres(centroids, radii, ids)
 
 
+class SphereMemoryMappedIndex(SphereIndexBase):
+    pass
+
+
 class PointIndexBase(Index, _FromMetaDataWithOutSonata):
     @property
     def element_type(self):
@@ -668,6 +1582,10 @@ class PointIndex(PointIndexBase, _WriteInMemoryIndex):
     pass
 
 
+class PointMemoryMappedIndex(PointIndexBase):
+    pass
+
+
 def _wrap_as_multi_population(func):
     @functools.wraps(func)
     def _multi_pop_func(self, *args, population_mode=None, populations=None, **kwargs):
@@ -700,6 +1618,42 @@ class MultiPopulationIndex(IndexInterface):
     def box_query(self, index, *args, **kwargs):
         return index.box_query(*args, **kwargs)
 
+    @_wrap_as_multi_population
+    def cylinder_query(self, index, *args, **kwargs):
+        return index.cylinder_query(*args, **kwargs)
+
+    @_wrap_as_multi_population
+    def capsule_query(self, index, *args, **kwargs):
+        return index.capsule_query(*args, **kwargs)
+
+    @_wrap_as_multi_population
+    def polyline_query(self, index, *args, **kwargs):
+        return index.polyline_query(*args, **kwargs)
+
+    @_wrap_as_multi_population
+    def sphere_query_batch(self, index, *args, **kwargs):
+        return index.sphere_query_batch(*args, **kwargs)
+
+    @_wrap_as_multi_population
+    def box_query_batch(self, index, *args, **kwargs):
+        return index.box_query_batch(*args, **kwargs)
+
+    @_wrap_as_multi_population
+    def box_unique_gids(self, index, *args, **kwargs):
+        return index.box_unique_gids(*args, **kwargs)
+
+    @_wrap_as_multi_population
+    def sphere_unique_gids(self, index, *args, **kwargs):
+        return index.sphere_unique_gids(*args, **kwargs)
+
+    @_wrap_as_multi_population
+    def box_unique_gids_batch(self, index, *args, **kwargs):
+        return index.box_unique_gids_batch(*args, **kwargs)
+
+    @_wrap_as_multi_population
+    def sphere_unique_gids_batch(self, index, *args, **kwargs):
+        return index.sphere_unique_gids_batch(*args, **kwargs)
+
     @_wrap_as_multi_population
     def box_counts(self, index, *args, **kwargs):
         return index.box_counts(*args, **kwargs)
@@ -708,6 +1662,26 @@ class MultiPopulationIndex(IndexInterface):
     def sphere_counts(self, index, *args, **kwargs):
         return index.sphere_counts(*args, **kwargs)
 
+    @_wrap_as_multi_population
+    def cylinder_counts(self, index, *args, **kwargs):
+        return index.cylinder_counts(*args, **kwargs)
+
+    @_wrap_as_multi_population
+    def capsule_counts(self, index, *args, **kwargs):
+        return index.capsule_counts(*args, **kwargs)
+
+    @_wrap_as_multi_population
+    def polyline_counts(self, index, *args, **kwargs):
+        return index.polyline_counts(*args, **kwargs)
+
+    @_wrap_as_multi_population
+    def box_counts_batch(self, index, *args, **kwargs):
+        return index.box_counts_batch(*args, **kwargs)
+
+    @_wrap_as_multi_population
+    def sphere_counts_batch(self, index, *args, **kwargs):
+        return index.sphere_counts_batch(*args, **kwargs)
+
     @_wrap_as_multi_population
     def box_empty(self, index, *args, **kwargs):
         return index.box_empty(*args, **kwargs)
@@ -716,6 +1690,22 @@ class MultiPopulationIndex(IndexInterface):
     def sphere_empty(self, index, *args, **kwargs):
         return index.sphere_empty(*args, **kwargs)
 
+    @_wrap_as_multi_population
+    def cylinder_empty(self, index, *args, **kwargs):
+        return index.cylinder_empty(*args, **kwargs)
+
+    @_wrap_as_multi_population
+    def capsule_empty(self, index, *args, **kwargs):
+        return index.capsule_empty(*args, **kwargs)
+
+    @_wrap_as_multi_population
+    def polyline_empty(self, index, *args, **kwargs):
+        return index.polyline_empty(*args, **kwargs)
+
+    @_wrap_as_multi_population
+    def rasterize(self, index, *args, **kwargs):
+        return index.rasterize(*args, **kwargs)
+
     @_wrap_as_multi_population
     def bounds(self, index, *args, **kwargs):
         return index.bounds(*args, **kwargs)
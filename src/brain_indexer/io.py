@@ -1,5 +1,6 @@
 import os
 import json
+import hashlib
 import tempfile
 import contextlib
 
@@ -96,7 +97,8 @@ class MetaData:
     def index_variant(self):
         known_index_variants = [
             MetaData._Constants.in_memory_key,
-            MetaData._Constants.multi_index_key
+            MetaData._Constants.multi_index_key,
+            MetaData._Constants.memory_mapped_key,
         ]
 
         variants = list(
@@ -118,6 +120,10 @@ class MetaData:
     def multi_index(self):
         return self._sub_config(MetaData._Constants.multi_index_key)
 
+    @property
+    def memory_mapped(self):
+        return self._sub_config(MetaData._Constants.memory_mapped_key)
+
     @property
     def multi_population(self):
         if "multi_population" in self._raw_meta_data:
@@ -134,17 +140,48 @@ class MetaData:
         return core.deduce_meta_data_path(path)
 
 
-def open_core_from_meta_data(meta_data, *, max_cache_size_mb=None, resolver=None):
+def shared_cache_name(meta_data_filename):
+    """The name of the shared memory segment of a multi-index.
+
+    All processes of a user that open the same index agree on the name. It
+    changes when the index is rebuilt, since it depends on the modification
+    time of the meta data file.
+    """
+    path = os.path.realpath(meta_data_filename)
+    key = f"{path}:{os.stat(path).st_mtime_ns}:{os.getuid()}"
+    return "brain_indexer_" + hashlib.sha1(key.encode()).hexdigest()[:16]
+
+
+def open_core_from_meta_data(meta_data, *, max_cache_size_mb=None, eviction_policy=None,
+                             shared_cache=False, io_threads=None, resolver=None):
     if in_memory_conf := meta_data.in_memory:
         return resolver.core_class("in_memory")(in_memory_conf.index_path)
 
+    elif memory_mapped_conf := meta_data.memory_mapped:
+        return resolver.core_class("memory_mapped")(memory_mapped_conf.index_path)
+
     elif multi_index_conf := meta_data.multi_index:
         max_cache_size_mb = max_cache_size_mb or 1024
         mem = 1024 ** 2 * max_cache_size_mb
 
-        return resolver.core_class("multi_index")(
-            multi_index_conf.index_path, max_cached_bytes=mem
-        )
+        if shared_cache:
+            core_index = resolver.core_class("shared_multi_index")(
+                multi_index_conf.index_path,
+                max_cached_bytes=mem,
+                name=shared_cache_name(multi_index_conf.index_path),
+            )
+
+        else:
+            core_index = resolver.core_class("multi_index")(
+                multi_index_conf.index_path,
+                max_cached_bytes=mem,
+                eviction_policy=eviction_policy or "usage_rate",
+            )
+
+        if io_threads:
+            core_index._set_io_threads(io_threads)
+
+        return core_index
 
     else:
         raise ValueError("Invalid 'meta_data'.")
@@ -139,6 +139,8 @@ class MorphIndexBuilderBase:
                 Warn: None will index all synapses, please mind memory limits
             output_dir: If not ``None`` the index will be stored in the folder
                 ``output_dir``.
+            n_threads: Number of threads used to build an in-memory index.
+                Default: 1. Multi-indexes don't support this argument.
         """
         if "target_gids" in kw:
             logger.warning(
@@ -1,13 +1,16 @@
 from brain_indexer import core
 
 from .morphology_builder import MorphIndexBuilder
-from .synapse_builder import SynapseIndexBuilder
+from .synapse_builder import SynapseIndexBuilder, PointSynapseIndexBuilder
 
 from .builder import SphereIndexBuilder, PointIndexBuilder
 
-from .index import MorphIndex, MorphMultiIndex
-from .index import SynapseIndex, SynapseMultiIndex
+from .index import MorphIndex, MorphMultiIndex, MorphMemoryMappedIndex
+from .index import SynapseIndex, SynapseMultiIndex, SynapseMemoryMappedIndex
+from .index import PointSynapseIndex, PointSynapseMultiIndex
+from .index import PointSynapseMemoryMappedIndex
 from .index import SphereIndex, PointIndex
+from .index import SphereMemoryMappedIndex, PointMemoryMappedIndex
 from .index import MultiPopulationIndex
 
 from .io import MetaData
@@ -47,10 +50,12 @@ class PointIndexResolver(_SingleKindIndexResolverBase):
     """
     _core_classes = {
         core._MetaDataConstants.in_memory_key: core.PointIndex,
+        core._MetaDataConstants.memory_mapped_key: core.PointMemoryMappedIndex,
     }
 
     _index_classes = {
         core._MetaDataConstants.in_memory_key: PointIndex,
+        core._MetaDataConstants.memory_mapped_key: PointMemoryMappedIndex,
     }
 
     _builder_classes = {
@@ -65,10 +70,12 @@ class SphereIndexResolver(_SingleKindIndexResolverBase):
     """
     _core_classes = {
         core._MetaDataConstants.in_memory_key: core.SphereIndex,
+        core._MetaDataConstants.memory_mapped_key: core.SphereMemoryMappedIndex,
     }
 
     _index_classes = {
         core._MetaDataConstants.in_memory_key: SphereIndex,
+        core._MetaDataConstants.memory_mapped_key: SphereMemoryMappedIndex,
     }
 
     _builder_classes = {
@@ -90,11 +97,14 @@ class SynapseIndexResolver(_SingleKindIndexResolverBase):
     _core_classes = {
         core._MetaDataConstants.in_memory_key: core.SynapseIndex,
         core._MetaDataConstants.multi_index_key: core.SynapseMultiIndex,
+        core._MetaDataConstants.memory_mapped_key: core.SynapseMemoryMappedIndex,
+        "shared_multi_index": core.SynapseSharedMultiIndex,
     }
 
     _index_classes = {
         core._MetaDataConstants.in_memory_key: SynapseIndex,
         core._MetaDataConstants.multi_index_key: SynapseMultiIndex,
+        core._MetaDataConstants.memory_mapped_key: SynapseMemoryMappedIndex,
     }
 
     _builder_classes = {
@@ -106,6 +116,40 @@ class SynapseIndexResolver(_SingleKindIndexResolverBase):
         _builder_classes[key] = SynapseMultiIndexBuilder
 
 
+class PointSynapseIndexResolver(_SingleKindIndexResolverBase):
+    """Provides string to class mapping.
+
+    This class is for all classes related to indexes of synapses without
+    radius, i.e. synapses indexed as points.
+    """
+    try:
+        from .synapse_builder import PointSynapseMultiIndexBuilder  # noqa
+        si_has_mpi = True
+    except ImportError:
+        si_has_mpi = False
+
+    _core_classes = {
+        core._MetaDataConstants.in_memory_key: core.PointSynapseIndex,
+        core._MetaDataConstants.multi_index_key: core.PointSynapseMultiIndex,
+        core._MetaDataConstants.memory_mapped_key: core.PointSynapseMemoryMappedIndex,
+        "shared_multi_index": core.PointSynapseSharedMultiIndex,
+    }
+
+    _index_classes = {
+        core._MetaDataConstants.in_memory_key: PointSynapseIndex,
+        core._MetaDataConstants.multi_index_key: PointSynapseMultiIndex,
+        core._MetaDataConstants.memory_mapped_key: PointSynapseMemoryMappedIndex,
+    }
+
+    _builder_classes = {
+        core._MetaDataConstants.in_memory_key: PointSynapseIndexBuilder,
+    }
+
+    if si_has_mpi:
+        key = core._MetaDataConstants.multi_index_key
+        _builder_classes[key] = PointSynapseMultiIndexBuilder
+
+
 class MorphIndexResolver(_SingleKindIndexResolverBase):
     """Provides string to class mapping.
 
@@ -121,11 +165,14 @@ class MorphIndexResolver(_SingleKindIndexResolverBase):
     _core_classes = {
         core._MetaDataConstants.in_memory_key: core.MorphIndex,
         core._MetaDataConstants.multi_index_key: core.MorphMultiIndex,
+        core._MetaDataConstants.memory_mapped_key: core.MorphMemoryMappedIndex,
+        "shared_multi_index": core.MorphSharedMultiIndex,
     }
 
     _index_classes = {
         core._MetaDataConstants.in_memory_key: MorphIndex,
         core._MetaDataConstants.multi_index_key: MorphMultiIndex,
+        core._MetaDataConstants.memory_mapped_key: MorphMemoryMappedIndex,
     }
 
     _builder_classes = {
@@ -147,7 +194,8 @@ class IndexResolver:
         "point": PointIndexResolver,
         "sphere": SphereIndexResolver,
         "morphology": MorphIndexResolver,
-        "synapse": SynapseIndexResolver
+        "synapse": SynapseIndexResolver,
+        "point_synapse": PointSynapseIndexResolver,
     }
 
     @staticmethod
@@ -195,7 +243,8 @@ def _open_multi_population_index(meta_data, **kwargs):
     return MultiPopulationIndex(indexes)
 
 
-def open_index(path, max_cache_size_mb=None):
+def open_index(path, max_cache_size_mb=None, eviction_policy=None, shared_cache=False,
+               io_threads=None):
     """Open an index.
 
     Indexes are stored in folders, these folders contain the actual index and
@@ -205,11 +254,30 @@ def open_index(path, max_cache_size_mb=None):
 
     When opening multi-indexes one must specify the amount of memory the index
     is allowed to consume. This is done through ``max_cache_size_mb`` which is
-    the size maximum amount of memory all loaded indexed elements may consume,
-    in MB. Note that this does not include the space required for the tree
-    structure itself. The User Guide contains more information about how a
-    multi-index works and how the cache size affects performance. Regular,
-    in-memory indexes will ignore this flag.
+    the maximum amount of memory all loaded subtrees may consume, in MB. This
+    includes the nodes of the subtrees, not only the indexed elements. The
+    User Guide contains more information about how a multi-index works and how
+    the cache size affects performance. Regular, in-memory indexes will ignore
+    this flag.
+
+    Once the cache is full, ``eviction_policy`` decides which subtree of a
+    multi-index is evicted. It's one of ``"usage_rate"`` (the default),
+    ``"lru"``, ``"clock"``, ``"arc"`` or ``"cost_aware"``. Other indexes
+    ignore it.
+
+    With ``shared_cache=True`` the subtrees of a multi-index are kept in shared
+    memory, and all processes on the node that open the same index share them.
+    Then, ``max_cache_size_mb`` is the budget of the node, set by the first
+    process; and subtrees are evicted least recently used first.
+
+    With ``io_threads`` a multi-index loads the subtrees needed by a query,
+    and prefetched subtrees, concurrently on that many threads. By default,
+    they're loaded one after the other by the querying thread. Other indexes
+    ignore it.
+
+    Memory mapped indexes are not loaded into memory, they're mapped read-only
+    and queried in place. Hence, opening them is cheap and processes on the
+    same node share the index through the page cache.
     """
 
     meta_data = MetaData(path)
@@ -217,11 +285,17 @@ def open_index(path, max_cache_size_mb=None):
     if meta_data.multi_population:
         return _open_multi_population_index(
             meta_data,
-            max_cache_size_mb=max_cache_size_mb
+            max_cache_size_mb=max_cache_size_mb,
+            eviction_policy=eviction_policy,
+            shared_cache=shared_cache,
+            io_threads=io_threads
         )
 
     else:
         return _open_single_population_index(
             meta_data,
-            max_cache_size_mb=max_cache_size_mb
+            max_cache_size_mb=max_cache_size_mb,
+            eviction_policy=eviction_policy,
+            shared_cache=shared_cache,
+            io_threads=io_threads
         )
@@ -4,7 +4,7 @@ import numpy as np
 import brain_indexer
 from . import _brain_indexer as core
 from .util import chunk_sonata_selection, bcast_sonata_selection
-from .index import SynapseIndex
+from .index import SynapseIndex, PointSynapseIndex
 from .builder import _WriteSONATAMetadataMixin, _WriteSONATAMetadataMultiMixin
 from .chunked_builder import ChunkedProcessingMixin, MultiIndexBuilderMixin
 from .io import open_sonata_edges, validated_sonata_edges_population
@@ -55,6 +55,8 @@ class SynapseIndexBuilderBase:
                 present on the constructor rank.
             output_dir: If not ``None`` the index will be stored in the folder
                 ``output_dir``.
+            n_threads: Number of threads used to build an in-memory index.
+                Default: 1. Multi-indexes don't support this argument.
         """
         population_name = validated_sonata_edges_population(
             edge_filename, population_name
@@ -111,9 +113,12 @@ class SynapseIndexBuilder(SynapseIndexBuilderBase,
     # set in `SynapseIndexBuilderBase` not `ChunkedProcessingMixin`.
     N_ELEMENTS_CHUNK = SynapseIndexBuilderBase.N_ELEMENTS_CHUNK
 
+    _core_builder_class = core.SynapseIndexBulkBuilder
+    _index_class = SynapseIndex
+
     def __init__(self, sonata_edges, selection):
         super().__init__(sonata_edges, selection)
-        self._core_builder = core.SynapseIndexBulkBuilder()
+        self._core_builder = self._core_builder_class()
         self._warn_when_too_large()
 
     def _warn_when_too_large(self):
@@ -126,7 +131,7 @@ class SynapseIndexBuilder(SynapseIndexBuilderBase,
 
     @property
     def index(self):
-        return SynapseIndex(self._core_index, self._sonata_edges)
+        return self._index_class(self._core_index, self._sonata_edges)
 
     @property
     def _core_index(self):
@@ -142,6 +147,16 @@ class SynapseIndexBuilder(SynapseIndexBuilderBase,
             self._core_index._dump(output_dir)
 
 
+class PointSynapseIndexBuilder(SynapseIndexBuilder):
+    """Builder for in-memory indexes of synapses without radius.
+
+    The synapses are indexed as points, see ``PointSynapseIndex``.
+    """
+
+    _core_builder_class = core.PointSynapseIndexBulkBuilder
+    _index_class = PointSynapseIndex
+
+
 # Only provide MPI MultiIndex builders if enabled at the core
 if hasattr(core, "SynapseMultiIndexBulkBuilder"):
 
@@ -153,11 +168,13 @@ if hasattr(core, "SynapseMultiIndexBulkBuilder"):
         Note: this requires MPI support. Guidance on choosing the number of
         MPI ranks can be found in the User Guide.
         """
+        _core_builder_class = core.SynapseMultiIndexBulkBuilder
+
         def __init__(self, sonata_edges, selection, output_dir=None):
             super().__init__(sonata_edges, selection)
 
             assert output_dir is not None, f"Invalid `output_dir`. [{output_dir}]"
-            self._core_builder = core.SynapseMultiIndexBulkBuilder(output_dir)
+            self._core_builder = self._core_builder_class(output_dir)
 
         @classmethod
         def constructor_rank(cls, mpi_comm=None):
@@ -222,3 +239,11 @@ if hasattr(core, "SynapseMultiIndexBulkBuilder"):
                 chunk_size = chunk_size // 8
 
             raise ValueError("Unable to create a suitable selection.")
+
+    class PointSynapseMultiIndexBuilder(SynapseMultiIndexBuilder):
+        """Builder for multi-index indexes of synapses without radius.
+
+        The synapses are indexed as points, see ``PointSynapseMultiIndex``.
+        """
+
+        _core_builder_class = core.PointSynapseMultiIndexBulkBuilder
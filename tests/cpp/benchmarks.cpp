@@ -3,7 +3,9 @@
 #include <boost/timer/timer.hpp>
 
 #include <numeric>
+#include <random>
 #include <brain_indexer/index.hpp>
+#include <brain_indexer/packed_index.hpp>
 #include <brain_indexer/util.hpp>
 
 
@@ -42,4 +44,105 @@ BOOST_AUTO_TEST_CASE(VariantUsingSOA) {
         std::cout << "Without Copy (SoA reader):" << timer.format() << std::endl;
 
     }
-}
\ No newline at end of file
+}
+
+template <class Tree>
+static void run_segment_queries(const std::string& label,
+                                const Tree& rtree,
+                                const std::vector<Box3D>& queries) {
+    size_t n_found = 0;
+    {
+        cpu_timer timer;
+        for (const auto& query : queries) {
+            n_found += rtree.count_intersecting(query);
+        }
+        std::cout << label << " (bounding box):" << timer.format() << std::endl;
+    }
+
+    {
+        cpu_timer timer;
+        for (const auto& query : queries) {
+            n_found += rtree.template count_intersecting<BestEffortGeometry>(query);
+        }
+        std::cout << label << " (best effort):" << timer.format() << std::endl;
+    }
+
+    std::cout << label << " found: " << n_found << std::endl;
+}
+
+
+BOOST_AUTO_TEST_CASE(CachedBoundingBoxes) {
+    size_t n_segments = 1e6;
+    size_t n_queries = 1e3;
+
+    std::default_random_engine gen;
+    std::uniform_real_distribution<CoordType> pos_dist(0.0, 1000.0);
+    std::uniform_real_distribution<CoordType> offset_dist(-2.0, 2.0);
+
+    std::vector<MorphoEntry> segments;
+    segments.reserve(n_segments);
+    for (size_t i = 0; i < n_segments; ++i) {
+        auto p1 = Point3Dx{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+        auto p2 = p1 + Point3Dx{offset_dist(gen), offset_dist(gen), offset_dist(gen)};
+        segments.push_back(Segment{i, 0u, 0u, p1, p2, 0.5f});
+    }
+
+    std::vector<Box3D> queries;
+    queries.reserve(n_queries);
+    for (size_t i = 0; i < n_queries; ++i) {
+        auto p = Point3Dx{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+        queries.emplace_back(p, p + 20.0f);
+    }
+
+    IndexTree<MorphoEntry> rtree(segments);
+    IndexTree<CachedMorphoEntry> cached_rtree(segments);
+
+    run_segment_queries("MorphoEntry", rtree, queries);
+    run_segment_queries("CachedMorphoEntry", cached_rtree, queries);
+
+    BOOST_CHECK_EQUAL(rtree.count_intersecting(queries[0]),
+                      cached_rtree.count_intersecting(queries[0]));
+}
+
+
+BOOST_AUTO_TEST_CASE(PackedSphereQueries) {
+    size_t n_spheres = 1e6;
+    size_t n_queries = 1e4;
+
+    std::default_random_engine gen;
+    std::uniform_real_distribution<CoordType> pos_dist(0.0, 1000.0);
+
+    std::vector<Soma> somas;
+    somas.reserve(n_spheres);
+    for (size_t i = 0; i < n_spheres; ++i) {
+        somas.emplace_back(i, Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)}, 1.0f);
+    }
+
+    std::vector<Sphere> queries;
+    queries.reserve(n_queries);
+    for (size_t i = 0; i < n_queries; ++i) {
+        queries.push_back(Sphere{Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)}, 20.0f});
+    }
+
+    IndexTree<Soma> rtree(somas);
+    PackedIndexTree<Soma> packed_rtree(somas);
+
+    size_t n_expected = 0;
+    {
+        cpu_timer timer;
+        for (const auto& query : queries) {
+            n_expected += rtree.count_intersecting<BestEffortGeometry>(query);
+        }
+        std::cout << "IndexTree:" << timer.format() << std::endl;
+    }
+
+    {
+        size_t n_found = 0;
+        cpu_timer timer;
+        for (const auto& query : queries) {
+            n_found += packed_rtree.count_intersecting<BestEffortGeometry>(query);
+        }
+        std::cout << "PackedIndexTree:" << timer.format() << std::endl;
+        BOOST_CHECK_EQUAL(n_found, n_expected);
+    }
+}
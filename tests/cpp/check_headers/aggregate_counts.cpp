@@ -0,0 +1 @@
+#include <brain_indexer/aggregate_counts.hpp>
@@ -0,0 +1 @@
+#include <brain_indexer/compressed_index.hpp>
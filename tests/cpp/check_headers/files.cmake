@@ -10,6 +10,19 @@ target_sources(si_check_headers
     PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/meta_data.cpp
     PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/mpi_wrapper.cpp
     PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/index.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/memory_mapped_index.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/packed_index.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/compressed_index.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/segregated_morph_index.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/spatial_join.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/query_cursor.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/aggregate_counts.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/rasterize.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/eviction_policy.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/robust_mutex.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/shared_subtree_cache.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/parallel_bulk_loading.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/thread_pool.cpp
     PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/distributed_sorting.cpp
     PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/distributed_analysis.cpp
 )
@@ -0,0 +1 @@
+#include <brain_indexer/memory_mapped_index.hpp>
@@ -0,0 +1 @@
+#include <brain_indexer/robust_mutex.hpp>
@@ -0,0 +1 @@
+#include <brain_indexer/segregated_morph_index.hpp>
@@ -0,0 +1 @@
+#include <brain_indexer/shared_subtree_cache.hpp>
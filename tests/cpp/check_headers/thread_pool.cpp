@@ -0,0 +1 @@
+#include <brain_indexer/thread_pool.hpp>
@@ -4,6 +4,7 @@
 #include <random>
 #include <vector>
 #include <brain_indexer/index.hpp>
+#include <brain_indexer/packed_index.hpp>
 #include <brain_indexer/util.hpp>
 
 using namespace brain_indexer;
@@ -204,6 +205,65 @@ BOOST_AUTO_TEST_CASE(SelectedCases) {
 BOOST_AUTO_TEST_SUITE_END()
 
 
+//////////////////////////////////////////////////////////////////
+// Distance between a point and a shape
+//////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_SUITE(PointDistance)
+BOOST_AUTO_TEST_CASE(SelectedCases) {
+    auto tol = CoordType(1e3) * std::numeric_limits<CoordType>::epsilon();
+
+    auto sphere = Sphere{{1.0, 2.0, 3.0}, 2.0};
+    BOOST_CHECK_SMALL(geometry_distance(Point3D{1.0, 2.0, 3.5}, sphere), tol);
+    BOOST_CHECK_CLOSE(geometry_distance(Point3D{1.0, 7.0, 3.0}, sphere), 3.0, 1e-4);
+
+    auto box = Box3D{Point3D{0.0, 0.0, 0.0}, Point3D{1.0, 2.0, 3.0}};
+    BOOST_CHECK_SMALL(geometry_distance(Point3D{0.5, 0.5, 0.5}, box), tol);
+    BOOST_CHECK_CLOSE(geometry_distance(Point3D{4.0, 6.0, 1.0}, box), 5.0, 1e-4);
+
+    BOOST_CHECK_CLOSE(geometry_distance(Point3D{3.0, 4.0, 0.0}, Point3D{0.0, 0.0, 0.0}),
+                      5.0, 1e-4);
+
+    auto cylinder = Cylinder{{-1.0, 0.0, 0.0}, {1.0, 0.0, 0.0}, 2.0};
+
+    // Inside, next to the mantle and over the center of the cap.
+    BOOST_CHECK_SMALL(geometry_distance(Point3D{0.5, 1.0, 1.0}, cylinder), tol);
+    BOOST_CHECK_CLOSE(geometry_distance(Point3D{0.5, 0.0, 5.0}, cylinder), 3.0, 1e-4);
+    BOOST_CHECK_CLOSE(geometry_distance(Point3D{4.0, 1.0, 0.0}, cylinder), 3.0, 1e-4);
+
+    // Beyond the rim of the cap, the nearest point is on the rim.
+    BOOST_CHECK_CLOSE(geometry_distance(Point3D{4.0, 6.0, 0.0}, cylinder), 5.0, 1e-4);
+
+    // The same, for an oblique cylinder.
+    auto oblique = Cylinder{{0.0, 0.0, 0.0}, {10.0, 10.0, 10.0}, 1.0};
+    BOOST_CHECK_CLOSE(geometry_distance(Point3D{0.0, 10.0, 5.0}, oblique),
+                      std::sqrt(50.0) - 1.0, 1e-4);
+}
+
+BOOST_AUTO_TEST_CASE(NotLessThanBoundingBoxDistance) {
+    auto gen = std::default_random_engine{};
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-10.0, 10.0);
+    auto radius_dist = std::uniform_real_distribution<CoordType>(0.0, 3.0);
+
+    auto random_point = [&]() {
+        return Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+    };
+
+    for (size_t i = 0; i < 1000; ++i) {
+        auto x = random_point();
+        auto cylinder = Cylinder{random_point(), random_point(), radius_dist(gen)};
+        auto sphere = Sphere{random_point(), radius_dist(gen)};
+
+        auto cylinder_distance = geometry_distance(x, cylinder);
+        BOOST_CHECK(cylinder_distance + 1e-4 >= geometry_distance(x, cylinder.bounding_box()));
+        BOOST_CHECK_EQUAL(cylinder.contains(x), cylinder_distance == 0.0);
+
+        BOOST_CHECK(geometry_distance(x, sphere) + 1e-4
+                    >= geometry_distance(x, sphere.bounding_box()));
+    }
+}
+BOOST_AUTO_TEST_SUITE_END()
+
+
 //////////////////////////////////////////////////////////////////
 // Intersection between spheres
 //////////////////////////////////////////////////////////////////
@@ -615,6 +675,67 @@ BOOST_AUTO_TEST_CASE(SelectedCases) {
 BOOST_AUTO_TEST_SUITE_END()
 
 
+//////////////////////////////////////////////////////////////////
+// Intersection with Polylines
+//////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_SUITE(PolylineIntersection)
+BOOST_AUTO_TEST_CASE(SelectedCases) {
+    // An L-shaped path, first along x then along y.
+    auto polyline = Polyline{{{0.0, 0.0, 0.0}, {10.0, 0.0, 0.0}, {10.0, 10.0, 0.0}}, 1.0};
+
+    auto bbox = polyline.bounding_box();
+    BOOST_CHECK(Point3Dx(bbox.min_corner()) == Point3Dx(-1.0, -1.0, -1.0));
+    BOOST_CHECK(Point3Dx(bbox.max_corner()) == Point3Dx(11.0, 11.0, 1.0));
+
+    // Near either segment, or far from both, but inside the bounding box.
+    BOOST_CHECK(polyline.intersects(Point3D{5.0, 0.5, 0.0}));
+    BOOST_CHECK(polyline.intersects(Point3D{10.5, 5.0, 0.5}));
+    BOOST_CHECK(!polyline.intersects(Point3D{5.0, 5.0, 0.0}));
+    BOOST_CHECK(!polyline.intersects(Point3D{-0.9, -0.9, 0.0}));
+
+    BOOST_CHECK(polyline.intersects(Sphere{{5.0, 5.0, 0.0}, 4.5}));
+    BOOST_CHECK(!polyline.intersects(Sphere{{5.0, 5.0, 0.0}, 3.5}));
+
+    BOOST_CHECK(polyline.intersects(Box3D{{4.0, 1.5, -1.0}, {6.0, 2.0, 1.0}}) == false);
+    BOOST_CHECK(polyline.intersects(Box3D{{4.0, 0.5, -1.0}, {6.0, 2.0, 1.0}}));
+    BOOST_CHECK(polyline.intersects(Box3D{{2.0, 2.0, -1.0}, {8.0, 8.0, 1.0}}) == false);
+    BOOST_CHECK(polyline.intersects(Box3D{{2.0, 2.0, -1.0}, {9.5, 8.0, 1.0}}));
+
+    BOOST_CHECK(polyline.intersects(Cylinder{{5.0, 5.0, 0.0}, {5.0, 5.0, 5.0}, 4.5}));
+    BOOST_CHECK(!polyline.intersects(Cylinder{{5.0, 5.0, 0.0}, {5.0, 5.0, 5.0}, 3.5}));
+}
+
+BOOST_AUTO_TEST_CASE(AgreesWithCapsules) {
+    // A polyline is the union of capsules, and a single point is a sphere.
+    auto gen = std::default_random_engine{};
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-5.0, 5.0);
+    auto random_point = [&]() {
+        return Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+    };
+
+    auto sphere = Polyline{{Point3D{1.0, 2.0, 3.0}}, 1.5};
+    auto as_sphere = Sphere{{1.0, 2.0, 3.0}, 1.5};
+
+    for (size_t k = 0; k < 200; ++k) {
+        auto polyline = Polyline{{random_point(), random_point(), random_point()}, 1.0};
+        auto capsule0 = Cylinder{polyline.points[0], polyline.points[1], 1.0};
+        auto capsule1 = Cylinder{polyline.points[1], polyline.points[2], 1.0};
+
+        auto a = random_point();
+        auto b = random_point();
+        auto box = make_query_box(a, b);
+        auto cylinder = Cylinder{a, b, 0.5};
+
+        BOOST_CHECK(polyline.intersects(box) == (capsule0.intersects(box) || capsule1.intersects(box)));
+        BOOST_CHECK(polyline.intersects(cylinder)
+                    == (capsule0.intersects(cylinder) || capsule1.intersects(cylinder)));
+
+        BOOST_CHECK(sphere.intersects(a) == as_sphere.contains(a));
+        BOOST_CHECK(sphere.intersects(box) == as_sphere.intersects(box));
+    }
+}
+BOOST_AUTO_TEST_SUITE_END()
+
 //////////////////////////////////////////////////////////////////
 // Bounding Boxes
 //////////////////////////////////////////////////////////////////
@@ -746,3 +867,107 @@ BOOST_AUTO_TEST_CASE(CylinderSelectedCases) {
     }
 }
 BOOST_AUTO_TEST_SUITE_END()
+
+
+BOOST_AUTO_TEST_SUITE(PackedKernelsTests)
+
+static std::vector<detail::PackedKernelsISA> supported_isas() {
+    std::vector<detail::PackedKernelsISA> isas;
+    for (auto isa : {detail::PackedKernelsISA::scalar,
+                     detail::PackedKernelsISA::vector,
+                     detail::PackedKernelsISA::avx2,
+                     detail::PackedKernelsISA::avx512}) {
+        if (detail::is_supported(isa)) {
+            isas.push_back(isa);
+        }
+    }
+    return isas;
+}
+
+BOOST_AUTO_TEST_CASE(FiltersAreConservative) {
+    auto gen = std::default_random_engine{};
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-10.0, 10.0);
+    auto size_dist = std::uniform_real_distribution<CoordType>(0.0, 3.0);
+
+    auto random_point = [&]() {
+        return Point3Dx{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+    };
+
+    auto n_blocks = size_t(200);
+    auto n = detail::packed_block_size;
+
+    for (size_t k = 0; k < n_blocks; ++k) {
+        // The last block is only partially filled.
+        auto n_elements = k + 1 == n_blocks ? n / 2 : n;
+
+        std::vector<Box3D> boxes;
+        std::vector<Cylinder> cylinders;
+        PackedBoxes packed_boxes(n_elements);
+        PackedCapsules packed_capsules;
+        packed_capsules.resize(n_elements);
+
+        for (size_t i = 0; i < n_elements; ++i) {
+            auto p = random_point();
+            auto q = p + Point3Dx{size_dist(gen), size_dist(gen), size_dist(gen)};
+            boxes.emplace_back(p, q);
+            packed_boxes.set(i, boxes.back());
+
+            // Every fourth capsule is a sphere.
+            cylinders.emplace_back(p, i % 4 == 0 ? p : q, size_dist(gen) / 4);
+            packed_capsules.set(i, cylinders.back().p1, cylinders.back().p2, cylinders.back().radius);
+        }
+
+        auto query_center = random_point();
+        auto query_box = Box3D(query_center, query_center + Point3Dx{3.0, 2.0, 4.0});
+        auto query_sphere = Sphere{query_center, 2 * size_dist(gen)};
+        auto query_cylinder = Cylinder{query_center, random_point(), size_dist(gen)};
+
+        auto expected_box = detail::packed_kernels(detail::PackedKernelsISA::scalar).box(packed_boxes.block(0), query_box);
+
+        for (auto isa : supported_isas()) {
+            const auto& kernels = detail::packed_kernels(isa);
+
+            auto box_mask = kernels.box(packed_boxes.block(0), query_box);
+            auto sphere_mask = kernels.box_sphere(packed_boxes.block(0),
+                                                  query_sphere.centroid,
+                                                  query_sphere.radius);
+            auto capsule_mask = kernels.box_capsule(packed_boxes.block(0),
+                                                    query_cylinder.p1,
+                                                    query_cylinder.p2,
+                                                    query_cylinder.radius);
+            auto capsule_sphere_mask = kernels.capsule_sphere(packed_capsules.block(0),
+                                                              query_sphere.centroid,
+                                                              query_sphere.radius);
+
+            BOOST_CHECK_EQUAL(box_mask, expected_box);
+
+            for (size_t i = 0; i < n; ++i) {
+                auto bit = detail::packed_mask_t(1) << i;
+
+                if (i >= n_elements) {
+                    BOOST_CHECK(((box_mask | sphere_mask | capsule_mask | capsule_sphere_mask) & bit) == 0);
+                    continue;
+                }
+
+                BOOST_CHECK_EQUAL((box_mask & bit) != 0, bg::intersects(boxes[i], query_box));
+
+                if (query_sphere.intersects(boxes[i])) {
+                    BOOST_CHECK(sphere_mask & bit);
+                }
+
+                if (query_cylinder.intersects(boxes[i])) {
+                    BOOST_CHECK(capsule_mask & bit);
+                }
+
+                const auto& c = cylinders[i];
+                auto expected = i % 4 == 0 ? query_sphere.intersects(Sphere{c.p1, c.radius})
+                                           : query_sphere.intersects(c);
+                if (expected) {
+                    BOOST_CHECK(capsule_sphere_mask & bit);
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,11 +3,21 @@
 #include <boost/test/unit_test.hpp>
 namespace bt = boost::unit_test;
 
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <filesystem>
 #include <memory>
 #include <random>
+#include <thread>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include <brain_indexer/multi_index.hpp>
 #include <brain_indexer/distributed_sorting.hpp>
+#include <brain_indexer/shared_subtree_cache.hpp>
 
 using namespace brain_indexer;
 
@@ -22,6 +32,7 @@ struct SubtreeState {
 struct MockRTree {
     MockRTree() = default;
     MockRTree(const MockRTree &) = default;
+    MockRTree(MockRTree &&) = default;
 
     MockRTree(std::shared_ptr<SubtreeState> subtree_state, size_t subtree_id)
         : subtree_id(subtree_id),
@@ -64,6 +75,10 @@ class MockStorage {
         return MockRTree(subtree_state, subtree_id);
     }
 
+    static size_t allocated_bytes(const MockRTree& subtree) {
+        return subtree.size();
+    }
+
   private:
     std::shared_ptr<SubtreeState> subtree_state;
 };
@@ -112,9 +127,657 @@ BOOST_AUTO_TEST_CASE(MultiIndexLoad) {
 }
 
 
+/// \brief Counts the loads, and is slow enough for loads to overlap.
+class CountingStorage {
+  public:
+    using toptree_type = std::vector<size_t>;
+    using subtree_type = std::vector<size_t>;
+
+  public:
+    explicit CountingStorage(size_t n_subtrees)
+        : n_loaded(std::make_shared<std::vector<std::atomic<size_t>>>(n_subtrees)) {}
+
+    std::vector<size_t> load_subtree(size_t subtree_id) const {
+        ++(*n_loaded)[subtree_id];
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        return std::vector<size_t>(subtree_size, subtree_id);
+    }
+
+    static size_t allocated_bytes(const std::vector<size_t>& subtree) {
+        return subtree.size();
+    }
+
+    static constexpr size_t subtree_size = 10;
+    std::shared_ptr<std::vector<std::atomic<size_t>>> n_loaded;
+};
+
+
+template <class F>
+void run_on_threads(size_t n_threads, const F& f) {
+    auto threads = std::vector<std::thread>{};
+    for(size_t k = 0; k < n_threads; ++k) {
+        threads.emplace_back(f, k);
+    }
+
+    for(auto& thread : threads) {
+        thread.join();
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(MultiIndexConcurrentLoadsAreSingleFlight) {
+    size_t n_subtrees = 40;
+    auto storage = CountingStorage(n_subtrees);
+    auto params = UsageRateCacheParams(n_subtrees * CountingStorage::subtree_size);
+    auto cache = UsageRateCache(params, storage);
+
+    auto n_failures = std::atomic<size_t>{0};
+    run_on_threads(8, [&](size_t k) {
+        for(size_t i = 0; i < n_subtrees; ++i) {
+            size_t id = (i + 5 * k) % n_subtrees;
+            auto subtree = cache.load_subtree(SubtreeID{id, CountingStorage::subtree_size}, i);
+            if(subtree->size() != CountingStorage::subtree_size || subtree->front() != id) {
+                ++n_failures;
+            }
+        }
+    });
+
+    BOOST_CHECK(n_failures == 0);
+    for(size_t id = 0; id < n_subtrees; ++id) {
+        BOOST_CHECK((*storage.n_loaded)[id] == 1);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(MultiIndexPinnedSubtreesSurviveEviction) {
+    size_t n_subtrees = 40;
+    auto storage = CountingStorage(n_subtrees);
+
+    // Room for two subtrees, hence most loads evict a subtree.
+    auto params = UsageRateCacheParams(2 * CountingStorage::subtree_size);
+    auto cache = UsageRateCache(params, storage);
+
+    auto n_failures = std::atomic<size_t>{0};
+    run_on_threads(8, [&](size_t k) {
+        auto gen = std::default_random_engine(k);
+        auto dist = std::uniform_int_distribution<size_t>(0, n_subtrees - 1);
+
+        for(size_t i = 0; i < 50; ++i) {
+            size_t id = dist(gen);
+            auto subtree = cache.load_subtree(SubtreeID{id, CountingStorage::subtree_size}, i);
+
+            // Give other threads time to evict it.
+            std::this_thread::yield();
+            for(auto x : *subtree) {
+                if(x != id) {
+                    ++n_failures;
+                }
+            }
+        }
+    });
+
+    BOOST_CHECK(n_failures == 0);
+}
+
+
+BOOST_AUTO_TEST_CASE(MultiIndexPrefetchStats) {
+    size_t n_subtrees = 10;
+    size_t subtree_size = CountingStorage::subtree_size;
+    auto storage = CountingStorage(n_subtrees);
+
+    // Room for three subtrees.
+    auto params = UsageRateCacheParams(3 * subtree_size);
+    auto cache = UsageRateCache(params, storage);
+
+    BOOST_CHECK(cache.prefetch_subtree(SubtreeID{0, subtree_size}, 0));
+    BOOST_CHECK(cache.prefetch_subtree(SubtreeID{1, subtree_size}, 0));
+    BOOST_CHECK(!cache.prefetch_subtree(SubtreeID{1, subtree_size}, 0));
+    BOOST_CHECK(cache.is_cached(SubtreeID{1, subtree_size}));
+
+    // Used by a query, hence a hit; and not loaded again.
+    cache.load_subtree(SubtreeID{0, subtree_size}, 1);
+    cache.load_subtree(SubtreeID{0, subtree_size}, 2);
+    BOOST_CHECK((*storage.n_loaded)[0] == 1);
+
+    // Prefetching never evicts.
+    cache.load_subtree(SubtreeID{2, subtree_size}, 3);
+    BOOST_CHECK(!cache.prefetch_subtree(SubtreeID{3, subtree_size}, 3));
+    BOOST_CHECK((*storage.n_loaded)[3] == 0);
+
+    // The unused prefetched subtree is evicted first.
+    cache.load_subtree(SubtreeID{4, subtree_size}, 4);
+    BOOST_CHECK(!cache.is_cached(SubtreeID{1, subtree_size}));
+
+    auto stats = cache.prefetch_stats();
+    BOOST_CHECK(stats.n_prefetched == 2);
+    BOOST_CHECK(stats.n_hits == 1);
+    BOOST_CHECK(stats.n_wasted == 1);
+}
+
+
+// The meta data of a subtree of `bytes` bytes, which took `load_seconds` to load.
+UsageRateMetaData make_meta_data(size_t bytes, double load_seconds, bool prefetched = false) {
+    auto md = UsageRateMetaData{};
+    md.on_load(0);
+    if(prefetched) {
+        md.on_prefetch();
+    }
+    md.on_read(bytes, load_seconds);
+    return md;
+}
+
+
+BOOST_AUTO_TEST_CASE(EvictionPolicyUsageRate) {
+    auto policy = UsageRatePolicy();
+    BOOST_CHECK(!policy.select_victim(0));
+
+    auto md = std::vector<UsageRateMetaData>(3, make_meta_data(10, 1.0));
+    for(size_t id = 0; id < md.size(); ++id) {
+        policy.on_insert(id, md[id], 0);
+    }
+
+    md[1].on_query();
+    md[1].on_query();
+    md[2].on_query();
+    BOOST_CHECK(*policy.select_victim(5) == 0);
+
+    policy.on_remove(0, 5);
+    BOOST_CHECK(*policy.select_victim(5) == 2);
+
+    // The policy reads the meta data of the cache, rather than a copy.
+    for(size_t i = 0; i < 5; ++i) {
+        md[2].on_query();
+    }
+    BOOST_CHECK(*policy.select_victim(5) == 1);
+}
+
+
+BOOST_AUTO_TEST_CASE(EvictionPolicyLRU) {
+    auto policy = LRUPolicy();
+    BOOST_CHECK(!policy.select_victim(0));
+
+    policy.on_insert(1, make_meta_data(10, 1.0), 0);
+    policy.on_insert(2, make_meta_data(10, 1.0), 0);
+    policy.on_insert(3, make_meta_data(10, 1.0), 0);
+    policy.on_access(1, 1);
+    BOOST_CHECK(*policy.select_victim(1) == 2);
+
+    policy.on_remove(2, 1);
+    BOOST_CHECK(*policy.select_victim(1) == 3);
+
+    // Unused prefetches are evicted first.
+    policy.on_insert(4, make_meta_data(10, 1.0, true), 2);
+    BOOST_CHECK(*policy.select_victim(2) == 4);
+
+    // Unknown subtrees are ignored.
+    policy.on_access(42, 2);
+    policy.on_remove(42, 2);
+    BOOST_CHECK(*policy.select_victim(2) == 4);
+}
+
+
+BOOST_AUTO_TEST_CASE(EvictionPolicyClock) {
+    auto policy = ClockPolicy();
+    BOOST_CHECK(!policy.select_victim(0));
+
+    policy.on_insert(1, make_meta_data(10, 1.0), 0);
+    policy.on_insert(2, make_meta_data(10, 1.0), 0);
+    policy.on_insert(3, make_meta_data(10, 1.0), 0);
+
+    // All referenced, hence the first round only clears the bits.
+    BOOST_CHECK(*policy.select_victim(0) == 1);
+    policy.on_remove(1, 0);
+
+    // Reuses the slot of `1`, but gets a second chance.
+    policy.on_insert(4, make_meta_data(10, 1.0), 1);
+    policy.on_access(2, 1);
+    BOOST_CHECK(*policy.select_victim(1) == 3);
+}
+
+
+BOOST_AUTO_TEST_CASE(EvictionPolicyARC) {
+    auto policy = ARCPolicy();
+    BOOST_CHECK(!policy.select_victim(0));
+
+    // A subtree used repeatedly survives a scan of subtrees used once.
+    policy.on_insert(1, make_meta_data(10, 1.0), 0);
+    policy.on_access(1, 1);
+
+    for(size_t id = 10; id < 20; ++id) {
+        policy.on_insert(id, make_meta_data(10, 1.0), id);
+        if(id > 10) {
+            auto victim = policy.select_victim(id);
+            BOOST_CHECK(*victim == id - 1);
+            policy.on_remove(*victim, id);
+        }
+    }
+
+    // A ghost hit of `T1` moves the subtree to `T2`.
+    policy.on_remove(19, 20);
+    policy.on_insert(19, make_meta_data(10, 1.0), 20);
+    BOOST_CHECK(*policy.select_victim(20) == 1);
+}
+
+
+BOOST_AUTO_TEST_CASE(EvictionPolicyCostAware) {
+    auto policy = CostAwarePolicy();
+    BOOST_CHECK(!policy.select_victim(0));
+
+    policy.on_insert(1, make_meta_data(100, 1.0), 0);
+    policy.on_insert(2, make_meta_data(100, 0.1), 0);
+    BOOST_CHECK(*policy.select_victim(0) == 2);
+
+    // Frequently used subtrees are kept, even if they're cheap to load.
+    for(size_t i = 0; i < 19; ++i) {
+        policy.on_access(2, i);
+    }
+    BOOST_CHECK(*policy.select_victim(19) == 1);
+
+    // Selecting a victim that isn't removed doesn't age the other subtrees.
+    for(size_t i = 0; i < 100; ++i) {
+        BOOST_CHECK(*policy.select_victim(19) == 1);
+    }
+    policy.on_insert(3, make_meta_data(100, 0.5), 19);
+    BOOST_CHECK(*policy.select_victim(19) == 3);
+
+    // Subtrees inserted after an eviction start at the priority of the victim.
+    policy.on_remove(3, 20);
+    policy.on_remove(1, 20);
+    policy.on_insert(4, make_meta_data(100, 1.5), 20);
+    BOOST_CHECK(*policy.select_victim(20) == 2);
+}
+
+
+BOOST_AUTO_TEST_CASE(MultiIndexAllocatedBytes) {
+    using storage_type = NativeStorageT<MorphoEntry>;
+    using subtree_type = MultiIndexSubTreeT<MorphoEntry>;
+
+    BOOST_CHECK(storage_type::allocated_bytes(subtree_type()) == sizeof(subtree_type));
+
+    auto spheres = std::vector<MorphoEntry>{};
+    for(size_t i = 0; i < 1000; ++i) {
+        spheres.push_back(Soma(identifier_t(i), Point3D{CoordType(i), 0.0, 0.0}, 0.5));
+    }
+
+    auto subtree = subtree_type(spheres.begin(), spheres.end());
+    auto n_bytes = storage_type::allocated_bytes(subtree);
+    BOOST_CHECK(n_bytes > spheres.size() * sizeof(MorphoEntry));
+    BOOST_CHECK(n_bytes < 4 * spheres.size() * sizeof(MorphoEntry));
+}
+
+
+BOOST_AUTO_TEST_CASE(MultiIndexCacheStaysWithinBudget) {
+    auto policies = std::vector<EvictionPolicyKind>{
+        EvictionPolicyKind::usage_rate,
+        EvictionPolicyKind::lru,
+        EvictionPolicyKind::clock,
+        EvictionPolicyKind::arc,
+        EvictionPolicyKind::cost_aware
+    };
+
+    size_t n_subtrees = 20;
+    size_t subtree_size = CountingStorage::subtree_size;
+
+    for(auto kind : policies) {
+        auto storage = CountingStorage(n_subtrees);
+        auto params = UsageRateCacheParams(5 * subtree_size, kind);
+        auto cache = UsageRateCache(params, storage);
+
+        auto gen = std::default_random_engine(0);
+        auto dist = std::uniform_int_distribution<size_t>(0, n_subtrees - 1);
+        for(size_t i = 0; i < 100; ++i) {
+            size_t id = dist(gen);
+            auto subtree = cache.load_subtree(SubtreeID{id, subtree_size}, i);
+
+            BOOST_CHECK(subtree->front() == id);
+            BOOST_CHECK(cache.cached_bytes() <= 5 * subtree_size);
+            BOOST_CHECK(cache.is_cached(SubtreeID{id, subtree_size}));
+        }
+    }
+}
+
+
+/// \brief Saves a multi index of `n_subtrees` unit cubes along the x-axis.
+std::vector<MorphoEntry> save_row_of_subtrees(const std::string& output_dir, size_t n_subtrees) {
+    std::filesystem::create_directories(output_dir);
+    auto storage = NativeStorageT<MorphoEntry>(output_dir);
+
+    auto all_segments = std::vector<MorphoEntry>{};
+    auto subtree_boxes = std::vector<IndexedSubtreeBox>{};
+    for(size_t k = 0; k < n_subtrees; ++k) {
+        auto segments = std::vector<MorphoEntry>{};
+        for(size_t i = 0; i < 10; ++i) {
+            auto x = CoordType(k) + CoordType(0.05 + 0.1 * i);
+            auto gid = identifier_t(10 * k + i);
+            segments.push_back(Segment(gid, 0u, 0u, Point3D{x, 0.2, 0.5}, Point3D{x, 0.8, 0.5}, 0.01));
+        }
+
+        auto subtree = MultiIndexSubTreeT<MorphoEntry>(segments.begin(), segments.end());
+        storage.save_subtree(subtree, k);
+        subtree_boxes.emplace_back(k, subtree.size(), subtree.bounds());
+        all_segments.insert(all_segments.end(), segments.begin(), segments.end());
+    }
+
+    storage.save_top_tree(MultiIndexTopTreeT(subtree_boxes.begin(), subtree_boxes.end()));
+    return all_segments;
+}
+
+
+BOOST_AUTO_TEST_CASE(MultiIndexPrefetchSweep) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    auto output_dir = std::string("tmp-pfmi");
+    size_t n_subtrees = 8;
+    auto expected_index = IndexTree<MorphoEntry>(save_row_of_subtrees(output_dir, n_subtrees));
+
+    auto storage = NativeStorageT<MorphoEntry>(output_dir);
+    auto index = MultiIndexTree<MorphoEntry>(storage, UsageRateCacheParams(size_t(1e6)));
+    index.set_io_threads(4);
+    index.set_prefetch_mode(PrefetchMode::trajectory);
+
+    // A sweep along the x-axis, each query is within one subtree.
+    for(size_t k = 0; k < 4 * n_subtrees; ++k) {
+        auto x = CoordType(0.25) * CoordType(k) + CoordType(0.01);
+        auto box = Box3D{{x, 0.0, 0.0}, {x + CoordType(0.2), 1.0, 1.0}};
+
+        auto gids = index.find_intersecting_np<BestEffortGeometry>(box).gid;
+        auto expected = expected_index.find_intersecting_np<BestEffortGeometry>(box).gid;
+        std::sort(gids.begin(), gids.end());
+        std::sort(expected.begin(), expected.end());
+        BOOST_CHECK(gids == expected);
+
+        // Otherwise, the next query might load the subtree itself.
+        index.wait_for_prefetches();
+    }
+
+    auto stats = index.prefetch_stats();
+    BOOST_CHECK(stats.n_prefetched > 0);
+    BOOST_CHECK(stats.n_hits > 0);
+    BOOST_CHECK(stats.n_hits <= stats.n_prefetched);
+    BOOST_CHECK(stats.n_wasted == 0);
+
+    std::filesystem::remove_all(output_dir);
+}
+
+
+BOOST_AUTO_TEST_CASE(MultiIndexPrefetchHint) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    auto output_dir = std::string("tmp-phmi");
+    size_t n_subtrees = 6;
+    auto segments = save_row_of_subtrees(output_dir, n_subtrees);
+
+    auto storage = NativeStorageT<MorphoEntry>(output_dir);
+    auto index = MultiIndexTree<MorphoEntry>(storage, UsageRateCacheParams(size_t(1e6)));
+    index.set_io_threads(4);
+    index.prefetch(Box3D{{1.5, 0.0, 0.0}, {3.5, 1.0, 1.0}});
+    index.wait_for_prefetches();
+
+    auto box = Box3D{{0.0, 0.0, 0.0}, {6.0, 1.0, 1.0}};
+    BOOST_CHECK(index.find_intersecting_np<BestEffortGeometry>(box).gid.size() == segments.size());
+
+    // Without I/O threads, nothing is prefetched.
+    index.set_io_threads(0);
+    index.prefetch(box);
+
+    auto stats = index.prefetch_stats();
+    BOOST_CHECK(stats.n_prefetched == 3);
+    BOOST_CHECK(stats.n_hits == 3);
+
+    std::filesystem::remove_all(output_dir);
+}
+
+
+/// \brief Counts the subtrees deserialized by this process.
+class LoadCountingStorage : public NativeStorageT<MorphoEntry> {
+  public:
+    using NativeStorage::NativeStorage;
+
+    template <class RTree>
+    void load_subtree_into(size_t subtree_id, RTree& subtree) const {
+        ++(*n_loaded);
+        NativeStorageT<MorphoEntry>::load_subtree_into(subtree_id, subtree);
+    }
+
+    std::shared_ptr<std::atomic<size_t>> n_loaded = std::make_shared<std::atomic<size_t>>(0);
+};
+
+using LoadCountingSharedCache = SharedSubtreeCache<LoadCountingStorage>;
+
+
+BOOST_AUTO_TEST_CASE(SharedMultiIndexLoadsOncePerNode) {
+    auto comm = MPI_COMM_WORLD;
+    auto output_dir = std::string("tmp-shmi");
+    auto name = std::string("brain_indexer_test_shmi");
+    size_t n_subtrees = 8;
+
+    if(mpi::rank(comm) == 0) {
+        save_row_of_subtrees(output_dir, n_subtrees);
+        LoadCountingSharedCache::remove(name);
+    }
+    MPI_Barrier(comm);
+
+    size_t n_loaded = 0;
+    {
+        auto storage = LoadCountingStorage(output_dir);
+        auto cache = LoadCountingSharedCache(SharedSubtreeCacheParams(1ul << 24, name), storage);
+        auto index = MultiIndexTree<MorphoEntry, LoadCountingSharedCache>(storage, std::move(cache));
+
+        auto box = Box3D{{0.0, 0.0, 0.0}, {CoordType(n_subtrees), 1.0, 1.0}};
+        for(size_t k = 0; k < 3; ++k) {
+            auto gids = index.find_intersecting_np<BestEffortGeometry>(box).gid;
+            BOOST_CHECK(gids.size() == 10 * n_subtrees);
+        }
+
+        n_loaded = *storage.n_loaded;
+        MPI_Barrier(comm);
+    }
+
+    // Every subtree was deserialized by exactly one of the processes.
+    size_t n_loaded_total = 0;
+    MPI_Allreduce(&n_loaded, &n_loaded_total, 1, MPI_UNSIGNED_LONG, MPI_SUM, comm);
+    BOOST_CHECK(n_loaded_total == n_subtrees);
+
+    MPI_Barrier(comm);
+    if(mpi::rank(comm) == 0) {
+        LoadCountingSharedCache::remove(name);
+        std::filesystem::remove_all(output_dir);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(SharedMultiIndexPinnedSubtreesSurviveEviction) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    auto output_dir = std::string("tmp-shpi");
+    auto name = std::string("brain_indexer_test_shpi");
+    size_t n_subtrees = 8;
+    save_row_of_subtrees(output_dir, n_subtrees);
+    LoadCountingSharedCache::remove(name);
+
+    // Room for a few subtrees, hence loading all of them evicts some.
+    size_t segment_size = 1ul << 12;
+    auto storage = LoadCountingStorage(output_dir);
+    auto cache = LoadCountingSharedCache(SharedSubtreeCacheParams(segment_size, name), storage);
+
+    auto is_intact = [](const auto& subtree, size_t id) {
+        return subtree->size() == 10 && std::all_of(
+            subtree->begin(), subtree->end(), [id](const MorphoEntry& entry) {
+                return boost::get<Segment>(entry).gid() / 10 == id;
+            });
+    };
+
+    auto pinned = cache.load_subtree(SubtreeID{0, 10}, 0);
+    for(size_t k = 0; k < 2; ++k) {
+        for(size_t id = 1; id < n_subtrees; ++id) {
+            BOOST_CHECK(is_intact(cache.load_subtree(SubtreeID{id, 10}, 0), id));
+            BOOST_CHECK(cache.cached_bytes() <= segment_size);
+        }
+    }
+
+    BOOST_CHECK(*storage.n_loaded > n_subtrees);
+    BOOST_CHECK(cache.is_cached(SubtreeID{0, 10}));
+    BOOST_CHECK(is_intact(pinned, 0));
+
+    // With everything pinned, the subtrees that don't fit are private.
+    auto handles = std::vector<LoadCountingSharedCache::subtree_handle>{};
+    for(size_t id = 0; id < n_subtrees; ++id) {
+        handles.push_back(cache.load_subtree(SubtreeID{id, 10}, 0));
+    }
+
+    for(size_t id = 0; id < n_subtrees; ++id) {
+        BOOST_CHECK(is_intact(handles[id], id));
+    }
+
+    handles.clear();
+    pinned = nullptr;
+    LoadCountingSharedCache::remove(name);
+    std::filesystem::remove_all(output_dir);
+}
+
+
+/// \brief Runs `f` in a child process, which is then killed.
+template <class F>
+void run_and_kill_child(F f) {
+    auto pid = fork();
+    if(pid == 0) {
+        f();
+        raise(SIGKILL);
+    }
+
+    // Until it's reaped, the child counts as alive.
+    int status = 0;
+    BOOST_REQUIRE(waitpid(pid, &status, 0) == pid);
+    BOOST_CHECK(WIFSIGNALED(status));
+}
+
+
+#if SI_HAS_ROBUST_MUTEX == 1
+BOOST_AUTO_TEST_CASE(RobustMutexOwnerDied) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    auto memory = mmap(nullptr, sizeof(RobustMutex), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    BOOST_REQUIRE(memory != MAP_FAILED);
+    auto mutex = new (memory) RobustMutex();
+
+    run_and_kill_child([mutex]() { mutex->lock(); });
+
+    mutex->lock();
+    BOOST_CHECK(mutex->owner_died());
+    BOOST_CHECK(!mutex->owner_died());
+    mutex->unlock();
+
+    mutex->lock();
+    BOOST_CHECK(!mutex->owner_died());
+    mutex->unlock();
+
+    mutex->~RobustMutex();
+    munmap(memory, sizeof(RobustMutex));
+}
+#endif
+
+
+/// \brief Kills the calling process while loading, if `die` is set.
+class DyingStorage : public LoadCountingStorage {
+  public:
+    using LoadCountingStorage::LoadCountingStorage;
+
+    template <class RTree>
+    void load_subtree_into(size_t subtree_id, RTree& subtree) const {
+        if(*die) {
+            raise(SIGKILL);
+        }
+        LoadCountingStorage::load_subtree_into(subtree_id, subtree);
+    }
+
+    std::shared_ptr<bool> die = std::make_shared<bool>(false);
+};
+
+
+BOOST_AUTO_TEST_CASE(SharedMultiIndexReclaimsDeadProcesses) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    using SharedCache = SharedSubtreeCache<DyingStorage>;
+
+    auto output_dir = std::string("tmp-shdp");
+    auto name = std::string("brain_indexer_test_shdp");
+    size_t n_subtrees = 8;
+    save_row_of_subtrees(output_dir, n_subtrees);
+    SharedCache::remove(name);
+
+    // Room for a few subtrees only.
+    size_t segment_size = 1ul << 12;
+    auto storage = DyingStorage(output_dir);
+    auto cache = SharedCache(SharedSubtreeCacheParams(segment_size, name), storage);
+
+    // A process killed while it pins every subtree in the cache.
+    run_and_kill_child([&cache, n_subtrees]() {
+        auto handles = std::vector<SharedCache::subtree_handle>{};
+        for(size_t id = 1; id < n_subtrees; ++id) {
+            handles.push_back(cache.load_subtree(SubtreeID{id, 10}, 0));
+        }
+    });
+
+    // Unless its pins are reclaimed, nothing can be evicted.
+    for(size_t id = 1; id < n_subtrees; ++id) {
+        auto subtree = cache.load_subtree(SubtreeID{id, 10}, 0);
+        BOOST_CHECK(subtree->size() == 10);
+        BOOST_CHECK(cache.is_cached(SubtreeID{id, 10}));
+    }
+
+    // A process killed while loading a subtree.
+    run_and_kill_child([&cache, &storage]() {
+        *storage.die = true;
+        cache.load_subtree(SubtreeID{0, 10}, 0);
+    });
+
+    // Otherwise, this waits forever.
+    auto subtree = cache.load_subtree(SubtreeID{0, 10}, 0);
+    BOOST_CHECK(subtree->size() == 10);
+    BOOST_CHECK(cache.find_subtree(SubtreeID{0, 10}, 0) != nullptr);
+
+    subtree = nullptr;
+    SharedCache::remove(name);
+    std::filesystem::remove_all(output_dir);
+}
+
+
+/// \brief The threaded queries, called as by the Python bindings.
+template <class Index>
+void run_threaded_queries(const Index& index) {
+    static_assert(supports_concurrent_queries<Index>::value);
+
+    auto& pool = ThreadPool::global();
+    auto spheres = std::vector<Sphere>{};
+    auto points = std::vector<Point3D>{};
+    auto inf = std::numeric_limits<CoordType>::infinity();
+
+    BOOST_CHECK(index.template find_intersecting_batch_np<BestEffortGeometry>(
+        spheres, pool, 2).offsets.size() == 1);
+    BOOST_CHECK(index.find_nearest_exact_batch(points, 3u, inf, pool, 2).ids.empty());
+}
+
 BOOST_AUTO_TEST_CASE(MultiIndexCompiles) {
     auto synapse_index = MultiIndexTree<Synapse>{};
     auto morpho_index = MultiIndexTree<MorphoEntry>{};
+    auto point_synapse_index = MultiIndexTree<PointSynapse>{};
+    auto shared_index = SharedMultiIndexTree<MorphoEntry>{};
+
+    run_threaded_queries(synapse_index);
+    run_threaded_queries(morpho_index);
+    run_threaded_queries(point_synapse_index);
+    run_threaded_queries(shared_index);
 }
 
 BOOST_AUTO_TEST_CASE(TwoLevelParamsCutoff) {
@@ -6,10 +6,21 @@ namespace bt = boost::unit_test;
 #include <random>
 #include <vector>
 
+#include <brain_indexer/compressed_index.hpp>
 #include <brain_indexer/index.hpp>
 #include <brain_indexer/multi_index.hpp>
+#include <brain_indexer/packed_index.hpp>
+#include <brain_indexer/parallel_bulk_loading.hpp>
+#include <brain_indexer/query_cursor.hpp>
+#include <brain_indexer/rasterize.hpp>
+#include <brain_indexer/segregated_morph_index.hpp>
+#include <brain_indexer/spatial_join.hpp>
 #include <brain_indexer/util.hpp>
 
+#include <boost/geometry/index/detail/rtree/utilities/are_boxes_ok.hpp>
+#include <boost/geometry/index/detail/rtree/utilities/are_counts_ok.hpp>
+#include <boost/geometry/index/detail/rtree/utilities/are_levels_ok.hpp>
+
 using namespace brain_indexer;
 
 using EveryEntry = boost::variant<IndexedSubtreeBox, Soma, Segment>;
@@ -355,6 +366,196 @@ BOOST_AUTO_TEST_CASE(MorphIndexQueries) {
 }
 
 
+BOOST_AUTO_TEST_CASE(PackedIndexQueries) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    auto gen = std::default_random_engine{};
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    // Cover trees with a single, partially filled and several full levels.
+    for(auto n_elements : {identifier_t(1), identifier_t(6), identifier_t(100), identifier_t(1000)}) {
+        auto elements = random_elements<EveryEntry>(n_elements, domain, 0, gen);
+        auto index = PackedIndexTree<EveryEntry>(elements);
+
+        BOOST_CHECK(index.size() == elements.size());
+        BOOST_CHECK(bg::equals(index.bounds(), IndexTree<EveryEntry>(elements).bounds()));
+
+        check_with_all_query_shapes(elements, index, domain, gen);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(CompressedIndexQueries) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    auto gen = std::default_random_engine{};
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    for(auto n_elements : {identifier_t(1), identifier_t(6), identifier_t(1000)}) {
+        auto somas = random_elements<Soma>(n_elements, domain, 0, gen);
+        auto segments = random_elements<Segment>(n_elements, domain, n_elements, gen);
+
+        auto elements = std::vector<MorphoEntry>(somas.begin(), somas.end());
+        elements.insert(elements.end(), segments.begin(), segments.end());
+
+        auto index = CompressedIndexTree<MorphoEntry>(elements);
+        BOOST_CHECK(index.size() == elements.size());
+
+        // The ids are exact, the coordinates are quantized.
+        auto decoded = index.values();
+        std::sort(decoded.begin(), decoded.end(), [](const auto& a, const auto& b) {
+            return get_id(a) < get_id(b);
+        });
+
+        BOOST_REQUIRE(decoded.size() == elements.size());
+        for(size_t i = 0; i < elements.size(); ++i) {
+            BOOST_CHECK(get_id(decoded[i]) == get_id(elements[i]));
+            BOOST_CHECK(decoded[i].which() == elements[i].which());
+
+            // Boxes of short cylinders depend on the direction, compare the points.
+            using codec = detail::CompressedCodec<MorphoEntry>;
+            auto expected = codec::points(elements[i]);
+            auto actual = codec::points(decoded[i]);
+            BOOST_CHECK(bg::distance(expected[0], actual[0]) < 1e-3);
+            BOOST_CHECK(bg::distance(expected[1], actual[1]) < 1e-3);
+            BOOST_CHECK(codec::radius(decoded[i]) == codec::radius(elements[i]));
+        }
+
+        check_with_all_query_shapes(decoded, index, domain, gen);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(SegregatedMorphIndexQueries) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    auto gen = std::default_random_engine{};
+    auto n_elements = identifier_t(1000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto somas = random_elements<Soma>(n_elements / 10, domain, 0, gen);
+    auto segments = random_elements<Segment>(n_elements, domain, n_elements / 10, gen);
+
+    auto elements = std::vector<MorphoEntry>(somas.begin(), somas.end());
+    elements.insert(elements.end(), segments.begin(), segments.end());
+
+    auto expected_index = IndexTree<MorphoEntry>(elements);
+    auto index = SegregatedMorphIndexTree(elements);
+
+    BOOST_CHECK(index.size() == elements.size());
+    BOOST_CHECK(index.somas().size() == somas.size());
+    BOOST_CHECK(bg::equals(index.bounds(), expected_index.bounds()));
+
+    check_with_all_query_shapes(elements, index, domain, gen);
+
+    auto sorted_gids = [](std::vector<identifier_t> gids) {
+        std::sort(gids.begin(), gids.end());
+        return gids;
+    };
+
+    auto pos_dist = std::uniform_real_distribution<CoordType>(domain[0], domain[1]);
+    for(size_t i = 0; i < 20; ++i) {
+        auto query_point = Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+        auto sphere = Sphere{query_point, 2.0};
+
+        auto actual = index.find_intersecting_np<BestEffortGeometry>(sphere);
+        auto expected = expected_index.find_intersecting_np<BestEffortGeometry>(sphere);
+        BOOST_CHECK(sorted_gids(actual.gid) == sorted_gids(expected.gid));
+        BOOST_CHECK(std::count(actual.is_soma.begin(), actual.is_soma.end(), true)
+                    == std::count(expected.is_soma.begin(), expected.is_soma.end(), true));
+
+        for(unsigned k : {1u, 10u, 100u}) {
+            auto gids = [&sorted_gids](const std::vector<gid_segm_t>& ids) {
+                std::vector<identifier_t> gids;
+                for(const auto& id : ids) {
+                    gids.push_back(id.gid);
+                }
+                return sorted_gids(gids);
+            };
+
+            auto actual_nearest = gids(index.find_nearest(query_point, k));
+            auto expected_nearest = gids(expected_index.find_nearest(query_point, k));
+
+            BOOST_CHECK(actual_nearest.size() == k);
+            BOOST_CHECK(actual_nearest == expected_nearest);
+        }
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(PackedIndexNearest) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    auto gen = std::default_random_engine{};
+    auto n_elements = identifier_t(1000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto segments = random_elements<Segment>(n_elements, domain, 0, gen);
+    auto expected_index = IndexTree<MorphoEntry>(segments.begin(), segments.end());
+    auto index = PackedIndexTree<MorphoEntry>(segments.begin(), segments.end());
+
+    auto pos_dist = std::uniform_real_distribution<CoordType>(domain[0], domain[1]);
+    for(size_t i = 0; i < 20; ++i) {
+        auto query_point = Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+
+        for(unsigned k : {1u, 10u, 100u}) {
+            auto gids = [](const std::vector<gid_segm_t>& ids) {
+                std::vector<identifier_t> gids;
+                for(const auto& id : ids) {
+                    gids.push_back(id.gid);
+                }
+                std::sort(gids.begin(), gids.end());
+                return gids;
+            };
+
+            auto actual = gids(index.find_nearest(query_point, k));
+            auto expected = gids(expected_index.find_nearest(query_point, k));
+
+            BOOST_CHECK(actual.size() == k);
+            BOOST_CHECK(actual == expected);
+        }
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(ParallelBulkLoadingQueries) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    auto gen = std::default_random_engine{};
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+    auto pool = ThreadPool(3);
+
+    // The small tree is packed serially, the large one in parallel.
+    for(auto n_elements : {identifier_t(100), identifier_t(20000)}) {
+        auto elements = random_elements<EveryEntry>(n_elements, domain, 0, gen);
+
+        for(size_t n_threads : {2ul, 4ul}) {
+            auto values = elements;
+            auto index = parallel_bulk_load(values, pool, n_threads);
+            const auto& rtree = static_cast<const IndexTreeBaseT<EveryEntry>&>(index);
+
+            BOOST_CHECK(index.size() == elements.size());
+            BOOST_CHECK(bg::equals(index.bounds(), IndexTree<EveryEntry>(elements).bounds()));
+            BOOST_CHECK(bgi::detail::rtree::utilities::are_levels_ok(rtree));
+            BOOST_CHECK(bgi::detail::rtree::utilities::are_counts_ok(rtree));
+            BOOST_CHECK(bgi::detail::rtree::utilities::are_boxes_ok(rtree));
+
+            check_with_all_query_shapes(elements, index, domain, gen);
+        }
+    }
+}
+
+
 BOOST_AUTO_TEST_CASE(MultiIndexQueries) {
     auto output_dir = "tmp-ndwiu";
 
@@ -383,6 +584,321 @@ BOOST_AUTO_TEST_CASE(MultiIndexQueries) {
     if(mpi_rank == 0) {
         auto index = MultiIndexTree<EveryEntry>(output_dir, /* mem = */ size_t(1e6));
         check_with_all_query_shapes(all_elements, index, domain, gen);
+
+        // Large shapes contain entire subtrees, which are counted without loading them.
+        auto large_boxes = std::vector<Box3D>{
+            Box3D{{-11.0, -11.0, -11.0}, {11.0, 11.0, 11.0}},
+            Box3D{{-11.0, -11.0, -11.0}, {0.0, 11.0, 11.0}},
+        };
+        for(const auto& box : large_boxes) {
+            check_queries_against_geometric_primitives<BoundingBoxGeometry>(all_elements, index, box);
+            check_queries_against_geometric_primitives<BestEffortGeometry>(all_elements, index, box);
+        }
+
+        auto large_sphere = Sphere{{2.0, -1.0, 0.0}, 12.0};
+        check_queries_against_geometric_primitives<BoundingBoxGeometry>(all_elements, index, large_sphere);
+        check_queries_against_geometric_primitives<BestEffortGeometry>(all_elements, index, large_sphere);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MultiIndexNearestExact) {
+    auto output_dir = "tmp-kdmwe";
+
+    int n_required_ranks = 2;
+    auto comm = mpi::comm_shrink(MPI_COMM_WORLD, n_required_ranks);
+
+    if(*comm == MPI_COMM_NULL) {
+        return;
+    }
+
+    auto n_elements = identifier_t(1000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto mpi_rank = mpi::rank(*comm);
+
+    // Distinct seeds, such that there are no ties between the two ranks.
+    auto gen = std::default_random_engine{
+      util::integer_cast<std::default_random_engine::result_type>(mpi_rank + 1)
+    };
+    auto elements = random_elements<Segment>(n_elements, domain, mpi_rank * n_elements, gen);
+    auto all_elements = gather_elements(elements, *comm);
+
+    auto builder = MultiIndexBulkBuilder<Segment>(output_dir);
+    builder.insert(elements.begin(), elements.end());
+    builder.finalize(*comm);
+
+    if(mpi_rank == 0) {
+        auto index = MultiIndexTree<Segment>(output_dir, /* mem = */ size_t(1e6));
+        auto expected_index = IndexTree<Segment>(all_elements);
+
+        auto points = std::vector<Point3D>{};
+        for(const auto& sphere : random_shapes<Sphere>(50, domain, {-2.0, 1.0}, gen)) {
+            points.push_back(sphere.centroid);
+        }
+
+        auto k = 7u;
+        auto expected = expected_index.find_nearest_exact_batch(points, k);
+        auto inf = std::numeric_limits<CoordType>::infinity();
+        for(const auto& actual : {index.find_nearest_exact_batch(points, k),
+                                  index.find_nearest_exact_batch(points, k, inf,
+                                                                 ThreadPool::global(), 4)}) {
+            BOOST_CHECK(actual.distances == expected.distances);
+            BOOST_REQUIRE(actual.ids.size() == expected.ids.size());
+            for(size_t i = 0; i < actual.ids.size(); ++i) {
+                BOOST_CHECK(actual.ids[i].gid == expected.ids[i].gid);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MultiIndexChunkedQuery) {
+    auto output_dir = "tmp-qcmi";
+
+    int n_required_ranks = 2;
+    auto comm = mpi::comm_shrink(MPI_COMM_WORLD, n_required_ranks);
+
+    if(*comm == MPI_COMM_NULL) {
+        return;
+    }
+
+    auto n_elements = identifier_t(1000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto mpi_rank = mpi::rank(*comm);
+    auto gen = std::default_random_engine{
+      util::integer_cast<std::default_random_engine::result_type>(mpi_rank + 1)
+    };
+    auto segments = random_elements<Segment>(n_elements, domain, mpi_rank * n_elements, gen);
+    auto elements = std::vector<MorphoEntry>(segments.begin(), segments.end());
+
+    auto builder = MultiIndexBulkBuilder<MorphoEntry>(output_dir);
+    builder.insert(elements.begin(), elements.end());
+    builder.finalize(*comm);
+
+    if(mpi_rank == 0) {
+        // Small enough that subtrees are evicted by the interleaved queries.
+        auto index = MultiIndexTree<MorphoEntry>(output_dir, /* mem = */ size_t(1e4));
+        auto box = Box3D{{-8.0, -8.0, -8.0}, {8.0, 8.0, 8.0}};
+        auto expected = index.find_intersecting_np<BestEffortGeometry>(box).gid;
+        std::sort(expected.begin(), expected.end());
+
+        {
+            auto cursor = make_query_cursor<BestEffortGeometry>(index, box);
+
+            auto actual = std::vector<identifier_t>{};
+            while(!cursor->done()) {
+                auto chunk = cursor->next_chunk(37);
+                BOOST_CHECK(chunk.gid.size() <= 37);
+                actual.insert(actual.end(), chunk.gid.begin(), chunk.gid.end());
+
+                // Other queries may evict any subtree of the cache.
+                index.count_intersecting(Box3D{{-2.0, -2.0, -2.0}, {2.0, 2.0, 2.0}});
+            }
+
+            BOOST_CHECK(cursor->next_chunk(37).gid.empty());
+
+            std::sort(actual.begin(), actual.end());
+            BOOST_CHECK(actual == expected);
+        }
+
+        // The distinct gids are collected across subtrees.
+        auto unique_gids = expected;
+        unique_gids.erase(std::unique(unique_gids.begin(), unique_gids.end()),
+                          unique_gids.end());
+        BOOST_CHECK(index.find_unique_gids<BestEffortGeometry>(box).gids == unique_gids);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MultiIndexConcurrentQueries) {
+    auto output_dir = "tmp-cqmi";
+
+    int n_required_ranks = 2;
+    auto comm = mpi::comm_shrink(MPI_COMM_WORLD, n_required_ranks);
+
+    if(*comm == MPI_COMM_NULL) {
+        return;
+    }
+
+    auto n_elements = identifier_t(1000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto mpi_rank = mpi::rank(*comm);
+    auto gen = std::default_random_engine{
+      util::integer_cast<std::default_random_engine::result_type>(mpi_rank + 1)
+    };
+    auto segments = random_elements<Segment>(n_elements, domain, mpi_rank * n_elements, gen);
+    auto elements = std::vector<MorphoEntry>(segments.begin(), segments.end());
+
+    auto builder = MultiIndexBulkBuilder<MorphoEntry>(output_dir);
+    builder.insert(elements.begin(), elements.end());
+    builder.finalize(*comm);
+
+    if(mpi_rank == 0) {
+        // Small enough that the threads evict each other's subtrees.
+        auto index = MultiIndexTree<MorphoEntry>(output_dir, /* mem = */ size_t(1e4));
+        auto boxes = random_shapes<Box3D>(200, domain, {-1.0, 1.0}, gen);
+
+        // Subtrees are visited in the order in which they're loaded, hence the
+        // order of the results of a query varies.
+        auto sorted_results = [](const auto& batch) {
+            auto results = std::vector<std::vector<std::tuple<identifier_t, unsigned, unsigned>>>{};
+            for(size_t i = 0; i + 1 < batch.offsets.size(); ++i) {
+                auto& query_results = results.emplace_back();
+                for(size_t k = batch.offsets[i]; k < batch.offsets[i + 1]; ++k) {
+                    query_results.emplace_back(batch.results.gid[k],
+                                               batch.results.section_id[k],
+                                               batch.results.segment_id[k]);
+                }
+                std::sort(query_results.begin(), query_results.end());
+            }
+            return results;
+        };
+
+        auto expected_batch = index.find_intersecting_batch_np<BestEffortGeometry>(boxes);
+        auto expected = sorted_results(expected_batch);
+
+        ThreadPool pool(3);
+        for(size_t n_io_threads : {0ul, 1ul, 3ul}) {
+            index.set_io_threads(n_io_threads);
+            for(size_t n_threads : {1ul, 4ul}) {
+                auto actual = index.find_intersecting_batch_np<BestEffortGeometry>(
+                    boxes, pool, n_threads
+                );
+
+                BOOST_CHECK(actual.offsets == expected_batch.offsets);
+                BOOST_CHECK(sorted_results(actual) == expected);
+            }
+        }
+
+        auto policies = {
+            EvictionPolicyKind::lru,
+            EvictionPolicyKind::clock,
+            EvictionPolicyKind::arc,
+            EvictionPolicyKind::cost_aware
+        };
+
+        for(auto policy : policies) {
+            auto other = MultiIndexTree<MorphoEntry>(output_dir, size_t(1e4), policy);
+            auto actual = other.find_intersecting_batch_np<BestEffortGeometry>(boxes, pool, 4);
+
+            BOOST_CHECK(actual.offsets == expected_batch.offsets);
+            BOOST_CHECK(sorted_results(actual) == expected);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MultiIndexRasterize) {
+    auto output_dir = "tmp-rzmi";
+
+    int n_required_ranks = 2;
+    auto comm = mpi::comm_shrink(MPI_COMM_WORLD, n_required_ranks);
+
+    if(*comm == MPI_COMM_NULL) {
+        return;
+    }
+
+    auto n_elements = identifier_t(1000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto mpi_rank = mpi::rank(*comm);
+    auto gen = std::default_random_engine{
+      util::integer_cast<std::default_random_engine::result_type>(mpi_rank + 1)
+    };
+    auto segments = random_elements<Segment>(n_elements, domain, mpi_rank * n_elements, gen);
+    auto all_segments = gather_elements(segments, *comm);
+    auto elements = std::vector<MorphoEntry>(segments.begin(), segments.end());
+
+    auto builder = MultiIndexBulkBuilder<MorphoEntry>(output_dir);
+    builder.insert(elements.begin(), elements.end());
+    builder.finalize(*comm);
+
+    if(mpi_rank == 0) {
+        // Small enough that the subtrees are streamed through the cache.
+        auto index = MultiIndexTree<MorphoEntry>(output_dir, /* mem = */ size_t(1e4));
+        index.set_io_threads(2);
+        auto expected_index = IndexTree<MorphoEntry>(all_segments);
+
+        auto grid = VoxelGrid{Point3D{-8.0, -6.0, -8.0}, CoordType(1.5), {10, 8, 11}};
+        ThreadPool pool(2);
+
+        for(auto quantity : {RasterQuantity::count, RasterQuantity::length}) {
+            auto expected = rasterize(expected_index, grid, quantity);
+            auto actual = rasterize(index, grid, quantity, pool, 2);
+
+            BOOST_REQUIRE_EQUAL(actual.size(), expected.size());
+            for(size_t i = 0; i < actual.size(); ++i) {
+                BOOST_CHECK_SMALL(actual[i] - expected[i], 1e-6);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MultiIndexJoinWithin) {
+    auto output_dir = "tmp-jwmi";
+
+    int n_required_ranks = 2;
+    auto comm = mpi::comm_shrink(MPI_COMM_WORLD, n_required_ranks);
+
+    if(*comm == MPI_COMM_NULL) {
+        return;
+    }
+
+    auto n_elements = identifier_t(1000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto mpi_rank = mpi::rank(*comm);
+
+    auto gen = std::default_random_engine{
+      util::integer_cast<std::default_random_engine::result_type>(mpi_rank + 1)
+    };
+    auto elements = random_elements<Segment>(n_elements, domain, mpi_rank * n_elements, gen);
+    auto all_elements = gather_elements(elements, *comm);
+
+    auto builder = MultiIndexBulkBuilder<Segment>(output_dir);
+    builder.insert(elements.begin(), elements.end());
+    builder.finalize(*comm);
+
+    if(mpi_rank == 0) {
+        // Small enough that subtrees are evicted while joining.
+        auto index = MultiIndexTree<Segment>(output_dir, /* mem = */ size_t(1e4));
+        auto expected_index = IndexTree<Segment>(all_elements);
+
+        auto sorted_pairs = [](const auto& result) {
+            auto pairs = std::vector<std::pair<identifier_t, identifier_t>>{};
+            for(size_t i = 0; i < result.lhs_ids.size(); ++i) {
+                auto a = result.lhs_ids[i].gid;
+                auto b = result.rhs_ids[i].gid;
+                pairs.emplace_back(a, b);
+            }
+            std::sort(pairs.begin(), pairs.end());
+            return pairs;
+        };
+
+        auto unordered_pairs = [&sorted_pairs](const auto& result) {
+            auto pairs = sorted_pairs(result);
+            for(auto& pair : pairs) {
+                if(pair.first > pair.second) {
+                    std::swap(pair.first, pair.second);
+                }
+            }
+            std::sort(pairs.begin(), pairs.end());
+            return pairs;
+        };
+
+        auto distance = CoordType(0.5);
+        auto pool = ThreadPool(2);
+
+        BOOST_CHECK(sorted_pairs(join_within(index, index, distance))
+                    == sorted_pairs(join_within(expected_index, expected_index, distance)));
+
+        BOOST_CHECK(sorted_pairs(join_within<BestEffortGeometry>(index, index, distance, pool, 2))
+                    == sorted_pairs(join_within<BestEffortGeometry>(expected_index,
+                                                                    expected_index,
+                                                                    distance)));
+
+        auto expected_self = unordered_pairs(join_within(expected_index, distance));
+        BOOST_CHECK(!expected_self.empty());
+        BOOST_CHECK(unordered_pairs(join_within(index, distance)) == expected_self);
     }
 }
 
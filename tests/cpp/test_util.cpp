@@ -2,9 +2,12 @@
 #include <boost/test/unit_test.hpp>
 namespace bt = boost::unit_test;
 
+#include <algorithm>
 #include <memory>
 #include <random>
+#include <vector>
 
+#include <brain_indexer/thread_pool.hpp>
 #include <brain_indexer/util.hpp>
 
 using namespace brain_indexer;
@@ -24,3 +27,29 @@ BOOST_AUTO_TEST_CASE(CheckThrowNoSuchFile) {
         }
     }, std::runtime_error);
 }
+
+
+BOOST_AUTO_TEST_CASE(ParallelForVisitsEveryTaskOnce) {
+    ThreadPool pool(4);
+    for (size_t n_threads : {1ul, 3ul, 8ul}) {
+        size_t n_tasks = 1000;
+        std::vector<int> visited(n_tasks, 0);
+
+        parallel_for(pool, n_tasks, n_threads, [&visited](size_t k) { visited[k] += 1; });
+
+        BOOST_CHECK(std::all_of(visited.begin(), visited.end(), [](int v) { return v == 1; }));
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(ParallelForRethrows) {
+    ThreadPool pool(4);
+    auto f = [](size_t k) {
+        if (k == 17) {
+            throw std::runtime_error("task failed");
+        }
+    };
+
+    BOOST_CHECK_THROW(parallel_for(pool, 100, 4, f), std::runtime_error);
+    BOOST_CHECK(pool.submit([]() { return 42; }).get() == 42);
+}
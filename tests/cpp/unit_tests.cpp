@@ -2,9 +2,18 @@
 #include <boost/test/unit_test.hpp>
 
 #include <filesystem>
+#include <limits>
+#include <map>
+#include <numeric>
 #include <random>
 #include <vector>
+#include <brain_indexer/aggregate_counts.hpp>
+#include <brain_indexer/compressed_index.hpp>
 #include <brain_indexer/index.hpp>
+#include <brain_indexer/memory_mapped_index.hpp>
+#include <brain_indexer/query_cursor.hpp>
+#include <brain_indexer/rasterize.hpp>
+#include <brain_indexer/spatial_join.hpp>
 #include <brain_indexer/util.hpp>
 
 // We need unit tests for each kind of tree
@@ -157,6 +166,835 @@ BOOST_AUTO_TEST_CASE(VariantNeuronPieces) {
 }
 
 
+BOOST_AUTO_TEST_CASE(CachedBoxNeuronPieces) {
+    auto somas = util::make_vec<Soma>(N_ITEMS, util::identity<>(), centers, radius);
+
+    IndexTree<CachedMorphoEntry> rtree(somas);
+    rtree.insert(Segment{10ul, 0u, 0u, centers[0], centers2[0], radius[0], SectionType::undefined});
+
+    TESTS_INTERSECTING_CHECKS(true, false, true, true);
+    TEST_INTERSECTING_IDS({2}, {}, {0}, {10});
+
+    IndexTree<MorphoEntry> expected_rtree(rtree.begin(), rtree.end());
+    for (const auto& c : {tcenter0, tcenter1, tcenter2, tcenter3}) {
+        auto box = Sphere{c, 2 * tradius}.bounding_box();
+        BOOST_CHECK_EQUAL(rtree.count_intersecting(box),
+                          expected_rtree.count_intersecting(box));
+        BOOST_CHECK_EQUAL(rtree.count_intersecting<BestEffortGeometry>(box),
+                          expected_rtree.count_intersecting<BestEffortGeometry>(box));
+    }
+
+    // Dump and load, the boxes are recomputed.
+    std::string index_path = "cached_box_index";
+    rtree.dump(index_path);
+    IndexTree<CachedMorphoEntry> rtree_loaded(index_path);
+    BOOST_CHECK(bg::equals(rtree.bounds(), rtree_loaded.bounds()));
+    BOOST_CHECK_EQUAL(rtree_loaded.find_intersecting_np(Sphere{tcenter3, tradius}).gid.size(), 1);
+    BOOST_CHECK_EQUAL(value_to_element_type<CachedMorphoEntry>(), "cached_morphology");
+
+    std::filesystem::remove_all(index_path);
+}
+
+
+BOOST_AUTO_TEST_CASE(BatchQueries) {
+    auto synapses = util::make_vec<Synapse>(N_ITEMS, util::identity<>(), post_gids, pre_gids, centers);
+    IndexTree<Synapse> rtree(synapses);
+
+    std::vector<Sphere> spheres;
+    for (const auto& c : {tcenter0, tcenter1, tcenter2, tcenter3}) {
+        spheres.push_back(Sphere{c, 2 * tradius});
+    }
+
+    auto batch = rtree.find_intersecting_batch_np<BestEffortGeometry>(spheres);
+    BOOST_REQUIRE_EQUAL(batch.offsets.size(), spheres.size() + 1);
+    BOOST_CHECK_EQUAL(batch.offsets.front(), 0);
+    BOOST_CHECK_EQUAL(batch.offsets.back(), batch.results.id.size());
+
+    for (size_t i = 0; i < spheres.size(); ++i) {
+        auto expected = rtree.find_intersecting_np<BestEffortGeometry>(spheres[i]);
+        auto first = batch.results.id.begin() + std::ptrdiff_t(batch.offsets[i]);
+        auto last = batch.results.id.begin() + std::ptrdiff_t(batch.offsets[i + 1]);
+
+        BOOST_CHECK(std::vector<identifier_t>(first, last) == expected.id);
+    }
+
+    auto empty_batch = rtree.find_intersecting_batch_np(std::vector<Box3D>{});
+    BOOST_CHECK(empty_batch.offsets == std::vector<size_t>{0});
+}
+
+
+BOOST_AUTO_TEST_CASE(ThreadedBatchQueries) {
+    auto somas = util::make_vec<Soma>(N_ITEMS, util::identity<>(), centers, radius);
+    IndexTree<MorphoEntry> rtree(somas);
+
+    std::vector<Sphere> spheres;
+    for (size_t i = 0; i < 50; ++i) {
+        spheres.push_back(Sphere{centers[i % N_ITEMS], CoordType(i % 7)});
+    }
+
+    ThreadPool pool(3);
+    auto expected = rtree.find_intersecting_batch_np<BestEffortGeometry>(spheres);
+    for (size_t n_threads : {1ul, 2ul, 4ul}) {
+        auto batch = rtree.find_intersecting_batch_np<BestEffortGeometry>(spheres, pool, n_threads);
+
+        BOOST_CHECK(batch.offsets == expected.offsets);
+        BOOST_CHECK(batch.results.gid == expected.results.gid);
+        BOOST_CHECK(batch.results.is_soma == expected.results.is_soma);
+    }
+
+    auto empty_batch = rtree.find_intersecting_batch_np(std::vector<Box3D>{}, pool, 4);
+    BOOST_CHECK(empty_batch.offsets == std::vector<size_t>{0});
+}
+
+
+BOOST_AUTO_TEST_CASE(FieldSelectiveQueries) {
+    auto somas = util::make_vec<Soma>(N_ITEMS, util::identity<>(), centers, radius);
+    IndexTree<MorphoEntry> rtree(somas);
+    rtree.insert(Segment{10ul, 0u, 0u, centers[0], centers2[0], radius[0], SectionType::undefined});
+
+    using result_t = detail::query_result<MorphoEntry>;
+    auto box = Box3D{Point3D{-10.0, -10.0, -10.0}, Point3D{30.0, 30.0, 30.0}};
+    auto expected = rtree.find_intersecting_np(box);
+    BOOST_REQUIRE(!expected.gid.empty());
+
+    auto mask = detail::make_field_mask<result_t>({"gid", "centroid"});
+    auto found = rtree.find_intersecting_np(box, mask);
+    BOOST_CHECK(found.gid == expected.gid);
+    BOOST_CHECK(found.centroid == expected.centroid);
+    BOOST_CHECK(found.section_id.empty());
+    BOOST_CHECK(found.ids.empty());
+    BOOST_CHECK(found.endpoint1.empty());
+    BOOST_CHECK(found.is_soma.empty());
+
+    BOOST_CHECK(rtree.find_intersecting_np(box, all_fields).radius == expected.radius);
+    BOOST_CHECK(rtree.find_intersecting_np(box, field_mask_t(0)).gid.empty());
+    BOOST_CHECK_THROW(detail::make_field_mask<result_t>({"position"}), std::invalid_argument);
+}
+
+
+BOOST_AUTO_TEST_CASE(UniqueGids) {
+    auto gen = std::default_random_engine{};
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-50.0, 50.0);
+
+    // Many segments per gid.
+    std::vector<Segment> segments;
+    for (identifier_t gid = 0; gid < 50; ++gid) {
+        for (unsigned section_id = 0; section_id < 20; ++section_id) {
+            auto p1 = Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+            auto p2 = Point3D{p1.get<0>() + 1, p1.get<1>(), p1.get<2>()};
+            segments.push_back(Segment{gid, section_id, 0u, p1, p2, CoordType(1.0),
+                                       SectionType::axon});
+        }
+    }
+    IndexTree<MorphoEntry> rtree(segments);
+
+    std::vector<Sphere> spheres;
+    for (CoordType r : {0.1, 10.0, 25.0, 100.0}) {
+        spheres.push_back(Sphere{Point3D{0.0, 0.0, 0.0}, r});
+    }
+
+    for (const auto& sphere : spheres) {
+        std::map<identifier_t, size_t> expected;
+        for (auto gid : rtree.find_intersecting_np<BestEffortGeometry>(sphere).gid) {
+            ++expected[gid];
+        }
+
+        auto found = rtree.find_unique_gids<BestEffortGeometry>(sphere);
+        BOOST_REQUIRE_EQUAL(found.gids.size(), expected.size());
+        BOOST_REQUIRE_EQUAL(found.counts.size(), expected.size());
+
+        size_t i = 0;
+        for (const auto& kv : expected) {
+            BOOST_CHECK_EQUAL(found.gids[i], kv.first);
+            BOOST_CHECK_EQUAL(found.counts[i], kv.second);
+            ++i;
+        }
+    }
+
+    auto batch = rtree.find_unique_gids_batch<BestEffortGeometry>(spheres);
+    BOOST_REQUIRE_EQUAL(batch.offsets.size(), spheres.size() + 1);
+    for (size_t k = 0; k < spheres.size(); ++k) {
+        auto expected = rtree.find_unique_gids<BestEffortGeometry>(spheres[k]);
+        auto first = batch.results.gids.begin() + std::ptrdiff_t(batch.offsets[k]);
+        auto last = batch.results.gids.begin() + std::ptrdiff_t(batch.offsets[k + 1]);
+        BOOST_CHECK(std::vector<identifier_t>(first, last) == expected.gids);
+    }
+
+    ThreadPool pool(3);
+    auto threaded = rtree.find_unique_gids_batch<BestEffortGeometry>(spheres, pool, 3);
+    BOOST_CHECK(threaded.offsets == batch.offsets);
+    BOOST_CHECK(threaded.results.gids == batch.results.gids);
+    BOOST_CHECK(threaded.results.counts == batch.results.counts);
+
+    // The gid of a synapse is the post-synaptic gid.
+    auto synapses = util::make_vec<Synapse>(N_ITEMS, util::identity<>(), post_gids, pre_gids, centers);
+    IndexTree<Synapse> synapse_rtree(synapses);
+    auto box = Box3D{Point3D{-10.0, -10.0, -10.0}, Point3D{30.0, 10.0, 10.0}};
+    auto found = synapse_rtree.find_unique_gids(box);
+    BOOST_CHECK(found.gids == (std::vector<identifier_t>{1, 2}));
+    BOOST_CHECK(found.counts == (std::vector<size_t>{1, 2}));
+}
+
+
+BOOST_AUTO_TEST_CASE(GroupedCounts) {
+    auto gen = std::default_random_engine{};
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-50.0, 50.0);
+    // Compact post gids are counted densely, sparse pre gids are sorted.
+    auto post_dist = std::uniform_int_distribution<identifier_t>(100, 140);
+    auto pre_dist = std::uniform_int_distribution<identifier_t>(0, identifier_t(1) << 40);
+    auto pre_gids = std::vector<identifier_t>(30);
+    std::generate(pre_gids.begin(), pre_gids.end(), [&]() { return pre_dist(gen); });
+
+    std::vector<Synapse> synapses;
+    for (identifier_t i = 0; i < 3000; ++i) {
+        auto point = Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+        synapses.push_back(Synapse{i, post_dist(gen), pre_gids[i % pre_gids.size()], point});
+    }
+    IndexTree<Synapse> rtree(synapses);
+
+    std::vector<Box3D> boxes;
+    for (CoordType w : {0.5, 5.0, 20.0, 60.0}) {
+        boxes.push_back(Box3D{Point3D{-w, -w, -w}, Point3D{w, w, w}});
+    }
+
+    for (auto group_by : {GroupBy::post_gid, GroupBy::pre_gid, GroupBy::pre_post_gid}) {
+        auto batch = rtree.count_intersecting_grouped(boxes, group_by);
+        BOOST_REQUIRE_EQUAL(batch.offsets.size(), boxes.size() + 1);
+        BOOST_CHECK_EQUAL(batch.results.pre_gids.empty(), group_by == GroupBy::post_gid);
+        BOOST_CHECK_EQUAL(batch.results.post_gids.empty(), group_by == GroupBy::pre_gid);
+
+        for (size_t k = 0; k < boxes.size(); ++k) {
+            std::map<std::pair<identifier_t, identifier_t>, size_t> expected;
+            for (const Synapse& synapse : rtree.find_intersecting_objs(boxes[k])) {
+                identifier_t pre = group_by == GroupBy::post_gid ? 0 : synapse.pre_gid();
+                identifier_t post = group_by == GroupBy::pre_gid ? 0 : synapse.post_gid();
+                ++expected[{pre, post}];
+            }
+
+            BOOST_REQUIRE_EQUAL(batch.offsets[k + 1] - batch.offsets[k], expected.size());
+            auto i = batch.offsets[k];
+            for (const auto& kv : expected) {
+                if (group_by != GroupBy::post_gid) {
+                    BOOST_CHECK_EQUAL(batch.results.pre_gids[i], kv.first.first);
+                }
+                if (group_by != GroupBy::pre_gid) {
+                    BOOST_CHECK_EQUAL(batch.results.post_gids[i], kv.first.second);
+                }
+                BOOST_CHECK_EQUAL(batch.results.counts[i], kv.second);
+                ++i;
+            }
+        }
+
+        ThreadPool pool(3);
+        auto threaded = rtree.count_intersecting_grouped(boxes, group_by, pool, 3);
+        BOOST_CHECK(threaded.offsets == batch.offsets);
+        BOOST_CHECK(threaded.results.pre_gids == batch.results.pre_gids);
+        BOOST_CHECK(threaded.results.post_gids == batch.results.post_gids);
+        BOOST_CHECK(threaded.results.counts == batch.results.counts);
+    }
+
+    // Gids spanning the whole range, e.g. a sentinel, are sorted.
+    auto max_gid = std::numeric_limits<identifier_t>::max();
+    auto origin = Point3D{0.0, 0.0, 0.0};
+    IndexTree<Synapse> extreme_rtree(std::vector<Synapse>{
+        Synapse{0, 100, 0, origin}, Synapse{1, 100, max_gid, origin}, Synapse{2, 100, 0, origin}
+    });
+    auto extreme = extreme_rtree.count_intersecting_grouped(boxes, GroupBy::pre_gid);
+    BOOST_REQUIRE_EQUAL(extreme.offsets[1], 2);
+    BOOST_CHECK_EQUAL(extreme.results.pre_gids[0], 0);
+    BOOST_CHECK_EQUAL(extreme.results.pre_gids[1], max_gid);
+    BOOST_CHECK_EQUAL(extreme.results.counts[0], 2);
+    BOOST_CHECK_EQUAL(extreme.results.counts[1], 1);
+}
+
+
+BOOST_AUTO_TEST_CASE(NearestExact) {
+    // The bounding box of the long, oblique segment is closer to the query
+    // point than the soma, but the segment itself is further away.
+    auto query_point = Point3D{10.0, 0.0, 0.0};
+    std::vector<MorphoEntry> entries{
+        Segment{1, 0, 0, Point3D{0.0, 0.0, 0.0}, Point3D{10.0, 10.0, 0.0}, 0.5},
+        Soma{2, Point3D{13.0, 0.0, 0.0}, 1.0}
+    };
+    IndexTree<MorphoEntry> small_rtree(entries);
+
+    BOOST_CHECK_EQUAL(small_rtree.find_nearest(query_point, 1)[0].gid, 1);
+
+    auto nearest = small_rtree.find_nearest_exact(query_point, 1);
+    BOOST_REQUIRE_EQUAL(nearest.ids.size(), 1);
+    BOOST_CHECK_EQUAL(nearest.ids[0].gid, 2);
+    BOOST_CHECK_CLOSE(nearest.distances[0], 2.0, 1e-4);
+
+    BOOST_CHECK(small_rtree.find_nearest_exact(query_point, 2, 1.0).ids.empty());
+    BOOST_CHECK_EQUAL(small_rtree.find_nearest_exact(query_point, 5).ids.size(), 2);
+
+    // Compare against brute force.
+    auto gen = std::default_random_engine{};
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-100.0, 100.0);
+    auto offset_dist = std::uniform_real_distribution<CoordType>(-20.0, 20.0);
+    auto radius_dist = std::uniform_real_distribution<CoordType>(0.1, 2.0);
+    auto random_point = [&]() {
+        return Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+    };
+
+    std::vector<MorphoEntry> morphology;
+    for (identifier_t i = 0; i < 2000; ++i) {
+        auto p = random_point();
+        auto q = Point3Dx(p) + Point3Dx{offset_dist(gen), offset_dist(gen), offset_dist(gen)};
+        if (i % 10 == 0) {
+            morphology.push_back(Soma{i, p, 2 * radius_dist(gen)});
+        } else {
+            morphology.push_back(Segment{i, 0, 0, p, q, radius_dist(gen)});
+        }
+    }
+    IndexTree<MorphoEntry> rtree(morphology);
+
+    unsigned k = 8;
+    std::vector<Point3D> points;
+    for (size_t i = 0; i < 50; ++i) {
+        points.push_back(random_point());
+    }
+
+    for (const auto& point : points) {
+        std::vector<CoordType> expected;
+        for (const auto& entry : morphology) {
+            expected.push_back(geometry_distance(point, entry));
+        }
+        std::sort(expected.begin(), expected.end());
+
+        auto found = rtree.find_nearest_exact(point, k);
+        BOOST_REQUIRE_EQUAL(found.distances.size(), k);
+        for (size_t j = 0; j < k; ++j) {
+            BOOST_CHECK_CLOSE(found.distances[j], expected[j], 1e-4);
+        }
+
+        auto max_distance = expected[k / 2];
+        auto within = rtree.find_nearest_exact(point, k, max_distance);
+        BOOST_CHECK(within.distances.size() > k / 2);
+        for (auto d : within.distances) {
+            BOOST_CHECK(d <= max_distance);
+        }
+    }
+
+    // Batches, with and without threads, have the same rows.
+    ThreadPool pool(3);
+    auto max_distance = CoordType(10.0);
+    auto batch = rtree.find_nearest_exact_batch(points, k, max_distance);
+    auto threaded_batch = rtree.find_nearest_exact_batch(points, k, max_distance, pool, 4);
+    BOOST_REQUIRE_EQUAL(batch.ids.size(), points.size() * k);
+    BOOST_CHECK(batch.distances == threaded_batch.distances);
+
+    for (size_t i = 0; i < points.size(); ++i) {
+        auto expected = rtree.find_nearest_exact(points[i], k, max_distance);
+        for (size_t j = 0; j < k; ++j) {
+            if (j < expected.ids.size()) {
+                BOOST_CHECK_EQUAL(batch.ids[i * k + j].gid, expected.ids[j].gid);
+                BOOST_CHECK_EQUAL(batch.distances[i * k + j], expected.distances[j]);
+            } else {
+                BOOST_CHECK(std::isinf(batch.distances[i * k + j]));
+            }
+        }
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(JoinWithin) {
+    auto gen = std::default_random_engine{};
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-50.0, 50.0);
+    auto offset_dist = std::uniform_real_distribution<CoordType>(-5.0, 5.0);
+    auto radius_dist = std::uniform_real_distribution<CoordType>(0.1, 1.0);
+    auto random_point = [&]() {
+        return Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+    };
+
+    std::vector<Soma> somas;
+    std::vector<Segment> segments;
+    for (identifier_t i = 0; i < 300; ++i) {
+        somas.push_back(Soma{i, random_point(), 2 * radius_dist(gen)});
+    }
+    for (identifier_t i = 0; i < 1500; ++i) {
+        auto p = random_point();
+        auto q = Point3Dx(p) + Point3Dx{offset_dist(gen), offset_dist(gen), offset_dist(gen)};
+        segments.push_back(Segment{i, 0, 0, p, q, radius_dist(gen)});
+    }
+
+    IndexTree<Soma> soma_rtree(somas);
+    IndexTree<Segment> segment_rtree(segments);
+    auto distance = CoordType(2.0);
+
+    using pairs_t = std::vector<std::pair<identifier_t, identifier_t>>;
+    auto sorted_pairs = [](const auto& result) {
+        pairs_t pairs;
+        for (size_t i = 0; i < result.lhs_ids.size(); ++i) {
+            pairs.emplace_back(result.lhs_ids[i].gid, result.rhs_ids[i].gid);
+        }
+        std::sort(pairs.begin(), pairs.end());
+        return pairs;
+    };
+
+    auto is_near = [distance](const auto& a, const auto& b) {
+        return bg::comparable_distance(a.bounding_box(), b.bounding_box())
+               <= distance * distance;
+    };
+
+    pairs_t expected_bbox;
+    pairs_t expected_best_effort;
+    for (const auto& soma : somas) {
+        auto grown = Sphere{soma.centroid, soma.radius + distance};
+        for (const auto& segment : segments) {
+            if (is_near(soma, segment)) {
+                expected_bbox.emplace_back(soma.gid(), segment.gid());
+                if (grown.intersects(segment)) {
+                    expected_best_effort.emplace_back(soma.gid(), segment.gid());
+                }
+            }
+        }
+    }
+    std::sort(expected_bbox.begin(), expected_bbox.end());
+    std::sort(expected_best_effort.begin(), expected_best_effort.end());
+    BOOST_REQUIRE(expected_best_effort.size() < expected_bbox.size());
+
+    auto bbox = join_within(soma_rtree, segment_rtree, distance);
+    BOOST_CHECK(sorted_pairs(bbox) == expected_bbox);
+
+    auto best_effort = join_within<BestEffortGeometry>(soma_rtree, segment_rtree, distance);
+    BOOST_CHECK(sorted_pairs(best_effort) == expected_best_effort);
+
+    // The threaded join finds the same pairs in the same order.
+    ThreadPool pool(3);
+    auto threaded = join_within(soma_rtree, segment_rtree, distance, pool, 4);
+    BOOST_CHECK(sorted_pairs(threaded) == expected_bbox);
+    BOOST_CHECK_EQUAL(threaded.lhs_ids.size(), bbox.lhs_ids.size());
+    for (size_t i = 0; i < bbox.lhs_ids.size(); ++i) {
+        BOOST_CHECK_EQUAL(threaded.lhs_ids[i].gid, bbox.lhs_ids[i].gid);
+        BOOST_CHECK_EQUAL(threaded.rhs_ids[i].gid, bbox.rhs_ids[i].gid);
+    }
+
+    // The self-join reports every unordered pair of distinct elements once.
+    pairs_t expected_self;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        for (size_t j = i + 1; j < segments.size(); ++j) {
+            if (is_near(segments[i], segments[j])) {
+                expected_self.emplace_back(segments[i].gid(), segments[j].gid());
+            }
+        }
+    }
+
+    auto normalized_pairs = [&sorted_pairs](const auto& result) {
+        auto pairs = sorted_pairs(result);
+        for (auto& pair : pairs) {
+            if (pair.first > pair.second) {
+                std::swap(pair.first, pair.second);
+            }
+        }
+        std::sort(pairs.begin(), pairs.end());
+        return pairs;
+    };
+
+    BOOST_CHECK(normalized_pairs(join_within(segment_rtree, distance)) == expected_self);
+    BOOST_CHECK(normalized_pairs(join_within(segment_rtree, distance, pool, 4))
+                == expected_self);
+
+    BOOST_CHECK(join_within(IndexTree<Soma>{}, segment_rtree, distance).lhs_ids.empty());
+}
+
+
+BOOST_AUTO_TEST_CASE(PolylineQueries) {
+    auto gen = std::default_random_engine{};
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-50.0, 50.0);
+    auto offset_dist = std::uniform_real_distribution<CoordType>(-5.0, 5.0);
+    auto radius_dist = std::uniform_real_distribution<CoordType>(0.1, 1.0);
+    auto random_point = [&]() {
+        return Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+    };
+
+    std::vector<MorphoEntry> entries;
+    for (identifier_t i = 0; i < 2000; ++i) {
+        auto p = random_point();
+        auto q = Point3Dx(p) + Point3Dx{offset_dist(gen), offset_dist(gen), offset_dist(gen)};
+        if (i % 10 == 0) {
+            entries.push_back(Soma{i, p, 2 * radius_dist(gen)});
+        } else {
+            entries.push_back(Segment{i, 0, 0, p, q, radius_dist(gen)});
+        }
+    }
+    IndexTree<MorphoEntry> rtree(entries);
+
+    auto polyline = Polyline{{}, 3.0};
+    for (size_t k = 0; k < 8; ++k) {
+        polyline.points.push_back(random_point());
+    }
+
+    auto sorted_gids = [](std::vector<identifier_t> gids) {
+        std::sort(gids.begin(), gids.end());
+        return gids;
+    };
+
+    auto brute_force = [&](auto geo) {
+        std::vector<identifier_t> gids;
+        for (const auto& e : entries) {
+            if (geometry_intersects(polyline, e, geo)) {
+                gids.push_back(detail::get_id_from(e));
+            }
+        }
+        return gids;
+    };
+
+    // The union of the queries with the capsules around every segment.
+    std::vector<identifier_t> per_segment;
+    for (size_t i = 0; i + 1 < polyline.points.size(); ++i) {
+        auto capsule = Polyline{{polyline.points[i], polyline.points[i + 1]}, polyline.radius};
+        auto gids = rtree.find_intersecting_np<BestEffortGeometry>(capsule).gid;
+        per_segment.insert(per_segment.end(), gids.begin(), gids.end());
+    }
+    std::sort(per_segment.begin(), per_segment.end());
+    per_segment.erase(std::unique(per_segment.begin(), per_segment.end()), per_segment.end());
+
+    auto best_effort = sorted_gids(rtree.find_intersecting_np<BestEffortGeometry>(polyline).gid);
+    BOOST_CHECK(!best_effort.empty());
+    BOOST_CHECK(best_effort == brute_force(BestEffortGeometry{}));
+    BOOST_CHECK(best_effort == per_segment);
+    BOOST_CHECK_EQUAL(rtree.count_intersecting<BestEffortGeometry>(polyline), best_effort.size());
+
+    auto bbox = sorted_gids(rtree.find_intersecting_np<BoundingBoxGeometry>(polyline).gid);
+    BOOST_CHECK(bbox == brute_force(BoundingBoxGeometry{}));
+
+    BOOST_CHECK(rtree.is_intersecting<BestEffortGeometry>(polyline));
+    auto far_away = Polyline{{Point3D{100.0, 100.0, 100.0}, Point3D{110.0, 100.0, 100.0}}, 1.0};
+    BOOST_CHECK(!rtree.is_intersecting<BestEffortGeometry>(far_away));
+    BOOST_CHECK_EQUAL(rtree.count_intersecting<BestEffortGeometry>(far_away), 0);
+
+    // Cylinder queries are exposed the same way as sphere queries.
+    auto cylinder = Cylinder{polyline.points[0], polyline.points[1], polyline.radius};
+    BOOST_CHECK_EQUAL(rtree.count_intersecting<BestEffortGeometry>(cylinder),
+                      rtree.find_intersecting_np<BestEffortGeometry>(cylinder).gid.size());
+}
+
+BOOST_AUTO_TEST_CASE(QueryCursorChunks) {
+    auto gen = std::default_random_engine{};
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-50.0, 50.0);
+
+    std::vector<IndexedSphere> spheres;
+    for (identifier_t i = 0; i < 1000; ++i) {
+        auto centroid = Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+        spheres.push_back(IndexedSphere{i, centroid, CoordType(1.0)});
+    }
+    IndexTree<IndexedSphere> rtree(spheres);
+
+    auto sphere = Sphere{Point3D{0.0, 0.0, 0.0}, 30.0};
+    auto expected = rtree.find_intersecting_np<BestEffortGeometry>(sphere);
+
+    for (size_t chunk_size : {1ul, 7ul, 1000ul}) {
+        auto cursor = make_query_cursor<BestEffortGeometry>(rtree, sphere);
+
+        std::vector<identifier_t> ids;
+        std::vector<CoordType> radii;
+        while (!cursor.done()) {
+            auto chunk = cursor.next_chunk(chunk_size);
+            BOOST_CHECK(chunk.id.size() == chunk_size || cursor.done());
+            ids.insert(ids.end(), chunk.id.begin(), chunk.id.end());
+            radii.insert(radii.end(), chunk.radius.begin(), chunk.radius.end());
+        }
+
+        BOOST_CHECK(ids == expected.id);
+        BOOST_CHECK(radii == expected.radius);
+        BOOST_CHECK(cursor.next_chunk(chunk_size).id.empty());
+    }
+
+    auto far_away = Sphere{Point3D{100.0, 100.0, 100.0}, 1.0};
+    auto empty_cursor = make_query_cursor(rtree, far_away);
+    BOOST_CHECK(empty_cursor.done());
+    BOOST_CHECK(empty_cursor.next_chunk(10).id.empty());
+}
+
+
+BOOST_AUTO_TEST_CASE(AggregateCountsMatch) {
+    auto gen = std::default_random_engine{};
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-50.0, 50.0);
+    auto len_dist = std::uniform_real_distribution<CoordType>(-3.0, 3.0);
+
+    std::vector<MorphoEntry> entries;
+    for (identifier_t i = 0; i < 2000; ++i) {
+        auto p1 = Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+        auto p2 = p1 + Point3D{len_dist(gen), len_dist(gen), len_dist(gen)};
+        entries.push_back(Segment{i, 1u, 0u, p1, p2, CoordType(0.5), SectionType::axon});
+    }
+    IndexTree<MorphoEntry> rtree(entries);
+
+    auto counts = make_aggregate_counts(rtree);
+    BOOST_CHECK_EQUAL(counts.size(), rtree.size());
+
+    auto boxes = std::vector<Box3D>{
+        Box3D{Point3D{-20.0, -20.0, -20.0}, Point3D{20.0, 20.0, 20.0}},
+        Box3D{Point3D{-60.0, -60.0, -60.0}, Point3D{0.0, 60.0, 60.0}},
+        Box3D{Point3D{-100.0, -100.0, -100.0}, Point3D{100.0, 100.0, 100.0}},
+        Box3D{Point3D{200.0, 200.0, 200.0}, Point3D{300.0, 300.0, 300.0}},
+    };
+
+    for (const auto& box : boxes) {
+        BOOST_CHECK_EQUAL(counts.count_intersecting(box), rtree.count_intersecting(box));
+        BOOST_CHECK_EQUAL(counts.count_intersecting<BestEffortGeometry>(box),
+                          rtree.count_intersecting<BestEffortGeometry>(box));
+    }
+
+    for (auto radius : {CoordType(1.0), CoordType(25.0), CoordType(45.0), CoordType(200.0)}) {
+        auto sphere = Sphere{Point3D{10.0, -5.0, 0.0}, radius};
+        BOOST_CHECK_EQUAL(counts.count_intersecting(sphere), rtree.count_intersecting(sphere));
+        BOOST_CHECK_EQUAL(counts.count_intersecting<BestEffortGeometry>(sphere),
+                          rtree.count_intersecting<BestEffortGeometry>(sphere));
+    }
+
+    auto cylinder = Cylinder{Point3D{-30.0, 0.0, 0.0}, Point3D{30.0, 0.0, 0.0}, 10.0};
+    BOOST_CHECK_EQUAL(counts.count_intersecting<BestEffortGeometry>(cylinder),
+                      rtree.count_intersecting<BestEffortGeometry>(cylinder));
+
+    IndexTree<MorphoEntry> empty;
+    auto empty_counts = make_aggregate_counts(empty);
+    BOOST_CHECK_EQUAL(empty_counts.size(), 0);
+    BOOST_CHECK_EQUAL(empty_counts.count_intersecting(boxes[2]), 0);
+}
+
+
+BOOST_AUTO_TEST_CASE(ClippedLength) {
+    auto box = Box3D{Point3D{0.0, 0.0, 0.0}, Point3D{1.0, 1.0, 1.0}};
+    BOOST_CHECK_CLOSE(detail::clipped_length({-1.0, 0.5, 0.5}, {2.0, 0.5, 0.5}, box), 1.0, 1e-6);
+    BOOST_CHECK_CLOSE(detail::clipped_length({0.5, 0.5, 0.5}, {0.5, 0.5, 3.0}, box), 0.5, 1e-6);
+    BOOST_CHECK_CLOSE(detail::clipped_length({0.0, 0.0, 0.0}, {2.0, 2.0, 2.0}, box),
+                      std::sqrt(3.0), 1e-5);
+    BOOST_CHECK_EQUAL(detail::clipped_length({2.0, 0.5, 0.5}, {3.0, 0.5, 0.5}, box), 0.0);
+    BOOST_CHECK_EQUAL(detail::clipped_length({-1.0, 2.0, 0.5}, {2.0, 2.0, 0.5}, box), 0.0);
+}
+
+
+BOOST_AUTO_TEST_CASE(RasterizeTree) {
+    auto gen = std::default_random_engine{};
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-9.0, 9.0);
+    auto len_dist = std::uniform_real_distribution<CoordType>(-3.0, 3.0);
+
+    std::vector<MorphoEntry> entries;
+    double total_length = 0.0;
+    double total_volume = 0.0;
+    for (identifier_t i = 0; i < 500; ++i) {
+        auto p1 = Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+        auto p2 = Point3D{p1.get<0>() + len_dist(gen), p1.get<1>() + len_dist(gen),
+                          p1.get<2>() + len_dist(gen)};
+        auto segment = Segment{i, 1u, 0u, p1, p2, CoordType(0.2), SectionType::axon};
+        total_length += segment.length();
+        total_volume += M_PI * 0.2 * 0.2 * segment.length();
+        entries.push_back(segment);
+    }
+    for (identifier_t i = 500; i < 520; ++i) {
+        auto center = Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+        entries.push_back(Soma{i, center, CoordType(1.0)});
+        total_volume += 4.0 / 3.0 * M_PI;
+    }
+    IndexTree<MorphoEntry> rtree(entries);
+
+    // Covers all elements.
+    auto grid = VoxelGrid{Point3D{-15.0, -15.0, -15.0}, CoordType(2.5), {12, 12, 12}};
+    auto count = rasterize(rtree, grid, RasterQuantity::count);
+    auto length = rasterize(rtree, grid, RasterQuantity::length);
+    auto volume = rasterize(rtree, grid, RasterQuantity::volume);
+    BOOST_REQUIRE_EQUAL(count.size(), grid.n_voxels());
+
+    for (size_t i = 0; i < grid.shape[0]; ++i) {
+        for (size_t j = 0; j < grid.shape[1]; ++j) {
+            for (size_t k = 0; k < grid.shape[2]; ++k) {
+                auto index = (i * grid.shape[1] + j) * grid.shape[2] + k;
+                auto voxel = grid.voxel_box(i, j, k);
+                BOOST_CHECK_EQUAL(count[index],
+                                  double(rtree.count_intersecting<BestEffortGeometry>(voxel)));
+            }
+        }
+    }
+
+    auto sum = [](const std::vector<double>& values) {
+        return std::accumulate(values.begin(), values.end(), 0.0);
+    };
+    BOOST_CHECK_CLOSE(sum(length), total_length, 1e-3);
+    BOOST_CHECK_CLOSE(sum(volume), total_volume, 1e-3);
+
+    ThreadPool pool(3);
+    for (auto quantity : {RasterQuantity::count, RasterQuantity::length}) {
+        auto serial = rasterize(rtree, grid, quantity);
+        auto threaded = rasterize(rtree, grid, quantity, pool, 3);
+        BOOST_REQUIRE_EQUAL(serial.size(), threaded.size());
+        for (size_t i = 0; i < serial.size(); ++i) {
+            BOOST_CHECK_SMALL(serial[i] - threaded[i], 1e-9);
+        }
+    }
+
+    // Parts outside of a smaller grid are ignored.
+    auto half = VoxelGrid{Point3D{0.0, -15.0, -15.0}, CoordType(2.5), {6, 12, 12}};
+    auto half_length = rasterize(rtree, half, RasterQuantity::length, pool, 2);
+    BOOST_CHECK(sum(half_length) > 0.0);
+    BOOST_CHECK(sum(half_length) < sum(length));
+
+    // Grids whose number of voxels overflows are rejected before allocating.
+    auto huge_n = size_t(1) << (std::numeric_limits<size_t>::digits / 2 + 1);
+    auto huge = VoxelGrid{Point3D{0.0, 0.0, 0.0}, CoordType(1.0), {huge_n, huge_n, 1}};
+    BOOST_CHECK_THROW(huge.n_voxels(), std::invalid_argument);
+    BOOST_CHECK_THROW(rasterize(rtree, huge, RasterQuantity::count), std::invalid_argument);
+}
+
+
+BOOST_AUTO_TEST_CASE(MemoryMappedTree) {
+    auto somas = util::make_vec<Soma>(N_ITEMS, util::identity<>(), centers, radius);
+    IndexTree<MorphoEntry> in_memory(somas);
+    in_memory.insert(Segment{10ul, 0u, 0u, centers[0], centers2[0], radius[0], SectionType::undefined});
+
+    std::string index_path = "memory_mapped_index";
+    MemoryMappedIndexTree<MorphoEntry>::create(index_path, in_memory.begin(), in_memory.end());
+
+    auto meta_data = read_meta_data(index_path);
+    BOOST_CHECK(meta_data.contains(MetaDataConstants::memory_mapped_key));
+
+    {
+        MemoryMappedIndexTree<MorphoEntry> rtree(index_path);
+        BOOST_CHECK_EQUAL(rtree.size(), in_memory.size());
+        BOOST_CHECK(bg::equals(rtree.bounds(), in_memory.bounds()));
+
+        TESTS_INTERSECTING_CHECKS(true, false, true, true);
+        BOOST_CHECK_EQUAL(rtree.find_intersecting_objs(Sphere{tcenter3, tradius}).size(), 1);
+        BOOST_CHECK_EQUAL(rtree.find_nearest(centers[0], 2).size(), 2);
+
+        for (const auto& c : {tcenter0, tcenter1, tcenter2, tcenter3}) {
+            auto sphere = Sphere{c, tradius};
+            auto expected = in_memory.find_intersecting_np<BestEffortGeometry>(sphere).gid;
+            auto actual = rtree.find_intersecting_np<BestEffortGeometry>(sphere).gid;
+            std::sort(expected.begin(), expected.end());
+            std::sort(actual.begin(), actual.end());
+            BOOST_CHECK(expected == actual);
+            BOOST_CHECK_EQUAL(rtree.count_intersecting(sphere),
+                              in_memory.count_intersecting(sphere));
+            BOOST_CHECK_EQUAL(make_aggregate_counts(rtree).count_intersecting(sphere),
+                              in_memory.count_intersecting(sphere));
+
+            auto cursor = make_query_cursor<BestEffortGeometry>(rtree, sphere);
+            auto chunked = cursor.next_chunk(in_memory.size()).gid;
+            std::sort(chunked.begin(), chunked.end());
+            BOOST_CHECK(cursor.done());
+            BOOST_CHECK(expected == chunked);
+        }
+    }
+
+    std::filesystem::remove_all(index_path);
+}
+
+
+BOOST_AUTO_TEST_CASE(CompressedSynapseTree) {
+    auto gen = std::default_random_engine{};
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-100.0, 100.0);
+    auto gid_dist = std::uniform_int_distribution<identifier_t>(0, 100000);
+
+    size_t n_synapses = 10000;
+    std::vector<Synapse> synapses;
+    for (size_t i = 0; i < n_synapses; ++i) {
+        auto point = Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+        synapses.emplace_back(i, gid_dist(gen), gid_dist(gen), point);
+    }
+
+    CompressedIndexTree<Synapse> rtree(synapses);
+    BOOST_CHECK_EQUAL(rtree.size(), n_synapses);
+    BOOST_CHECK(rtree.memory_usage() < n_synapses * sizeof(Synapse) / 2);
+
+    // Ids are exact, coordinates are within a quantization step.
+    auto decoded = rtree.values();
+    std::sort(decoded.begin(), decoded.end(), [](const Synapse& a, const Synapse& b) {
+        return a.id < b.id;
+    });
+
+    BOOST_REQUIRE_EQUAL(decoded.size(), n_synapses);
+    for (size_t i = 0; i < n_synapses; ++i) {
+        BOOST_CHECK_EQUAL(decoded[i].id, synapses[i].id);
+        BOOST_CHECK_EQUAL(decoded[i].post_gid(), synapses[i].post_gid());
+        BOOST_CHECK_EQUAL(decoded[i].pre_gid(), synapses[i].pre_gid());
+        BOOST_CHECK(bg::distance(decoded[i].centroid, synapses[i].centroid) < 0.01);
+    }
+
+    IndexTree<Synapse> expected_rtree(decoded);
+    auto ids = [](std::vector<Synapse> found) {
+        std::vector<identifier_t> ids;
+        for (const auto& s : found) {
+            ids.push_back(s.id);
+        }
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    };
+
+    for (size_t i = 0; i < 20; ++i) {
+        auto center = Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+        auto sphere = Sphere{center, 20.0};
+        auto box = Box3D{Point3Dx(center) - 15.0, Point3Dx(center) + 15.0};
+
+        std::vector<Synapse> expected;
+        expected_rtree.find_intersecting(sphere, std::back_inserter(expected));
+        BOOST_CHECK(ids(rtree.find_intersecting_objs(sphere)) == ids(expected));
+
+        expected.clear();
+        expected_rtree.find_intersecting(box, std::back_inserter(expected));
+        BOOST_CHECK(ids(rtree.find_intersecting_objs(box)) == ids(expected));
+
+        BOOST_CHECK_EQUAL(rtree.count_intersecting(box), expected_rtree.count_intersecting(box));
+
+        auto nearest = rtree.find_nearest(center, 10);
+        auto expected_nearest = expected_rtree.find_nearest(center, 10);
+        std::sort(nearest.begin(), nearest.end());
+        std::sort(expected_nearest.begin(), expected_nearest.end());
+        BOOST_CHECK(nearest == expected_nearest);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(PointSynapseTree) {
+    auto gen = std::default_random_engine{};
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-100.0, 100.0);
+    auto gid_dist = std::uniform_int_distribution<identifier_t>(0, 100);
+
+    size_t n_synapses = 10000;
+    std::vector<Synapse> synapses;
+    std::vector<PointSynapse> point_synapses;
+    for (size_t i = 0; i < n_synapses; ++i) {
+        auto point = Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+        auto post_gid = gid_dist(gen);
+        auto pre_gid = gid_dist(gen);
+        synapses.emplace_back(i, post_gid, pre_gid, point);
+        point_synapses.emplace_back(i, post_gid, pre_gid, point);
+    }
+
+    IndexTree<Synapse> expected_rtree(synapses);
+    IndexTree<PointSynapse> rtree(point_synapses);
+
+    auto sorted = [](std::vector<identifier_t> ids) {
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    };
+
+    for (size_t i = 0; i < 20; ++i) {
+        auto center = Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+        auto sphere = Sphere{center, 20.0};
+        auto box = Box3D{Point3Dx(center) - 15.0, Point3Dx(center) + 15.0};
+
+        auto found = rtree.find_intersecting_np(sphere);
+        auto expected = expected_rtree.find_intersecting_np(sphere);
+        BOOST_CHECK(sorted(found.id) == sorted(expected.id));
+        BOOST_CHECK(sorted(found.post_gid) == sorted(expected.post_gid));
+
+        found = rtree.find_intersecting_np<BestEffortGeometry>(box);
+        expected = expected_rtree.find_intersecting_np<BestEffortGeometry>(box);
+        BOOST_CHECK(sorted(found.id) == sorted(expected.id));
+        BOOST_CHECK(sorted(found.pre_gid) == sorted(expected.pre_gid));
+
+        BOOST_CHECK_EQUAL(rtree.count_intersecting(box), expected_rtree.count_intersecting(box));
+        BOOST_CHECK(rtree.count_intersecting_agg_gid(sphere)
+                    == expected_rtree.count_intersecting_agg_gid(sphere));
+
+        BOOST_CHECK(sorted(rtree.find_nearest(center, 10))
+                    == sorted(expected_rtree.find_nearest(center, 10)));
+    }
+}
+
+
 //////////////////////////////////////////////////////////////////
 // Advanced features
 //////////////////////////////////////////////////////////////////
@@ -8,7 +8,7 @@ import os
 
 from brain_indexer import open_index
 from brain_indexer import IndexResolver
-from brain_indexer.io import MetaData, shared_temporary_directory
+from brain_indexer.io import MetaData, shared_temporary_directory, shared_cache_name
 
 
 CIRCUIT_10_DIR = "tests/data/tiny_circuits/circuit-10"
@@ -31,7 +31,7 @@ def small_morphology_sonata_conf():
 
 
 def small_sonata_conf(element_type):
-    if element_type == "synapse":
+    if element_type in ["synapse", "point_synapse"]:
         return small_synapse_sonata_conf()
 
     elif element_type == "morphology":
@@ -63,6 +63,16 @@ def check_builder_from_sonata(element_type,
             assert isinstance(loaded_index, Index)
             assert meta_data.extended is not None
 
+            if index_variant == "multi_index":
+                loaded_index = open_index(index_path, eviction_policy="arc")
+                assert isinstance(loaded_index, Index)
+
+                shared_index = open_index(index_path, shared_cache=True)
+                assert isinstance(shared_index, Index)
+
+                name = shared_cache_name(meta_data.multi_index.index_path)
+                type(shared_index._core_index)._remove_shared_cache(name)
+
 
 def from_sonata_file_callback(element_type, index_variant, output_dir=None):
     args = small_sonata_conf(element_type)
@@ -132,6 +142,36 @@ def test_synapse_multi_index_from_sonata_file():
     check_builder_from_sonata_file("synapse", "multi_index", mpi_comm=mpi_comm)
 
 
+@pytest.mark.skipif(not os.path.exists(CIRCUIT_10_DIR), reason="Missing data file.")
+def test_point_synapse_in_memory_from_sonata_file():
+    check_builder_from_sonata_file("point_synapse", "in_memory")
+
+
+@pytest.mark.skipif(not os.path.exists(CIRCUIT_10_DIR), reason="Missing data file.")
+def test_point_synapse_matches_synapse():
+    import numpy as np
+
+    args = small_synapse_sonata_conf()
+    Builder = IndexResolver.builder_class("synapse", "in_memory")
+    PointBuilder = IndexResolver.builder_class("point_synapse", "in_memory")
+
+    expected = Builder.from_sonata_file(*args)
+    index = PointBuilder.from_sonata_file(*args)
+
+    assert index.element_type == "point_synapse"
+    assert len(index) == len(expected)
+
+    center = np.mean(expected.bounds(), axis=0)
+    for radius in [10.0, 100.0, 1000.0]:
+        np.testing.assert_array_equal(
+            np.sort(index.sphere_query(center, radius, fields="id")),
+            np.sort(expected.sphere_query(center, radius, fields="id"))
+        )
+
+        assert index.sphere_counts(center, radius, group_by="post_gid") == \
+            expected.sphere_counts(center, radius, group_by="post_gid")
+
+
 @pytest.mark.skipif(not os.path.exists(CIRCUIT_10_DIR), reason="Missing data file.")
 def test_morphology_in_memory_from_sonata():
     check_morphology_from_sonata("in_memory")
@@ -146,6 +186,24 @@ def test_morphology_multi_index_from_sonata():
     check_morphology_from_sonata("multi_index", mpi_comm=mpi_comm)
 
 
+@pytest.mark.skipif(not os.path.exists(CIRCUIT_10_DIR), reason="Missing data file.")
+def test_synapse_in_memory_from_sonata_file_threaded():
+    import numpy as np
+
+    args = small_synapse_sonata_conf()
+    Builder = IndexResolver.builder_class("synapse", "in_memory")
+
+    expected = Builder.from_sonata_file(*args)
+    index = Builder.from_sonata_file(*args, n_threads=4)
+
+    window = (np.full(3, -1e6), np.full(3, 1e6))
+    assert len(index) == len(expected)
+    np.testing.assert_array_equal(
+        np.sort(index.box_query(*window, fields="id")),
+        np.sort(expected.box_query(*window, fields="id"))
+    )
+
+
 def test_sphere_index_builder_add_sphere():
     Builder = IndexResolver.builder_class("sphere", "in_memory")
     builder = Builder()
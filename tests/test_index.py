@@ -1,6 +1,8 @@
 # This file covers correctness of indexes contained in `index.py`.
 
 import numpy as np
+import pytest
+
 import brain_indexer
 
 
@@ -73,6 +75,151 @@ def check_point_index_spheres(index, positions):
         )
 
 
+def check_point_index_batch(index, n_queries=20):
+    corners = np.random.uniform(size=(n_queries, 3))
+    opposite_corners = np.random.uniform(size=(n_queries, 3))
+    centers = np.random.uniform(size=(n_queries, 3))
+    radii = np.random.uniform(size=n_queries)
+
+    offsets, found = index.box_query_batch(corners, opposite_corners, fields="id")
+    assert offsets.shape == (n_queries + 1,)
+    for i, (p1, p2) in enumerate(zip(corners, opposite_corners)):
+        expected = index.box_query(p1, p2, fields="id")
+        np.testing.assert_array_equal(found[offsets[i]:offsets[i + 1]], expected)
+
+    offsets, found = index.sphere_query_batch(centers, radii, fields=["id", "position"])
+    assert offsets.shape == (n_queries + 1,)
+    for i, (c, r) in enumerate(zip(centers, radii)):
+        expected = index.sphere_query(c, r, fields=["id", "position"])
+        for field in expected:
+            np.testing.assert_array_equal(
+                found[field][offsets[i]:offsets[i + 1]], expected[field]
+            )
+
+    threaded_offsets, threaded_found = index.box_query_batch(
+        corners, opposite_corners, fields="id", n_threads=4
+    )
+    serial_offsets, serial_found = index.box_query_batch(
+        corners, opposite_corners, fields="id"
+    )
+    np.testing.assert_array_equal(threaded_offsets, serial_offsets)
+    np.testing.assert_array_equal(threaded_found, serial_found)
+
+
+def check_point_index_join(index, centroids):
+    distance = 0.05
+
+    ids, other_ids = index.join_within(distance, index, accuracy="best_effort")
+    found = set(zip(ids, other_ids))
+    for i, c in enumerate(centroids):
+        near = np.linalg.norm(centroids - c, axis=1) <= 0.999 * distance
+        assert {(i, j) for j in np.nonzero(near)[0]} <= found
+
+    ids, other_ids = index.join_within(distance, n_threads=4)
+    assert np.all(ids != other_ids)
+    assert 2 * len(ids) + len(centroids) == len(found)
+
+
+def check_point_index_polylines(index, positions):
+    eps = 1e-5
+    n_queries = 10
+
+    def distance_to_segment(x, a, b):
+        t = np.clip(np.dot(x - a, b - a) / np.dot(b - a, b - a), 0.0, 1.0)
+        return np.linalg.norm(x - (a + t[:, np.newaxis] * (b - a)), axis=1)
+
+    for _ in range(n_queries):
+        points = np.random.uniform(size=(5, 3))
+        radius = 0.1
+
+        found = np.sort(index.polyline_query(points, radius, fields="id"))
+        assert index.polyline_counts(points, radius) == found.size
+        assert index.polyline_empty(points, radius) == (found.size == 0)
+
+        distance = np.min(
+            [distance_to_segment(positions, a, b) for a, b in zip(points, points[1:])],
+            axis=0
+        )
+        assert np.all(distance[found] < radius + eps)
+        assert np.all(np.delete(distance, found) > radius - eps)
+
+        per_segment = [
+            index.capsule_query(a, b, radius, fields="id")
+            for a, b in zip(points, points[1:])
+        ]
+        assert np.all(found == np.unique(np.concatenate(per_segment)))
+
+        p1, p2 = points[0], points[1]
+        cylinder = index.cylinder_query(p1, p2, radius, fields="id")
+        assert index.cylinder_counts(p1, p2, radius) == cylinder.size
+        assert np.all(np.isin(cylinder, per_segment[0]))
+
+
+def check_point_index_chunks(index):
+    corner, opposite_corner = np.zeros(3), np.full(3, 0.8)
+    expected = index.box_query(corner, opposite_corner, fields="id")
+
+    chunks = list(index.box_query_chunks(corner, opposite_corner, fields="id",
+                                         chunk_size=100))
+    assert all(chunk.size == 100 for chunk in chunks[:-1])
+    assert 0 < chunks[-1].size <= 100
+    assert np.all(np.concatenate(chunks) == expected)
+
+    chunks = index.sphere_query_chunks(np.full(3, 0.5), 0.3, fields=["id", "position"])
+    results = list(chunks)
+    expected = index.sphere_query(np.full(3, 0.5), 0.3, fields="id")
+    assert np.all(np.concatenate([r["id"] for r in results]) == expected)
+
+    far_away = index.sphere_query_chunks(np.full(3, 10.0), 0.1, fields="id")
+    assert list(far_away) == []
+
+
+def check_point_index_unique_gids(index):
+    corner, opposite_corner = np.full(3, 0.1), np.full(3, 0.6)
+    ids = index.box_query(corner, opposite_corner, fields="id")
+    expected_gids, expected_counts = np.unique(ids, return_counts=True)
+
+    gids, counts = index.box_unique_gids(corner, opposite_corner, return_counts=True)
+    assert np.all(gids == expected_gids)
+    assert np.all(counts == expected_counts)
+
+    gids = index.sphere_unique_gids(np.full(3, 0.5), 0.3)
+    assert np.all(gids == np.unique(index.sphere_query(np.full(3, 0.5), 0.3, fields="id")))
+
+    centers = np.random.uniform(size=(10, 3))
+    radii = np.random.uniform(0.05, 0.2, size=10)
+    offsets, gids = index.sphere_unique_gids_batch(centers, radii, n_threads=2)
+    for i in range(len(radii)):
+        expected = index.sphere_unique_gids(centers[i], radii[i])
+        assert np.all(gids[offsets[i]:offsets[i + 1]] == expected)
+
+
+def check_point_index_rasterize(index, centroids):
+    origin, voxel_size, shape = np.zeros(3), 0.25, (4, 4, 2)
+    counts = index.rasterize(origin, voxel_size, shape, "count", n_threads=2)
+    assert counts.shape == shape
+
+    # Every point is counted in the voxel containing it; the index stores floats.
+    points = centroids.astype(np.float32)
+    voxels = np.floor((points - origin) / voxel_size).astype(int)
+    inside = np.all((voxels >= 0) & (voxels < shape), axis=1)
+    expected = np.zeros(shape)
+    np.add.at(expected, tuple(voxels[inside].T), 1.0)
+    assert np.all(counts == expected)
+
+    for invalid_voxel_size in [0.0, -0.25, np.nan, np.inf]:
+        with pytest.raises(ValueError):
+            index.rasterize(origin, invalid_voxel_size, shape)
+
+    for invalid_origin in [[np.nan, 0.0, 0.0], [0.0, -np.inf, 0.0], [0.0, 0.0, np.inf]]:
+        with pytest.raises(ValueError):
+            index.rasterize(invalid_origin, voxel_size, shape)
+
+    for invalid_shape in [(4, 4, 0), (4, -1, 2), (4, 4, 2.5), (4, 4), (4, 4, 2, 1)]:
+        with pytest.raises(ValueError):
+            index.rasterize(origin, voxel_size, invalid_shape)
+
+
 def test_point_index():
     n_elements = 1000
     centroids = np.random.uniform(size=(n_elements, 3))
@@ -85,3 +232,9 @@ def test_point_index():
 
     check_point_index_boxes(index, centroids)
     check_point_index_spheres(index, centroids)
+    check_point_index_batch(index)
+    check_point_index_join(index, centroids)
+    check_point_index_polylines(index, centroids)
+    check_point_index_chunks(index)
+    check_point_index_unique_gids(index)
+    check_point_index_rasterize(index, centroids)
@@ -195,6 +195,38 @@ def check_query(query, query_shape, *, query_kwargs=None, available_fields=None,
     )
 
 
+@_wrap_assert_for_multi_population
+def assert_valid_batch_result(result, fields, n_queries):
+    offsets, results = result
+    assert isinstance(offsets, np.ndarray)
+    assert offsets.shape == (n_queries + 1,)
+
+    if is_non_string_iterable(fields):
+        assert_valid_dict_result(results, fields)
+    else:
+        assert_valid_single_result(results, fields)
+
+
+@_wrap_check_for_multi_population
+def check_batch_query(query, query_shapes, *, query_kwargs=None, builtin_fields=None,
+                      expected_populations=None):
+    n_queries = query_shapes[0].shape[0]
+
+    for field in builtin_fields:
+        result = query(*query_shapes, fields=field, **query_kwargs)
+        assert_valid_batch_result(
+            result, field, n_queries, expected_populations=expected_populations
+        )
+
+    result = query(*query_shapes, fields=None, **query_kwargs)
+    assert_valid_batch_result(
+        result, builtin_fields, n_queries, expected_populations=expected_populations
+    )
+
+    with pytest.raises(Exception):
+        query(*query_shapes, fields="raw_elements", **query_kwargs)
+
+
 @_wrap_assert_for_multi_population
 def assert_valid_counts(counts):
     assert counts > 0
@@ -308,6 +340,24 @@ def check_all_regular_query_api(index, window, sphere, accuracy, population_mode
         population_mode=expected_population_mode,
     )
 
+    print("Checking batched box query...")
+    windows = (np.array([window[0], window[1]]), np.array([window[1], window[0]]))
+    check_batch_query(
+        index.box_query_batch, windows, query_kwargs=query_kwargs,
+        builtin_fields=index.builtin_fields,
+        populations=populations,
+        population_mode=expected_population_mode,
+    )
+
+    print("Checking batched sphere query...")
+    spheres = (np.array([sphere[0]]), np.array([sphere[1]]))
+    check_batch_query(
+        index.sphere_query_batch, spheres, query_kwargs=query_kwargs,
+        builtin_fields=index.builtin_fields,
+        populations=populations,
+        population_mode=expected_population_mode,
+    )
+
 
 def check_all_counts_api(index, window, sphere, accuracy, population_mode):
     query_kwargs = {"accuracy": accuracy, "population_mode": population_mode}
@@ -533,6 +583,25 @@ def test_index_write_sonata_api(element_type, index_variant):
         assert fake_population in extended_conf.value("population")
 
 
+@pytest.mark.parametrize("element_type", ["sphere", "point"])
+def test_index_write_memory_mapped_api(element_type):
+    index, window, sphere = load_single_test_index("in_memory", element_type)
+
+    with tempfile.TemporaryDirectory(prefix="api_write_test") as d:
+        index_path = os.path.join(d, "foo")
+
+        index.write(index_path, memory_mapped=True)
+        meta_data = brain_indexer.io.MetaData(index_path)
+        assert meta_data.index_variant == "memory_mapped"
+
+        loaded_index = brain_indexer.open_index(index_path)
+        check_all_index_api(loaded_index, window, sphere, None, None)
+
+        expected = np.sort(index.box_query(*window, fields="id"))
+        actual = np.sort(loaded_index.box_query(*window, fields="id"))
+        np.testing.assert_array_equal(actual, expected)
+
+
 def test_index_insert():
     radius_cases = [1.0, [0.2, 0.4]]
     centroid_cases = [[1.0, 2.0, 3.0], [[1.0, 2.0, 3.0], [4.0, 5.0, 6.0]]]
@@ -558,6 +627,27 @@ def test_index_insert():
             )
 
 
+def test_aggregate_counts():
+    index = brain_indexer.SphereIndexBuilder.create_empty()
+    index.insert(
+        id=[2, 3], radius=[0.2, 0.4], centroid=[[1.0, 2.0, 3.0], [4.0, 5.0, 6.0]]
+    )
+
+    box = (np.zeros(3), np.full(3, 10.0))
+    expected = index.box_counts(*box)
+
+    index.build_aggregate_counts()
+    assert index.box_counts(*box) == expected
+    assert index.sphere_counts(np.zeros(3), 100.0) == expected
+
+    # Elements added afterwards are still counted.
+    index.insert(id=4, radius=0.1, centroid=[5.0, 5.0, 5.0])
+    assert index.box_counts(*box) == expected + 1
+
+    index.drop_aggregate_counts()
+    assert index.box_counts(*box) == expected + 1
+
+
 def test_is_non_string_iterable():
     assert not is_non_string_iterable("")
     assert not is_non_string_iterable("foo")
@@ -72,7 +72,33 @@ def _test_rtree(index):
         assert a == b
 
 
+def _test_grouped_counts_batch(index):
+    corners = np.array([[-1., -1., -1.], [-5., -5., -5.]])
+    opposite_corners = np.array([[1., 1., 1.], [5., 5., 5.]])
+
+    csr = index.box_counts_batch(corners, opposite_corners, group_by="post_gid")
+    assert list(csr["offsets"]) == [0, 3, 7]
+    assert list(csr["post_gid"]) == [1, 2, 4, 1, 2, 3, 4]
+    assert list(csr["count"]) == [2, 1, 1, 2, 1, 3, 1]
+
+    coo = index.box_counts_batch(
+        corners, opposite_corners, group_by="pre_gid", format="coo"
+    )
+    assert list(coo["region"]) == [0, 0, 0, 1, 1, 1, 1]
+    assert list(coo["pre_gid"]) == [0, 1, 3, 0, 1, 2, 3]
+    assert list(coo["count"]) == [2, 1, 1, 2, 1, 3, 1]
+    assert "post_gid" not in coo
+
+    pairs = index.sphere_counts_batch(
+        np.zeros((1, 3)), np.array([10.0]), group_by=("pre_gid", "post_gid")
+    )
+    assert list(pairs["pre_gid"]) == [0, 1, 2, 3]
+    assert list(pairs["post_gid"]) == [1, 2, 3, 4]
+    assert list(pairs["count"]) == [2, 1, 3, 1]
+
+
 def test_synapse_query_aggregate():
     rtree = core.SynapseIndex()
     rtree._add_synapses(ids, post_gids, pre_gids, points)
     _test_rtree(SynapseIndex(rtree))
+    _test_grouped_counts_batch(SynapseIndex(rtree))